@@ -27,11 +27,11 @@ Block *block_construct(int64_t length, Flower *flower) {
 Block *block_construct2(Name name, int64_t length,
 		End *leftEnd, End *rightEnd,
 		Flower *flower) {
-	Block *block;
-	block = st_malloc(sizeof(Block));
-	block->rBlock = st_malloc(sizeof(Block));
+	BlockUnit *blockUnit = cactusSlabAllocator_allocate(flower_getBlockAllocator(flower));
+	Block *block = &blockUnit->block;
+	block->rBlock = &blockUnit->rBlock;
 	block->rBlock->rBlock = block;
-	block->blockContents = st_malloc(sizeof(BlockContents));
+	block->blockContents = &blockUnit->blockContents;
 	block->rBlock->blockContents = block->blockContents;
 
 	block->orientation = 1;
@@ -64,9 +64,7 @@ void block_destruct(Block *block) {
 	//now the actual instances.
 	stSortedSet_destruct(block->blockContents->segments);
 
-	free(block->rBlock);
-	free(block->blockContents);
-	free(block);
+	cactusSlab_free(block->blockContents); //The contents are at the start of the unit.
 }
 
 bool block_getOrientation(Block *block) {
@@ -372,22 +370,22 @@ void block_setFlower(Block *block, Flower *flower) {
  * Serialisation functions.
  */
 
-void block_writeBinaryRepresentation(Block *block, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+void block_writeBinaryRepresentation(Block *block, BinaryRepresentationWriter *writer) {
 	Block_InstanceIterator *iterator;
 	Segment *segment;
 
 	assert(block_getOrientation(block));
-	binaryRepresentation_writeElementType(CODE_BLOCK, writeFn);
-	binaryRepresentation_writeName(block_getName(block), writeFn);
-	binaryRepresentation_writeInteger(block_getLength(block), writeFn);
-	binaryRepresentation_writeName(end_getName(block_get5End(block)), writeFn);
-	binaryRepresentation_writeName(end_getName(block_get3End(block)), writeFn);
+	binaryRepresentation_writeElementType(CODE_BLOCK, writer);
+	binaryRepresentation_writeName(block_getName(block), writer);
+	binaryRepresentation_writeInteger(block_getLength(block), writer);
+	binaryRepresentation_writeName(end_getName(block_get5End(block)), writer);
+	binaryRepresentation_writeName(end_getName(block_get3End(block)), writer);
 	iterator = block_getInstanceIterator(block);
 	while((segment = block_getNext(iterator)) != NULL) {
-		segment_writeBinaryRepresentation(segment, writeFn);
+		segment_writeBinaryRepresentation(segment, writer);
 	}
 	block_destructInstanceIterator(iterator);
-	binaryRepresentation_writeElementType(CODE_BLOCK, writeFn);
+	binaryRepresentation_writeElementType(CODE_BLOCK, writer);
 }
 
 Block *block_loadFromBinaryRepresentation(void **binaryString, Flower *flower) {
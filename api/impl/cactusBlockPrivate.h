@@ -29,6 +29,15 @@ struct _block {
 	Block *rBlock;
 };
 
+/*
+ * A block, its reverse and their contents, allocated together from the slabs of the cactus disk.
+ */
+typedef struct _blockUnit {
+	BlockContents blockContents;
+	Block block;
+	Block rBlock;
+} BlockUnit;
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -60,7 +69,7 @@ void block_removeInstance(Block *block, Segment *segment);
 /*
  * Write a binary representation of the block to the write function.
  */
-void block_writeBinaryRepresentation(Block *block, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void block_writeBinaryRepresentation(Block *block, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <pthread.h>
+
+#define CACTUS_CACHE_SHARDS 16
+#define CACTUS_CACHE_INITIAL_BUCKETS 64
+
+typedef struct _cactusCacheEntry CactusCacheEntry;
+typedef struct _cactusCacheKey CactusCacheKey;
+
+/*
+ * A cached record or substring. Entries are linked into the LRU list of their shard.
+ */
+struct _cactusCacheEntry {
+    CactusCacheKey *cacheKey;
+    int64_t start;
+    int64_t size;
+    char *data;
+    CactusCacheEntry *newer;
+    CactusCacheEntry *older;
+};
+
+/*
+ * The entries of a key, sorted by start. The entries are disjoint and do not abut.
+ */
+struct _cactusCacheKey {
+    int64_t key;
+    CactusCacheEntry **entries;
+    int64_t entryNumber;
+    int64_t maxEntryNumber;
+    CactusCacheKey *next;
+};
+
+typedef struct _cactusCacheShard {
+    CactusCache *cache;
+    pthread_mutex_t mutex;
+    CactusCacheKey **buckets;
+    int64_t bucketNumber;
+    int64_t keyNumber;
+    CactusCacheEntry *newest;
+    CactusCacheEntry *oldest;
+    int64_t size; //Changed under the lock, but read without it when choosing a shard to evict from
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+} CactusCacheShard;
+
+/*
+ * The shards share one byte budget, so a single long string, whose substrings all go to one
+ * shard, can use the whole cache.
+ */
+struct _cactusCache {
+    CactusCacheShard shards[CACTUS_CACHE_SHARDS];
+    int64_t size; //The total size of the shards
+    int64_t maxSize;
+};
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Private functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static uint64_t hashKey(int64_t key) {
+    /*
+     * Mixes the bits of the key, as names are often consecutive integers.
+     */
+    uint64_t h = (uint64_t) key;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static CactusCacheShard *getShard(CactusCache *cache, uint64_t hash) {
+    return cache->shards + hash % CACTUS_CACHE_SHARDS;
+}
+
+static int64_t getBucket(CactusCacheShard *shard, uint64_t hash) {
+    return (hash / CACTUS_CACHE_SHARDS) & (shard->bucketNumber - 1);
+}
+
+static int64_t entrySize(CactusCacheEntry *entry) {
+    /*
+     * The number of bytes an entry is charged against the budget.
+     */
+    return entry->size + sizeof(CactusCacheEntry);
+}
+
+static CactusCacheKey *shard_getKey(CactusCacheShard *shard, int64_t key, uint64_t hash) {
+    CactusCacheKey *cacheKey = shard->buckets[getBucket(shard, hash)];
+    while (cacheKey != NULL && cacheKey->key != key) {
+        cacheKey = cacheKey->next;
+    }
+    return cacheKey;
+}
+
+static void shard_resize(CactusCacheShard *shard) {
+    CactusCacheKey **buckets = shard->buckets;
+    int64_t bucketNumber = shard->bucketNumber;
+    shard->bucketNumber *= 2;
+    shard->buckets = st_calloc(shard->bucketNumber, sizeof(CactusCacheKey *));
+    for (int64_t i = 0; i < bucketNumber; i++) {
+        CactusCacheKey *cacheKey = buckets[i];
+        while (cacheKey != NULL) {
+            CactusCacheKey *next = cacheKey->next;
+            int64_t j = getBucket(shard, hashKey(cacheKey->key));
+            cacheKey->next = shard->buckets[j];
+            shard->buckets[j] = cacheKey;
+            cacheKey = next;
+        }
+    }
+    free(buckets);
+}
+
+static CactusCacheKey *shard_addKey(CactusCacheShard *shard, int64_t key, uint64_t hash) {
+    if (shard->keyNumber >= shard->bucketNumber) {
+        shard_resize(shard);
+    }
+    CactusCacheKey *cacheKey = st_calloc(1, sizeof(CactusCacheKey));
+    cacheKey->key = key;
+    int64_t i = getBucket(shard, hash);
+    cacheKey->next = shard->buckets[i];
+    shard->buckets[i] = cacheKey;
+    shard->keyNumber++;
+    return cacheKey;
+}
+
+static void shard_unlinkEntry(CactusCacheShard *shard, CactusCacheEntry *entry) {
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        shard->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        shard->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+static void shard_linkEntry(CactusCacheShard *shard, CactusCacheEntry *entry) {
+    /*
+     * Makes the entry the most recently used in the shard.
+     */
+    entry->older = shard->newest;
+    entry->newer = NULL;
+    if (shard->newest != NULL) {
+        shard->newest->newer = entry;
+    } else {
+        shard->oldest = entry;
+    }
+    shard->newest = entry;
+}
+
+static void shard_addSize(CactusCacheShard *shard, int64_t size) {
+    __atomic_add_fetch(&shard->size, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->cache->size, size, __ATOMIC_RELAXED);
+}
+
+static bool cache_isOverBudget(CactusCache *cache) {
+    return __atomic_load_n(&cache->size, __ATOMIC_RELAXED) > __atomic_load_n(&cache->maxSize, __ATOMIC_RELAXED);
+}
+
+static void shard_destructEntry(CactusCacheShard *shard, CactusCacheEntry *entry) {
+    shard_unlinkEntry(shard, entry);
+    shard_addSize(shard, -entrySize(entry));
+    free(entry->data);
+    free(entry);
+}
+
+static void shard_removeKey(CactusCacheShard *shard, CactusCacheKey *cacheKey) {
+    /*
+     * Removes the key and all its entries from the shard.
+     */
+    CactusCacheKey **p = shard->buckets + getBucket(shard, hashKey(cacheKey->key));
+    while (*p != cacheKey) {
+        p = &(*p)->next;
+    }
+    *p = cacheKey->next;
+    for (int64_t i = 0; i < cacheKey->entryNumber; i++) {
+        shard_destructEntry(shard, cacheKey->entries[i]);
+    }
+    free(cacheKey->entries);
+    free(cacheKey);
+    shard->keyNumber--;
+}
+
+static int64_t cacheKey_findEntry(CactusCacheKey *cacheKey, int64_t start) {
+    /*
+     * Returns the index of the last entry starting at or before start, or -1 if there is none.
+     */
+    int64_t i = 0, j = cacheKey->entryNumber;
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (cacheKey->entries[k]->start <= start) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i - 1;
+}
+
+static void cacheKey_replaceEntries(CactusCacheKey *cacheKey, int64_t first, int64_t last, CactusCacheEntry *entry) {
+    /*
+     * Replaces the entries [first, last) of the key, which the caller has already freed, with the given entry.
+     */
+    if (first == last && cacheKey->entryNumber == cacheKey->maxEntryNumber) {
+        cacheKey->maxEntryNumber = cacheKey->maxEntryNumber == 0 ? 1 : cacheKey->maxEntryNumber * 2;
+        cacheKey->entries = st_realloc(cacheKey->entries, cacheKey->maxEntryNumber * sizeof(CactusCacheEntry *));
+    }
+    memmove(cacheKey->entries + first + 1, cacheKey->entries + last,
+            (cacheKey->entryNumber - last) * sizeof(CactusCacheEntry *));
+    cacheKey->entries[first] = entry;
+    cacheKey->entryNumber += first + 1 - last;
+    entry->cacheKey = cacheKey;
+}
+
+static bool shard_evictOldest(CactusCacheShard *shard, CactusCacheEntry *keep) {
+    /*
+     * Evicts the least recently used entry of the shard, unless it is the entry to keep (the one
+     * just added). Returns non-zero if an entry was evicted. The shard must be locked.
+     */
+    CactusCacheEntry *entry = shard->oldest;
+    if (entry == NULL || entry == keep) {
+        return 0;
+    }
+    CactusCacheKey *cacheKey = entry->cacheKey;
+    shard->evictions++;
+    if (cacheKey->entryNumber == 1) {
+        shard_removeKey(shard, cacheKey);
+    } else {
+        int64_t i = cacheKey_findEntry(cacheKey, entry->start);
+        assert(i >= 0 && cacheKey->entries[i] == entry);
+        memmove(cacheKey->entries + i, cacheKey->entries + i + 1,
+                (cacheKey->entryNumber - i - 1) * sizeof(CactusCacheEntry *));
+        cacheKey->entryNumber--;
+        shard_destructEntry(shard, entry);
+    }
+    return 1;
+}
+
+static CactusCacheShard *cache_getLargestShard(CactusCache *cache) {
+    /*
+     * Returns the shard holding the most bytes, or NULL if the cache is empty. The sizes are
+     * read without locking the shards, so may be slightly out of date.
+     */
+    CactusCacheShard *largest = NULL;
+    int64_t largestSize = 0;
+    for (int64_t i = 0; i < CACTUS_CACHE_SHARDS; i++) {
+        int64_t size = __atomic_load_n(&cache->shards[i].size, __ATOMIC_RELAXED);
+        if (size > largestSize) {
+            largest = cache->shards + i;
+            largestSize = size;
+        }
+    }
+    return largest;
+}
+
+static void shard_evict(CactusCacheShard *shard, CactusCacheEntry *keep) {
+    /*
+     * Evicts least recently used entries until the cache is within its budget, taking them from
+     * the largest shard. The given shard must be locked; other shards are only tried, never
+     * waited for, so two threads evicting at once cannot deadlock. If the shard to evict from is
+     * busy the given shard is evicted from instead. The entry to keep is never evicted, even if
+     * it alone is over the budget.
+     */
+    while (cache_isOverBudget(shard->cache)) {
+        CactusCacheShard *largest = cache_getLargestShard(shard->cache);
+        if (largest != shard && largest != NULL && pthread_mutex_trylock(&largest->mutex) == 0) {
+            bool evicted = shard_evictOldest(largest, NULL);
+            pthread_mutex_unlock(&largest->mutex);
+            if (evicted) {
+                continue;
+            }
+        }
+        if (!shard_evictOldest(shard, keep)) {
+            break;
+        }
+    }
+}
+
+static CactusCacheEntry *shard_addEntry(CactusCacheShard *shard, CactusCacheKey *cacheKey, int64_t first,
+        int64_t last, int64_t start, int64_t size, char *data) {
+    CactusCacheEntry *entry = st_calloc(1, sizeof(CactusCacheEntry));
+    entry->start = start;
+    entry->size = size;
+    entry->data = data;
+    cacheKey_replaceEntries(cacheKey, first, last, entry);
+    shard_linkEntry(shard, entry);
+    shard_addSize(shard, entrySize(entry));
+    shard_evict(shard, entry);
+    return entry;
+}
+
+static char *copyEntry(CactusCacheEntry *entry, int64_t start, int64_t size) {
+    char *copy = st_malloc(size + 1);
+    memcpy(copy, entry->data + (start - entry->start), size);
+    copy[size] = '\0';
+    return copy;
+}
+
+static void shard_clear(CactusCacheShard *shard) {
+    for (int64_t i = 0; i < shard->bucketNumber; i++) {
+        while (shard->buckets[i] != NULL) {
+            shard_removeKey(shard, shard->buckets[i]);
+        }
+    }
+    assert(shard->size == 0);
+    assert(shard->newest == NULL && shard->oldest == NULL);
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Public functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+CactusCache *cactusCache_construct(int64_t maxSize) {
+    CactusCache *cache = st_calloc(1, sizeof(CactusCache));
+    for (int64_t i = 0; i < CACTUS_CACHE_SHARDS; i++) {
+        CactusCacheShard *shard = cache->shards + i;
+        shard->cache = cache;
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->bucketNumber = CACTUS_CACHE_INITIAL_BUCKETS;
+        shard->buckets = st_calloc(shard->bucketNumber, sizeof(CactusCacheKey *));
+    }
+    cactusCache_setMaxSize(cache, maxSize);
+    return cache;
+}
+
+void cactusCache_destruct(CactusCache *cache) {
+    for (int64_t i = 0; i < CACTUS_CACHE_SHARDS; i++) {
+        CactusCacheShard *shard = cache->shards + i;
+        shard_clear(shard);
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    free(cache);
+}
+
+void cactusCache_setMaxSize(CactusCache *cache, int64_t maxSize) {
+    assert(maxSize >= 0);
+    __atomic_store_n(&cache->maxSize, maxSize, __ATOMIC_RELAXED);
+    CactusCacheShard *shard;
+    while (cache_isOverBudget(cache) && (shard = cache_getLargestShard(cache)) != NULL) {
+        pthread_mutex_lock(&shard->mutex);
+        shard_evictOldest(shard, NULL);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
+void cactusCache_clear(CactusCache *cache) {
+    for (int64_t i = 0; i < CACTUS_CACHE_SHARDS; i++) {
+        CactusCacheShard *shard = cache->shards + i;
+        pthread_mutex_lock(&shard->mutex);
+        shard_clear(shard);
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
+void cactusCache_setRecord(CactusCache *cache, int64_t key, const void *record, int64_t recordSize) {
+    assert(recordSize >= 0);
+    uint64_t hash = hashKey(key);
+    CactusCacheShard *shard = getShard(cache, hash);
+    char *data = st_malloc(recordSize > 0 ? recordSize : 1);
+    memcpy(data, record, recordSize);
+    pthread_mutex_lock(&shard->mutex);
+    CactusCacheKey *cacheKey = shard_getKey(shard, key, hash);
+    if (cacheKey != NULL) {
+        shard_removeKey(shard, cacheKey);
+    }
+    cacheKey = shard_addKey(shard, key, hash);
+    shard_addEntry(shard, cacheKey, 0, 0, 0, recordSize, data);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void *cactusCache_getRecord(CactusCache *cache, int64_t key, int64_t *recordSize) {
+    uint64_t hash = hashKey(key);
+    CactusCacheShard *shard = getShard(cache, hash);
+    void *record = NULL;
+    pthread_mutex_lock(&shard->mutex);
+    CactusCacheKey *cacheKey = shard_getKey(shard, key, hash);
+    if (cacheKey != NULL && cacheKey->entries[0]->start == 0) {
+        CactusCacheEntry *entry = cacheKey->entries[0];
+        record = copyEntry(entry, 0, entry->size);
+        *recordSize = entry->size;
+        shard_unlinkEntry(shard, entry);
+        shard_linkEntry(shard, entry);
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return record;
+}
+
+bool cactusCache_containsRecord(CactusCache *cache, int64_t key) {
+    uint64_t hash = hashKey(key);
+    CactusCacheShard *shard = getShard(cache, hash);
+    pthread_mutex_lock(&shard->mutex);
+    bool contains = shard_getKey(shard, key, hash) != NULL;
+    pthread_mutex_unlock(&shard->mutex);
+    return contains;
+}
+
+void cactusCache_setSubstring(CactusCache *cache, int64_t key, int64_t start, const void *substring, int64_t size) {
+    assert(start >= 0);
+    assert(size > 0);
+    uint64_t hash = hashKey(key);
+    CactusCacheShard *shard = getShard(cache, hash);
+    pthread_mutex_lock(&shard->mutex);
+    CactusCacheKey *cacheKey = shard_getKey(shard, key, hash);
+    if (cacheKey == NULL) {
+        cacheKey = shard_addKey(shard, key, hash);
+    }
+    //Find the run of entries [first, last) that overlap or abut the new substring
+    int64_t first = cacheKey_findEntry(cacheKey, start);
+    if (first < 0 || cacheKey->entries[first]->start + cacheKey->entries[first]->size < start) {
+        first++;
+    }
+    int64_t last = first;
+    int64_t mergedStart = start, mergedEnd = start + size;
+    while (last < cacheKey->entryNumber && cacheKey->entries[last]->start <= start + size) {
+        CactusCacheEntry *entry = cacheKey->entries[last++];
+        if (entry->start < mergedStart) {
+            mergedStart = entry->start;
+        }
+        if (entry->start + entry->size > mergedEnd) {
+            mergedEnd = entry->start + entry->size;
+        }
+    }
+    char *data = st_malloc(mergedEnd - mergedStart);
+    for (int64_t i = first; i < last; i++) {
+        CactusCacheEntry *entry = cacheKey->entries[i];
+        memcpy(data + (entry->start - mergedStart), entry->data, entry->size);
+        shard_destructEntry(shard, entry);
+    }
+    memcpy(data + (start - mergedStart), substring, size);
+    shard_addEntry(shard, cacheKey, first, last, mergedStart, mergedEnd - mergedStart, data);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+char *cactusCache_getSubstring(CactusCache *cache, int64_t key, int64_t start, int64_t size) {
+    assert(size >= 0);
+    uint64_t hash = hashKey(key);
+    CactusCacheShard *shard = getShard(cache, hash);
+    char *substring = NULL;
+    pthread_mutex_lock(&shard->mutex);
+    CactusCacheKey *cacheKey = shard_getKey(shard, key, hash);
+    int64_t i;
+    if (cacheKey != NULL && (i = cacheKey_findEntry(cacheKey, start)) >= 0
+            && cacheKey->entries[i]->start + cacheKey->entries[i]->size >= start + size) {
+        CactusCacheEntry *entry = cacheKey->entries[i];
+        substring = copyEntry(entry, start, size);
+        shard_unlinkEntry(shard, entry);
+        shard_linkEntry(shard, entry);
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return substring;
+}
+
+void cactusCache_getStats(CactusCache *cache, CactusDiskCacheStats *stats) {
+    memset(stats, 0, sizeof(CactusDiskCacheStats));
+    for (int64_t i = 0; i < CACTUS_CACHE_SHARDS; i++) {
+        CactusCacheShard *shard = cache->shards + i;
+        pthread_mutex_lock(&shard->mutex);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->size += shard->size;
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    stats->maxSize = __atomic_load_n(&cache->maxSize, __ATOMIC_RELAXED);
+}
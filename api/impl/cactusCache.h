@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_CACHE_H_
+#define CACTUS_CACHE_H_
+
+#include "cactusGlobals.h"
+#include "cactusDisk.h"
+
+/*
+ * A byte budgeted least recently used cache of byte strings keyed by integers, used by the
+ * cactus disk for uncompressed DB records and for sequence strings. The keys are spread
+ * over a fixed number of shards, each with its own lock and LRU list, so the cache can be used
+ * from several threads at once. The shards share the budget: when the cache is over it, the
+ * least recently used entries of the largest shard are evicted.
+ *
+ * A key holds either a whole record or a set of disjoint substrings of a string, each given
+ * by its start coordinate. A cache should not mix the two for the same key.
+ */
+typedef struct _cactusCache CactusCache;
+
+/*
+ * Constructs a cache holding at most (approximately) maxSize bytes.
+ */
+CactusCache *cactusCache_construct(int64_t maxSize);
+
+/*
+ * Frees the cache and everything in it.
+ */
+void cactusCache_destruct(CactusCache *cache);
+
+/*
+ * Changes the byte budget of the cache, evicting least recently used entries if the cache
+ * is now over the budget.
+ */
+void cactusCache_setMaxSize(CactusCache *cache, int64_t maxSize);
+
+/*
+ * Removes everything from the cache. The counters are not reset.
+ */
+void cactusCache_clear(CactusCache *cache);
+
+/*
+ * Sets the record for the key, replacing anything previously cached for the key.
+ */
+void cactusCache_setRecord(CactusCache *cache, int64_t key, const void *record, int64_t recordSize);
+
+/*
+ * Returns a copy of the record for the key, setting recordSize to its size, or NULL if the
+ * record is not cached. The copy is followed by a zero byte, which is not counted in
+ * recordSize.
+ */
+void *cactusCache_getRecord(CactusCache *cache, int64_t key, int64_t *recordSize);
+
+/*
+ * Returns non-zero if the cache holds something for the key. Does not count as a use
+ * of the key.
+ */
+bool cactusCache_containsRecord(CactusCache *cache, int64_t key);
+
+/*
+ * Caches the substring [start, start + size) of the string with the given key. Cached
+ * substrings of the key that overlap or abut it are merged with it into one entry.
+ */
+void cactusCache_setSubstring(CactusCache *cache, int64_t key, int64_t start, const void *substring, int64_t size);
+
+/*
+ * Returns a zero terminated copy of the substring [start, start + size) of the string with
+ * the given key, or NULL if it is not contained in a single cached substring.
+ */
+char *cactusCache_getSubstring(CactusCache *cache, int64_t key, int64_t start, int64_t size);
+
+/*
+ * Fills in the hit, miss and eviction counters and the current size and budget of the cache.
+ */
+void cactusCache_getStats(CactusCache *cache, CactusDiskCacheStats *stats);
+
+#endif
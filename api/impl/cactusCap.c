@@ -22,11 +22,10 @@ Cap *cap_construct3(Name instance, Event *event, End *end) {
     assert(end != NULL);
     assert(event != NULL);
     assert(instance != NULL_NAME);
-    Cap *cap;
-
-    cap = st_malloc(sizeof(Cap));
-    cap->capContents = st_malloc(sizeof(CapContents));
-    cap->rCap = st_malloc(sizeof(Cap));
+    CapUnit *capUnit = cactusSlabAllocator_allocate(flower_getCapAllocator(end_getFlower(end)));
+    Cap *cap = &capUnit->cap;
+    cap->capContents = &capUnit->capContents;
+    cap->rCap = &capUnit->rCap;
     cap->rCap->rCap = cap;
     cap->rCap->capContents = cap->capContents;
 
@@ -118,9 +117,7 @@ void cap_destruct(Cap *cap) {
     }
 
     destructList(cap->capContents->children);
-    free(cap->rCap);
-    free(cap->capContents);
-    free(cap);
+    cactusSlab_free(cap->capContents); //The contents are at the start of the unit.
 }
 
 Name cap_getName(Cap *cap) {
@@ -425,36 +422,36 @@ void cap_breakAdjacency(Cap *cap) {
  */
 
 void cap_writeBinaryRepresentationP(Cap *cap2, int64_t elementType,
-        void(*writeFn)(const void * ptr, size_t size, size_t count)) {
-    binaryRepresentation_writeElementType(elementType, writeFn);
-    binaryRepresentation_writeName(cap_getName(cap2), writeFn);
+        BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeElementType(elementType, writer);
+    binaryRepresentation_writeName(cap_getName(cap2), writer);
 }
 
-void cap_writeBinaryRepresentation(Cap *cap, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+void cap_writeBinaryRepresentation(Cap *cap, BinaryRepresentationWriter *writer) {
     Cap *cap2;
     if (cap_getCoordinate(cap) == INT64_MAX) {
-        binaryRepresentation_writeElementType(CODE_CAP, writeFn);
-        binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
-        binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writeFn);
+        binaryRepresentation_writeElementType(CODE_CAP, writer);
+        binaryRepresentation_writeName(cap_getName(cap), writer);
+        binaryRepresentation_writeBool(cap_getStrand(cap), writer);
+        binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writer);
     } else if (cap_getSequence(cap) != NULL) {
-        binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES, writeFn);
-        binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
-        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
-        binaryRepresentation_writeName(sequence_getName(cap_getSequence(cap)), writeFn);
+        binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES, writer);
+        binaryRepresentation_writeName(cap_getName(cap), writer);
+        binaryRepresentation_writeCoordinate(cap_getCoordinate(cap), writer);
+        binaryRepresentation_writeBool(cap_getStrand(cap), writer);
+        binaryRepresentation_writeName(sequence_getName(cap_getSequence(cap)), writer);
     } else {
-        binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE, writeFn);
-        binaryRepresentation_writeName(cap_getName(cap), writeFn);
-        binaryRepresentation_writeInteger(cap_getCoordinate(cap), writeFn);
-        binaryRepresentation_writeBool(cap_getStrand(cap), writeFn);
-        binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writeFn);
+        binaryRepresentation_writeElementType(CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE, writer);
+        binaryRepresentation_writeName(cap_getName(cap), writer);
+        binaryRepresentation_writeCoordinate(cap_getCoordinate(cap), writer);
+        binaryRepresentation_writeBool(cap_getStrand(cap), writer);
+        binaryRepresentation_writeName(event_getName(cap_getEvent(cap)), writer);
     }
     if ((cap2 = cap_getAdjacency(cap)) != NULL) {
-        cap_writeBinaryRepresentationP(cap2, CODE_ADJACENCY, writeFn);
+        cap_writeBinaryRepresentationP(cap2, CODE_ADJACENCY, writer);
     }
     if ((cap2 = cap_getParent(cap)) != NULL) {
-        cap_writeBinaryRepresentationP(cap2, CODE_PARENT, writeFn);
+        cap_writeBinaryRepresentationP(cap2, CODE_PARENT, writer);
     }
 }
 
@@ -500,7 +497,7 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
+        coordinate = binaryRepresentation_getCoordinate(binaryString);
         strand = binaryRepresentation_getBool(binaryString);
         sequence = flower_getSequence(end_getFlower(end), binaryRepresentation_getName(binaryString));
         cap = cap_construct4(name, end, coordinate, strand, sequence);
@@ -508,7 +505,7 @@ Cap *cap_loadFromBinaryRepresentation(void **binaryString, End *end) {
     } else if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_CAP_WITH_COORDINATES_BUT_NO_SEQUENCE) {
         binaryRepresentation_popNextElementType(binaryString);
         name = binaryRepresentation_getName(binaryString);
-        coordinate = binaryRepresentation_getInteger(binaryString);
+        coordinate = binaryRepresentation_getCoordinate(binaryString);
         strand = binaryRepresentation_getBool(binaryString);
         event = eventTree_getEvent(flower_getEventTree(end_getFlower(end)), binaryRepresentation_getName(binaryString));
         cap = cap_construct3(name, event, end);
@@ -29,6 +29,15 @@ struct _cap {
     Cap *rCap;
 };
 
+/*
+ * A cap, its reverse and their contents, allocated together from the slabs of the cactus disk.
+ */
+typedef struct _capUnit {
+    CapContents capContents;
+    Cap cap;
+    Cap rCap;
+} CapUnit;
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -77,8 +86,7 @@ void cap_breakAdjacency2(Cap *cap);
 /*
  * Write a binary representation of the cap to the write function.
  */
-void cap_writeBinaryRepresentation(Cap *cap, void(*writeFn)(const void * ptr,
-        size_t size, size_t count));
+void cap_writeBinaryRepresentation(Cap *cap, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
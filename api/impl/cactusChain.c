@@ -254,17 +254,16 @@ void chain_join(Chain *_5Chain, Chain *_3Chain) {
  * Serialisation functions.
  */
 
-void chain_writeBinaryRepresentation(Chain *chain, void(*writeFn)(
-        const void * ptr, size_t size, size_t count)) {
+void chain_writeBinaryRepresentation(Chain *chain, BinaryRepresentationWriter *writer) {
     Link *link;
-    binaryRepresentation_writeElementType(CODE_CHAIN, writeFn);
-    binaryRepresentation_writeName(chain_getName(chain), writeFn);
+    binaryRepresentation_writeElementType(CODE_CHAIN, writer);
+    binaryRepresentation_writeName(chain_getName(chain), writer);
     link = chain_getFirst(chain);
     while (link != NULL) {
-        link_writeBinaryRepresentation(link, writeFn);
+        link_writeBinaryRepresentation(link, writer);
         link = link_getNextLink(link);
     }
-    binaryRepresentation_writeElementType(CODE_CHAIN, writeFn);
+    binaryRepresentation_writeElementType(CODE_CHAIN, writer);
 }
 
 Chain *chain_loadFromBinaryRepresentation(void **binaryString, Flower *flower) {
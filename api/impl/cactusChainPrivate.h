@@ -39,7 +39,7 @@ void chain_addLink(Chain *chain, Link *childLink);
 /*
  * Write a binary representation of the chain to the write function.
  */
-void chain_writeBinaryRepresentation(Chain *chain, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void chain_writeBinaryRepresentation(Chain *chain, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
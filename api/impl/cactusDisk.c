@@ -12,10 +12,12 @@
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
 #define CACTUS_DISK_NAME_INCREMENT 16384
 #define CACTUS_DISK_BUCKET_NUMBER 65536
 #define CACTUS_DISK_PARAMETER_KEY -100000
 #define CACTUS_DISK_SEQUENCE_CHUNK_SIZE 500
+#define CACTUS_DISK_WRITE_WINDOW 1024
 
 /*
  * Functions on meta sequences.
@@ -39,6 +41,11 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
     /*
      * Adds a string to the database.
      */
+    if (cactusDisk->sequenceStore != NULL) {
+        Name name = cactusDisk_getUniqueID(cactusDisk);
+        cactusSequenceStore_addString(cactusDisk->sequenceStore, name, string);
+        return name;
+    }
     int64_t stringSize = strlen(string);
     int64_t intervalSize = ceil((double) stringSize / CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
     Name name = cactusDisk_getUniqueIDInterval(cactusDisk, intervalSize);
@@ -51,16 +58,19 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
         stList_append(insertRequests, stKVDatabaseBulkRequest_constructInsertRequest(name + i, subString, j + 1));
         free(subString);
     }
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
     stTry
     {
         stKVDatabase_bulkSetRecords(cactusDisk->database, insertRequests);
     }
     stCatch(except)
     {
+        pthread_mutex_unlock(&cactusDisk->databaseMutex);
         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when we tried to add a string to the cactus disk");
     }stTryEnd
          ;
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
     stList_destruct(insertRequests);
     return name;
 }
@@ -161,16 +171,19 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
         return;
     }
     stList *records = NULL;
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
     stTry
     {
         records = stKVDatabase_bulkGetRecords(cactusDisk->database, getRequests);
     }
     stCatch(except)
     {
+        pthread_mutex_unlock(&cactusDisk->databaseMutex);
         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when getting a sequence string");
     }stTryEnd
          ;
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
     assert(records != NULL);
     assert(stList_length(records) == stList_length(getRequests));
     stList_destruct(getRequests);
@@ -192,9 +205,9 @@ static void cacheSubstringsFromDB(CactusDisk *cactusDisk, stList *substrings) {
         }
         assert(stList_length(strings) > 0);
         char *joinedString = stString_join2("", strings);
-        stCache_setRecord(cactusDisk->stringCache, substring->name,
-                          (substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE,
-                          strlen(joinedString), joinedString);
+        cactusCache_setSubstring(cactusDisk->stringCache, substring->name,
+                                 (substring->start / CACTUS_DISK_SEQUENCE_CHUNK_SIZE) * CACTUS_DISK_SEQUENCE_CHUNK_SIZE,
+                                 joinedString, strlen(joinedString));
         free(joinedString);
         stList_destruct(strings);
     }
@@ -211,14 +224,24 @@ void cactusDisk_preCacheStrings2(CactusDisk *cactusDisk, stList *substrings) {
         // No string cache.
         return;
     }
+    //Strings in the sequence store are read straight from its mapping, so are not cached
+    stList *databaseSubstrings = stList_construct();
+    for (int64_t i = 0; i < stList_length(substrings); i++) {
+        Substring *substring = stList_get(substrings, i);
+        if (cactusDisk->sequenceStore == NULL
+                || !cactusSequenceStore_containsString(cactusDisk->sequenceStore, substring->name)) {
+            stList_append(databaseSubstrings, substring);
+        }
+    }
     //Now do some simple merging to reduce granularity
-    stList *mergedSubstrings = mergeSubstrings(substrings, CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
+    stList *mergedSubstrings = mergeSubstrings(databaseSubstrings, CACTUS_DISK_SEQUENCE_CHUNK_SIZE);
+    stList_destruct(databaseSubstrings);
     //Now cache the sequences
     cacheSubstringsFromDB(cactusDisk, mergedSubstrings);
     stList_destruct(mergedSubstrings);
 }
 
-static stList *getSubstringsForFlowers(stList *flowers) {
+stList *cactusDisk_getSubstringsForFlowers(stList *flowers) {
     /*
      * Get the set of substrings for sequence intervals in the given set of flowers.
      */
@@ -264,7 +287,7 @@ void cactusDisk_preCacheStrings(CactusDisk *cactusDisk, stList *flowers) {
         // No string cache.
         return;
     }
-    stList *substrings = getSubstringsForFlowers(flowers);
+    stList *substrings = cactusDisk_getSubstringsForFlowers(flowers);
     cactusDisk_preCacheStrings2(cactusDisk, substrings);
     stList_destruct(substrings);
 }
@@ -320,14 +343,8 @@ char *cactusDisk_getStringFromCache(CactusDisk *cactusDisk, Name name, int64_t s
         // No cache.
         return NULL;
     }
-    char *string = NULL;
-    if (stCache_containsRecord(cactusDisk->stringCache, name, start, sizeof(char) * length)) {
-        int64_t recordSize;
-        string = stCache_getRecord(cactusDisk->stringCache, name, start, sizeof(char) * length, &recordSize);
-        assert(string != NULL);
-        assert(recordSize == length);
-        string = st_realloc(string, sizeof(char) * (length + 1));
-        string[length] = '\0';
+    char *string = cactusCache_getSubstring(cactusDisk->stringCache, name, start, sizeof(char) * length);
+    if (string != NULL) {
         if (!strand) {
             char *string2 = stString_reverseComplementString(string);
             free(string);
@@ -347,6 +364,12 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
     if (length == 0) {
         return stString_copy("");
     }
+    if (cactusDisk->sequenceStore != NULL) {
+        char *string = cactusSequenceStore_getString(cactusDisk->sequenceStore, name, start, length, strand);
+        if (string != NULL) {
+            return string;
+        }
+    }
     //First try getting it from the cache
     char *string = cactusDisk_getStringFromCache(cactusDisk, name, start, length, strand);
     if (string == NULL) { //If not in the cache, add it to the cache and then get it from the cache.
@@ -379,18 +402,28 @@ static int cactusDisk_constructMetaSequencesP(const void *o1, const void *o2) {
 }
 
 static void cactusDisk_writeBinaryRepresentation(CactusDisk *cactusDisk,
-        void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-    binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writeFn);
+        BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writer);
     if (cactusDisk->eventTree != NULL) {
-        eventTree_writeBinaryRepresentation(cactusDisk->eventTree, writeFn);
+        eventTree_writeBinaryRepresentation(cactusDisk->eventTree, writer);
+    }
+    if (cactusDisk->sequenceStore != NULL) {
+        binaryRepresentation_writeElementType(CODE_SEQUENCE_STORE, writer);
+        binaryRepresentation_writeString(cactusSequenceStore_getFileName(cactusDisk->sequenceStore), writer);
     }
-    binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writeFn);
+    binaryRepresentation_writeElementType(CODE_CACTUS_DISK, writer);
 }
 
 static void cactusDisk_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk, stKVDatabaseConf *conf) {
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
     cactusDisk->eventTree = eventTree_loadFromBinaryRepresentation(binaryString, cactusDisk);
+    if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_SEQUENCE_STORE) {
+        binaryRepresentation_popNextElementType(binaryString);
+        char *fileName = binaryRepresentation_getString(binaryString);
+        cactusDisk->sequenceStore = cactusSequenceStore_open(fileName);
+        free(fileName);
+    }
     assert(binaryRepresentation_peekNextElementType(*binaryString) == CODE_CACTUS_DISK);
     binaryRepresentation_popNextElementType(binaryString);
 }
@@ -416,21 +449,27 @@ static void *decompress(void *data, int64_t *dataSize) {
     return data2;
 }
 
-static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *type) {
+static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *type, int64_t *totalRecordSize) {
+    if (totalRecordSize != NULL) {
+        *totalRecordSize = 0;
+    }
     if (stList_length(objectNames) == 0) {
         return stList_construct3(0, NULL);
     }
     stList *records = NULL;
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
     stTry
         {
             records = stKVDatabase_bulkGetRecords(cactusDisk->database, objectNames);
         }
         stCatch(except)
             {
+                pthread_mutex_unlock(&cactusDisk->databaseMutex);
                 stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                         "An unknown database error occurred when getting a bulk set of %s", type);
             }stTryEnd
     ;
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
     assert(records != NULL);
     assert(stList_length(objectNames) == stList_length(records));
     stList_setDestructor(records, free);
@@ -441,18 +480,18 @@ static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *typ
         stKVDatabaseBulkResult *result = stList_get(records, i);
         assert(result != NULL);
         if (cactusDisk->cache == NULL
-            || !stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX)) {
+            || (record = cactusCache_getRecord(cactusDisk->cache, objectName, &recordSize)) == NULL) {
             record = stKVDatabaseBulkResult_getRecord(result, &recordSize);
             assert(recordSize >= 0);
             assert(record != NULL);
             record = decompress(record, &recordSize);
             if (cactusDisk->cache != NULL) {
-                stCache_setRecord(cactusDisk->cache, objectName, 0, recordSize, record);
+                cactusCache_setRecord(cactusDisk->cache, objectName, record, recordSize);
             }
-        } else {
-            record = stCache_getRecord(cactusDisk->cache, objectName, 0, INT64_MAX, &recordSize);
-            assert(recordSize >= 0);
-            assert(record != NULL);
+        }
+        assert(recordSize >= 0);
+        if (totalRecordSize != NULL) {
+            *totalRecordSize += recordSize;
         }
         stKVDatabaseBulkResult_destruct(result);
         stList_set(records, i, record);
@@ -463,20 +502,23 @@ static stList *getRecords(CactusDisk *cactusDisk, stList *objectNames, char *typ
 static void *getRecord(CactusDisk *cactusDisk, Name objectName, char *type, int64_t *size) {
     void *cA = NULL;
     int64_t recordSize = 0;
-    if (cactusDisk->cache != NULL
-        && stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX)) { //If we already have the record, we won't update it.
-        cA = stCache_getRecord(cactusDisk->cache, objectName, 0, INT64_MAX, &recordSize);
-    } else {
+    if (cactusDisk->cache != NULL) { //If we already have the record, we won't update it.
+        cA = cactusCache_getRecord(cactusDisk->cache, objectName, &recordSize);
+    }
+    if (cA == NULL) {
+        pthread_mutex_lock(&cactusDisk->databaseMutex);
         stTry
             {
                 cA = stKVDatabase_getRecord2(cactusDisk->database, objectName, &recordSize);
             }
             stCatch(except)
                 {
+                    pthread_mutex_unlock(&cactusDisk->databaseMutex);
                     stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                             "An unknown database error occurred when getting a %s", type);
                 }stTryEnd
         ;
+        pthread_mutex_unlock(&cactusDisk->databaseMutex);
         if (cA == NULL) {
             return NULL;
         }
@@ -487,7 +529,7 @@ static void *getRecord(CactusDisk *cactusDisk, Name objectName, char *type, int6
         cA = cA2;
         // Add the uncompressed record to the cache.
         if (cactusDisk->cache != NULL) {
-            stCache_setRecord(cactusDisk->cache, objectName, 0, recordSize, cA);
+            cactusCache_setRecord(cactusDisk->cache, objectName, cA, recordSize);
         }
     }
     if (size != NULL) {
@@ -497,9 +539,13 @@ static void *getRecord(CactusDisk *cactusDisk, Name objectName, char *type, int6
 }
 
 static bool containsRecord(CactusDisk *cactusDisk, Name objectName) {
-    return (cactusDisk->cache != NULL
-            && stCache_containsRecord(cactusDisk->cache, objectName, 0, INT64_MAX))
-        || stKVDatabase_containsRecord(cactusDisk->database, objectName);
+    if (cactusDisk->cache != NULL && cactusCache_containsRecord(cactusDisk->cache, objectName)) {
+        return 1;
+    }
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
+    bool contains = stKVDatabase_containsRecord(cactusDisk->database, objectName);
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
+    return contains;
 }
 
 static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool create, bool cache) {
@@ -513,15 +559,19 @@ static CactusDisk *cactusDisk_constructPrivate(stKVDatabaseConf *conf, bool crea
     cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
 
     cactusDisk->eventTree = NULL;
+    cactusDisk->writeThreads = 1;
+    cactusDisk->capAllocator = cactusSlabAllocator_construct(sizeof(CapUnit));
+    cactusDisk->endAllocator = cactusSlabAllocator_construct(sizeof(EndUnit));
+    cactusDisk->segmentAllocator = cactusSlabAllocator_construct(sizeof(SegmentUnit));
+    cactusDisk->blockAllocator = cactusSlabAllocator_construct(sizeof(BlockUnit));
+    pthread_mutex_init(&cactusDisk->databaseMutex, NULL);
 
     //Now open the database
     cactusDisk->database = stKVDatabase_construct(conf, create);
     if (cache) {
-        // 10MB for general DB responses
-        cactusDisk->cache = stCache_construct2(10000000);
+        cactusDisk->cache = cactusCache_construct(CACTUS_DISK_RECORD_CACHE_SIZE);
     }
-    // 100MB for strings
-    cactusDisk->stringCache = stCache_construct2(10000000);
+    cactusDisk->stringCache = cactusCache_construct(CACTUS_DISK_STRING_CACHE_SIZE);
 
     //initialise the unique ids.
     int64_t seed = (clock() << 24) | (time(NULL) << 16) | (getpid() & 65535); //Likely to be unique
@@ -566,14 +616,31 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     }
     stSortedSet_destruct(cactusDisk->metaSequences);
 
+    //With the flowers gone their slabs are released.
+    cactusSlabAllocator_destruct(cactusDisk->capAllocator);
+    cactusSlabAllocator_destruct(cactusDisk->endAllocator);
+    cactusSlabAllocator_destruct(cactusDisk->segmentAllocator);
+    cactusSlabAllocator_destruct(cactusDisk->blockAllocator);
+
     //close DB
     stKVDatabase_destruct(cactusDisk->database);
+    pthread_mutex_destroy(&cactusDisk->databaseMutex);
+
+    CactusDiskCacheStats recordCacheStats, stringCacheStats;
+    cactusDisk_getCacheStats(cactusDisk, &recordCacheStats, &stringCacheStats);
+    st_logDebug("The cactus disk record cache had %" PRIi64 " hits, %" PRIi64 " misses and %" PRIi64
+            " evictions, the string cache had %" PRIi64 " hits, %" PRIi64 " misses and %" PRIi64 " evictions\n",
+            recordCacheStats.hits, recordCacheStats.misses, recordCacheStats.evictions,
+            stringCacheStats.hits, stringCacheStats.misses, stringCacheStats.evictions);
 
     if (cactusDisk->cache != NULL) {
-        stCache_destruct(cactusDisk->cache);
+        cactusCache_destruct(cactusDisk->cache);
     }
     if (cactusDisk->stringCache != NULL) {
-        stCache_destruct(cactusDisk->stringCache);
+        cactusCache_destruct(cactusDisk->stringCache);
+    }
+    if (cactusDisk->sequenceStore != NULL) {
+        cactusSequenceStore_destruct(cactusDisk->sequenceStore);
     }
 
     stList_destruct(cactusDisk->updateRequests);
@@ -581,36 +648,234 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     free(cactusDisk);
 }
 
-void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
+/*
+ * Records are serialised by a pipeline: a pool of worker threads serialises and compresses
+ * records, at most CACTUS_DISK_WRITE_WINDOW records ahead of the main thread, which turns them
+ * into update requests, in order. All database calls are made by the main thread, and all the
+ * updates of a write, including the nulling of flowers marked for deletion, are sent in one
+ * atomic bulk request, so an interrupted write leaves the database unchanged.
+ */
+
+typedef struct _serialisedRecord {
+    Name name;
+    void *object;
+    void (*writeBinaryRepresentation)(void *, BinaryRepresentationWriter *);
+    bool skipIfUnchanged;
+    void *record;
     int64_t recordSize;
-    void *vA = binaryRepresentation_makeBinaryRepresentation(flower,
-            (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) flower_writeBinaryRepresentation,
-            &recordSize);
-    //Compression
+    void *compressed;
     int64_t compressedSize;
-    void *compressed = stCompression_compress(vA, recordSize, &compressedSize, -1);
-    if (containsRecord(cactusDisk, flower_getName(flower))) {
-        // Check if this is a redundant update.
-        int64_t recordSize2;
-        void *vA2 = getRecord(cactusDisk, flower_getName(flower), "flower", &recordSize2);
-        if (!stCache_recordsIdentical(vA, recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
+    double serialiseTime;
+    double compressTime;
+    bool done;
+} SerialisedRecord;
+
+typedef struct _cactusDiskWriteStats {
+    int64_t records;
+    int64_t recordsUnchanged;
+    int64_t serialisedBytes;
+    int64_t compressedBytes;
+    int64_t writtenBytes;
+    double serialiseTime;
+    double compressTime;
+    double writeTime;
+} CactusDiskWriteStats;
+
+typedef struct _recordPipeline {
+    SerialisedRecord *records;
+    int64_t recordNumber;
+    int64_t nextRecord;
+    int64_t consumedRecords;
+    pthread_mutex_t mutex;
+    pthread_cond_t recordDone;
+    pthread_cond_t windowOpen;
+} RecordPipeline;
+
+static double getTime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+static void serialisedRecord_set(SerialisedRecord *serialisedRecord, Name name, void *object,
+        void (*writeBinaryRepresentation)(void *, BinaryRepresentationWriter *), bool skipIfUnchanged) {
+    memset(serialisedRecord, 0, sizeof(SerialisedRecord));
+    serialisedRecord->name = name;
+    serialisedRecord->object = object;
+    serialisedRecord->writeBinaryRepresentation = writeBinaryRepresentation;
+    serialisedRecord->skipIfUnchanged = skipIfUnchanged;
+}
+
+static void serialiseRecord(SerialisedRecord *serialisedRecord) {
+    /*
+     * Only reads the object, so may be run on several records concurrently.
+     */
+    double startTime = getTime();
+    serialisedRecord->record = binaryRepresentation_makeBinaryRepresentation(serialisedRecord->object,
+            serialisedRecord->writeBinaryRepresentation, &serialisedRecord->recordSize);
+    double midTime = getTime();
+    serialisedRecord->compressed = stCompression_compress(serialisedRecord->record, serialisedRecord->recordSize,
+            &serialisedRecord->compressedSize, -1);
+    serialisedRecord->serialiseTime = midTime - startTime;
+    serialisedRecord->compressTime = getTime() - midTime;
+}
+
+static void addUpdateRequestForSerialisedRecord(CactusDisk *cactusDisk, SerialisedRecord *serialisedRecord,
+        CactusDiskWriteStats *stats) {
+    int64_t bytesAdded = serialisedRecord->compressedSize;
+    if (containsRecord(cactusDisk, serialisedRecord->name)) {
+        if (serialisedRecord->skipIfUnchanged) {
+            // Check if this is a redundant update.
+            int64_t recordSize2;
+            void *vA2 = getRecord(cactusDisk, serialisedRecord->name, "flower", &recordSize2);
+            if (!stCache_recordsIdentical(serialisedRecord->record, serialisedRecord->recordSize, vA2, recordSize2)) { //Only rewrite if we actually did something
+                stList_append(cactusDisk->updateRequests,
+                        stKVDatabaseBulkRequest_constructUpdateRequest(serialisedRecord->name, serialisedRecord->compressed,
+                                serialisedRecord->compressedSize));
+            } else {
+                bytesAdded = 0;
+            }
+            free(vA2);
+        } else {
             stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(flower_getName(flower), compressed, compressedSize));
+                    stKVDatabaseBulkRequest_constructUpdateRequest(serialisedRecord->name, serialisedRecord->compressed,
+                            serialisedRecord->compressedSize));
         }
-        free(vA2);
     } else {
         stList_append(cactusDisk->updateRequests,
-                stKVDatabaseBulkRequest_constructInsertRequest(flower_getName(flower), compressed, compressedSize));
+                stKVDatabaseBulkRequest_constructInsertRequest(serialisedRecord->name, serialisedRecord->compressed,
+                        serialisedRecord->compressedSize));
+    }
+    if (stats != NULL) {
+        stats->records++;
+        stats->writtenBytes += bytesAdded;
+        stats->recordsUnchanged += bytesAdded == 0 ? 1 : 0;
+        stats->serialisedBytes += serialisedRecord->recordSize;
+        stats->compressedBytes += serialisedRecord->compressedSize;
+        stats->serialiseTime += serialisedRecord->serialiseTime;
+        stats->compressTime += serialisedRecord->compressTime;
     }
-    free(vA);
-    free(compressed);
+    free(serialisedRecord->record);
+    free(serialisedRecord->compressed);
+    serialisedRecord->record = NULL;
+    serialisedRecord->compressed = NULL;
+}
+
+void cactusDisk_addUpdateRequest(CactusDisk *cactusDisk, Flower *flower) {
+    SerialisedRecord serialisedRecord;
+    serialisedRecord_set(&serialisedRecord, flower_getName(flower), flower,
+            (void (*)(void *, BinaryRepresentationWriter *)) flower_writeBinaryRepresentation, 1);
+    serialiseRecord(&serialisedRecord);
+    addUpdateRequestForSerialisedRecord(cactusDisk, &serialisedRecord, NULL);
+}
+
+static void flushUpdateRequests(CactusDisk *cactusDisk, CactusDiskWriteStats *stats) {
+    /*
+     * Sends the pending update requests to the database as one bulk request.
+     */
+    if (stList_length(cactusDisk->updateRequests) == 0) {
+        return;
+    }
+    double startTime = getTime();
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
+    stTry
+        {
+            st_logDebug("Writing %" PRIi64 " updates\n", stList_length(cactusDisk->updateRequests));
+            stKVDatabase_bulkSetRecords(cactusDisk->database, cactusDisk->updateRequests);
+        }
+        stCatch(except)
+            {
+                pthread_mutex_unlock(&cactusDisk->databaseMutex);
+                stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
+                        "Failed when trying to set records in updating the cactus disk");
+            }stTryEnd
+    ;
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
+    stList_destruct(cactusDisk->updateRequests);
+    cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
+    stats->writeTime += getTime() - startTime;
+}
+
+static void *recordPipeline_worker(RecordPipeline *pipeline) {
+    while (1) {
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->nextRecord < pipeline->recordNumber
+                && pipeline->nextRecord >= pipeline->consumedRecords + CACTUS_DISK_WRITE_WINDOW) {
+            pthread_cond_wait(&pipeline->windowOpen, &pipeline->mutex);
+        }
+        if (pipeline->nextRecord >= pipeline->recordNumber) {
+            pthread_mutex_unlock(&pipeline->mutex);
+            return NULL;
+        }
+        SerialisedRecord *serialisedRecord = &pipeline->records[pipeline->nextRecord++];
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        serialiseRecord(serialisedRecord);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        serialisedRecord->done = 1;
+        pthread_cond_broadcast(&pipeline->recordDone);
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+}
+
+static void writeRecords(CactusDisk *cactusDisk, SerialisedRecord *records, int64_t recordNumber,
+        CactusDiskWriteStats *stats) {
+    /*
+     * Serialises and compresses the records into update requests, overlapping the encoding of
+     * later records with the database reads (to find unchanged flowers) of earlier ones.
+     */
+    RecordPipeline pipeline;
+    pipeline.records = records;
+    pipeline.recordNumber = recordNumber;
+    pipeline.nextRecord = 0;
+    pipeline.consumedRecords = 0;
+    pthread_mutex_init(&pipeline.mutex, NULL);
+    pthread_cond_init(&pipeline.recordDone, NULL);
+    pthread_cond_init(&pipeline.windowOpen, NULL);
+
+    int64_t threadNumber = cactusDisk->writeThreads > 1 && recordNumber > 1 ? cactusDisk->writeThreads : 0;
+    pthread_t *threads = st_malloc(sizeof(pthread_t) * (threadNumber > 0 ? threadNumber : 1));
+    for (int64_t i = 0; i < threadNumber; i++) {
+        if (pthread_create(&threads[i], NULL, (void *(*)(void *)) recordPipeline_worker, &pipeline) != 0) {
+            st_errAbort("Could not create a thread to serialise the cactus disk");
+        }
+    }
+
+    for (int64_t i = 0; i < recordNumber; i++) {
+        SerialisedRecord *serialisedRecord = &records[i];
+        if (threadNumber == 0) {
+            serialiseRecord(serialisedRecord);
+        } else {
+            pthread_mutex_lock(&pipeline.mutex);
+            while (!serialisedRecord->done) {
+                pthread_cond_wait(&pipeline.recordDone, &pipeline.mutex);
+            }
+            pthread_mutex_unlock(&pipeline.mutex);
+        }
+        addUpdateRequestForSerialisedRecord(cactusDisk, serialisedRecord, stats);
+        if (threadNumber > 0) {
+            pthread_mutex_lock(&pipeline.mutex);
+            pipeline.consumedRecords = i + 1;
+            pthread_cond_broadcast(&pipeline.windowOpen);
+            pthread_mutex_unlock(&pipeline.mutex);
+        }
+    }
+
+    for (int64_t i = 0; i < threadNumber; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_cond_destroy(&pipeline.windowOpen);
+    pthread_cond_destroy(&pipeline.recordDone);
+    pthread_mutex_destroy(&pipeline.mutex);
 }
 
 void cactusDisk_forceParameterUpdate(CactusDisk *cactusDisk, bool keyAlreadyExists) {
     int64_t recordSize;
     void *cactusDiskParameters =
         binaryRepresentation_makeBinaryRepresentation(cactusDisk,
-                                                      (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) cactusDisk_writeBinaryRepresentation,
+                                                      (void (*)(void *, BinaryRepresentationWriter *)) cactusDisk_writeBinaryRepresentation,
                                                       &recordSize);
     //Compression
     cactusDiskParameters = compress(cactusDiskParameters, &recordSize);
@@ -627,21 +892,37 @@ void cactusDisk_forceParameterUpdate(CactusDisk *cactusDisk, bool keyAlreadyExis
 }
 
 void cactusDisk_write(CactusDisk *cactusDisk) {
-    Flower *flower;
-    int64_t recordSize;
+    CactusDiskWriteStats stats;
+    memset(&stats, 0, sizeof(CactusDiskWriteStats));
+    double startTime = getTime();
 
     stList *removeRequests = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
 
     st_logDebug("Starting to write the cactus to disk\n");
 
+    //Serialise the flowers and the meta-sequences.
+    int64_t recordNumber = stSortedSet_size(cactusDisk->flowers) + stSortedSet_size(cactusDisk->metaSequences);
+    SerialisedRecord *records = st_malloc(sizeof(SerialisedRecord) * (recordNumber > 0 ? recordNumber : 1));
+    int64_t i = 0;
     stSortedSetIterator *it = stSortedSet_getIterator(cactusDisk->flowers);
-    //Sort flowers to update.
+    Flower *flower;
     while ((flower = stSortedSet_getNext(it)) != NULL) {
-        cactusDisk_addUpdateRequest(cactusDisk, flower);
+        serialisedRecord_set(&records[i++], flower_getName(flower), flower,
+                (void (*)(void *, BinaryRepresentationWriter *)) flower_writeBinaryRepresentation, 1);
     }
     stSortedSet_destructIterator(it);
+    it = stSortedSet_getIterator(cactusDisk->metaSequences);
+    MetaSequence *metaSequence;
+    while ((metaSequence = stSortedSet_getNext(it)) != NULL) {
+        serialisedRecord_set(&records[i++], metaSequence_getName(metaSequence), metaSequence,
+                (void (*)(void *, BinaryRepresentationWriter *)) metaSequence_writeBinaryRepresentation, 0);
+    }
+    stSortedSet_destructIterator(it);
+    assert(i == recordNumber);
+    writeRecords(cactusDisk, records, recordNumber, &stats);
+    free(records);
 
-    st_logDebug("Got the flowers to update\n");
+    st_logDebug("Got the flowers and sequences to update\n");
 
     //Remove nets that are marked for deletion..
     it = stSortedSet_getIterator(cactusDisk->flowerNamesMarkedForDeletion);
@@ -657,77 +938,56 @@ void cactusDisk_write(CactusDisk *cactusDisk) {
 
     st_logDebug("Avoided updating nets marked for deletion\n");
 
-    // Insert and/or update meta-sequences.
-    it = stSortedSet_getIterator(cactusDisk->metaSequences);
-    MetaSequence *metaSequence;
-    while ((metaSequence = stSortedSet_getNext(it)) != NULL) {
-        void *vA =
-                binaryRepresentation_makeBinaryRepresentation(metaSequence,
-                        (void (*)(void *, void (*)(const void * ptr, size_t size, size_t count))) metaSequence_writeBinaryRepresentation,
-                        &recordSize);
-        //Compression
-        vA = compress(vA, &recordSize);
-        if (!containsRecord(cactusDisk, metaSequence_getName(metaSequence))) {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructInsertRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        } else {
-            stList_append(cactusDisk->updateRequests,
-                    stKVDatabaseBulkRequest_constructUpdateRequest(metaSequence_getName(metaSequence), vA, recordSize));
-        }
-        free(vA);
-    }
-    stSortedSet_destructIterator(it);
-
-    st_logDebug("Got the sequences we are going to add to the database.\n");
-
     if (!containsRecord(cactusDisk, CACTUS_DISK_PARAMETER_KEY)) { //We only write the parameters once.
         cactusDisk_forceParameterUpdate(cactusDisk, false);
     }
 
     st_logDebug("Checked if need to write the initial parameters\n");
 
-    if (stList_length(cactusDisk->updateRequests) > 0) {
-        st_logDebug("Going to write %" PRIi64 " updates\n", stList_length(cactusDisk->updateRequests));
-        stTry
-            {
-                st_logDebug("Writing %" PRIi64 " updates\n", stList_length(cactusDisk->updateRequests));
-                assert(stList_length(cactusDisk->updateRequests) > 0);
-                stKVDatabase_bulkSetRecords(cactusDisk->database, cactusDisk->updateRequests);
-            }
-            stCatch(except)
-                {
-                    stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
-                            "Failed when trying to set records in updating the cactus disk");
-                }stTryEnd
-        ;
-    }
+    flushUpdateRequests(cactusDisk, &stats);
 
     st_logDebug("Updated the database with inserts\n");
 
     if (stList_length(removeRequests) > 0) {
+        pthread_mutex_lock(&cactusDisk->databaseMutex);
         stTry
             {
                 stKVDatabase_bulkRemoveRecords(cactusDisk->database, removeRequests);
             }
             stCatch(except)
                 {
+                    pthread_mutex_unlock(&cactusDisk->databaseMutex);
                     stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                             "Failed when trying to remove records in updating the cactus disk");
                 }stTryEnd
         ;
+        pthread_mutex_unlock(&cactusDisk->databaseMutex);
     }
 
     st_logDebug("Now removed flowers we don't need\n");
 
-    stList_destruct(cactusDisk->updateRequests);
-    cactusDisk->updateRequests = stList_construct3(0, (void (*)(void *)) stKVDatabaseBulkRequest_destruct);
     stList_destruct(removeRequests);
 
-    st_logDebug("Finished writing to the database\n");
+    st_logInfo("Wrote %" PRIi64 " records (%" PRIi64 " unchanged) to the cactus disk in %f seconds with %" PRIi64 " threads: "
+            "serialised %" PRIi64 " bytes in %f seconds, compressed them to %" PRIi64 " bytes in %f seconds (thread time), "
+            "sent %" PRIi64 " bytes in %f seconds\n",
+            stats.records, stats.recordsUnchanged, getTime() - startTime, cactusDisk->writeThreads,
+            stats.serialisedBytes, stats.serialiseTime, stats.compressedBytes, stats.compressTime,
+            stats.writtenBytes, stats.writeTime);
+}
+
+stList *cactusDisk_getFlowerRecords(CactusDisk *cactusDisk, stList *flowerNames, int64_t *totalRecordSize) {
+    return getRecords(cactusDisk, flowerNames, "flowers", totalRecordSize);
 }
 
 stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
-    stList *records = getRecords(cactusDisk, flowerNames, "flowers");
+    stList *records = getRecords(cactusDisk, flowerNames, "flowers", NULL);
+    stList *flowers = cactusDisk_loadFlowers(cactusDisk, flowerNames, records);
+    stList_destruct(records);
+    return flowers;
+}
+
+stList *cactusDisk_loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records) {
     assert(stList_length(flowerNames) == stList_length(records));
     stList *flowers = stList_construct();
     for (int64_t i = 0; i < stList_length(flowerNames); i++) {
@@ -744,7 +1004,6 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames) {
         }
         stList_append(flowers, flower2);
     }
-    stList_destruct(records);
     return flowers;
 }
 
@@ -787,6 +1046,22 @@ MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequen
  * Private functions.
  */
 
+CactusSlabAllocator *cactusDisk_getCapAllocator(CactusDisk *cactusDisk) {
+    return cactusDisk->capAllocator;
+}
+
+CactusSlabAllocator *cactusDisk_getEndAllocator(CactusDisk *cactusDisk) {
+    return cactusDisk->endAllocator;
+}
+
+CactusSlabAllocator *cactusDisk_getSegmentAllocator(CactusDisk *cactusDisk) {
+    return cactusDisk->segmentAllocator;
+}
+
+CactusSlabAllocator *cactusDisk_getBlockAllocator(CactusDisk *cactusDisk) {
+    return cactusDisk->blockAllocator;
+}
+
 bool cactusDisk_flowerIsLoaded(CactusDisk *cactusDisk, Name flowerName) {
     static Flower flower;
     flower.name = flowerName;
@@ -824,6 +1099,7 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
     intervalSize = intervalSize < CACTUS_DISK_NAME_INCREMENT ? CACTUS_DISK_NAME_INCREMENT : intervalSize;
     bool done = 0;
     int64_t collisionCount = 0;
+    pthread_mutex_lock(&cactusDisk->databaseMutex);
     while (!done) {
         stTry
             {
@@ -877,6 +1153,7 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 {
                     collisionCount++;
                     if (collisionCount >= 10) {
+                        pthread_mutex_unlock(&cactusDisk->databaseMutex);
                         stThrowNewCause(except, ST_KV_DATABASE_EXCEPTION_ID,
                                 "Repeated unknown database errors occurred when we tried to get a unique ID, collision count %" PRIi64 "",
                                 collisionCount);
@@ -886,6 +1163,7 @@ void cactusDisk_getBlockOfUniqueIDs(CactusDisk *cactusDisk, int64_t intervalSize
                 }stTryEnd
         ;
     }
+    pthread_mutex_unlock(&cactusDisk->databaseMutex);
 }
 
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
@@ -902,12 +1180,43 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk) {
     return cactusDisk_getUniqueIDInterval(cactusDisk, 1);
 }
 
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads) {
+    assert(writeThreads >= 1);
+    cactusDisk->writeThreads = writeThreads;
+}
+
 void cactusDisk_clearStringCache(CactusDisk *cactusDisk) {
-    stCache_clear(cactusDisk->stringCache);
+    cactusCache_clear(cactusDisk->stringCache);
 }
 
 void cactusDisk_clearCache(CactusDisk *cactusDisk) {
-    stCache_clear(cactusDisk->cache);
+    if (cactusDisk->cache != NULL) {
+        cactusCache_clear(cactusDisk->cache);
+    }
+}
+
+void cactusDisk_setSequenceStore(CactusDisk *cactusDisk, const char *fileName) {
+    if (cactusDisk->sequenceStore != NULL) {
+        cactusSequenceStore_destruct(cactusDisk->sequenceStore);
+    }
+    cactusDisk->sequenceStore = cactusSequenceStore_construct(fileName);
+}
+
+void cactusDisk_setCacheSizes(CactusDisk *cactusDisk, int64_t recordCacheSize, int64_t stringCacheSize) {
+    if (cactusDisk->cache != NULL) {
+        cactusCache_setMaxSize(cactusDisk->cache, recordCacheSize);
+    }
+    cactusCache_setMaxSize(cactusDisk->stringCache, stringCacheSize);
+}
+
+void cactusDisk_getCacheStats(CactusDisk *cactusDisk, CactusDiskCacheStats *recordCacheStats,
+        CactusDiskCacheStats *stringCacheStats) {
+    if (cactusDisk->cache != NULL) {
+        cactusCache_getStats(cactusDisk->cache, recordCacheStats);
+    } else {
+        memset(recordCacheStats, 0, sizeof(CactusDiskCacheStats));
+    }
+    cactusCache_getStats(cactusDisk->stringCache, stringCacheStats);
 }
 
 EventTree *cactusDisk_getEventTree(CactusDisk *cactusDisk) {
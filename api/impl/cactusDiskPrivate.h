@@ -8,6 +8,7 @@
 #define CACTUS_DISK_PRIVATE_H_
 
 #include "cactusGlobals.h"
+#include <pthread.h>
 
 struct _cactusDisk {
     stKVDatabase *database;
@@ -15,11 +16,18 @@ struct _cactusDisk {
     stSortedSet *flowers;
     stSortedSet *flowerNamesMarkedForDeletion;
     stList *updateRequests;
-    stCache *cache;
-    stCache *stringCache;
+    CactusCache *cache;
+    CactusCache *stringCache;
+    CactusSequenceStore *sequenceStore;
     EventTree *eventTree;
     Name uniqueNumber;
     Name maxUniqueNumber;
+    int64_t writeThreads;
+    CactusSlabAllocator *capAllocator; //The caps, ends, segments and blocks of all the loaded flowers.
+    CactusSlabAllocator *endAllocator;
+    CactusSlabAllocator *segmentAllocator;
+    CactusSlabAllocator *blockAllocator;
+    pthread_mutex_t databaseMutex; //Serialises use of the database connection by the threads of a FlowerStream
 };
 
 ////////////////////////////////////////////////
@@ -30,6 +38,19 @@ struct _cactusDisk {
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
+/*
+ * Get the allocators from which the caps, ends, segments and blocks of the flowers of the cactus
+ * disk are allocated, see CapUnit, EndUnit, SegmentUnit and BlockUnit. The allocators are shared
+ * by the flowers, so many small flowers do not each hold a partly filled slab of every kind.
+ */
+CactusSlabAllocator *cactusDisk_getCapAllocator(CactusDisk *cactusDisk);
+
+CactusSlabAllocator *cactusDisk_getEndAllocator(CactusDisk *cactusDisk);
+
+CactusSlabAllocator *cactusDisk_getSegmentAllocator(CactusDisk *cactusDisk);
+
+CactusSlabAllocator *cactusDisk_getBlockAllocator(CactusDisk *cactusDisk);
+
 /*
  * Returns non-zero if the given flower is loaded in memory.
  */
@@ -85,6 +106,31 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string);
 char *cactusDisk_getString(CactusDisk *cactusDisk, Name name,
         int64_t start, int64_t length, int64_t strand, int64_t totalSequenceLength);
 
+/*
+ * Gets the decompressed records of the given flowers, without loading them. Safe to call
+ * from a thread other than the one using the cactus disk. If totalRecordSize is not NULL
+ * it is set to the total size of the records.
+ */
+stList *cactusDisk_getFlowerRecords(CactusDisk *cactusDisk, stList *flowerNames, int64_t *totalRecordSize);
+
+/*
+ * Loads the given flowers from the records returned by cactusDisk_getFlowerRecords, as
+ * cactusDisk_getFlowers. Flowers that are already loaded are not reloaded.
+ */
+stList *cactusDisk_loadFlowers(CactusDisk *cactusDisk, stList *flowerNames, stList *records);
+
+/*
+ * Gets the list of substrings (see cactusDisk_preCacheStrings2) spanned by the
+ * adjacencies of the stub ends of the given flowers.
+ */
+stList *cactusDisk_getSubstringsForFlowers(stList *flowers);
+
+/*
+ * Precaches the given list of substrings. Safe to call from a thread other than the
+ * one using the cactus disk.
+ */
+void cactusDisk_preCacheStrings2(CactusDisk *cactusDisk, stList *substrings);
+
 /*
  * Gets the string from a cache.
  */
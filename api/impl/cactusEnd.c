@@ -30,11 +30,11 @@ End *end_construct2(bool side, bool isAttached, Flower *flower) {
 
 End *end_construct3(Name name, int64_t isStub, int64_t isAttached,
         int64_t side, Flower *flower) {
-    End *end;
-    end = st_malloc(sizeof(End));
-    end->rEnd = st_malloc(sizeof(End));
+    EndUnit *endUnit = cactusSlabAllocator_allocate(flower_getEndAllocator(flower));
+    End *end = &endUnit->end;
+    end->rEnd = &endUnit->rEnd;
     end->rEnd->rEnd = end;
-    end->endContents = st_malloc(sizeof(EndContents));
+    end->endContents = &endUnit->endContents;
     end->rEnd->endContents = end->endContents;
 
     end->orientation = 1;
@@ -111,9 +111,7 @@ void end_destruct(End *end) {
     //now the actual instances.
     stSortedSet_destruct(end->endContents->caps);
 
-    free(end->endContents);
-    free(end->rEnd);
-    free(end);
+    cactusSlab_free(end->endContents); //The contents are at the start of the unit.
 }
 
 void end_setBlock(End *end, Block *block) {
@@ -381,40 +379,38 @@ void end_setFlower(End *end, Flower *flower) {
  * Serialisation functions.
  */
 
-void end_writeBinaryRepresentationP(Cap *cap, void(*writeFn)(const void * ptr,
-        size_t size, size_t count)) {
+void end_writeBinaryRepresentationP(Cap *cap, BinaryRepresentationWriter *writer) {
     int64_t i;
-    cap_writeBinaryRepresentation(cap, writeFn);
+    cap_writeBinaryRepresentation(cap, writer);
     for (i = 0; i < cap_getChildNumber(cap); i++) {
-        end_writeBinaryRepresentationP(cap_getChild(cap, i), writeFn);
+        end_writeBinaryRepresentationP(cap_getChild(cap, i), writer);
     }
 }
 
-void end_writeBinaryRepresentation(End *end, void(*writeFn)(const void * ptr,
-        size_t size, size_t count)) {
+void end_writeBinaryRepresentation(End *end, BinaryRepresentationWriter *writer) {
     End_InstanceIterator *iterator;
     Cap *cap;
 
     assert(end_getOrientation(end));
     cap = end_getRootInstance(end);
     int64_t endType = cap == NULL ? CODE_END_WITHOUT_PHYLOGENY : CODE_END_WITH_PHYLOGENY;
-    binaryRepresentation_writeElementType(endType, writeFn);
-    binaryRepresentation_writeName(end_getName(end), writeFn);
-    binaryRepresentation_writeBool(end_isStubEnd(end), writeFn);
-    binaryRepresentation_writeBool(end_isAttached(end), writeFn);
-    binaryRepresentation_writeBool(end_getSide(end), writeFn);
+    binaryRepresentation_writeElementType(endType, writer);
+    binaryRepresentation_writeName(end_getName(end), writer);
+    binaryRepresentation_writeBool(end_isStubEnd(end), writer);
+    binaryRepresentation_writeBool(end_isAttached(end), writer);
+    binaryRepresentation_writeBool(end_getSide(end), writer);
 
     if (cap == NULL) {
         iterator = end_getInstanceIterator(end);
         while ((cap = end_getNext(iterator)) != NULL) {
             assert(cap_getParent(cap) == NULL);
-            cap_writeBinaryRepresentation(cap, writeFn);
+            cap_writeBinaryRepresentation(cap, writer);
         }
         end_destructInstanceIterator(iterator);
     } else {
-        end_writeBinaryRepresentationP(cap, writeFn);
+        end_writeBinaryRepresentationP(cap, writer);
     }
-    binaryRepresentation_writeElementType(endType, writeFn);
+    binaryRepresentation_writeElementType(endType, writer);
 }
 
 End *end_loadFromBinaryRepresentation(void **binaryString, Flower *flower) {
@@ -32,6 +32,15 @@ struct _end {
 	End *rEnd;
 };
 
+/*
+ * An end, its reverse and their contents, allocated together from the slabs of the cactus disk.
+ */
+typedef struct _endUnit {
+	EndContents endContents;
+	End end;
+	End rEnd;
+} EndUnit;
+
 
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -69,7 +78,7 @@ void end_removeInstance(End *end, Cap *cap);
 /*
  * Write a binary representation of the end to the write function.
  */
-void end_writeBinaryRepresentation(End *end, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void end_writeBinaryRepresentation(End *end, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
@@ -206,15 +206,14 @@ void event_destruct(Event *event) {
  * Serialisation functions
  */
 
-void event_writeBinaryRepresentation(Event *event, void(*writeFn)(
-        const void * ptr, size_t size, size_t count)) {
-    binaryRepresentation_writeElementType(CODE_EVENT, writeFn);
+void event_writeBinaryRepresentation(Event *event, BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeElementType(CODE_EVENT, writer);
     binaryRepresentation_writeName(event_getName(event_getParent(event)),
-            writeFn);
-    binaryRepresentation_writeName(event_getName(event), writeFn);
-    binaryRepresentation_writeFloat(event_getBranchLength(event), writeFn);
-    binaryRepresentation_writeString(event_getHeader(event), writeFn);
-    binaryRepresentation_writeBool(event_isOutgroup(event), writeFn);
+            writer);
+    binaryRepresentation_writeName(event_getName(event), writer);
+    binaryRepresentation_writeFloat(event_getBranchLength(event), writer);
+    binaryRepresentation_writeString(event_getHeader(event), writer);
+    binaryRepresentation_writeBool(event_isOutgroup(event), writer);
 }
 
 Event *event_loadFromBinaryRepresentation(void **binaryString,
@@ -35,8 +35,7 @@ void event_destruct(Event *event);
 /*
  * Creates a binary representation of the event, returned as a char string.
  */
-void event_writeBinaryRepresentation(Event *event, void(*writeFn)(
-        const void * ptr, size_t size, size_t count));
+void event_writeBinaryRepresentation(Event *event, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a event into memory from a binary representation of the event.
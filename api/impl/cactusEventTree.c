@@ -213,24 +213,24 @@ void eventTree_removeEvent(EventTree *eventTree, Event *event) {
  * Serialisation functions
  */
 
-void eventTree_writeBinaryRepresentationP(Event *event, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+void eventTree_writeBinaryRepresentationP(Event *event, BinaryRepresentationWriter *writer) {
 	int64_t i;
-	event_writeBinaryRepresentation(event, writeFn);
+	event_writeBinaryRepresentation(event, writer);
 	for(i=0; i<event_getChildNumber(event); i++) {
-		eventTree_writeBinaryRepresentationP(event_getChild(event, i), writeFn);
+		eventTree_writeBinaryRepresentationP(event_getChild(event, i), writer);
 	}
 }
 
-void eventTree_writeBinaryRepresentation(EventTree *eventTree, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+void eventTree_writeBinaryRepresentation(EventTree *eventTree, BinaryRepresentationWriter *writer) {
 	int64_t i;
 	Event *event;
 	event = eventTree_getRootEvent(eventTree);
-	binaryRepresentation_writeElementType(CODE_EVENT_TREE, writeFn);
-	binaryRepresentation_writeName(event_getName(event), writeFn);
+	binaryRepresentation_writeElementType(CODE_EVENT_TREE, writer);
+	binaryRepresentation_writeName(event_getName(event), writer);
 	for(i=0; i<event_getChildNumber(event); i++) {
-		eventTree_writeBinaryRepresentationP(event_getChild(event, i), writeFn);
+		eventTree_writeBinaryRepresentationP(event_getChild(event, i), writer);
 	}
-	binaryRepresentation_writeElementType(CODE_EVENT_TREE, writeFn);
+	binaryRepresentation_writeElementType(CODE_EVENT_TREE, writer);
 }
 
 EventTree *eventTree_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk) {
@@ -42,7 +42,7 @@ void eventTree_removeEvent(EventTree *eventTree, Event *event);
 /*
  * Creates a binary representation of the eventTree, returned as a char string.
  */
-void eventTree_writeBinaryRepresentation(EventTree *eventTree, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void eventTree_writeBinaryRepresentation(EventTree *eventTree, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a eventTree into memory from a binary representation of the eventTree.
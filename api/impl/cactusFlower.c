@@ -63,6 +63,12 @@ static Flower *flower_construct3(Name name, CactusDisk *cactusDisk) {
     flower->chains = stSortedSet_construct3(flower_constructChainsP, NULL);
     flower->faces = stSortedSet_construct3(flower_constructFacesP, NULL);
 
+    flower->capIndex = cactusNameIndex_construct();
+    flower->endIndex = cactusNameIndex_construct();
+    flower->segmentIndex = cactusNameIndex_construct();
+    flower->blockIndex = cactusNameIndex_construct();
+    flower->groupIndex = cactusNameIndex_construct();
+
     flower->parentFlowerName = NULL_NAME;
     flower->cactusDisk = cactusDisk;
     flower->faceIndex = 0;
@@ -126,21 +132,42 @@ void flower_destruct(Flower *flower, int64_t recursive) {
     }
     stSortedSet_destruct(flower->caps);
     stSortedSet_destruct(flower->ends);
+    cactusNameIndex_destruct(flower->capIndex);
+    cactusNameIndex_destruct(flower->endIndex);
 
     while ((block = flower_getFirstBlock(flower)) != NULL) {
         block_destruct(block);
     }
     stSortedSet_destruct(flower->segments);
     stSortedSet_destruct(flower->blocks);
+    cactusNameIndex_destruct(flower->segmentIndex);
+    cactusNameIndex_destruct(flower->blockIndex);
 
     while ((group = flower_getFirstGroup(flower)) != NULL) {
         group_destruct(group);
     }
     stSortedSet_destruct(flower->groups);
+    cactusNameIndex_destruct(flower->groupIndex);
 
     free(flower);
 }
 
+CactusSlabAllocator *flower_getCapAllocator(Flower *flower) {
+    return cactusDisk_getCapAllocator(flower->cactusDisk);
+}
+
+CactusSlabAllocator *flower_getEndAllocator(Flower *flower) {
+    return cactusDisk_getEndAllocator(flower->cactusDisk);
+}
+
+CactusSlabAllocator *flower_getSegmentAllocator(Flower *flower) {
+    return cactusDisk_getSegmentAllocator(flower->cactusDisk);
+}
+
+CactusSlabAllocator *flower_getBlockAllocator(Flower *flower) {
+    return cactusDisk_getBlockAllocator(flower->cactusDisk);
+}
+
 Name flower_getName(Flower *flower) {
     return flower->name;
 }
@@ -194,11 +221,7 @@ Cap *flower_getFirstCap(Flower *flower) {
 }
 
 Cap *flower_getCap(Flower *flower, Name name) {
-    Cap cap;
-    CapContents capContents;
-    cap.capContents = &capContents;
-    cap.capContents->instance = name;
-    return stSortedSet_search(flower->caps, &cap);
+    return cactusNameIndex_search(flower->capIndex, name);
 }
 
 int64_t flower_getCapNumber(Flower *flower) {
@@ -230,12 +253,7 @@ End *flower_getFirstEnd(Flower *flower) {
 }
 
 End *flower_getEnd(Flower *flower, Name name) {
-    End end;
-    EndContents endContents;
-    end.endContents = &endContents;
-    endContents.name = name;
-    end.orientation = 1;
-    return stSortedSet_search(flower->ends, &end);
+    return cactusNameIndex_search(flower->endIndex, name);
 }
 
 int64_t flower_getEndNumber(Flower *flower) {
@@ -292,9 +310,7 @@ Segment *flower_getFirstSegment(Flower *flower) {
 }
 
 Segment *flower_getSegment(Flower *flower, Name name) {
-    Segment segment;
-    segment.name = name;
-    return stSortedSet_search(flower->segments, &segment);
+    return cactusNameIndex_search(flower->segmentIndex, name);
 }
 
 int64_t flower_getSegmentNumber(Flower *flower) {
@@ -326,11 +342,7 @@ Block *flower_getFirstBlock(Flower *flower) {
 }
 
 Block *flower_getBlock(Flower *flower, Name name) {
-    Block block;
-    BlockContents blockContents;
-    block.blockContents = &blockContents;
-    blockContents.name = name;
-    return stSortedSet_search(flower->blocks, &block);
+    return cactusNameIndex_search(flower->blockIndex, name);
 }
 
 int64_t flower_getBlockNumber(Flower *flower) {
@@ -362,9 +374,7 @@ Group *flower_getFirstGroup(Flower *flower) {
 }
 
 Group *flower_getGroup(Flower *flower, Name flowerName) {
-    Group group;
-    group.name = flowerName;
-    return stSortedSet_search(flower->groups, &group);
+    return cactusNameIndex_search(flower->groupIndex, flowerName);
 }
 
 int64_t flower_getGroupNumber(Flower *flower) {
@@ -810,48 +820,56 @@ void flower_addCap(Flower *flower, Cap *cap) {
     cap = cap_getPositiveOrientation(cap);
     assert(stSortedSet_search(flower->caps, cap) == NULL);
     stSortedSet_insert(flower->caps, cap);
+    cactusNameIndex_insert(flower->capIndex, cap_getName(cap), cap);
 }
 
 void flower_removeCap(Flower *flower, Cap *cap) {
     cap = cap_getPositiveOrientation(cap);
     assert(stSortedSet_search(flower->caps, cap) != NULL);
     stSortedSet_remove(flower->caps, cap);
+    cactusNameIndex_remove(flower->capIndex, cap_getName(cap));
 }
 
 void flower_addEnd(Flower *flower, End *end) {
     end = end_getPositiveOrientation(end);
     assert(stSortedSet_search(flower->ends, end) == NULL);
     stSortedSet_insert(flower->ends, end);
+    cactusNameIndex_insert(flower->endIndex, end_getName(end), end);
 }
 
 void flower_removeEnd(Flower *flower, End *end) {
     end = end_getPositiveOrientation(end);
     assert(stSortedSet_search(flower->ends, end) != NULL);
     stSortedSet_remove(flower->ends, end);
+    cactusNameIndex_remove(flower->endIndex, end_getName(end));
 }
 
 void flower_addSegment(Flower *flower, Segment *segment) {
     segment = segment_getPositiveOrientation(segment);
     assert(stSortedSet_search(flower->segments, segment) == NULL);
     stSortedSet_insert(flower->segments, segment);
+    cactusNameIndex_insert(flower->segmentIndex, segment_getName(segment), segment);
 }
 
 void flower_removeSegment(Flower *flower, Segment *segment) {
     segment = segment_getPositiveOrientation(segment);
     assert(stSortedSet_search(flower->segments, segment) != NULL);
     stSortedSet_remove(flower->segments, segment);
+    cactusNameIndex_remove(flower->segmentIndex, segment_getName(segment));
 }
 
 void flower_addBlock(Flower *flower, Block *block) {
     block = block_getPositiveOrientation(block);
     assert(stSortedSet_search(flower->blocks, block) == NULL);
     stSortedSet_insert(flower->blocks, block);
+    cactusNameIndex_insert(flower->blockIndex, block_getName(block), block);
 }
 
 void flower_removeBlock(Flower *flower, Block *block) {
     block = block_getPositiveOrientation(block);
     assert(stSortedSet_search(flower->blocks, block) != NULL);
     stSortedSet_remove(flower->blocks, block);
+    cactusNameIndex_remove(flower->blockIndex, block_getName(block));
 }
 
 void flower_addChain(Flower *flower, Chain *chain) {
@@ -867,11 +885,13 @@ void flower_removeChain(Flower *flower, Chain *chain) {
 void flower_addGroup(Flower *flower, Group *group) {
     assert(stSortedSet_search(flower->groups, group) == NULL);
     stSortedSet_insert(flower->groups, group);
+    cactusNameIndex_insert(flower->groupIndex, group_getName(group), group);
 }
 
 void flower_removeGroup(Flower *flower, Group *group) {
     assert(stSortedSet_search(flower->groups, group) != NULL);
     stSortedSet_remove(flower->groups, group);
+    cactusNameIndex_remove(flower->groupIndex, group_getName(group));
 }
 
 void flower_setParentGroup(Flower *flower, Group *group) {
@@ -893,7 +913,7 @@ void flower_removeFace(Flower *flower, Face *face) {
  * Serialisation functions.
  */
 
-void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+void flower_writeBinaryRepresentation(Flower *flower, BinaryRepresentationWriter *writer) {
     Flower_SequenceIterator *sequenceIterator;
     Flower_EndIterator *endIterator;
     Flower_BlockIterator *blockIterator;
@@ -905,49 +925,51 @@ void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void
     Group *group;
     Chain *chain;
 
-    binaryRepresentation_writeElementType(CODE_FLOWER, writeFn);
-    binaryRepresentation_writeName(flower_getName(flower), writeFn);
-    binaryRepresentation_writeBool(flower_builtBlocks(flower), writeFn);
-    binaryRepresentation_writeBool(flower_builtTrees(flower), writeFn);
-    binaryRepresentation_writeBool(flower_builtFaces(flower), writeFn);
-    binaryRepresentation_writeName(flower->parentFlowerName, writeFn);
+    binaryRepresentation_writeVersionHeader(BINARY_REPRESENTATION_FORMAT_VARINT, writer);
+    binaryRepresentation_writeElementType(CODE_FLOWER, writer);
+    binaryRepresentation_writeName(flower_getName(flower), writer);
+    binaryRepresentation_writeBool(flower_builtBlocks(flower), writer);
+    binaryRepresentation_writeBool(flower_builtTrees(flower), writer);
+    binaryRepresentation_writeBool(flower_builtFaces(flower), writer);
+    binaryRepresentation_writeName(flower->parentFlowerName, writer);
 
     sequenceIterator = flower_getSequenceIterator(flower);
     while ((sequence = flower_getNextSequence(sequenceIterator)) != NULL) {
-        sequence_writeBinaryRepresentation(sequence, writeFn);
+        sequence_writeBinaryRepresentation(sequence, writer);
     }
     flower_destructSequenceIterator(sequenceIterator);
 
     endIterator = flower_getEndIterator(flower);
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
-        end_writeBinaryRepresentation(end, writeFn);
+        end_writeBinaryRepresentation(end, writer);
     }
     flower_destructEndIterator(endIterator);
 
     blockIterator = flower_getBlockIterator(flower);
     while ((block = flower_getNextBlock(blockIterator)) != NULL) {
-        block_writeBinaryRepresentation(block, writeFn);
+        block_writeBinaryRepresentation(block, writer);
     }
     flower_destructBlockIterator(blockIterator);
 
     groupIterator = flower_getGroupIterator(flower);
     while ((group = flower_getNextGroup(groupIterator)) != NULL) {
-        group_writeBinaryRepresentation(group, writeFn);
+        group_writeBinaryRepresentation(group, writer);
     }
     flower_destructGroupIterator(groupIterator);
 
     chainIterator = flower_getChainIterator(flower);
     while ((chain = flower_getNextChain(chainIterator)) != NULL) {
-        chain_writeBinaryRepresentation(chain, writeFn);
+        chain_writeBinaryRepresentation(chain, writer);
     }
     flower_destructChainIterator(chainIterator);
 
-    binaryRepresentation_writeElementType(CODE_FLOWER, writeFn); //this avoids interpretting things wrong.
+    binaryRepresentation_writeElementType(CODE_FLOWER, writer); //this avoids interpretting things wrong.
 }
 
 Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cactusDisk) {
     Flower *flower = NULL;
     bool buildFaces;
+    binaryRepresentation_beginRecord(binaryString); //Flowers written before the versioned format have no header.
     if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_FLOWER) {
         binaryRepresentation_popNextElementType(binaryString);
         flower = flower_construct3(binaryRepresentation_getName(binaryString), cactusDisk);
@@ -968,5 +990,6 @@ Flower *flower_loadFromBinaryRepresentation(void **binaryString, CactusDisk *cac
         flower_setBuildFaces(flower, buildFaces);
         assert(binaryRepresentation_popNextElementType(binaryString) == CODE_FLOWER);
     }
+    binaryRepresentation_endRecord();
     return flower;
 }
@@ -26,6 +26,11 @@ struct _flower {
     bool builtBlocks;
     bool builtTrees;
     bool builtFaces;
+    CactusNameIndex *capIndex; //Lookups by name, the sorted sets give the order of iteration.
+    CactusNameIndex *endIndex;
+    CactusNameIndex *segmentIndex;
+    CactusNameIndex *blockIndex;
+    CactusNameIndex *groupIndex;
 };
 
 ////////////////////////////////////////////////
@@ -42,6 +47,18 @@ struct _flower {
  */
 void flower_destruct(Flower *flower, int64_t recursive);
 
+/*
+ * Get the allocators from which the caps, ends, segments and blocks of the flower are allocated,
+ * those of its cactus disk, see cactusDisk_getCapAllocator.
+ */
+CactusSlabAllocator *flower_getCapAllocator(Flower *flower);
+
+CactusSlabAllocator *flower_getEndAllocator(Flower *flower);
+
+CactusSlabAllocator *flower_getSegmentAllocator(Flower *flower);
+
+CactusSlabAllocator *flower_getBlockAllocator(Flower *flower);
+
 /*
  * Adds the event tree for the flower to the flower.
  * If an previous event tree exists for the flower
@@ -154,8 +171,7 @@ void flower_destructFaces(Flower *flower);
 /*
  * Write a binary representation of the flower to the write function.
  */
-void flower_writeBinaryRepresentation(Flower *flower, void(*writeFn)(const void * ptr,
-        size_t size, size_t count));
+void flower_writeBinaryRepresentation(Flower *flower, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
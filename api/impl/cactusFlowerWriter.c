@@ -1,7 +1,12 @@
 #include "sonLib.h"
 #include "cactusGlobalsPrivate.h"
+#include <pthread.h>
 
 #define FLOWER_STREAM_BATCH_SIZE 50
+#define FLOWER_STREAM_MAX_BATCH_SIZE 1000
+#define FLOWER_STREAM_BATCH_BYTES 16777216
+#define FLOWER_STREAM_PREFETCH_BYTES 134217728
+#define FLOWER_STREAM_MAX_PREFETCH_DEPTH 8
 
 struct _flowerWriter {
         stList *flowerNamesAndSizes;
@@ -174,22 +179,205 @@ stList *flowerWriter_parseFlowersFromStdin(CactusDisk *cactusDisk) {
     return flowers;
 }
 
-static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cactusDisk) {
+/*
+ * A batch of flower records fetched ahead by the prefetch thread.
+ */
+typedef struct _flowerStreamBatch {
+    stList *flowerNames;
+    stList *records;
+} FlowerStreamBatch;
+
+/*
+ * The state shared by a flower stream and its prefetch thread. The thread only touches the
+ * cactus disk through cactusDisk_getFlowerRecords and cactusDisk_preCacheStrings2, which
+ * lock the database connection; flowers are only ever loaded by the stream's own thread.
+ */
+struct _flowerStreamPrefetcher {
+    CactusDisk *cactusDisk;
+    stList *flowerNames;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    stList *batches; //Fetched batches, in stream order
+    stList *substringLists; //Sequence intervals of loaded batches, waiting to be pre-cached
+    stList *loadedFlowers; //The next batch, loaded ahead so its sequences are pre-cached before it is needed, or NULL
+    int64_t loadedNumber; //The number of flowers loaded by the stream's thread
+    int64_t nextIdx; //Index of the next flower name to fetch
+    int64_t batchSize;
+    int64_t prefetchDepth;
+    int64_t fetchedRecords;
+    int64_t fetchedBytes;
+    bool stop;
+};
+
+static void flowerStreamBatch_destruct(FlowerStreamBatch *batch) {
+    stList_destruct(batch->flowerNames);
+    stList_destruct(batch->records);
+    free(batch);
+}
+
+static void flowerStreamPrefetcher_adapt(struct _flowerStreamPrefetcher *prefetcher) {
+    /*
+     * Sizes the batches to about FLOWER_STREAM_BATCH_BYTES of records and keeps about
+     * FLOWER_STREAM_PREFETCH_BYTES of records fetched ahead, using the mean record size
+     * seen so far. Called with the mutex held.
+     */
+    int64_t meanRecordSize = prefetcher->fetchedBytes / prefetcher->fetchedRecords;
+    meanRecordSize = meanRecordSize > 0 ? meanRecordSize : 1;
+    int64_t batchSize = FLOWER_STREAM_BATCH_BYTES / meanRecordSize;
+    prefetcher->batchSize = batchSize < 1 ? 1 : (batchSize > FLOWER_STREAM_MAX_BATCH_SIZE ?
+            FLOWER_STREAM_MAX_BATCH_SIZE : batchSize);
+    int64_t prefetchDepth = FLOWER_STREAM_PREFETCH_BYTES / (prefetcher->batchSize * meanRecordSize);
+    prefetcher->prefetchDepth = prefetchDepth < 1 ? 1 : (prefetchDepth > FLOWER_STREAM_MAX_PREFETCH_DEPTH ?
+            FLOWER_STREAM_MAX_PREFETCH_DEPTH : prefetchDepth);
+}
+
+static void *flowerStreamPrefetcher_run(void *arg) {
+    struct _flowerStreamPrefetcher *prefetcher = arg;
+    pthread_mutex_lock(&prefetcher->mutex);
+    while (!prefetcher->stop) {
+        if (stList_length(prefetcher->substringLists) > 0) {
+            // Sequences are needed sooner than the records of later batches.
+            stList *substrings = stList_remove(prefetcher->substringLists, 0);
+            pthread_mutex_unlock(&prefetcher->mutex);
+            cactusDisk_preCacheStrings2(prefetcher->cactusDisk, substrings);
+            stList_destruct(substrings);
+            pthread_mutex_lock(&prefetcher->mutex);
+        } else if (prefetcher->nextIdx < stList_length(prefetcher->flowerNames)
+                && stList_length(prefetcher->batches) < prefetcher->prefetchDepth) {
+            int64_t batchEnd = prefetcher->nextIdx + prefetcher->batchSize;
+            if (batchEnd > stList_length(prefetcher->flowerNames)) {
+                batchEnd = stList_length(prefetcher->flowerNames);
+            }
+            FlowerStreamBatch *batch = st_malloc(sizeof(FlowerStreamBatch));
+            batch->flowerNames = stList_construct();
+            for (int64_t i = prefetcher->nextIdx; i < batchEnd; i++) {
+                stList_append(batch->flowerNames, stList_get(prefetcher->flowerNames, i));
+            }
+            prefetcher->nextIdx = batchEnd;
+            pthread_mutex_unlock(&prefetcher->mutex);
+            int64_t batchBytes;
+            batch->records = cactusDisk_getFlowerRecords(prefetcher->cactusDisk, batch->flowerNames, &batchBytes);
+            pthread_mutex_lock(&prefetcher->mutex);
+            stList_append(prefetcher->batches, batch);
+            prefetcher->fetchedRecords += stList_length(batch->flowerNames);
+            prefetcher->fetchedBytes += batchBytes;
+            flowerStreamPrefetcher_adapt(prefetcher);
+            pthread_cond_broadcast(&prefetcher->cond);
+        } else {
+            pthread_cond_wait(&prefetcher->cond, &prefetcher->mutex);
+        }
+    }
+    pthread_mutex_unlock(&prefetcher->mutex);
+    return NULL;
+}
+
+static struct _flowerStreamPrefetcher *flowerStreamPrefetcher_construct(CactusDisk *cactusDisk, stList *flowerNames) {
+    struct _flowerStreamPrefetcher *prefetcher = st_calloc(1, sizeof(struct _flowerStreamPrefetcher));
+    prefetcher->cactusDisk = cactusDisk;
+    prefetcher->flowerNames = flowerNames;
+    prefetcher->batches = stList_construct3(0, (void (*)(void *)) flowerStreamBatch_destruct);
+    prefetcher->substringLists = stList_construct3(0, (void (*)(void *)) stList_destruct);
+    prefetcher->batchSize = FLOWER_STREAM_BATCH_SIZE;
+    prefetcher->prefetchDepth = 2;
+    pthread_mutex_init(&prefetcher->mutex, NULL);
+    pthread_cond_init(&prefetcher->cond, NULL);
+    if (pthread_create(&prefetcher->thread, NULL, flowerStreamPrefetcher_run, prefetcher) != 0) {
+        st_errAbort("Could not start the flower stream prefetch thread");
+    }
+    return prefetcher;
+}
+
+static void flowerStreamPrefetcher_destruct(struct _flowerStreamPrefetcher *prefetcher) {
+    pthread_mutex_lock(&prefetcher->mutex);
+    prefetcher->stop = 1;
+    pthread_cond_broadcast(&prefetcher->cond);
+    pthread_mutex_unlock(&prefetcher->mutex);
+    pthread_join(prefetcher->thread, NULL);
+    if (prefetcher->loadedFlowers != NULL) {
+        while (stList_length(prefetcher->loadedFlowers) > 0) {
+            flower_destruct(stList_pop(prefetcher->loadedFlowers), false);
+        }
+        stList_destruct(prefetcher->loadedFlowers);
+    }
+    st_logDebug("The flower stream prefetched %" PRIi64 " flower records, totalling %" PRIi64 " bytes\n",
+            prefetcher->fetchedRecords, prefetcher->fetchedBytes);
+    stList_destruct(prefetcher->batches);
+    stList_destruct(prefetcher->substringLists);
+    pthread_cond_destroy(&prefetcher->cond);
+    pthread_mutex_destroy(&prefetcher->mutex);
+    free(prefetcher);
+}
+
+static stList *flowerStreamPrefetcher_loadBatch(struct _flowerStreamPrefetcher *prefetcher, bool wait) {
+    /*
+     * Loads the flowers of the next fetched batch, returning them as a stack, and queues their
+     * sequences to be pre-cached. If wait is false and the next batch has not been fetched yet
+     * returns NULL.
+     */
+    pthread_mutex_lock(&prefetcher->mutex);
+    while (wait && stList_length(prefetcher->batches) == 0) {
+        pthread_cond_wait(&prefetcher->cond, &prefetcher->mutex);
+    }
+    if (stList_length(prefetcher->batches) == 0) {
+        pthread_mutex_unlock(&prefetcher->mutex);
+        return NULL;
+    }
+    FlowerStreamBatch *batch = stList_remove(prefetcher->batches, 0);
+    pthread_cond_broadcast(&prefetcher->cond);
+    pthread_mutex_unlock(&prefetcher->mutex);
+
+    stList *flowers = cactusDisk_loadFlowers(prefetcher->cactusDisk, batch->flowerNames, batch->records);
+    flowerStreamBatch_destruct(batch);
+    prefetcher->loadedNumber += stList_length(flowers);
+    stList *substrings = cactusDisk_getSubstringsForFlowers(flowers);
+    pthread_mutex_lock(&prefetcher->mutex);
+    stList_append(prefetcher->substringLists, substrings);
+    pthread_cond_broadcast(&prefetcher->cond);
+    pthread_mutex_unlock(&prefetcher->mutex);
+    stList_reverse(flowers);
+    return flowers;
+}
+
+static stList *flowerStreamPrefetcher_getNextBatch(struct _flowerStreamPrefetcher *prefetcher) {
+    /*
+     * Returns the flowers of the next batch as a stack. The batch after it is loaded too, if
+     * its records have been fetched, so that its sequences are pre-cached while this batch is
+     * processed rather than alongside its own processing.
+     */
+    stList *flowers = prefetcher->loadedFlowers;
+    if (flowers == NULL) {
+        flowers = flowerStreamPrefetcher_loadBatch(prefetcher, 1);
+    }
+    prefetcher->loadedFlowers = prefetcher->loadedNumber < stList_length(prefetcher->flowerNames) ?
+            flowerStreamPrefetcher_loadBatch(prefetcher, 0) : NULL;
+    return flowers;
+}
+
+static FlowerStream *flowerStream_construct(stList *flowerNames, CactusDisk *cactusDisk, bool prefetch) {
     FlowerStream *ret = malloc(sizeof(FlowerStream));
     ret->flowerNames = flowerNames;
     ret->flowerBatch = stList_construct();
     ret->curFlower = NULL;
     ret->nextIdx = 0;
     ret->cactusDisk = cactusDisk;
+    ret->prefetcher = prefetch ? flowerStreamPrefetcher_construct(cactusDisk, flowerNames) : NULL;
     return ret;
 }
 
 FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file) {
+    return flowerWriter_getFlowerStream2(cactusDisk, file, false);
+}
+
+FlowerStream *flowerWriter_getFlowerStream2(CactusDisk *cactusDisk, FILE *file, bool prefetch) {
     stList *flowerNamesList = flowerWriter_parseNames(file);
-    return flowerStream_construct(flowerNamesList, cactusDisk);
+    return flowerStream_construct(flowerNamesList, cactusDisk, prefetch);
 }
 
 void flowerStream_destruct(FlowerStream *flowerStream) {
+    if (flowerStream->prefetcher != NULL) {
+        flowerStreamPrefetcher_destruct(flowerStream->prefetcher);
+    }
     if (flowerStream->curFlower != NULL) {
         flower_destruct(flowerStream->curFlower, false);
     }
@@ -207,7 +395,11 @@ Flower *flowerStream_getNext(FlowerStream *flowerStream) {
         flowerStream->curFlower = NULL;
         return NULL;
     }
-    if (stList_length(flowerStream->flowerBatch) == 0) {
+    if (stList_length(flowerStream->flowerBatch) == 0 && flowerStream->prefetcher != NULL) {
+        // Load the next batch of flowers from the records the prefetch thread fetched.
+        stList_destruct(flowerStream->flowerBatch);
+        flowerStream->flowerBatch = flowerStreamPrefetcher_getNextBatch(flowerStream->prefetcher);
+    } else if (stList_length(flowerStream->flowerBatch) == 0) {
         // Time to load the next batch of flowers from the DB.
         // Get the next batch of names.
         int64_t batchStart = flowerStream->nextIdx;
@@ -25,6 +25,8 @@
 
 #define NAME_STRING "%" PRIi64 "" //%" PRIi64 "64d" //"%llX"
 
+#include "cactusSerialisation.h"
+
 #include "cactusGroup.h"
 #include "cactusGroupPrivate.h"
 #include "cactusBlock.h"
@@ -48,6 +50,10 @@
 #include "cactusMetaSequencePrivate.h"
 #include "cactusFlower.h"
 #include "cactusDisk.h"
+#include "cactusCache.h"
+#include "cactusSlab.h"
+#include "cactusNameIndex.h"
+#include "cactusSequenceStore.h"
 #include "cactusDiskPrivate.h"
 #include "cactusMisc.h"
 #include "cactusFlowerPrivate.h"
@@ -57,7 +63,6 @@
 #include "cactusFaceEndPrivate.h"
 #include "cactusSequence.h"
 #include "cactusSequencePrivate.h"
-#include "cactusSerialisation.h"
 #include "cactusTestCommon.h"
 #include "cactusFlowerWriter.h"
 
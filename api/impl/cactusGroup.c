@@ -416,20 +416,20 @@ void group_setFlower(Group *group, Flower *flower) {
  * Serialisation functions
  */
 
-void group_writeBinaryRepresentation(Group *group, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
+void group_writeBinaryRepresentation(Group *group, BinaryRepresentationWriter *writer) {
     End *end;
     Group_EndIterator *iterator;
 
-    binaryRepresentation_writeElementType(CODE_GROUP, writeFn);
-    binaryRepresentation_writeBool(group_isLeaf(group), writeFn);
-    binaryRepresentation_writeName(group_getName(group), writeFn);
+    binaryRepresentation_writeElementType(CODE_GROUP, writer);
+    binaryRepresentation_writeBool(group_isLeaf(group), writer);
+    binaryRepresentation_writeName(group_getName(group), writer);
     iterator = group_getEndIterator(group);
     while ((end = group_getNextEnd(iterator)) != NULL) {
-        binaryRepresentation_writeElementType(CODE_GROUP_END, writeFn);
-        binaryRepresentation_writeName(end_getName(end), writeFn);
+        binaryRepresentation_writeElementType(CODE_GROUP_END, writer);
+        binaryRepresentation_writeName(end_getName(end), writer);
     }
     group_destructEndIterator(iterator);
-    binaryRepresentation_writeElementType(CODE_GROUP, writeFn);
+    binaryRepresentation_writeElementType(CODE_GROUP, writer);
 }
 
 Group *group_loadFromBinaryRepresentation(void **binaryString, Flower *flower) {
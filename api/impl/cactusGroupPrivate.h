@@ -51,7 +51,7 @@ void group_removeEnd(Group *group, End *end);
 /*
  * Write a binary representation of the group to the write function.
  */
-void group_writeBinaryRepresentation(Group *group, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void group_writeBinaryRepresentation(Group *group, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
@@ -270,12 +270,11 @@ bool link_mergeIfTrivial(Link *link) {
  * Serialisation functions.
  */
 
-void link_writeBinaryRepresentation(Link *link, void(*writeFn)(
-        const void * ptr, size_t size, size_t count)) {
-    binaryRepresentation_writeElementType(CODE_LINK, writeFn);
-    binaryRepresentation_writeName(group_getName(link_getGroup(link)), writeFn);
-    binaryRepresentation_writeName(end_getName(link_get3End(link)), writeFn);
-    binaryRepresentation_writeName(end_getName(link_get5End(link)), writeFn);
+void link_writeBinaryRepresentation(Link *link, BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeElementType(CODE_LINK, writer);
+    binaryRepresentation_writeName(group_getName(link_getGroup(link)), writer);
+    binaryRepresentation_writeName(end_getName(link_get3End(link)), writer);
+    binaryRepresentation_writeName(end_getName(link_get5End(link)), writer);
 }
 
 Link *link_loadFromBinaryRepresentation(void **binaryString, Chain *chain) {
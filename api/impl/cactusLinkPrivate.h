@@ -36,8 +36,7 @@ void link_destruct(Link *link);
 /*
  * Write a binary representation of the link to the write function.
  */
-void link_writeBinaryRepresentation(Link *link, void(*writeFn)(
-        const void * ptr, size_t size, size_t count));
+void link_writeBinaryRepresentation(Link *link, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
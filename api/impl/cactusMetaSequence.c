@@ -98,15 +98,15 @@ void metaSequence_setHeader(MetaSequence *metaSequence,
  */
 
 void metaSequence_writeBinaryRepresentation(MetaSequence *metaSequence,
-		void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	binaryRepresentation_writeElementType(CODE_META_SEQUENCE, writeFn);
-	binaryRepresentation_writeName(metaSequence_getName(metaSequence), writeFn);
-	binaryRepresentation_writeInteger(metaSequence_getStart(metaSequence), writeFn);
-	binaryRepresentation_writeInteger(metaSequence_getLength(metaSequence), writeFn);
-	binaryRepresentation_writeName(metaSequence_getEventName(metaSequence), writeFn);
-	binaryRepresentation_writeName(metaSequence->stringName, writeFn);
-	binaryRepresentation_writeString(metaSequence_getHeader(metaSequence), writeFn);
-	binaryRepresentation_writeBool(metaSequence_isTrivialSequence(metaSequence), writeFn);
+		BinaryRepresentationWriter *writer) {
+	binaryRepresentation_writeElementType(CODE_META_SEQUENCE, writer);
+	binaryRepresentation_writeName(metaSequence_getName(metaSequence), writer);
+	binaryRepresentation_writeInteger(metaSequence_getStart(metaSequence), writer);
+	binaryRepresentation_writeInteger(metaSequence_getLength(metaSequence), writer);
+	binaryRepresentation_writeName(metaSequence_getEventName(metaSequence), writer);
+	binaryRepresentation_writeName(metaSequence->stringName, writer);
+	binaryRepresentation_writeString(metaSequence_getHeader(metaSequence), writer);
+	binaryRepresentation_writeBool(metaSequence_isTrivialSequence(metaSequence), writer);
 }
 
 MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
@@ -120,6 +120,7 @@ MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
 	char *header;
 
 	metaSequence = NULL;
+	binaryRepresentation_beginRecord(binaryString); //Meta sequences are loaded while flowers are being parsed.
 	if(binaryRepresentation_peekNextElementType(*binaryString) == CODE_META_SEQUENCE) {
 		binaryRepresentation_popNextElementType(binaryString);
 		name = binaryRepresentation_getName(binaryString);
@@ -133,6 +134,7 @@ MetaSequence *metaSequence_loadFromBinaryRepresentation(void **binaryString,
 				stringName, header, eventName, isTrivialSequence, cactusDisk);
 		free(header);
 	}
+	binaryRepresentation_endRecord();
 	return metaSequence;
 }
 
@@ -42,7 +42,7 @@ void metaSequence_destruct(MetaSequence *metaSequence);
 /*
  * Creates a binary representation of the eventTree, returned as a char string.
  */
-void metaSequence_writeBinaryRepresentation(MetaSequence *metaSequence, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void metaSequence_writeBinaryRepresentation(MetaSequence *metaSequence, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a eventTree into memory from a binary representation of the eventTree.
@@ -91,3 +91,5 @@ void cactusCheck2(bool condition, char *string, ...) {
     }
 }
 
+void cactusMisc_ignoreThreadPoolResult(void *result) {
+}
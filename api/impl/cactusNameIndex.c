@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+#define CACTUS_NAME_INDEX_INITIAL_SLOTS 16
+
+/*
+ * A slot of the table, empty if the object is NULL. The name is kept in the slot so that
+ * probing does not dereference the objects.
+ */
+typedef struct _cactusNameIndexSlot {
+    Name name;
+    void *object;
+} CactusNameIndexSlot;
+
+/*
+ * Uses linear probing, with at most half the slots full, and removes entries by shifting
+ * later entries of the probe sequence back, so there are no tombstones.
+ */
+struct _cactusNameIndex {
+    CactusNameIndexSlot *slots; //NULL until the first insertion.
+    int64_t slotNumber; //Zero or a power of two.
+    int64_t size;
+};
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Private functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static int64_t getHomeSlot(CactusNameIndex *index, Name name) {
+    //Names are mostly consecutive integers, so they are mixed (the splitmix64 finaliser) before masking.
+    uint64_t i = (uint64_t) name;
+    i = (i ^ (i >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    i = (i ^ (i >> 27)) * UINT64_C(0x94d049bb133111eb);
+    i = i ^ (i >> 31);
+    return i & (index->slotNumber - 1);
+}
+
+static int64_t getSlot(CactusNameIndex *index, Name name) {
+    /*
+     * Returns the slot holding the name, or the empty slot where it would be inserted.
+     */
+    int64_t i = getHomeSlot(index, name);
+    while (index->slots[i].object != NULL && index->slots[i].name != name) {
+        i = (i + 1) & (index->slotNumber - 1);
+    }
+    return i;
+}
+
+static void resize(CactusNameIndex *index, int64_t slotNumber) {
+    CactusNameIndexSlot *slots = index->slots;
+    int64_t oldSlotNumber = index->slotNumber;
+    index->slots = st_calloc(slotNumber, sizeof(CactusNameIndexSlot));
+    index->slotNumber = slotNumber;
+    for (int64_t i = 0; i < oldSlotNumber; i++) {
+        if (slots[i].object != NULL) {
+            index->slots[getSlot(index, slots[i].name)] = slots[i];
+        }
+    }
+    free(slots);
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Public functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+CactusNameIndex *cactusNameIndex_construct(void) {
+    CactusNameIndex *index = st_malloc(sizeof(CactusNameIndex));
+    index->slots = NULL;
+    index->slotNumber = 0;
+    index->size = 0;
+    return index;
+}
+
+void cactusNameIndex_destruct(CactusNameIndex *index) {
+    free(index->slots);
+    free(index);
+}
+
+void cactusNameIndex_insert(CactusNameIndex *index, Name name, void *object) {
+    assert(object != NULL);
+    if (2 * (index->size + 1) > index->slotNumber) {
+        resize(index, index->slotNumber == 0 ? CACTUS_NAME_INDEX_INITIAL_SLOTS : 2 * index->slotNumber);
+    }
+    int64_t i = getSlot(index, name);
+    assert(index->slots[i].object == NULL);
+    index->slots[i].name = name;
+    index->slots[i].object = object;
+    index->size++;
+}
+
+void cactusNameIndex_remove(CactusNameIndex *index, Name name) {
+    assert(cactusNameIndex_search(index, name) != NULL);
+    int64_t mask = index->slotNumber - 1;
+    int64_t i = getSlot(index, name);
+    //Shift back the following entries of the run that would no longer be found past the hole.
+    for (int64_t j = (i + 1) & mask; index->slots[j].object != NULL; j = (j + 1) & mask) {
+        int64_t k = getHomeSlot(index, index->slots[j].name);
+        if (((j - k) & mask) >= ((j - i) & mask)) { //The home slot of the entry is not between the hole and the entry.
+            index->slots[i] = index->slots[j];
+            i = j;
+        }
+    }
+    index->slots[i].object = NULL;
+    index->size--;
+}
+
+void *cactusNameIndex_search(CactusNameIndex *index, Name name) {
+    if (index->size == 0) {
+        return NULL;
+    }
+    return index->slots[getSlot(index, name)].object;
+}
+
+int64_t cactusNameIndex_size(CactusNameIndex *index) {
+    return index->size;
+}
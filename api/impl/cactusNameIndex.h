@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_NAME_INDEX_H_
+#define CACTUS_NAME_INDEX_H_
+
+#include "cactusGlobals.h"
+
+/*
+ * An open addressing hash table from names to objects, used by a flower to look up its
+ * caps, ends, segments, blocks and groups by name. The flower keeps its sorted sets of
+ * these objects for ordered iteration; the index is only for lookups.
+ */
+typedef struct _cactusNameIndex CactusNameIndex;
+
+/*
+ * Constructs an empty index.
+ */
+CactusNameIndex *cactusNameIndex_construct(void);
+
+/*
+ * Destructs the index, but not the objects in it.
+ */
+void cactusNameIndex_destruct(CactusNameIndex *index);
+
+/*
+ * Adds the object with the given name, which must not already be in the index. The object
+ * must not be NULL.
+ */
+void cactusNameIndex_insert(CactusNameIndex *index, Name name, void *object);
+
+/*
+ * Removes the object with the given name, which must be in the index.
+ */
+void cactusNameIndex_remove(CactusNameIndex *index, Name name);
+
+/*
+ * Returns the object with the given name, or NULL if there is none.
+ */
+void *cactusNameIndex_search(CactusNameIndex *index, Name name);
+
+/*
+ * Returns the number of objects in the index.
+ */
+int64_t cactusNameIndex_size(CactusNameIndex *index);
+
+#endif
@@ -39,9 +39,9 @@ Segment *segment_construct2(Block *block, int64_t startCoordinate, bool strand,
 }
 
 Segment *segment_construct3(Name name, Block *block, Cap *_5Cap, Cap *_3Cap) {
-    Segment *segment;
-    segment = st_malloc(sizeof(Segment));
-    segment->rInstance = st_malloc(sizeof(Segment));
+    SegmentUnit *segmentUnit = cactusSlabAllocator_allocate(flower_getSegmentAllocator(block_getFlower(block)));
+    Segment *segment = &segmentUnit->segment;
+    segment->rInstance = &segmentUnit->rSegment;
     segment->rInstance->rInstance = segment;
     segment->name = name;
     segment->rInstance->name = name;
@@ -59,8 +59,8 @@ Segment *segment_construct3(Name name, Block *block, Cap *_5Cap, Cap *_3Cap) {
 void segment_destruct(Segment *segment) {
     block_removeInstance(segment_getBlock(segment), segment);
     flower_removeSegment(block_getFlower(segment_getBlock(segment)), segment);
-    free(segment->rInstance);
-    free(segment);
+    //The unit starts with whichever of the segment and its reverse comes first.
+    cactusSlab_free(segment < segment->rInstance ? segment : segment->rInstance);
 }
 
 Block *segment_getBlock(Segment *segment) {
@@ -112,6 +112,16 @@ char *segment_getString(Segment *segment) {
             segment_getStrand(segment));
 }
 
+SequenceView segment_getView(Segment *segment) {
+    Sequence *sequence = segment_getSequence(segment);
+    if (sequence == NULL) {
+        SequenceView view = { NULL, 0, segment_getStrand(segment) };
+        return view;
+    }
+    return sequence_getView(sequence, segment_getStart(segment_getStrand(segment) ? segment : segment_getReverse(segment)),
+            segment_getLength(segment), segment_getStrand(segment));
+}
+
 Cap *segment_get5Cap(Segment *segment) {
     return segment->_5Cap;
 }
@@ -248,15 +258,14 @@ void segment_check(Segment *segment) {
  * Serialisation functions.
  */
 
-void segment_writeBinaryRepresentation(Segment *segment, void(*writeFn)(
-        const void * ptr, size_t size, size_t count)) {
+void segment_writeBinaryRepresentation(Segment *segment, BinaryRepresentationWriter *writer) {
     assert(segment_getOrientation(segment));
-    binaryRepresentation_writeElementType(CODE_SEGMENT, writeFn);
-    binaryRepresentation_writeName(segment_getName(segment), writeFn);
+    binaryRepresentation_writeElementType(CODE_SEGMENT, writer);
+    binaryRepresentation_writeName(segment_getName(segment), writer);
     binaryRepresentation_writeName(cap_getName(segment_get5Cap(segment)),
-            writeFn);
+            writer);
     binaryRepresentation_writeName(cap_getName(segment_get3Cap(segment)),
-            writeFn);
+            writer);
 }
 
 Segment *segment_loadFromBinaryRepresentation(void **binaryString, Block *block) {
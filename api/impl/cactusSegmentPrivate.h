@@ -16,6 +16,14 @@ struct _segment {
 	Block *block;
 };
 
+/*
+ * A segment and its reverse, allocated together from the slabs of the cactus disk.
+ */
+typedef struct _segmentUnit {
+	Segment segment;
+	Segment rSegment;
+} SegmentUnit;
+
 
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -39,7 +47,7 @@ void segment_destruct(Segment *segment);
 /*
  * Write a binary representation of the segment to the write function.
  */
-void segment_writeBinaryRepresentation(Segment *segment, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void segment_writeBinaryRepresentation(Segment *segment, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a flower into memory from a binary representation of the flower.
@@ -6,6 +6,72 @@
 
 #include "cactusGlobalsPrivate.h"
 
+/*
+ * The bases of views are loaded in chunks aligned to this many bases from the start of the sequence.
+ */
+#define SEQUENCE_VIEW_CHUNK_SIZE 4096
+
+typedef struct _sequenceViewChunk {
+	int64_t start;
+	int64_t length;
+	char *bases;
+} SequenceViewChunk;
+
+static int sequenceViewChunk_cmp(const void *o1, const void *o2) {
+	int64_t i = ((SequenceViewChunk *) o1)->start, j = ((SequenceViewChunk *) o2)->start;
+	return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static void sequenceViewChunk_destruct(SequenceViewChunk *chunk) {
+	free(chunk->bases);
+	free(chunk);
+}
+
+static SequenceViewChunk *sequence_getViewChunk(Sequence *sequence, int64_t start, int64_t length) {
+	/*
+	 * Gets a chunk of cached bases containing the substring, loading it if needed. A new chunk
+	 * absorbs the chunks it overlaps, so that the chunks in the set are disjoint, and at least
+	 * doubles the length of the chunk it extends, so that reading along a sequence with views that
+	 * cross chunk boundaries does not repeatedly reload the same bases. The absorbed chunks are kept
+	 * until the views are released, as earlier views may point into them.
+	 */
+	if (sequence->viewChunks == NULL) {
+		sequence->viewChunks = stSortedSet_construct3(sequenceViewChunk_cmp, (void (*)(void *)) sequenceViewChunk_destruct);
+		sequence->absorbedViewChunks = stList_construct3(0, (void (*)(void *)) sequenceViewChunk_destruct);
+	}
+	SequenceViewChunk key;
+	key.start = start;
+	SequenceViewChunk *chunk = stSortedSet_searchLessThanOrEqual(sequence->viewChunks, &key);
+	if (chunk != NULL && start + length <= chunk->start + chunk->length) {
+		return chunk;
+	}
+	int64_t sequenceStart = sequence_getStart(sequence);
+	int64_t sequenceEnd = sequenceStart + sequence_getLength(sequence);
+	int64_t chunkStart = sequenceStart + (start - sequenceStart) / SEQUENCE_VIEW_CHUNK_SIZE * SEQUENCE_VIEW_CHUNK_SIZE;
+	int64_t chunkEnd = sequenceStart + (start + length - sequenceStart + SEQUENCE_VIEW_CHUNK_SIZE - 1)
+			/ SEQUENCE_VIEW_CHUNK_SIZE * SEQUENCE_VIEW_CHUNK_SIZE;
+	if (chunk != NULL && chunk->start + chunk->length >= chunkStart && chunkEnd < chunk->start + 2 * chunk->length) {
+		chunkEnd = chunk->start + 2 * chunk->length;
+	}
+	if (chunkEnd > sequenceEnd) {
+		chunkEnd = sequenceEnd;
+	}
+	key.start = chunkEnd;
+	while ((chunk = stSortedSet_searchLessThan(sequence->viewChunks, &key)) != NULL
+			&& chunk->start + chunk->length > chunkStart) {
+		chunkStart = chunk->start < chunkStart ? chunk->start : chunkStart;
+		chunkEnd = chunk->start + chunk->length > chunkEnd ? chunk->start + chunk->length : chunkEnd;
+		stSortedSet_remove(sequence->viewChunks, chunk);
+		stList_append(sequence->absorbedViewChunks, chunk);
+	}
+	chunk = st_malloc(sizeof(SequenceViewChunk));
+	chunk->start = chunkStart;
+	chunk->length = chunkEnd - chunkStart;
+	chunk->bases = metaSequence_getString(sequence->metaSequence, chunk->start, chunk->length, 1);
+	stSortedSet_insert(sequence->viewChunks, chunk);
+	return chunk;
+}
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -19,12 +85,15 @@ Sequence *sequence_construct(MetaSequence *metaSequence, Flower *flower) {
 	sequence = st_malloc(sizeof(Sequence));
 	sequence->metaSequence = metaSequence;
 	sequence->flower = flower;
+	sequence->viewChunks = NULL;
+	sequence->absorbedViewChunks = NULL;
 	flower_addSequence(flower, sequence);
 	return sequence;
 }
 
 void sequence_destruct(Sequence *sequence) {
 	flower_removeSequence(sequence_getFlower(sequence), sequence);
+	sequence_clearViewCache(sequence);
 	free(sequence);
 }
 
@@ -56,6 +125,55 @@ char *sequence_getString(Sequence *sequence, int64_t start, int64_t length, bool
 	return metaSequence_getString(sequence->metaSequence, start, length, strand);
 }
 
+SequenceView sequence_getView(Sequence *sequence, int64_t start, int64_t length, bool strand) {
+	assert(start >= sequence_getStart(sequence));
+	assert(length >= 0);
+	assert(start + length <= sequence_getStart(sequence) + sequence_getLength(sequence));
+	SequenceView view;
+	view.length = length;
+	view.strand = strand;
+	if (length == 0) {
+		view.bases = "";
+	} else {
+		SequenceViewChunk *chunk = sequence_getViewChunk(sequence, start, length);
+		view.bases = chunk->bases + (start - chunk->start);
+	}
+	return view;
+}
+
+void sequence_releaseViews(Sequence *sequence) {
+	if (sequence->absorbedViewChunks != NULL) {
+		while (stList_length(sequence->absorbedViewChunks) > 0) {
+			sequenceViewChunk_destruct(stList_pop(sequence->absorbedViewChunks));
+		}
+	}
+}
+
+void sequence_clearViewCache(Sequence *sequence) {
+	if (sequence->viewChunks != NULL) {
+		stSortedSet_destruct(sequence->viewChunks);
+		stList_destruct(sequence->absorbedViewChunks);
+		sequence->viewChunks = NULL;
+		sequence->absorbedViewChunks = NULL;
+	}
+}
+
+char sequenceView_getBase(const SequenceView *view, int64_t i) {
+	assert(i >= 0 && i < view->length);
+	return view->strand ? view->bases[i] : stString_reverseComplementChar(view->bases[view->length - 1 - i]);
+}
+
+void sequenceView_copyString(const SequenceView *view, char *string) {
+	if (view->strand) {
+		memcpy(string, view->bases, view->length);
+	} else {
+		for (int64_t i = 0; i < view->length; i++) {
+			string[i] = stString_reverseComplementChar(view->bases[view->length - 1 - i]);
+		}
+	}
+	string[view->length] = '\0';
+}
+
 const char *sequence_getHeader(Sequence *sequence) {
 	return metaSequence_getHeader(sequence->metaSequence);
 }
@@ -78,9 +196,9 @@ void sequence_check(Sequence *sequence) {
  * Serialisation functions.
  */
 
-void sequence_writeBinaryRepresentation(Sequence *sequence, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	binaryRepresentation_writeElementType(CODE_SEQUENCE, writeFn);
-	binaryRepresentation_writeName(sequence_getName(sequence), writeFn);
+void sequence_writeBinaryRepresentation(Sequence *sequence, BinaryRepresentationWriter *writer) {
+	binaryRepresentation_writeElementType(CODE_SEQUENCE, writer);
+	binaryRepresentation_writeName(sequence_getName(sequence), writer);
 }
 
 Sequence *sequence_loadFromBinaryRepresentation(void **binaryString, Flower *flower) {
@@ -12,6 +12,8 @@
 struct _sequence {
 	MetaSequence *metaSequence;
 	Flower *flower;
+	stSortedSet *viewChunks; //Disjoint chunks of cached bases that views are taken from, by start, NULL until the first view.
+	stList *absorbedViewChunks; //Chunks merged into larger ones, kept until sequence_releaseViews as earlier views may use them.
 };
 
 
@@ -26,7 +28,7 @@ struct _sequence {
 /*
  * Write a binary representation of the sequence to the write function.
  */
-void sequence_writeBinaryRepresentation(Sequence *sequence, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void sequence_writeBinaryRepresentation(Sequence *sequence, BinaryRepresentationWriter *writer);
 
 /*
  * Loads a sequence into memory from a binary representation of the sequence.
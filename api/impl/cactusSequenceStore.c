@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define CACTUS_SEQUENCE_STORE_MAGIC "CACTUSSQ"
+#define CACTUS_SEQUENCE_STORE_VERSION 1
+
+/*
+ * The layout of the file: a header, then the sequences one after another. Every
+ * field is an int64_t, so everything stays 8 byte aligned in the mapping.
+ */
+typedef struct _sequenceStoreHeader {
+    char magic[8];
+    int64_t version;
+} SequenceStoreHeader;
+
+/*
+ * A sequence: this record, then exceptionNumber SequenceStoreRuns giving the runs of
+ * bases other than A, C, G and T, then maskNumber SequenceStoreRuns giving the soft masked
+ * intervals, then the 2 bit packed bases, padded to a multiple of 8 bytes. Runs are
+ * sorted by start and do not overlap.
+ */
+typedef struct _sequenceStoreRecord {
+    int64_t name;
+    int64_t length;
+    int64_t exceptionNumber;
+    int64_t maskNumber;
+} SequenceStoreRecord;
+
+typedef struct _sequenceStoreRun {
+    int64_t start;
+    int64_t length;
+    int64_t base; //The upper case base of an exception run, unused for mask runs
+} SequenceStoreRun;
+
+/*
+ * The in memory index of the sequences in the mapped part of the file.
+ */
+typedef struct _sequenceStoreEntry {
+    Name name;
+    int64_t offset;
+} SequenceStoreEntry;
+
+struct _cactusSequenceStore {
+    char *fileName;
+    int fileHandle;
+    char *map;
+    int64_t mapSize;
+    int64_t indexedSize;
+    stHash *entries;
+    pthread_mutex_t mutex;
+};
+
+static const char sequenceStore_bases[4] = { 'A', 'C', 'G', 'T' };
+
+static int64_t sequenceStore_getBaseCode(char base) {
+    switch (base) {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+static int64_t sequenceStore_getPackedSize(int64_t length) {
+    return ((length + 3) / 4 + 7) / 8 * 8;
+}
+
+static int64_t sequenceStore_getRecordSize(const SequenceStoreRecord *record) {
+    return sizeof(SequenceStoreRecord) + (record->exceptionNumber + record->maskNumber) * sizeof(SequenceStoreRun)
+            + sequenceStore_getPackedSize(record->length);
+}
+
+static uint64_t sequenceStore_hashEntry(const void *entry) {
+    return (uint64_t) ((const SequenceStoreEntry *) entry)->name;
+}
+
+static int sequenceStore_equalEntries(const void *entry1, const void *entry2) {
+    return ((const SequenceStoreEntry *) entry1)->name == ((const SequenceStoreEntry *) entry2)->name;
+}
+
+static void sequenceStore_lock(CactusSequenceStore *sequenceStore, int operation) {
+    while (flock(sequenceStore->fileHandle, operation) != 0) {
+        if (errno != EINTR) {
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not lock the sequence store %s", sequenceStore->fileName);
+        }
+    }
+}
+
+static void sequenceStore_refresh(CactusSequenceStore *sequenceStore) {
+    /*
+     * Remaps the file if it has grown and adds the sequences appended since the last
+     * refresh to the index. Called with the mutex held.
+     */
+    struct stat fileStat;
+    if (fstat(sequenceStore->fileHandle, &fileStat) != 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not stat the sequence store %s", sequenceStore->fileName);
+    }
+    if (fileStat.st_size == sequenceStore->indexedSize) {
+        return;
+    }
+    sequenceStore_lock(sequenceStore, LOCK_SH); //Excludes half written appends
+    if (fstat(sequenceStore->fileHandle, &fileStat) != 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not stat the sequence store %s", sequenceStore->fileName);
+    }
+    if (sequenceStore->map != NULL) {
+        munmap(sequenceStore->map, sequenceStore->mapSize);
+    }
+    sequenceStore->mapSize = fileStat.st_size;
+    sequenceStore->map = mmap(NULL, sequenceStore->mapSize, PROT_READ, MAP_SHARED, sequenceStore->fileHandle, 0);
+    if (sequenceStore->map == MAP_FAILED) {
+        sequenceStore->map = NULL;
+        flock(sequenceStore->fileHandle, LOCK_UN);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not map the sequence store %s", sequenceStore->fileName);
+    }
+    if (sequenceStore->indexedSize == 0) {
+        const SequenceStoreHeader *header = (const SequenceStoreHeader *) sequenceStore->map;
+        if (sequenceStore->mapSize < sizeof(SequenceStoreHeader)
+                || memcmp(header->magic, CACTUS_SEQUENCE_STORE_MAGIC, sizeof(header->magic)) != 0
+                || header->version != CACTUS_SEQUENCE_STORE_VERSION) {
+            flock(sequenceStore->fileHandle, LOCK_UN);
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The file %s is not a cactus sequence store", sequenceStore->fileName);
+        }
+        sequenceStore->indexedSize = sizeof(SequenceStoreHeader);
+    }
+    while (sequenceStore->indexedSize < sequenceStore->mapSize) {
+        const SequenceStoreRecord *record = (const SequenceStoreRecord *) (sequenceStore->map
+                + sequenceStore->indexedSize);
+        SequenceStoreEntry *entry = st_malloc(sizeof(SequenceStoreEntry));
+        entry->name = record->name;
+        entry->offset = sequenceStore->indexedSize;
+        assert(stHash_search(sequenceStore->entries, entry) == NULL);
+        stHash_insert(sequenceStore->entries, entry, entry);
+        sequenceStore->indexedSize += sequenceStore_getRecordSize(record);
+    }
+    assert(sequenceStore->indexedSize == sequenceStore->mapSize);
+    flock(sequenceStore->fileHandle, LOCK_UN);
+}
+
+static SequenceStoreEntry *sequenceStore_getEntry(CactusSequenceStore *sequenceStore, Name name) {
+    /*
+     * Looks up a sequence, refreshing the index if it is not found in case another process
+     * appended it. Called with the mutex held.
+     */
+    SequenceStoreEntry key;
+    key.name = name;
+    SequenceStoreEntry *entry = stHash_search(sequenceStore->entries, &key);
+    if (entry == NULL) {
+        sequenceStore_refresh(sequenceStore);
+        entry = stHash_search(sequenceStore->entries, &key);
+    }
+    return entry;
+}
+
+static void sequenceStore_addRun(SequenceStoreRun **runs, int64_t *runNumber, int64_t i, int64_t base) {
+    /*
+     * Adds position i to the runs, extending the last run if i follows it and has the same base.
+     */
+    if (*runNumber > 0) {
+        SequenceStoreRun *run = *runs + *runNumber - 1;
+        if (run->start + run->length == i && run->base == base) {
+            run->length++;
+            return;
+        }
+    }
+    if ((*runNumber & (*runNumber - 1)) == 0) { //Grow when the number of runs reaches a power of two
+        *runs = st_realloc(*runs, (*runNumber == 0 ? 1 : 2 * *runNumber) * sizeof(SequenceStoreRun));
+    }
+    SequenceStoreRun *run = *runs + (*runNumber)++;
+    run->start = i;
+    run->length = 1;
+    run->base = base;
+}
+
+static int64_t sequenceStore_getFirstRun(const SequenceStoreRun *runs, int64_t runNumber, int64_t start) {
+    /*
+     * Returns the index of the first run ending after start.
+     */
+    int64_t i = 0, j = runNumber;
+    while (i < j) {
+        int64_t k = i + (j - i) / 2;
+        if (runs[k].start + runs[k].length <= start) {
+            i = k + 1;
+        } else {
+            j = k;
+        }
+    }
+    return i;
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Public functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static CactusSequenceStore *sequenceStore_construct(const char *fileName, int createFlag) {
+    /*
+     * Opens the file, read only if it can not be written. createFlag is O_CREAT or 0.
+     */
+    int fileHandle = open(fileName, O_RDWR | createFlag, 0644);
+    if (fileHandle < 0 && errno != ENOENT) {
+        fileHandle = open(fileName, O_RDONLY);
+    }
+    if (fileHandle < 0) {
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not open the sequence store %s: %s", fileName, strerror(errno));
+    }
+    CactusSequenceStore *sequenceStore = st_calloc(1, sizeof(CactusSequenceStore));
+    sequenceStore->fileHandle = fileHandle;
+    //Keep the absolute path, as the name is shared with processes with other working directories
+    sequenceStore->fileName = realpath(fileName, NULL);
+    if (sequenceStore->fileName == NULL) {
+        sequenceStore->fileName = stString_copy(fileName);
+    }
+    sequenceStore->entries = stHash_construct3(sequenceStore_hashEntry, sequenceStore_equalEntries, NULL, free);
+    pthread_mutex_init(&sequenceStore->mutex, NULL);
+    return sequenceStore;
+}
+
+CactusSequenceStore *cactusSequenceStore_construct(const char *fileName) {
+    CactusSequenceStore *sequenceStore = sequenceStore_construct(fileName, O_CREAT);
+    //Write the header if we created the file
+    sequenceStore_lock(sequenceStore, LOCK_EX);
+    struct stat fileStat;
+    if (fstat(sequenceStore->fileHandle, &fileStat) == 0 && fileStat.st_size == 0) {
+        SequenceStoreHeader header;
+        memcpy(header.magic, CACTUS_SEQUENCE_STORE_MAGIC, sizeof(header.magic));
+        header.version = CACTUS_SEQUENCE_STORE_VERSION;
+        if (write(sequenceStore->fileHandle, &header, sizeof(SequenceStoreHeader)) != sizeof(SequenceStoreHeader)) {
+            flock(sequenceStore->fileHandle, LOCK_UN);
+            stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not write to the sequence store %s", fileName);
+        }
+    }
+    flock(sequenceStore->fileHandle, LOCK_UN);
+    sequenceStore_refresh(sequenceStore);
+    return sequenceStore;
+}
+
+CactusSequenceStore *cactusSequenceStore_open(const char *fileName) {
+    CactusSequenceStore *sequenceStore = sequenceStore_construct(fileName, 0);
+    struct stat fileStat;
+    if (fstat(sequenceStore->fileHandle, &fileStat) != 0 || fileStat.st_size < (int64_t) sizeof(SequenceStoreHeader)) {
+        cactusSequenceStore_destruct(sequenceStore);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "The file %s is not a cactus sequence store", fileName);
+    }
+    sequenceStore_refresh(sequenceStore); //Checks the header
+    return sequenceStore;
+}
+
+void cactusSequenceStore_destruct(CactusSequenceStore *sequenceStore) {
+    if (sequenceStore->map != NULL) {
+        munmap(sequenceStore->map, sequenceStore->mapSize);
+    }
+    close(sequenceStore->fileHandle);
+    stHash_destruct(sequenceStore->entries);
+    pthread_mutex_destroy(&sequenceStore->mutex);
+    free(sequenceStore->fileName);
+    free(sequenceStore);
+}
+
+const char *cactusSequenceStore_getFileName(CactusSequenceStore *sequenceStore) {
+    return sequenceStore->fileName;
+}
+
+void cactusSequenceStore_addString(CactusSequenceStore *sequenceStore, Name name, const char *string) {
+    SequenceStoreRecord record;
+    record.name = name;
+    record.length = strlen(string);
+    record.exceptionNumber = 0;
+    record.maskNumber = 0;
+    SequenceStoreRun *exceptions = NULL, *masks = NULL;
+    int64_t packedSize = sequenceStore_getPackedSize(record.length);
+    uint8_t *packed = st_calloc(packedSize > 0 ? packedSize : 1, sizeof(uint8_t));
+    for (int64_t i = 0; i < record.length; i++) {
+        char base = string[i];
+        if (islower((unsigned char) base)) {
+            sequenceStore_addRun(&masks, &record.maskNumber, i, 0);
+            base = toupper((unsigned char) base);
+        }
+        int64_t code = sequenceStore_getBaseCode(base);
+        if (code == -1) {
+            sequenceStore_addRun(&exceptions, &record.exceptionNumber, i, base);
+            code = 0;
+        }
+        packed[i / 4] |= code << (2 * (i % 4));
+    }
+    //Build the record in one buffer, so it is appended with a single write
+    int64_t recordSize = sequenceStore_getRecordSize(&record);
+    char *buffer = st_malloc(recordSize);
+    char *p = buffer;
+    memcpy(p, &record, sizeof(SequenceStoreRecord));
+    p += sizeof(SequenceStoreRecord);
+    if (record.exceptionNumber > 0) {
+        memcpy(p, exceptions, record.exceptionNumber * sizeof(SequenceStoreRun));
+        p += record.exceptionNumber * sizeof(SequenceStoreRun);
+    }
+    if (record.maskNumber > 0) {
+        memcpy(p, masks, record.maskNumber * sizeof(SequenceStoreRun));
+        p += record.maskNumber * sizeof(SequenceStoreRun);
+    }
+    memcpy(p, packed, packedSize);
+    free(exceptions);
+    free(masks);
+    free(packed);
+
+    pthread_mutex_lock(&sequenceStore->mutex);
+    sequenceStore_lock(sequenceStore, LOCK_EX);
+    int64_t written = lseek(sequenceStore->fileHandle, 0, SEEK_END) < 0 ? -1 : 0;
+    while (written >= 0 && written < recordSize) {
+        ssize_t i = write(sequenceStore->fileHandle, buffer + written, recordSize - written);
+        if (i < 0 && errno != EINTR) {
+            written = -1;
+        } else if (i > 0) {
+            written += i;
+        }
+    }
+    flock(sequenceStore->fileHandle, LOCK_UN);
+    free(buffer);
+    if (written < 0) {
+        pthread_mutex_unlock(&sequenceStore->mutex);
+        stThrowNew(CACTUS_DISK_EXCEPTION_ID, "Could not append a string to the sequence store %s",
+                sequenceStore->fileName);
+    }
+    sequenceStore_refresh(sequenceStore);
+    pthread_mutex_unlock(&sequenceStore->mutex);
+}
+
+bool cactusSequenceStore_containsString(CactusSequenceStore *sequenceStore, Name name) {
+    pthread_mutex_lock(&sequenceStore->mutex);
+    bool containsString = sequenceStore_getEntry(sequenceStore, name) != NULL;
+    pthread_mutex_unlock(&sequenceStore->mutex);
+    return containsString;
+}
+
+char *cactusSequenceStore_getString(CactusSequenceStore *sequenceStore, Name name, int64_t start, int64_t length,
+        bool strand) {
+    pthread_mutex_lock(&sequenceStore->mutex);
+    SequenceStoreEntry *entry = sequenceStore_getEntry(sequenceStore, name);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&sequenceStore->mutex);
+        return NULL;
+    }
+    const SequenceStoreRecord *record = (const SequenceStoreRecord *) (sequenceStore->map + entry->offset);
+    const SequenceStoreRun *exceptions = (const SequenceStoreRun *) (record + 1);
+    const SequenceStoreRun *masks = exceptions + record->exceptionNumber;
+    const uint8_t *packed = (const uint8_t *) (masks + record->maskNumber);
+    assert(start >= 0 && length >= 0 && start + length <= record->length);
+    char *string = st_malloc(sizeof(char) * (length + 1));
+    for (int64_t i = 0; i < length; i++) {
+        int64_t j = start + i;
+        string[i] = sequenceStore_bases[(packed[j / 4] >> (2 * (j % 4))) & 3];
+    }
+    for (int64_t i = sequenceStore_getFirstRun(exceptions, record->exceptionNumber, start);
+            i < record->exceptionNumber && exceptions[i].start < start + length; i++) {
+        int64_t j = exceptions[i].start > start ? exceptions[i].start : start;
+        int64_t k = exceptions[i].start + exceptions[i].length < start + length ?
+                exceptions[i].start + exceptions[i].length : start + length;
+        memset(string + j - start, exceptions[i].base, k - j);
+    }
+    for (int64_t i = sequenceStore_getFirstRun(masks, record->maskNumber, start);
+            i < record->maskNumber && masks[i].start < start + length; i++) {
+        int64_t j = masks[i].start > start ? masks[i].start : start;
+        int64_t k = masks[i].start + masks[i].length < start + length ? masks[i].start + masks[i].length : start + length;
+        for (; j < k; j++) {
+            string[j - start] = tolower((unsigned char) string[j - start]);
+        }
+    }
+    string[length] = '\0';
+    pthread_mutex_unlock(&sequenceStore->mutex);
+    if (!strand) {
+        char *string2 = stString_reverseComplementString(string);
+        free(string);
+        string = string2;
+    }
+    return string;
+}
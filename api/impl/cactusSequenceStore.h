@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SEQUENCE_STORE_H_
+#define CACTUS_SEQUENCE_STORE_H_
+
+#include "cactusGlobals.h"
+
+/*
+ * An append only file of sequences, an alternative to storing the strings of a cactus
+ * disk as chunks in the database.
+ *
+ * Each sequence is stored as 2 bit packed bases (A, C, G and T) with two sparse side
+ * tables: runs of any other character (N, IUPAC codes, ...) and soft masked (lower case)
+ * intervals. The file is memory mapped, so substrings are decoded straight from the
+ * mapping without a database round trip. Sequences may be appended by several processes;
+ * appends are serialised with a file lock and readers remap the file when they are asked
+ * for a sequence they have not seen.
+ */
+typedef struct _cactusSequenceStore CactusSequenceStore;
+
+/*
+ * Opens the sequence store in the given file, creating the file if it does not exist.
+ */
+CactusSequenceStore *cactusSequenceStore_construct(const char *fileName);
+
+/*
+ * Opens an existing sequence store, as named in the parameters of a cactus disk. Throws
+ * an exception if the file does not exist or is not a sequence store, rather than creating it.
+ */
+CactusSequenceStore *cactusSequenceStore_open(const char *fileName);
+
+/*
+ * Unmaps and closes the sequence store.
+ */
+void cactusSequenceStore_destruct(CactusSequenceStore *sequenceStore);
+
+/*
+ * Gets the name of the file of the sequence store.
+ */
+const char *cactusSequenceStore_getFileName(CactusSequenceStore *sequenceStore);
+
+/*
+ * Appends the string to the store under the given name, which must be unique.
+ */
+void cactusSequenceStore_addString(CactusSequenceStore *sequenceStore, Name name, const char *string);
+
+/*
+ * Returns non-zero if the store contains a string with the given name.
+ */
+bool cactusSequenceStore_containsString(CactusSequenceStore *sequenceStore, Name name);
+
+/*
+ * Returns a copy of the substring [start, start + length) of the named string, reverse
+ * complemented if strand is false, or NULL if the store does not contain the string.
+ */
+char *cactusSequenceStore_getString(CactusSequenceStore *sequenceStore, Name name, int64_t start, int64_t length,
+        bool strand);
+
+#endif
@@ -14,30 +14,201 @@
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 
-void binaryRepresentation_writeElementType(char elementCode, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&elementCode, sizeof(char), 1);
+/*
+ * The state of the encoder/decoder for a record: the format and the values the
+ * deltas of the varint format are taken against.
+ */
+typedef struct _binaryRepresentationFormat {
+	int64_t format;
+	Name lastName;
+	int64_t lastCoordinate;
+} BinaryRepresentationFormat;
+
+/*
+ * A growable buffer that a record is serialised into in a single pass. Each record
+ * has its own writer, so records can be serialised concurrently.
+ */
+struct _binaryRepresentationWriter {
+	char *buffer;
+	int64_t length;
+	int64_t maxLength;
+	BinaryRepresentationFormat format;
+};
+
+#define BINARY_REPRESENTATION_MAX_RECORD_DEPTH 16
+#define BINARY_REPRESENTATION_INITIAL_WRITER_SIZE 256
+
+/*
+ * Stack of reader formats, the bottom entry is the raw format used by
+ * objects that are loaded outside of a record. Thread local, like the
+ * buffer of binaryRepresentation_getStringStatic, so that records can be
+ * decoded on more than one thread.
+ */
+static __thread BinaryRepresentationFormat binaryRepresentation_readFormats[BINARY_REPRESENTATION_MAX_RECORD_DEPTH];
+static __thread int64_t binaryRepresentation_readDepth = 0;
+
+static void binaryRepresentation_resetFormat(BinaryRepresentationFormat *format, int64_t version) {
+	format->format = version;
+	format->lastName = 0;
+	format->lastCoordinate = 0;
+}
+
+static uint64_t binaryRepresentation_zigZagEncode(int64_t i) {
+	return ((uint64_t)i << 1) ^ (uint64_t)(i >> 63);
+}
+
+static int64_t binaryRepresentation_zigZagDecode(uint64_t i) {
+	return (int64_t)((i >> 1) ^ (~(i & 1) + 1));
+}
+
+BinaryRepresentationWriter *binaryRepresentation_constructWriter(int64_t initialSize) {
+	BinaryRepresentationWriter *writer = st_malloc(sizeof(BinaryRepresentationWriter));
+	writer->maxLength = initialSize > 0 ? initialSize : BINARY_REPRESENTATION_INITIAL_WRITER_SIZE;
+	writer->buffer = st_malloc(writer->maxLength);
+	writer->length = 0;
+	binaryRepresentation_resetFormat(&writer->format, BINARY_REPRESENTATION_FORMAT_RAW);
+	return writer;
 }
 
-void binaryRepresentation_writeString(const char *name, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
+void binaryRepresentation_destructWriter(BinaryRepresentationWriter *writer) {
+	free(writer->buffer);
+	free(writer);
+}
+
+void *binaryRepresentation_finishWriter(BinaryRepresentationWriter *writer, int64_t *recordSize) {
+	void *vA = writer->buffer;
+	*recordSize = writer->length;
+	free(writer);
+	return vA;
+}
+
+int64_t binaryRepresentation_getWriterLength(BinaryRepresentationWriter *writer) {
+	return writer->length;
+}
+
+void binaryRepresentation_write(const void *ptr, int64_t size, BinaryRepresentationWriter *writer) {
+	assert(size >= 0);
+	if (writer->length + size > writer->maxLength) {
+		writer->maxLength = writer->maxLength * 2 > writer->length + size ? writer->maxLength * 2 : writer->length + size;
+		writer->buffer = st_realloc(writer->buffer, writer->maxLength);
+	}
+	memcpy(writer->buffer + writer->length, ptr, size);
+	writer->length += size;
+}
+
+static void binaryRepresentation_writeVarint(uint64_t i, BinaryRepresentationWriter *writer) {
+	uint8_t buffer[10];
+	int64_t j = 0;
+	while (i >= 0x80) {
+		buffer[j++] = (uint8_t)(i | 0x80);
+		i >>= 7;
+	}
+	buffer[j++] = (uint8_t)i;
+	binaryRepresentation_write(buffer, j, writer);
+}
+
+static uint64_t binaryRepresentation_getVarint(void **binaryString) {
+	uint8_t *cA = *binaryString;
+	uint64_t i = 0;
+	int64_t shift = 0;
+	while (*cA & 0x80) {
+		i |= (uint64_t)(*cA++ & 0x7F) << shift;
+		shift += 7;
+		assert(shift < 64);
+	}
+	i |= (uint64_t)(*cA++) << shift;
+	*binaryString = cA;
+	return i;
+}
+
+/*
+ * Writes a value as a zig-zag varint of its difference from the given previous value.
+ * The difference is taken modulo 2^64 so that NULL_NAME and other extreme values round trip.
+ */
+static void binaryRepresentation_writeDelta(int64_t i, int64_t *previous, BinaryRepresentationWriter *writer) {
+	binaryRepresentation_writeVarint(binaryRepresentation_zigZagEncode((int64_t)((uint64_t)i - (uint64_t)*previous)), writer);
+	*previous = i;
+}
+
+static int64_t binaryRepresentation_getDelta(void **binaryString, int64_t *previous) {
+	*previous = (int64_t)((uint64_t)*previous + (uint64_t)binaryRepresentation_zigZagDecode(binaryRepresentation_getVarint(binaryString)));
+	return *previous;
+}
+
+static BinaryRepresentationFormat *binaryRepresentation_getReadFormat(void) {
+	return &binaryRepresentation_readFormats[binaryRepresentation_readDepth];
+}
+
+void binaryRepresentation_writeVersionHeader(int64_t format, BinaryRepresentationWriter *writer) {
+	assert(format == BINARY_REPRESENTATION_FORMAT_RAW || format == BINARY_REPRESENTATION_FORMAT_VARINT);
+	char version = format;
+	binaryRepresentation_writeElementType(CODE_FORMAT_VERSION, writer);
+	binaryRepresentation_write(&version, sizeof(char), writer);
+	binaryRepresentation_resetFormat(&writer->format, format);
+}
+
+int64_t binaryRepresentation_beginRecord(void **binaryString) {
+	if (binaryRepresentation_readDepth + 1 >= BINARY_REPRESENTATION_MAX_RECORD_DEPTH) {
+		st_errAbort("Records are nested too deeply to be decoded");
+	}
+	BinaryRepresentationFormat *format = &binaryRepresentation_readFormats[++binaryRepresentation_readDepth];
+	binaryRepresentation_resetFormat(format, BINARY_REPRESENTATION_FORMAT_RAW);
+	if (binaryRepresentation_peekNextElementType(*binaryString) == CODE_FORMAT_VERSION) {
+		binaryRepresentation_popNextElementType(binaryString);
+		int64_t version = binaryRepresentation_popNextElementType(binaryString);
+		if (version != BINARY_REPRESENTATION_FORMAT_RAW && version != BINARY_REPRESENTATION_FORMAT_VARINT) {
+			st_errAbort("Got an unknown binary representation format version: %" PRIi64 "", version);
+		}
+		format->format = version;
+	}
+	return format->format;
+}
+
+void binaryRepresentation_endRecord(void) {
+	assert(binaryRepresentation_readDepth > 0);
+	binaryRepresentation_readDepth--;
+}
+
+void binaryRepresentation_writeElementType(char elementCode, BinaryRepresentationWriter *writer) {
+	binaryRepresentation_write(&elementCode, sizeof(char), writer);
+}
+
+void binaryRepresentation_writeString(const char *name, BinaryRepresentationWriter *writer) {
 	int64_t i = strlen(name);
-	writeFn(&i, sizeof(int64_t), 1);
-	writeFn(name, sizeof(char), i);
+	binaryRepresentation_writeInteger(i, writer);
+	binaryRepresentation_write(name, sizeof(char) * i, writer);
+}
+
+void binaryRepresentation_writeInteger(int64_t i, BinaryRepresentationWriter *writer) {
+	if (writer->format.format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		binaryRepresentation_writeVarint(binaryRepresentation_zigZagEncode(i), writer);
+	} else {
+		binaryRepresentation_write(&i, sizeof(int64_t), writer);
+	}
 }
 
-void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&i, sizeof(int64_t), 1);
+void binaryRepresentation_writeName(Name name, BinaryRepresentationWriter *writer) {
+	if (writer->format.format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		binaryRepresentation_writeDelta(name, &writer->format.lastName, writer);
+	} else {
+		binaryRepresentation_write(&name, sizeof(int64_t), writer);
+	}
 }
 
-void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	binaryRepresentation_writeInteger(name, writeFn);
+void binaryRepresentation_writeCoordinate(int64_t coordinate, BinaryRepresentationWriter *writer) {
+	if (writer->format.format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		binaryRepresentation_writeDelta(coordinate, &writer->format.lastCoordinate, writer);
+	} else {
+		binaryRepresentation_write(&coordinate, sizeof(int64_t), writer);
+	}
 }
 
-void binaryRepresentation_writeFloat(float f, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&f, sizeof(float), 1);
+void binaryRepresentation_writeFloat(float f, BinaryRepresentationWriter *writer) {
+	binaryRepresentation_write(&f, sizeof(float), writer);
 }
 
-void binaryRepresentation_writeBool(bool i, void (*writeFn)(const void * ptr, size_t size, size_t count)) {
-	writeFn(&i, sizeof(bool), 1);
+void binaryRepresentation_writeBool(bool i, BinaryRepresentationWriter *writer) {
+	binaryRepresentation_write(&i, sizeof(bool), writer);
 }
 
 char binaryRepresentation_peekNextElementType(void *binaryString) {
@@ -62,7 +233,7 @@ char *binaryRepresentation_getString(void **binaryString) {
 	return cA;
 }
 
-char *binaryRepresentation_getStringStatic_cA = NULL;
+static __thread char *binaryRepresentation_getStringStatic_cA = NULL;
 const char *binaryRepresentation_getStringStatic(void **binaryString) {
 	if(binaryRepresentation_getStringStatic_cA != NULL) {
 		free(binaryRepresentation_getStringStatic_cA);
@@ -71,15 +242,34 @@ const char *binaryRepresentation_getStringStatic(void **binaryString) {
 	return binaryRepresentation_getStringStatic_cA;
 }
 
-int64_t binaryRepresentation_getInteger(void **binaryString) {
+static int64_t binaryRepresentation_getRawInteger(void **binaryString) {
 	int64_t *i;
 	i = *binaryString;
 	*binaryString = i + 1;
 	return *i;
 }
 
+int64_t binaryRepresentation_getInteger(void **binaryString) {
+	if (binaryRepresentation_getReadFormat()->format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		return binaryRepresentation_zigZagDecode(binaryRepresentation_getVarint(binaryString));
+	}
+	return binaryRepresentation_getRawInteger(binaryString);
+}
+
 Name binaryRepresentation_getName(void **binaryString) {
-	return binaryRepresentation_getInteger(binaryString);
+	BinaryRepresentationFormat *format = binaryRepresentation_getReadFormat();
+	if (format->format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		return binaryRepresentation_getDelta(binaryString, &format->lastName);
+	}
+	return binaryRepresentation_getRawInteger(binaryString);
+}
+
+int64_t binaryRepresentation_getCoordinate(void **binaryString) {
+	BinaryRepresentationFormat *format = binaryRepresentation_getReadFormat();
+	if (format->format == BINARY_REPRESENTATION_FORMAT_VARINT) {
+		return binaryRepresentation_getDelta(binaryString, &format->lastCoordinate);
+	}
+	return binaryRepresentation_getRawInteger(binaryString);
 }
 
 float binaryRepresentation_getFloat(void **binaryString) {
@@ -96,34 +286,10 @@ bool binaryRepresentation_getBool(void **binaryString) {
 	return *i;
 }
 
-int64_t binaryRepresentation_makeBinaryRepresentationP_i = 0;
-void binaryRepresentation_makeBinaryRepresentationP(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Records the cummulative size of the substrings written out in creating the flower.
-	 */
-	assert(ptr != NULL);
-	binaryRepresentation_makeBinaryRepresentationP_i += size * count;
-}
-
-char *binaryRepresentation_makeBinaryRepresentationP2_vA = NULL;
-void binaryRepresentation_makeBinaryRepresentationP2(const void * ptr, size_t size, size_t count) {
-	/*
-	 * Cummulates all the binary data into one array
-	 */
-	memcpy(binaryRepresentation_makeBinaryRepresentationP2_vA, ptr, size*count);
-	binaryRepresentation_makeBinaryRepresentationP2_vA += size * count;
-}
-
-void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize) {
-	void *vA;
-	binaryRepresentation_makeBinaryRepresentationP_i = 0;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP);
-	assert(binaryRepresentation_makeBinaryRepresentationP_i < INT64_MAX);
-	vA = st_malloc(binaryRepresentation_makeBinaryRepresentationP_i);
-	binaryRepresentation_makeBinaryRepresentationP2_vA = vA;
-	writeBinaryRepresentation(object, binaryRepresentation_makeBinaryRepresentationP2);
-	*recordSize = binaryRepresentation_makeBinaryRepresentationP_i;
-	return vA;
+void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, BinaryRepresentationWriter *writer), int64_t *recordSize) {
+	BinaryRepresentationWriter *writer = binaryRepresentation_constructWriter(BINARY_REPRESENTATION_INITIAL_WRITER_SIZE);
+	writeBinaryRepresentation(object, writer);
+	return binaryRepresentation_finishWriter(writer, recordSize);
 }
 
 void *binaryRepresentation_resizeObjectAsPowerOf2(void *vA, int64_t *recordSize) {
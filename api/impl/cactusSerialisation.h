@@ -9,6 +9,8 @@
 
 #include "cactusGlobals.h"
 
+typedef struct _binaryRepresentationWriter BinaryRepresentationWriter;
+
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -46,36 +48,98 @@
 #define CODE_PSEUDO_CHROMOSOME 23
 #define CODE_PSEUDO_ADJACENCY 24
 #define CODE_CACTUS_DISK 25
+#define CODE_FORMAT_VERSION 26
+#define CODE_SEQUENCE_STORE 27
+
+/*
+ * Versions of the binary format. Records without a version header are in the raw format, in which
+ * every integer, name and string length is written as an 8 byte int64_t. In the varint format
+ * integers are zig-zag varints, and names and coordinates are delta coded against the previous
+ * name/coordinate in the same record.
+ */
+
+#define BINARY_REPRESENTATION_FORMAT_RAW 0
+#define BINARY_REPRESENTATION_FORMAT_VARINT 1
+
+/*
+ * Constructs a writer, which accumulates a record in a buffer that grows as needed. The initial
+ * size of the buffer is a hint, a value <= 0 gives a default size.
+ */
+BinaryRepresentationWriter *binaryRepresentation_constructWriter(int64_t initialSize);
+
+/*
+ * Destructs the writer and the record it holds.
+ */
+void binaryRepresentation_destructWriter(BinaryRepresentationWriter *writer);
+
+/*
+ * Destructs the writer, returning the record it holds, which must be freed, and
+ * setting recordSize to its length in bytes.
+ */
+void *binaryRepresentation_finishWriter(BinaryRepresentationWriter *writer, int64_t *recordSize);
+
+/*
+ * Gets the number of bytes written so far.
+ */
+int64_t binaryRepresentation_getWriterLength(BinaryRepresentationWriter *writer);
+
+/*
+ * Appends size bytes to the record.
+ */
+void binaryRepresentation_write(const void *ptr, int64_t size, BinaryRepresentationWriter *writer);
+
+/*
+ * Writes a version header, switching the writer to the given format for the rest of the
+ * record. Must be the first thing written to the writer.
+ */
+void binaryRepresentation_writeVersionHeader(int64_t format, BinaryRepresentationWriter *writer);
+
+/*
+ * Reads the version header at the start of a record, if present, and switches the reader to the format
+ * of the record until the matching call to binaryRepresentation_endRecord. Calls may be nested, so a
+ * record can be loaded while in the middle of parsing another one. Returns the format of the record.
+ */
+int64_t binaryRepresentation_beginRecord(void **binaryString);
+
+/*
+ * Restores the reader format to that in use before the matching call to binaryRepresentation_beginRecord.
+ */
+void binaryRepresentation_endRecord(void);
 
 /*
  * Writes a code for the element type.
  */
-void binaryRepresentation_writeElementType(char elementCode, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeElementType(char elementCode, BinaryRepresentationWriter *writer);
 
 /*
  * Writes a string to the binary stream.
  */
-void binaryRepresentation_writeString(const char *string, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeString(const char *string, BinaryRepresentationWriter *writer);
 
 /*
  * Writes an integer to the binary stream
  */
-void binaryRepresentation_writeInteger(int64_t i, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeInteger(int64_t i, BinaryRepresentationWriter *writer);
 
 /*
  * Writes an name to the binary stream
  */
-void binaryRepresentation_writeName(Name name, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeName(Name name, BinaryRepresentationWriter *writer);
+
+/*
+ * Writes a sequence coordinate to the binary stream.
+ */
+void binaryRepresentation_writeCoordinate(int64_t coordinate, BinaryRepresentationWriter *writer);
 
 /*
  * Writes a float to the binary stream.
  */
-void binaryRepresentation_writeFloat(float f, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeFloat(float f, BinaryRepresentationWriter *writer);
 
 /*
  * Writes an bool to the binary stream
  */
-void binaryRepresentation_writeBool(bool i, void (*writeFn)(const void * ptr, size_t size, size_t count));
+void binaryRepresentation_writeBool(bool i, BinaryRepresentationWriter *writer);
 
 /*
  * Returns indicating which element is next, but does not increment the string pointer.
@@ -94,7 +158,7 @@ char *binaryRepresentation_getString(void **binaryString);
 
 /*
  * Parses out a string, placing the memory in a buffer owned by the function. Thid buffer
- * will be overidden by the next call to the function.
+ * will be overidden by the next call to the function on the same thread.
  */
 const char *binaryRepresentation_getStringStatic(void **binaryString);
 
@@ -108,6 +172,11 @@ int64_t binaryRepresentation_getInteger(void **binaryString);
  */
 Name binaryRepresentation_getName(void **binaryString);
 
+/*
+ * Parses a sequence coordinate from a binary string.
+ */
+int64_t binaryRepresentation_getCoordinate(void **binaryString);
+
 /*
  * Parses a float from the binary string.
  */
@@ -120,9 +189,10 @@ bool binaryRepresentation_getBool(void **binaryString);
 
 /*
  * Makes a binary representation of an object, using a passed function which writes
- * out the representation of the considered object.
+ * out the representation of the considered object. The object is walked once and the
+ * function is safe to call concurrently on different objects.
  */
-void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, void (*writeFn)(const void * ptr, size_t size, size_t count)), int64_t *recordSize);
+void *binaryRepresentation_makeBinaryRepresentation(void *object, void (*writeBinaryRepresentation)(void *, BinaryRepresentationWriter *writer), int64_t *recordSize);
 
 /*
  * Resizes a record as a power of 2.
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+#define CACTUS_SLAB_ALIGNMENT 16
+
+typedef struct _cactusSlab CactusSlab;
+
+/*
+ * The header of a slab, at the start of the slab, followed by its objects. As slabs are aligned
+ * to their size the slab of an object is found by rounding the address of the object down.
+ */
+struct _cactusSlab {
+    CactusSlabAllocator *allocator; //NULL once the allocator has been destructed.
+    CactusSlab *previous; //The list of all the slabs of the allocator.
+    CactusSlab *next;
+    CactusSlab *previousWithSpace; //The list of the slabs of the allocator with room for more objects.
+    CactusSlab *nextWithSpace;
+    void *freeObjects; //Freed objects, each holding a pointer to the next.
+    int64_t objectNumber; //The number of objects in use.
+    int64_t unusedObjectNumber; //The number of objects at the end of the slab never handed out.
+};
+
+struct _cactusSlabAllocator {
+    int64_t objectSize;
+    int64_t objectsOffset;
+    int64_t objectsPerSlab;
+    int64_t slabNumber;
+    CactusSlab *slabs;
+    CactusSlab *slabsWithSpace;
+};
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Private functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+static int64_t roundUp(int64_t i) {
+    return (i + CACTUS_SLAB_ALIGNMENT - 1) / CACTUS_SLAB_ALIGNMENT * CACTUS_SLAB_ALIGNMENT;
+}
+
+static void addSlabWithSpace(CactusSlabAllocator *allocator, CactusSlab *slab) {
+    slab->previousWithSpace = NULL;
+    slab->nextWithSpace = allocator->slabsWithSpace;
+    if (allocator->slabsWithSpace != NULL) {
+        allocator->slabsWithSpace->previousWithSpace = slab;
+    }
+    allocator->slabsWithSpace = slab;
+}
+
+static void removeSlabWithSpace(CactusSlabAllocator *allocator, CactusSlab *slab) {
+    if (slab->previousWithSpace != NULL) {
+        slab->previousWithSpace->nextWithSpace = slab->nextWithSpace;
+    } else {
+        assert(allocator->slabsWithSpace == slab);
+        allocator->slabsWithSpace = slab->nextWithSpace;
+    }
+    if (slab->nextWithSpace != NULL) {
+        slab->nextWithSpace->previousWithSpace = slab->previousWithSpace;
+    }
+}
+
+static CactusSlab *slab_construct(CactusSlabAllocator *allocator) {
+    void *memory;
+    if (posix_memalign(&memory, CACTUS_SLAB_SIZE, CACTUS_SLAB_SIZE) != 0) {
+        st_errAbort("Failed to allocate a slab of %i bytes", CACTUS_SLAB_SIZE);
+    }
+    CactusSlab *slab = memory;
+    slab->allocator = allocator;
+    slab->freeObjects = NULL;
+    slab->objectNumber = 0;
+    slab->unusedObjectNumber = allocator->objectsPerSlab;
+    slab->previous = NULL;
+    slab->next = allocator->slabs;
+    if (allocator->slabs != NULL) {
+        allocator->slabs->previous = slab;
+    }
+    allocator->slabs = slab;
+    addSlabWithSpace(allocator, slab);
+    allocator->slabNumber++;
+    return slab;
+}
+
+static void slab_destruct(CactusSlabAllocator *allocator, CactusSlab *slab) {
+    assert(slab->objectNumber == 0);
+    removeSlabWithSpace(allocator, slab);
+    if (slab->previous != NULL) {
+        slab->previous->next = slab->next;
+    } else {
+        allocator->slabs = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->previous = slab->previous;
+    }
+    allocator->slabNumber--;
+    free(slab);
+}
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Public functions
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+CactusSlabAllocator *cactusSlabAllocator_construct(int64_t objectSize) {
+    assert(objectSize > 0);
+    CactusSlabAllocator *allocator = st_malloc(sizeof(CactusSlabAllocator));
+    allocator->objectSize = roundUp(objectSize < (int64_t) sizeof(void *) ? (int64_t) sizeof(void *) : objectSize);
+    allocator->objectsOffset = roundUp(sizeof(CactusSlab));
+    allocator->objectsPerSlab = (CACTUS_SLAB_SIZE - allocator->objectsOffset) / allocator->objectSize;
+    if (allocator->objectsPerSlab < 2) {
+        st_errAbort("Objects of %" PRIi64 " bytes are too large for a slab", objectSize);
+    }
+    allocator->slabNumber = 0;
+    allocator->slabs = NULL;
+    allocator->slabsWithSpace = NULL;
+    return allocator;
+}
+
+void cactusSlabAllocator_destruct(CactusSlabAllocator *allocator) {
+    CactusSlab *slab = allocator->slabs;
+    while (slab != NULL) {
+        CactusSlab *nextSlab = slab->next;
+        if (slab->objectNumber == 0) {
+            free(slab);
+        } else { //Left to be freed with its last object.
+            slab->allocator = NULL;
+        }
+        slab = nextSlab;
+    }
+    free(allocator);
+}
+
+void *cactusSlabAllocator_allocate(CactusSlabAllocator *allocator) {
+    CactusSlab *slab = allocator->slabsWithSpace;
+    if (slab == NULL) {
+        slab = slab_construct(allocator);
+    }
+    void *object;
+    if (slab->freeObjects != NULL) {
+        object = slab->freeObjects;
+        slab->freeObjects = *(void **) object;
+    } else {
+        assert(slab->unusedObjectNumber > 0);
+        object = (char *) slab + allocator->objectsOffset
+                + (allocator->objectsPerSlab - slab->unusedObjectNumber--) * allocator->objectSize;
+    }
+    if (++slab->objectNumber == allocator->objectsPerSlab) {
+        removeSlabWithSpace(allocator, slab);
+    }
+    return object;
+}
+
+void cactusSlab_free(void *object) {
+    CactusSlab *slab = (CactusSlab *) ((uintptr_t) object & ~((uintptr_t) CACTUS_SLAB_SIZE - 1));
+    assert(slab->objectNumber > 0);
+    CactusSlabAllocator *allocator = slab->allocator;
+    if (allocator == NULL) { //The allocator is gone, so the slab only waits for its last object.
+        if (--slab->objectNumber == 0) {
+            free(slab);
+        }
+        return;
+    }
+    if (slab->objectNumber-- == allocator->objectsPerSlab) {
+        addSlabWithSpace(allocator, slab);
+    }
+    *(void **) object = slab->freeObjects;
+    slab->freeObjects = object;
+    //An empty slab is released, unless it is the only one with space, so that alternately
+    //allocating and freeing a single object does not allocate a slab each time.
+    if (slab->objectNumber == 0 && (allocator->slabsWithSpace != slab || slab->nextWithSpace != NULL)) {
+        slab_destruct(allocator, slab);
+    }
+}
+
+int64_t cactusSlabAllocator_getSlabNumber(CactusSlabAllocator *allocator) {
+    return allocator->slabNumber;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_SLAB_H_
+#define CACTUS_SLAB_H_
+
+#include "cactusGlobals.h"
+
+/*
+ * A pool of fixed size objects carved out of large, aligned slabs, used by each cactus disk for
+ * the caps, ends, segments and blocks of its flowers, so that these objects are packed together
+ * in memory rather than scattered over the heap as separate small allocations.
+ *
+ * A slab is returned to the system as soon as its last object is freed. An object may outlive
+ * the allocator it came from, in which case its slab is kept until its last object is freed.
+ * Destructing a flower frees its objects one at a time: the flowers of a disk share slabs, so
+ * there are no slabs of the flower's own to release whole.
+ */
+typedef struct _cactusSlabAllocator CactusSlabAllocator;
+
+/*
+ * The size of a slab in bytes. Slabs are aligned to their size.
+ */
+#define CACTUS_SLAB_SIZE 65536
+
+/*
+ * Constructs an allocator of objects of the given size, which must be small enough that
+ * several fit in a slab.
+ */
+CactusSlabAllocator *cactusSlabAllocator_construct(int64_t objectSize);
+
+/*
+ * Destructs the allocator, releasing its empty slabs. Slabs still holding objects are released
+ * when those objects are freed.
+ */
+void cactusSlabAllocator_destruct(CactusSlabAllocator *allocator);
+
+/*
+ * Returns a new, uninitialised object.
+ */
+void *cactusSlabAllocator_allocate(CactusSlabAllocator *allocator);
+
+/*
+ * Frees an object returned by cactusSlabAllocator_allocate, whether or not the allocator it came
+ * from still exists.
+ */
+void cactusSlab_free(void *object);
+
+/*
+ * Returns the number of slabs held by the allocator.
+ */
+int64_t cactusSlabAllocator_getSlabNumber(CactusSlabAllocator *allocator);
+
+#endif
@@ -52,6 +52,14 @@ int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalS
  */
 void cactusDisk_write(CactusDisk *cactusDisk);
 
+/*
+ * Sets the number of threads used by cactusDisk_write to serialise and compress
+ * the loaded flowers and meta sequences, which overlaps with sending earlier
+ * records to the database. The default is 1, in which case records are encoded
+ * on the calling thread between database writes.
+ */
+void cactusDisk_setWriteThreads(CactusDisk *cactusDisk, int64_t writeThreads);
+
 /*
  * This is used to serialise a flower before a call to a cactusDisk_write, it is exposed for use in the cactus_caf code.
  */
@@ -76,6 +84,16 @@ stList *cactusDisk_getFlowers(CactusDisk *cactusDisk, stList *flowerNames);
  */
 MetaSequence *cactusDisk_getMetaSequence(CactusDisk *cactusDisk, Name metaSequenceName);
 
+/*
+ * Stores the strings added to the cactus disk from now on in the given sequence store
+ * file, 2 bit packed and memory mapped, rather than as chunks in the database. The file
+ * name is saved with the cactus disk parameters, so every process that opens the cactus
+ * disk maps the same file; call this before the first cactusDisk_write of a new cactus
+ * disk, or follow it with cactusDisk_forceParameterUpdate. Strings already in the
+ * database stay there and are still readable.
+ */
+void cactusDisk_setSequenceStore(CactusDisk *cactusDisk, const char *fileName);
+
 /*
  * Precaches all the sequences in a given set of flowers into the cache.
  */
@@ -96,6 +114,38 @@ void cactusDisk_clearStringCache(CactusDisk *cactusDisk);
  */
 void cactusDisk_clearCache(CactusDisk *cactusDisk);
 
+/*
+ * Counters for one of the caches of a cactus disk, for tuning the cache sizes.
+ * Sizes are in bytes.
+ */
+typedef struct {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t size;
+    int64_t maxSize;
+} CactusDiskCacheStats;
+
+/*
+ * The default byte budgets of the cache of DB responses and of the cache of sequences.
+ */
+#define CACTUS_DISK_RECORD_CACHE_SIZE 100000000
+#define CACTUS_DISK_STRING_CACHE_SIZE 100000000
+
+/*
+ * Sets the byte budgets of the cache of DB responses and of the cache of sequences.
+ * The least recently used entries are evicted once a cache is over its budget. The
+ * record cache size is ignored if the cactus disk was constructed without a cache.
+ */
+void cactusDisk_setCacheSizes(CactusDisk *cactusDisk, int64_t recordCacheSize, int64_t stringCacheSize);
+
+/*
+ * Gets the counters of the cache of DB responses and of the cache of sequences. The
+ * record cache counters are all zero if the cactus disk was constructed without a cache.
+ */
+void cactusDisk_getCacheStats(CactusDisk *cactusDisk, CactusDiskCacheStats *recordCacheStats,
+        CactusDiskCacheStats *stringCacheStats);
+
 /*
  * Get the event tree.
  */
@@ -36,6 +36,7 @@ typedef struct {
     CactusDisk *cactusDisk;
     Flower *curFlower;
     size_t nextIdx;
+    struct _flowerStreamPrefetcher *prefetcher;
 } FlowerStream;
 
 /*
@@ -49,6 +50,22 @@ typedef struct {
  */
 FlowerStream *flowerWriter_getFlowerStream(CactusDisk *cactusDisk, FILE *file);
 
+/*
+ * As flowerWriter_getFlowerStream, but if prefetch is true a background thread fetches
+ * and decompresses the records of the next batches of flowers while the current batch
+ * is processed. The flowers of the batch after the current one are loaded when the
+ * current batch is handed out, so that the thread can pre-cache their sequences (see
+ * cactusDisk_preCacheStrings) before they are needed; at most two batches of flowers are
+ * loaded at once. The batch size and the number of batches fetched ahead adapt to the
+ * size of the flower records.
+ *
+ * The tools do not use prefetching yet: sonLib keeps one exception stack for all threads, and
+ * the prefetch thread fetches through stTry blocks, as may the database, so an exception on one
+ * thread could unwind into a handler of the other. It should only be turned on once sonLib's
+ * exception handling is thread local.
+ */
+FlowerStream *flowerWriter_getFlowerStream2(CactusDisk *cactusDisk, FILE *file, bool prefetch);
+
 /*
  * Free a flowerStream.
  */
@@ -34,6 +34,7 @@ typedef struct _event Event;
 typedef struct _eventTree EventTree;
 typedef struct _metaSequence MetaSequence;
 typedef struct _sequence Sequence;
+typedef struct _sequenceView SequenceView;
 typedef struct _end End;
 typedef struct _cap Cap;
 typedef struct _segment Segment;
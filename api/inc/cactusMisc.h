@@ -69,4 +69,10 @@ void cactusCheck(bool condition);
  */
 void cactusCheck2(bool condition, char *string, ...);
 
+/*
+ * A finish function for stThreadPool_construct that does nothing, for pools whose results are
+ * collected in order once the pool has been drained.
+ */
+void cactusMisc_ignoreThreadPoolResult(void *result);
+
 #endif
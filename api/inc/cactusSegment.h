@@ -90,6 +90,12 @@ Sequence *segment_getSequence(Segment *segment);
  */
 char *segment_getString(Segment *segment);
 
+/*
+ * As segment_getString, but returns a view of the string of the segment, see sequence_getView.
+ * The bases of the view are NULL if the coordinates are not set.
+ */
+SequenceView segment_getView(Segment *segment);
+
 /*
  * Gets the left cap of the segment.
  */
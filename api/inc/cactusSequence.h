@@ -62,6 +62,49 @@ Event *sequence_getEvent(Sequence *sequence);
  */
 char *sequence_getString(Sequence *sequence, int64_t start, int64_t length, bool strand);
 
+/*
+ * A view of a substring of a sequence on either strand. The bases are those of the positive
+ * strand, and are not zero terminated. If the strand is negative the substring is their reverse
+ * complement, so its i-th base is the complement of bases[length - 1 - i].
+ */
+struct _sequenceView {
+    const char *bases;
+    int64_t length;
+    bool strand;
+};
+
+/*
+ * As sequence_getString, but returns a view of the substring rather than a copy. The bases are
+ * loaded into a cache held by the sequence the first time they are viewed, and the view is
+ * valid until sequence_releaseViews or sequence_clearViewCache is called, or the sequence is
+ * destructed.
+ */
+SequenceView sequence_getView(Sequence *sequence, int64_t start, int64_t length, bool strand);
+
+/*
+ * Declares the views of the sequence taken so far are no longer used. Frees the cached bases
+ * that later views can no longer be taken from, those merged into larger runs of bases, but keeps
+ * the rest cached for later views.
+ */
+void sequence_releaseViews(Sequence *sequence);
+
+/*
+ * Frees all the bases cached for the views of the sequence, which invalidates its views. Later
+ * views reload the bases.
+ */
+void sequence_clearViewCache(Sequence *sequence);
+
+/*
+ * Gets the i-th base of the view, complemented if the view is of the negative strand.
+ */
+char sequenceView_getBase(const SequenceView *view, int64_t i);
+
+/*
+ * Writes the bases of the view to the string, in the orientation of the view and followed by a
+ * zero byte, so the string must have room for the length of the view plus one.
+ */
+void sequenceView_copyString(const SequenceView *view, char *string);
+
 /*
  * Gets the header line associated with the sequence.
  */
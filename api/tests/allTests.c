@@ -24,6 +24,9 @@ CuSuite *cactusFaceEndTestSuite();
 CuSuite *cactusSequenceTestSuite();
 CuSuite *cactusSerialisationTestSuite();
 CuSuite *cactusFlowerWriterTestSuite();
+CuSuite *cactusCacheTestSuite();
+CuSuite *cactusSlabTestSuite();
+CuSuite *cactusNameIndexTestSuite();
 
 
 int cactusAPIRunAllTests(void) {
@@ -47,6 +50,9 @@ int cactusAPIRunAllTests(void) {
 	CuSuiteAddSuite(suite, cactusSequenceTestSuite());
 	CuSuiteAddSuite(suite, cactusSerialisationTestSuite());
 	CuSuiteAddSuite(suite, cactusFlowerWriterTestSuite());
+	CuSuiteAddSuite(suite, cactusCacheTestSuite());
+	CuSuiteAddSuite(suite, cactusSlabTestSuite());
+	CuSuiteAddSuite(suite, cactusNameIndexTestSuite());
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
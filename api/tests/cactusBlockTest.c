@@ -264,8 +264,7 @@ void testBlock_serialisation(CuTest* testCase) {
     void
             *vA =
                     binaryRepresentation_makeBinaryRepresentation(block,
-                            (void(*)(void *, void(*)(const void *, size_t,
-                                    size_t))) block_writeBinaryRepresentation,
+                            (void (*)(void *, BinaryRepresentationWriter *)) block_writeBinaryRepresentation,
                             &i);
     CuAssertTrue(testCase, i > 0);
     block_destruct(block);
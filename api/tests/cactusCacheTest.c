@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <pthread.h>
+
+static CactusCache *cache = NULL;
+
+static void cactusCacheTestTeardown() {
+    if (cache != NULL) {
+        cactusCache_destruct(cache);
+        cache = NULL;
+    }
+}
+
+static void cactusCacheTestSetup() {
+    cactusCacheTestTeardown();
+    cache = cactusCache_construct(100000000);
+}
+
+void testCactusCache_records(CuTest* testCase) {
+    cactusCacheTestSetup();
+    int64_t recordSize;
+    CuAssertTrue(testCase, !cactusCache_containsRecord(cache, 1));
+    CuAssertTrue(testCase, cactusCache_getRecord(cache, 1, &recordSize) == NULL);
+    cactusCache_setRecord(cache, 1, "hello", 5);
+    cactusCache_setRecord(cache, -5, "", 0);
+    CuAssertTrue(testCase, cactusCache_containsRecord(cache, 1));
+    CuAssertTrue(testCase, cactusCache_containsRecord(cache, -5));
+    char *record = cactusCache_getRecord(cache, 1, &recordSize);
+    CuAssertIntEquals(testCase, 5, recordSize);
+    CuAssertStrEquals(testCase, "hello", record);
+    free(record);
+    record = cactusCache_getRecord(cache, -5, &recordSize);
+    CuAssertIntEquals(testCase, 0, recordSize);
+    free(record);
+    //A shorter record replaces the whole of the old one
+    cactusCache_setRecord(cache, 1, "bye", 3);
+    record = cactusCache_getRecord(cache, 1, &recordSize);
+    CuAssertIntEquals(testCase, 3, recordSize);
+    CuAssertStrEquals(testCase, "bye", record);
+    free(record);
+    cactusCache_clear(cache);
+    CuAssertTrue(testCase, !cactusCache_containsRecord(cache, 1));
+    CactusDiskCacheStats stats;
+    cactusCache_getStats(cache, &stats);
+    CuAssertIntEquals(testCase, 3, stats.hits);
+    CuAssertIntEquals(testCase, 1, stats.misses);
+    CuAssertIntEquals(testCase, 0, stats.evictions);
+    CuAssertIntEquals(testCase, 0, stats.size);
+    cactusCacheTestTeardown();
+}
+
+void testCactusCache_substrings(CuTest* testCase) {
+    cactusCacheTestSetup();
+    const char *string = "ACGTACGTTTGGCCAANNNNacgtacgt";
+    cactusCache_setSubstring(cache, 7, 4, string + 4, 4);
+    cactusCache_setSubstring(cache, 7, 12, string + 12, 4);
+    CuAssertTrue(testCase, cactusCache_getSubstring(cache, 7, 0, 4) == NULL);
+    CuAssertTrue(testCase, cactusCache_getSubstring(cache, 7, 4, 5) == NULL);
+    char *substring = cactusCache_getSubstring(cache, 7, 5, 3);
+    CuAssertStrEquals(testCase, "CGT", substring);
+    free(substring);
+    //Abutting and overlapping substrings are merged
+    cactusCache_setSubstring(cache, 7, 8, string + 8, 4);
+    cactusCache_setSubstring(cache, 7, 14, string + 14, 10);
+    substring = cactusCache_getSubstring(cache, 7, 4, 20);
+    CuAssertTrue(testCase, substring != NULL);
+    CuAssertTrue(testCase, strncmp(string + 4, substring, 20) == 0);
+    free(substring);
+    CuAssertTrue(testCase, cactusCache_getSubstring(cache, 7, 4, 21) == NULL);
+    cactusCache_setSubstring(cache, 7, 0, string, strlen(string));
+    substring = cactusCache_getSubstring(cache, 7, 0, strlen(string));
+    CuAssertStrEquals(testCase, string, substring);
+    free(substring);
+    CuAssertTrue(testCase, cactusCache_getSubstring(cache, 8, 0, 1) == NULL);
+    cactusCacheTestTeardown();
+}
+
+void testCactusCache_eviction(CuTest* testCase) {
+    cactusCacheTestSetup();
+    char record[1000];
+    memset(record, 'A', 1000);
+    cactusCache_setMaxSize(cache, 1000000);
+    for (int64_t i = 0; i < 10000; i++) {
+        cactusCache_setRecord(cache, i, record, 1000);
+        //Keep using the first record, so it is never the least recently used
+        int64_t recordSize;
+        free(cactusCache_getRecord(cache, 0, &recordSize));
+    }
+    CactusDiskCacheStats stats;
+    cactusCache_getStats(cache, &stats);
+    CuAssertTrue(testCase, stats.size <= stats.maxSize);
+    CuAssertTrue(testCase, stats.evictions > 0);
+    CuAssertTrue(testCase, cactusCache_containsRecord(cache, 0));
+    CuAssertTrue(testCase, !cactusCache_containsRecord(cache, 1));
+    CuAssertTrue(testCase, cactusCache_containsRecord(cache, 9999));
+    //Shrinking the budget evicts down to the new budget
+    cactusCache_setMaxSize(cache, 0);
+    cactusCache_getStats(cache, &stats);
+    CuAssertIntEquals(testCase, 0, stats.size);
+    //A record bigger than the budget is still cached until something else is added to the cache
+    cactusCache_setRecord(cache, 1, record, 1000);
+    CuAssertTrue(testCase, cactusCache_containsRecord(cache, 1));
+    cactusCacheTestTeardown();
+}
+
+void testCactusCache_sharedBudget(CuTest* testCase) {
+    /*
+     * The substrings of one string all go to the same shard, but can still use the whole budget.
+     */
+    cactusCacheTestSetup();
+    char substring[1000];
+    memset(substring, 'A', 1000);
+    cactusCache_setMaxSize(cache, 2000000);
+    for (int64_t i = 0; i < 1000; i++) {
+        cactusCache_setSubstring(cache, 7, i * 2000, substring, 1000);
+    }
+    CactusDiskCacheStats stats;
+    cactusCache_getStats(cache, &stats);
+    CuAssertIntEquals(testCase, 0, stats.evictions);
+    CuAssertIntEquals(testCase, 2000000, stats.maxSize);
+    for (int64_t i = 0; i < 1000; i++) {
+        char *cached = cactusCache_getSubstring(cache, 7, i * 2000, 1000);
+        CuAssertTrue(testCase, cached != NULL);
+        free(cached);
+    }
+    //Filling the rest of the cache with records evicts the oldest substrings first
+    char record[1000];
+    memset(record, 'C', 1000);
+    for (int64_t i = 0; i < 2000; i++) {
+        cactusCache_setRecord(cache, i, record, 1000);
+    }
+    cactusCache_getStats(cache, &stats);
+    CuAssertTrue(testCase, stats.size <= stats.maxSize);
+    CuAssertTrue(testCase, stats.evictions > 0);
+    CuAssertTrue(testCase, cactusCache_getSubstring(cache, 7, 0, 1000) == NULL);
+    cactusCacheTestTeardown();
+}
+
+static void *cactusCacheTest_worker(void *arg) {
+    int64_t offset = *((int64_t *) arg);
+    for (int64_t i = 0; i < 10000; i++) {
+        int64_t key = offset + i % 1000, recordSize;
+        char *record = cactusCache_getRecord(cache, key, &recordSize);
+        if (record == NULL) {
+            cactusCache_setRecord(cache, key, &key, sizeof(int64_t));
+        } else {
+            assert(recordSize == sizeof(int64_t) && *((int64_t *) record) == key);
+            free(record);
+        }
+    }
+    return NULL;
+}
+
+void testCactusCache_threads(CuTest* testCase) {
+    cactusCacheTestSetup();
+    cactusCache_setMaxSize(cache, 50000);
+    pthread_t threads[4];
+    int64_t offsets[4];
+    for (int64_t i = 0; i < 4; i++) {
+        offsets[i] = i * 500;
+        pthread_create(&threads[i], NULL, cactusCacheTest_worker, &offsets[i]);
+    }
+    for (int64_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CactusDiskCacheStats stats;
+    cactusCache_getStats(cache, &stats);
+    CuAssertIntEquals(testCase, 40000, stats.hits + stats.misses);
+    CuAssertTrue(testCase, stats.size <= stats.maxSize);
+    cactusCacheTestTeardown();
+}
+
+CuSuite* cactusCacheTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusCache_records);
+    SUITE_ADD_TEST(suite, testCactusCache_substrings);
+    SUITE_ADD_TEST(suite, testCactusCache_eviction);
+    SUITE_ADD_TEST(suite, testCactusCache_sharedBudget);
+    SUITE_ADD_TEST(suite, testCactusCache_threads);
+    return suite;
+}
@@ -395,8 +395,7 @@ void testCap_serialisation(CuTest* testCase) {
     void
             *vA =
                     binaryRepresentation_makeBinaryRepresentation(leaf2Cap,
-                            (void(*)(void *, void(*)(const void *, size_t,
-                                    size_t))) cap_writeBinaryRepresentation, &i);
+                            (void (*)(void *, BinaryRepresentationWriter *)) cap_writeBinaryRepresentation, &i);
     CuAssertTrue(testCase, i > 0);
     cap_destruct(leaf2Cap);
     void *vA2 = vA;
@@ -104,8 +104,7 @@ void testChain_serialisation(CuTest* testCase) {
     void
             *vA =
                     binaryRepresentation_makeBinaryRepresentation(chain,
-                            (void(*)(void *, void(*)(const void *, size_t,
-                                    size_t))) chain_writeBinaryRepresentation,
+                            (void (*)(void *, BinaryRepresentationWriter *)) chain_writeBinaryRepresentation,
                             &i);
     CuAssertTrue(testCase, i> 0);
     chain_destruct(chain);
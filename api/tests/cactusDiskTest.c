@@ -58,6 +58,29 @@ void testCactusDisk_getFlower(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_writeWithThreads(CuTest* testCase) {
+    cactusDiskTestSetup();
+    cactusDisk_setWriteThreads(cactusDisk, 4);
+    stList *flowerNames = stList_construct3(0, free);
+    for (int64_t i = 0; i < 100; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        int64_t *name = st_malloc(sizeof(int64_t));
+        name[0] = flower_getName(flower);
+        stList_append(flowerNames, name);
+    }
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    stList *flowers = cactusDisk_getFlowers(cactusDisk, flowerNames);
+    CuAssertIntEquals(testCase, stList_length(flowerNames), stList_length(flowers));
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        CuAssertTrue(testCase, flower_getName(stList_get(flowers, i)) == *((int64_t *) stList_get(flowerNames, i)));
+    }
+    stList_destruct(flowers);
+    stList_destruct(flowerNames);
+    cactusDiskTestTeardown();
+}
+
 void testCactusDisk_getMetaSequence(CuTest* testCase) {
     cactusDiskTestSetup();
     MetaSequence *metaSequence = metaSequence_construct(1, 10, "ACTGACTGAG",
@@ -81,6 +104,77 @@ void testCactusDisk_getMetaSequence(CuTest* testCase) {
     cactusDiskTestTeardown();
 }
 
+void testCactusDisk_sequenceStore(CuTest* testCase) {
+    cactusDiskTestSetup();
+    int64_t i = system("rm -f temporarySequenceStore");
+    exitOnFailure(i, "Tried to delete the temporary sequence store\n");
+    cactusDisk_setSequenceStore(cactusDisk, "temporarySequenceStore");
+    const char *string = "ACGTNNNNacgtnnRYACGTTTGGCCAAgattaca";
+    int64_t length = strlen(string);
+    MetaSequence *metaSequence = metaSequence_construct(1, length, string, "FOO", 10, cactusDisk);
+    Name name = metaSequence_getName(metaSequence);
+    for (int64_t start = 0; start < length; start++) {
+        for (int64_t j = 0; start + j <= length; j++) {
+            char *subString = stString_getSubString(string, start, j);
+            char *storedString = metaSequence_getString(metaSequence, start + 1, j, 1);
+            CuAssertStrEquals(testCase, subString, storedString);
+            free(storedString);
+            char *reverseString = stString_reverseComplementString(subString);
+            storedString = metaSequence_getString(metaSequence, start + 1, j, 0);
+            CuAssertStrEquals(testCase, reverseString, storedString);
+            free(storedString);
+            free(reverseString);
+            free(subString);
+        }
+    }
+    //The store is reopened from the parameters when the cactus disk is reloaded
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    metaSequence = cactusDisk_getMetaSequence(cactusDisk, name);
+    char *storedString = metaSequence_getString(metaSequence, 1, length, 1);
+    CuAssertStrEquals(testCase, string, storedString);
+    free(storedString);
+    cactusDiskTestTeardown();
+    i = system("rm -f temporarySequenceStore");
+    exitOnFailure(i, "Tried to delete the temporary sequence store\n");
+}
+
+void testCactusDisk_sequenceStoreOpen(CuTest* testCase) {
+    //Opening an existing store fails if the file is missing or not a store, rather than creating it
+    int64_t i = system("rm -f temporarySequenceStore");
+    exitOnFailure(i, "Tried to delete the temporary sequence store\n");
+    const char *fileContents[] = { NULL, "", "CACTUSSQ", "Not a sequence store" };
+    for (int64_t j = 0; j < 4; j++) {
+        if (fileContents[j] != NULL) {
+            FILE *fileHandle = fopen("temporarySequenceStore", "w");
+            fputs(fileContents[j], fileHandle);
+            fclose(fileHandle);
+        }
+        bool threw = 0;
+        stTry {
+            cactusSequenceStore_destruct(cactusSequenceStore_open("temporarySequenceStore"));
+        } stCatch(except) {
+            threw = 1;
+            stExcept_free(except);
+        } stTryEnd
+        CuAssertTrue(testCase, threw);
+    }
+    i = system("rm -f temporarySequenceStore");
+    exitOnFailure(i, "Tried to delete the temporary sequence store\n");
+    //A store made by construct can be opened
+    CactusSequenceStore *sequenceStore = cactusSequenceStore_construct("temporarySequenceStore");
+    cactusSequenceStore_addString(sequenceStore, 1, "ACGTN");
+    cactusSequenceStore_destruct(sequenceStore);
+    sequenceStore = cactusSequenceStore_open("temporarySequenceStore");
+    char *string = cactusSequenceStore_getString(sequenceStore, 1, 0, 5, 1);
+    CuAssertStrEquals(testCase, "ACGTN", string);
+    free(string);
+    cactusSequenceStore_destruct(sequenceStore);
+    i = system("rm -f temporarySequenceStore");
+    exitOnFailure(i, "Tried to delete the temporary sequence store\n");
+}
+
 void testCactusDisk_getUniqueID(CuTest* testCase) {
     cactusDiskTestSetup();
     for (int64_t i = 0; i < 1000000; i++) { //Gets a billion ids, checks we are good.
@@ -138,7 +232,10 @@ CuSuite* cactusDiskTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testCactusDisk_write);
     SUITE_ADD_TEST(suite, testCactusDisk_getFlower);
+    SUITE_ADD_TEST(suite, testCactusDisk_writeWithThreads);
     SUITE_ADD_TEST(suite, testCactusDisk_getMetaSequence);
+    SUITE_ADD_TEST(suite, testCactusDisk_sequenceStore);
+    SUITE_ADD_TEST(suite, testCactusDisk_sequenceStoreOpen);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Unique);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_UniqueIntervals);
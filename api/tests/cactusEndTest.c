@@ -303,7 +303,7 @@ void testEnd_serialisation(CuTest* testCase) {
     Name leaf3InstanceName = cap_getName(leaf3Cap);
     int64_t i;
     void *vA = binaryRepresentation_makeBinaryRepresentation(end,
-            (void(*)(void *, void(*)(const void *, size_t, size_t))) end_writeBinaryRepresentation, &i);
+            (void (*)(void *, BinaryRepresentationWriter *)) end_writeBinaryRepresentation, &i);
     CuAssertTrue(testCase, i > 0);
     end_destruct(end);
     void *vA2 = vA;
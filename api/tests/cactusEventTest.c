@@ -228,7 +228,7 @@ void testEvent_serialisation(CuTest* testCase) {
 	cactusEventTestSetup();
 	int64_t i;
 	void *vA = binaryRepresentation_makeBinaryRepresentation(leafEvent1,
-			(void (*)(void *, void (*)(const void *, size_t, size_t)))event_writeBinaryRepresentation, &i);
+			(void (*)(void *, BinaryRepresentationWriter *))event_writeBinaryRepresentation, &i);
 	CuAssertTrue(testCase, i > 0);
 	event_destruct(leafEvent1);
 	void *vA2 = vA;
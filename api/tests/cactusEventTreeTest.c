@@ -161,7 +161,7 @@ void testEventTree_serialisation(CuTest* testCase) {
 	cactusEventTreeTestSetup();
 	int64_t i;
 	void *vA = binaryRepresentation_makeBinaryRepresentation(eventTree,
-			(void (*)(void *, void (*)(const void *, size_t, size_t)))eventTree_writeBinaryRepresentation, &i);
+			(void (*)(void *, BinaryRepresentationWriter *))eventTree_writeBinaryRepresentation, &i);
 	CuAssertTrue(testCase, i > 0);
 	eventTree_destruct(eventTree);
 	void *vA2 = vA;
@@ -53,6 +53,47 @@ static void testFlowerStream(CuTest *testCase) {
     testCommon_deleteTemporaryCactusDisk(cactusDisk);
 }
 
+static void testFlowerStream_prefetch(CuTest *testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    char *tempPath = getTempFile();
+    FILE *f = fopen(tempPath, "w");
+    int64_t flowerNumber = 500;
+    Name *flowerNames = st_malloc(sizeof(Name) * flowerNumber);
+    stList *flowers = stList_construct();
+    fprintf(f, "%" PRIi64, flowerNumber);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        flowerNames[i] = flower_getName(flower);
+        fprintf(f, " %" PRIi64, i == 0 ? flowerNames[i] : flowerNames[i] - flowerNames[i - 1]);
+        stList_append(flowers, flower);
+    }
+    fclose(f);
+    cactusDisk_write(cactusDisk);
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        flower_destruct(stList_get(flowers, i), false);
+    }
+    stList_destruct(flowers);
+
+    // Stream them back through the prefetch thread, checking the order is kept.
+    f = fopen(tempPath, "r");
+    FlowerStream *flowerStream = flowerWriter_getFlowerStream2(cactusDisk, f, true);
+    CuAssertIntEquals(testCase, flowerNumber, flowerStream_size(flowerStream));
+    int64_t i = 0;
+    Flower *flower;
+    while ((flower = flowerStream_getNext(flowerStream)) != NULL) {
+        CuAssertTrue(testCase, i < flowerNumber);
+        CuAssertIntEquals(testCase, flowerNames[i], flower_getName(flower));
+        i++;
+    }
+    CuAssertIntEquals(testCase, flowerNumber, i);
+    CuAssertIntEquals(testCase, 0, stSortedSet_size(cactusDisk->flowers));
+    flowerStream_destruct(flowerStream);
+    fclose(f);
+    free(flowerNames);
+    removeTempFile(tempPath);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
 static void testFlowerWriter(CuTest *testCase) {
     char *tempFile = "./flowerWriterTest.txt";
     FILE *fileHandle = fopen(tempFile, "w");
@@ -101,6 +142,7 @@ static void testFlowerWriter(CuTest *testCase) {
 CuSuite* cactusFlowerWriterTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testFlowerStream);
+    SUITE_ADD_TEST(suite, testFlowerStream_prefetch);
     SUITE_ADD_TEST(suite, testFlowerWriter);
     return suite;
 }
@@ -305,8 +305,7 @@ void testGroup_serialisation(CuTest* testCase) {
     void
             *vA =
                     binaryRepresentation_makeBinaryRepresentation(group,
-                            (void(*)(void *, void(*)(const void *, size_t,
-                                    size_t))) group_writeBinaryRepresentation,
+                            (void (*)(void *, BinaryRepresentationWriter *)) group_writeBinaryRepresentation,
                             &i);
     CuAssertTrue(testCase, i > 0);
     group_destruct(group);
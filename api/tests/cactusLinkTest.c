@@ -101,8 +101,7 @@ void testLink_serialisation(CuTest* testCase) {
     void
             *vA =
                     binaryRepresentation_makeBinaryRepresentation(link2,
-                            (void(*)(void *, void(*)(const void *, size_t,
-                                    size_t))) link_writeBinaryRepresentation,
+                            (void (*)(void *, BinaryRepresentationWriter *)) link_writeBinaryRepresentation,
                             &i);
     CuAssertTrue(testCase, i > 0);
     link_destruct(link2);
@@ -92,7 +92,7 @@ void testMetaSequence_serialisation(CuTest* testCase) {
 	Name name = metaSequence_getName(metaSequence);
 	CuAssertTrue(testCase, cactusDisk_getMetaSequence(cactusDisk, name) == metaSequence);
 	void *vA = binaryRepresentation_makeBinaryRepresentation(metaSequence,
-			(void (*)(void *, void (*)(const void *, size_t, size_t)))metaSequence_writeBinaryRepresentation, &i);
+			(void (*)(void *, BinaryRepresentationWriter *))metaSequence_writeBinaryRepresentation, &i);
 	CuAssertTrue(testCase, i > 0);
 	metaSequence_destruct(metaSequence);
 	CuAssertTrue(testCase, cactusDisk_getMetaSequence(cactusDisk, name) == NULL);
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+void testCactusNameIndex_empty(CuTest* testCase) {
+    CactusNameIndex *index = cactusNameIndex_construct();
+    CuAssertIntEquals(testCase, 0, cactusNameIndex_size(index));
+    CuAssertTrue(testCase, cactusNameIndex_search(index, 1) == NULL);
+    cactusNameIndex_destruct(index);
+}
+
+void testCactusNameIndex_random(CuTest* testCase) {
+    /*
+     * Compares the index with an array of the objects of each name under random insertions and
+     * removals, using a small range of names so there are many collisions and reinsertions.
+     */
+    for (int64_t test = 0; test < 100; test++) {
+        CactusNameIndex *index = cactusNameIndex_construct();
+        int64_t nameRange = st_randomInt(1, 1000), size = 0;
+        void **objects = st_calloc(nameRange, sizeof(void *));
+        for (int64_t i = 0; i < 2000; i++) {
+            Name name = st_randomInt(0, nameRange);
+            CuAssertPtrEquals(testCase, objects[name], cactusNameIndex_search(index, name));
+            if (objects[name] != NULL) {
+                cactusNameIndex_remove(index, name);
+                objects[name] = NULL;
+                size--;
+            } else {
+                objects[name] = (void *) (intptr_t) (name + 1);
+                cactusNameIndex_insert(index, name, objects[name]);
+                size++;
+            }
+            CuAssertIntEquals(testCase, size, cactusNameIndex_size(index));
+        }
+        for (Name name = 0; name < nameRange; name++) {
+            CuAssertPtrEquals(testCase, objects[name], cactusNameIndex_search(index, name));
+        }
+        CuAssertTrue(testCase, cactusNameIndex_search(index, nameRange) == NULL);
+        free(objects);
+        cactusNameIndex_destruct(index);
+    }
+}
+
+CuSuite* cactusNameIndexTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusNameIndex_empty);
+    SUITE_ADD_TEST(suite, testCactusNameIndex_random);
+    return suite;
+}
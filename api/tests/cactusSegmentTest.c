@@ -194,6 +194,23 @@ void testSegment_getString(CuTest* testCase) {
     testSegment_getStringP(testCase, 1);
 }
 
+void testSegment_getView(CuTest* testCase) {
+	cactusSegmentTestSetup();
+	CuAssertTrue(testCase, segment_getView(rootSegment).bases == NULL);
+	Segment *segments[] = { leaf1Segment, segment_getReverse(leaf1Segment), leaf2Segment, segment_getReverse(leaf2Segment) };
+	for(int64_t i=0; i<4; i++) {
+		SequenceView view = segment_getView(segments[i]);
+		CuAssertIntEquals(testCase, segment_getStrand(segments[i]), view.strand);
+		char *string = segment_getString(segments[i]);
+		char *viewString = st_malloc(view.length + 1);
+		sequenceView_copyString(&view, viewString);
+		CuAssertStrEquals(testCase, string, viewString);
+		free(string);
+		free(viewString);
+	}
+	cactusSegmentTestTeardown();
+}
+
 void testSegment_getStringWithPrecaching(CuTest* testCase) {
     testSegment_getStringP(testCase, 0);
 }
@@ -265,7 +282,7 @@ void testSegment_serialisation(CuTest* testCase) {
 	cactusSegmentTestSetup();
 	int64_t i;
 	void *vA = binaryRepresentation_makeBinaryRepresentation(leaf1Segment,
-			(void (*)(void *, void (*)(const void *, size_t, size_t)))segment_writeBinaryRepresentation, &i);
+			(void (*)(void *, BinaryRepresentationWriter *))segment_writeBinaryRepresentation, &i);
 	CuAssertTrue(testCase, i > 0);
 	segment_destruct(leaf1Segment);
 	void *vA2 = vA;
@@ -304,6 +321,7 @@ CuSuite* cactusSegmentTestSuite(void) {
 	SUITE_ADD_TEST(suite, testSegment_getSequence);
 	SUITE_ADD_TEST(suite, testSegment_getString);
 	SUITE_ADD_TEST(suite, testSegment_getStringWithPrecaching);
+	SUITE_ADD_TEST(suite, testSegment_getView);
 	SUITE_ADD_TEST(suite, testSegment_get5And3End);
 	SUITE_ADD_TEST(suite, testSegment_getParent);
 	SUITE_ADD_TEST(suite, testSegment_getChildNumber);
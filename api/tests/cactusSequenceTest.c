@@ -96,6 +96,115 @@ void testSequence_getString(CuTest* testCase) {
 	cactusSequenceTestTeardown();
 }
 
+static void checkView(CuTest *testCase, const char *string, SequenceView *view) {
+	char *viewString = st_malloc(view->length + 1);
+	sequenceView_copyString(view, viewString);
+	CuAssertStrEquals(testCase, string, viewString);
+	for(int64_t i=0; i<view->length; i++) {
+		CuAssertIntEquals(testCase, string[i], sequenceView_getBase(view, i));
+	}
+	free(viewString);
+}
+
+void testSequence_getView(CuTest* testCase) {
+	cactusSequenceTestSetup();
+	for(int64_t i=1; i<11; i++) {
+		for(int64_t j=11-i; j>=0; j--) {
+			for(int64_t strand=0; strand<2; strand++) {
+				char *string = metaSequence_getString(metaSequence, i, j, strand);
+				SequenceView view = sequence_getView(sequence, i, j, strand);
+				CuAssertIntEquals(testCase, j, view.length);
+				CuAssertIntEquals(testCase, strand, view.strand);
+				checkView(testCase, string, &view);
+				free(string);
+			}
+		}
+	}
+	cactusSequenceTestTeardown();
+}
+
+void testSequence_getView_random(CuTest* testCase) {
+	/*
+	 * Takes many views of a long sequence, so that its cached bases are loaded in several chunks that
+	 * are then merged, and checks the views are all still valid at the end.
+	 */
+	cactusSequenceTestSetup();
+	int64_t length = 100000;
+	char *string = stRandom_getRandomDNAString(length, true, true, true);
+	MetaSequence *metaSequence2 = metaSequence_construct(1, length, string, ">two", event_getName(event), cactusDisk);
+	Sequence *sequence2 = sequence_construct(metaSequence2, flower);
+	stList *views = stList_construct3(0, free);
+	stList *strings = stList_construct3(0, free);
+	for(int64_t i=0; i<1000; i++) {
+		int64_t viewLength = st_random() > 0.9 ? st_randomInt(0, 20000) : st_randomInt(0, 100);
+		int64_t start = st_randomInt(0, length - viewLength + 1);
+		bool strand = st_random() > 0.5;
+		SequenceView *view = st_malloc(sizeof(SequenceView));
+		*view = sequence_getView(sequence2, start + 1, viewLength, strand);
+		stList_append(views, view);
+		char *subString = stString_getSubString(string, start, viewLength);
+		if(!strand) {
+			char *subString2 = stString_reverseComplementString(subString);
+			free(subString);
+			subString = subString2;
+		}
+		stList_append(strings, subString);
+	}
+	for(int64_t i=0; i<stList_length(views); i++) {
+		checkView(testCase, stList_get(strings, i), stList_get(views, i));
+	}
+	stList_destruct(views);
+	stList_destruct(strings);
+	free(string);
+	cactusSequenceTestTeardown();
+}
+
+void testSequence_releaseViews(CuTest* testCase) {
+	/*
+	 * Takes rounds of views of a long sequence, checking each round's views before releasing them,
+	 * and clearing the cache every few rounds, so that views are taken from kept, merged and
+	 * reloaded chunks.
+	 */
+	cactusSequenceTestSetup();
+	int64_t length = 100000;
+	char *string = stRandom_getRandomDNAString(length, true, true, true);
+	MetaSequence *metaSequence2 = metaSequence_construct(1, length, string, ">two", event_getName(event), cactusDisk);
+	Sequence *sequence2 = sequence_construct(metaSequence2, flower);
+	for(int64_t round=0; round<20; round++) {
+		stList *views = stList_construct3(0, free);
+		stList *strings = stList_construct3(0, free);
+		for(int64_t i=0; i<100; i++) {
+			int64_t viewLength = st_random() > 0.9 ? st_randomInt(0, 20000) : st_randomInt(0, 100);
+			int64_t start = st_randomInt(0, length - viewLength + 1);
+			bool strand = st_random() > 0.5;
+			SequenceView *view = st_malloc(sizeof(SequenceView));
+			*view = sequence_getView(sequence2, start + 1, viewLength, strand);
+			stList_append(views, view);
+			char *subString = stString_getSubString(string, start, viewLength);
+			if(!strand) {
+				char *subString2 = stString_reverseComplementString(subString);
+				free(subString);
+				subString = subString2;
+			}
+			stList_append(strings, subString);
+		}
+		for(int64_t i=0; i<stList_length(views); i++) {
+			checkView(testCase, stList_get(strings, i), stList_get(views, i));
+		}
+		stList_destruct(views);
+		stList_destruct(strings);
+		if(round % 5 == 4) {
+			sequence_clearViewCache(sequence2);
+			CuAssertTrue(testCase, sequence2->viewChunks == NULL);
+		} else {
+			sequence_releaseViews(sequence2);
+			CuAssertTrue(testCase, sequence2->viewChunks == NULL || stList_length(sequence2->absorbedViewChunks) == 0);
+		}
+	}
+	free(string);
+	cactusSequenceTestTeardown();
+}
+
 static char *getRandomDNASequence(int64_t minSequenceLength, int64_t maxSequenceLength) {
     int64_t stringLength = st_randomInt(minSequenceLength, maxSequenceLength);
     char *string = st_malloc(sizeof(char) * (stringLength + 1));
@@ -239,7 +348,7 @@ void testSequence_serialisation(CuTest* testCase) {
 	cactusSequenceTestSetup();
 	int64_t i;
 	void *vA = binaryRepresentation_makeBinaryRepresentation(sequence,
-			(void (*)(void *, void (*)(const void *, size_t, size_t)))sequence_writeBinaryRepresentation, &i);
+			(void (*)(void *, BinaryRepresentationWriter *))sequence_writeBinaryRepresentation, &i);
 	CuAssertTrue(testCase, i > 0);
 	sequence_destruct(sequence);
 	void *vA2 = vA;
@@ -265,6 +374,9 @@ CuSuite* cactusSequenceTestSuite(void) {
 	SUITE_ADD_TEST(suite, testSequence_getName);
 	SUITE_ADD_TEST(suite, testSequence_getEvent);
 	SUITE_ADD_TEST(suite, testSequence_getString);
+	SUITE_ADD_TEST(suite, testSequence_getView);
+	SUITE_ADD_TEST(suite, testSequence_getView_random);
+	SUITE_ADD_TEST(suite, testSequence_releaseViews);
 	SUITE_ADD_TEST(suite, testSequence_addAndGetBigStrings);
 	SUITE_ADD_TEST(suite, testSequence_addAndGetBigStrings_preCacheSequences);
 	SUITE_ADD_TEST(suite, testSequence_addAndGetBigStrings_reopenCactusDisk);
@@ -6,26 +6,30 @@
 
 #include "cactusGlobalsPrivate.h"
 
-static char vA[1000];
-static char *vA3;
+static BinaryRepresentationWriter *writer = NULL;
+static void *record = NULL;
 
 static void cactusSerialisationTestSetup() {
-    vA3 = vA;
+    writer = binaryRepresentation_constructWriter(1); //Small, so that the buffer has to grow.
 }
 
-static void cactusSerialisationTestTeardown() {
+static void *cactusSerialisationTestGetRecord() {
+    int64_t recordSize;
+    record = binaryRepresentation_finishWriter(writer, &recordSize);
+    writer = NULL;
+    return record;
 }
 
-static void writeFn(const void * ptr, size_t size, size_t count) {
-    memcpy(vA3, ptr, size * count);
-    vA3 += size * count;
+static void cactusSerialisationTestTeardown() {
+    free(record);
+    record = NULL;
 }
 
 void testBinaryRepresentation_elementType(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
-    binaryRepresentation_writeElementType(CODE_ADJACENCY, writeFn);
-    binaryRepresentation_writeElementType(CODE_LINK, writeFn);
+    binaryRepresentation_writeElementType(CODE_ADJACENCY, writer);
+    binaryRepresentation_writeElementType(CODE_LINK, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertTrue(testCase, binaryRepresentation_peekNextElementType(vA2) == CODE_ADJACENCY);
     CuAssertTrue(testCase, binaryRepresentation_popNextElementType(&vA2) == CODE_ADJACENCY);
     CuAssertTrue(testCase, binaryRepresentation_peekNextElementType(vA2) == CODE_LINK);
@@ -35,9 +39,9 @@ void testBinaryRepresentation_elementType(CuTest* testCase) {
 
 void testBinaryRepresentation_string(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
-    binaryRepresentation_writeString("HELLO I AM A STRING", writeFn);
-    binaryRepresentation_writeString("GOOD_BYE", writeFn);
+    binaryRepresentation_writeString("HELLO I AM A STRING", writer);
+    binaryRepresentation_writeString("GOOD_BYE", writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertStrEquals(testCase, "HELLO I AM A STRING", binaryRepresentation_getString(&vA2));
     CuAssertStrEquals(testCase, "GOOD_BYE", binaryRepresentation_getStringStatic(&vA2));
     cactusSerialisationTestTeardown();
@@ -45,9 +49,9 @@ void testBinaryRepresentation_string(CuTest* testCase) {
 
 void testBinaryRepresentation_integer(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
-    binaryRepresentation_writeInteger(537869, writeFn);
-    binaryRepresentation_writeInteger(720032, writeFn);
+    binaryRepresentation_writeInteger(537869, writer);
+    binaryRepresentation_writeInteger(720032, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertIntEquals(testCase, 537869, binaryRepresentation_getInteger(&vA2));
     CuAssertIntEquals(testCase, 720032, binaryRepresentation_getInteger(&vA2));
     cactusSerialisationTestTeardown();
@@ -55,11 +59,11 @@ void testBinaryRepresentation_integer(CuTest* testCase) {
 
 void testBinaryRepresentation_64BitInteger(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
     int64_t i = 543829676894821452;
     int64_t j = 123456789876543234;
-    binaryRepresentation_writeInteger(i, writeFn);
-    binaryRepresentation_writeInteger(j, writeFn);
+    binaryRepresentation_writeInteger(i, writer);
+    binaryRepresentation_writeInteger(j, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertTrue(testCase, i == binaryRepresentation_getInteger(&vA2));
     CuAssertTrue(testCase, j == binaryRepresentation_getInteger(&vA2));
     cactusSerialisationTestTeardown();
@@ -67,11 +71,11 @@ void testBinaryRepresentation_64BitInteger(CuTest* testCase) {
 
 void testBinaryRepresentation_name(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
     Name name1 = 543829676894821452;
     Name name2 = 123456789876543234;
-    binaryRepresentation_writeName(name1, writeFn);
-    binaryRepresentation_writeName(name2, writeFn);
+    binaryRepresentation_writeName(name1, writer);
+    binaryRepresentation_writeName(name2, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertTrue(testCase, name1 == binaryRepresentation_getName(&vA2));
     CuAssertTrue(testCase, name2 == binaryRepresentation_getName(&vA2));
     cactusSerialisationTestTeardown();
@@ -79,11 +83,11 @@ void testBinaryRepresentation_name(CuTest* testCase) {
 
 void testBinaryRepresentation_float(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
     float i = 3.145678;
     float j = 2.714342;
-    binaryRepresentation_writeFloat(i, writeFn);
-    binaryRepresentation_writeFloat(j, writeFn);
+    binaryRepresentation_writeFloat(i, writer);
+    binaryRepresentation_writeFloat(j, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertTrue(testCase, i == binaryRepresentation_getFloat(&vA2));
     CuAssertTrue(testCase, j == binaryRepresentation_getFloat(&vA2));
     cactusSerialisationTestTeardown();
@@ -91,22 +95,21 @@ void testBinaryRepresentation_float(CuTest* testCase) {
 
 void testBinaryRepresentation_bool(CuTest* testCase) {
     cactusSerialisationTestSetup();
-    void *vA2 = vA;
     bool i = 0;
     bool j = 1;
-    binaryRepresentation_writeBool(i, writeFn);
-    binaryRepresentation_writeBool(j, writeFn);
+    binaryRepresentation_writeBool(i, writer);
+    binaryRepresentation_writeBool(j, writer);
+    void *vA2 = cactusSerialisationTestGetRecord();
     CuAssertTrue(testCase, i == binaryRepresentation_getBool(&vA2));
     CuAssertTrue(testCase, j == binaryRepresentation_getBool(&vA2));
     cactusSerialisationTestTeardown();
 }
 
-static void testBinaryRepresentation_fn(void *object, void(*writeFn)(const void * ptr, size_t size, size_t count)) {
-    binaryRepresentation_writeInteger(*(int64_t *) object, writeFn);
+static void testBinaryRepresentation_fn(void *object, BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeInteger(*(int64_t *) object, writer);
 }
 
 void testBinaryRepresentation_makeBinaryRepresentation(CuTest* testCase) {
-    cactusSerialisationTestSetup();
     int64_t i, j;
     i = 14314;
     void *vA = binaryRepresentation_makeBinaryRepresentation(&i, testBinaryRepresentation_fn, &j);
@@ -114,7 +117,80 @@ void testBinaryRepresentation_makeBinaryRepresentation(CuTest* testCase) {
     CuAssertTrue(testCase, j == sizeof(int64_t));
     CuAssertIntEquals(testCase, binaryRepresentation_getInteger(&vA2), i);
     free(vA);
-    cactusSerialisationTestTeardown();
+}
+
+static int64_t testBinaryRepresentation_values[] = { 0, 1, -1, 63, -64, 64, 127, 128, 16384, -16385, 543829676894821452,
+        -123456789876543234, INT64_MAX, INT64_MIN, NULL_NAME };
+static int64_t testBinaryRepresentation_valueNumber = sizeof(testBinaryRepresentation_values) / sizeof(int64_t);
+
+static void testBinaryRepresentation_varintFn(void *object, BinaryRepresentationWriter *writer) {
+    binaryRepresentation_writeVersionHeader(*(int64_t *) object, writer);
+    for (int64_t i = 0; i < testBinaryRepresentation_valueNumber; i++) {
+        binaryRepresentation_writeElementType(CODE_CAP, writer);
+        binaryRepresentation_writeInteger(testBinaryRepresentation_values[i], writer);
+        binaryRepresentation_writeName(testBinaryRepresentation_values[i], writer);
+        binaryRepresentation_writeCoordinate(testBinaryRepresentation_values[i], writer);
+        binaryRepresentation_writeBool(i % 2, writer);
+    }
+    //Runs of names and coordinates, as allocated by the cactus disk.
+    for (int64_t i = 0; i < 1000; i++) {
+        binaryRepresentation_writeName(1152921504606846976 + i, writer);
+        binaryRepresentation_writeCoordinate(100000000 + i * 7, writer);
+    }
+    binaryRepresentation_writeString("HELLO I AM A STRING", writer);
+}
+
+static void testBinaryRepresentation_checkVarintRecord(CuTest* testCase, void *vA, int64_t format) {
+    void *vA2 = vA;
+    CuAssertIntEquals(testCase, format, binaryRepresentation_beginRecord(&vA2));
+    for (int64_t i = 0; i < testBinaryRepresentation_valueNumber; i++) {
+        CuAssertTrue(testCase, binaryRepresentation_popNextElementType(&vA2) == CODE_CAP);
+        CuAssertTrue(testCase, binaryRepresentation_getInteger(&vA2) == testBinaryRepresentation_values[i]);
+        CuAssertTrue(testCase, binaryRepresentation_getName(&vA2) == testBinaryRepresentation_values[i]);
+        CuAssertTrue(testCase, binaryRepresentation_getCoordinate(&vA2) == testBinaryRepresentation_values[i]);
+        CuAssertTrue(testCase, binaryRepresentation_getBool(&vA2) == i % 2);
+    }
+    for (int64_t i = 0; i < 1000; i++) {
+        CuAssertTrue(testCase, binaryRepresentation_getName(&vA2) == 1152921504606846976 + i);
+        CuAssertTrue(testCase, binaryRepresentation_getCoordinate(&vA2) == 100000000 + i * 7);
+    }
+    CuAssertStrEquals(testCase, "HELLO I AM A STRING", binaryRepresentation_getStringStatic(&vA2));
+    binaryRepresentation_endRecord();
+}
+
+void testBinaryRepresentation_varint(CuTest* testCase) {
+    int64_t rawSize, varintSize;
+    int64_t format = BINARY_REPRESENTATION_FORMAT_RAW;
+    void *raw = binaryRepresentation_makeBinaryRepresentation(&format, testBinaryRepresentation_varintFn, &rawSize);
+    format = BINARY_REPRESENTATION_FORMAT_VARINT;
+    void *varint = binaryRepresentation_makeBinaryRepresentation(&format, testBinaryRepresentation_varintFn, &varintSize);
+    testBinaryRepresentation_checkVarintRecord(testCase, raw, BINARY_REPRESENTATION_FORMAT_RAW);
+    testBinaryRepresentation_checkVarintRecord(testCase, varint, BINARY_REPRESENTATION_FORMAT_VARINT);
+    CuAssertTrue(testCase, varintSize * 4 < rawSize);
+    free(raw);
+    free(varint);
+}
+
+void testBinaryRepresentation_nestedRecords(CuTest* testCase) {
+    int64_t i, j;
+    int64_t format = BINARY_REPRESENTATION_FORMAT_VARINT;
+    void *varint = binaryRepresentation_makeBinaryRepresentation(&format, testBinaryRepresentation_varintFn, &j);
+    i = 14314;
+    void *raw = binaryRepresentation_makeBinaryRepresentation(&i, testBinaryRepresentation_fn, &j);
+    //A record without a header, decoded while in the middle of a varint record, is read in the raw format.
+    void *vA2 = varint;
+    binaryRepresentation_beginRecord(&vA2);
+    CuAssertTrue(testCase, binaryRepresentation_popNextElementType(&vA2) == CODE_CAP);
+    CuAssertTrue(testCase, binaryRepresentation_getInteger(&vA2) == 0);
+    void *vA3 = raw;
+    CuAssertIntEquals(testCase, BINARY_REPRESENTATION_FORMAT_RAW, binaryRepresentation_beginRecord(&vA3));
+    CuAssertIntEquals(testCase, i, binaryRepresentation_getInteger(&vA3));
+    binaryRepresentation_endRecord();
+    CuAssertTrue(testCase, binaryRepresentation_getName(&vA2) == 0);
+    CuAssertTrue(testCase, binaryRepresentation_getCoordinate(&vA2) == 0);
+    binaryRepresentation_endRecord();
+    free(varint);
+    free(raw);
 }
 
 static void testBinaryRepresentation_resizeObjectAsPowerOf2(CuTest* testCase) {
@@ -138,6 +214,8 @@ CuSuite* cactusSerialisationTestSuite(void) {
     SUITE_ADD_TEST(suite, testBinaryRepresentation_float);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_bool);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_makeBinaryRepresentation);
+    SUITE_ADD_TEST(suite, testBinaryRepresentation_varint);
+    SUITE_ADD_TEST(suite, testBinaryRepresentation_nestedRecords);
     SUITE_ADD_TEST(suite, testBinaryRepresentation_resizeObjectAsPowerOf2);
     return suite;
 }
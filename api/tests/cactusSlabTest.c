@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2009-2011 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <time.h>
+
+static double getSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+void testCactusSlab_allocateAndFree(CuTest* testCase) {
+    int64_t objectSize = 40, objectNumber = 10000;
+    CactusSlabAllocator *allocator = cactusSlabAllocator_construct(objectSize);
+    CuAssertIntEquals(testCase, 0, cactusSlabAllocator_getSlabNumber(allocator));
+    stList *objects = stList_construct();
+    for (int64_t i = 0; i < objectNumber; i++) {
+        int64_t *object = cactusSlabAllocator_allocate(allocator);
+        memset(object, 0, objectSize);
+        object[0] = i;
+        stList_append(objects, object);
+    }
+    CuAssertTrue(testCase, cactusSlabAllocator_getSlabNumber(allocator) > 1);
+    CuAssertTrue(testCase, cactusSlabAllocator_getSlabNumber(allocator) < objectNumber * objectSize / CACTUS_SLAB_SIZE + 2);
+    //Objects do not overlap.
+    for (int64_t i = 0; i < objectNumber; i++) {
+        CuAssertIntEquals(testCase, i, ((int64_t *) stList_get(objects, i))[0]);
+    }
+    //Free every other object, then reallocate them.
+    for (int64_t i = 0; i < objectNumber; i += 2) {
+        cactusSlab_free(stList_get(objects, i));
+    }
+    int64_t slabNumber = cactusSlabAllocator_getSlabNumber(allocator);
+    for (int64_t i = 0; i < objectNumber; i += 2) {
+        int64_t *object = cactusSlabAllocator_allocate(allocator);
+        object[0] = i;
+        stList_set(objects, i, object);
+    }
+    CuAssertIntEquals(testCase, slabNumber, cactusSlabAllocator_getSlabNumber(allocator));
+    for (int64_t i = 0; i < objectNumber; i++) {
+        CuAssertIntEquals(testCase, i, ((int64_t *) stList_get(objects, i))[0]);
+    }
+    //Freeing everything releases all but one slab.
+    for (int64_t i = 0; i < objectNumber; i++) {
+        cactusSlab_free(stList_get(objects, i));
+    }
+    CuAssertIntEquals(testCase, 1, cactusSlabAllocator_getSlabNumber(allocator));
+    stList_destruct(objects);
+    cactusSlabAllocator_destruct(allocator);
+}
+
+void testCactusSlab_objectsOutliveAllocator(CuTest* testCase) {
+    CactusSlabAllocator *allocator = cactusSlabAllocator_construct(24);
+    stList *objects = stList_construct();
+    for (int64_t i = 0; i < 5000; i++) {
+        stList_append(objects, cactusSlabAllocator_allocate(allocator));
+    }
+    for (int64_t i = 0; i < 5000; i += 3) {
+        cactusSlab_free(stList_get(objects, i));
+    }
+    cactusSlabAllocator_destruct(allocator);
+    //The remaining objects can still be used and freed.
+    for (int64_t i = 0; i < 5000; i++) {
+        if (i % 3 != 0) {
+            memset(stList_get(objects, i), 1, 24);
+            cactusSlab_free(stList_get(objects, i));
+        }
+    }
+    stList_destruct(objects);
+    CuAssertTrue(testCase, 1);
+}
+
+void testCactusSlab_reversesAreAdjacent(CuTest* testCase) {
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    Event *rootEvent = eventTree_getRootEvent(flower_getEventTree(flower));
+    Block *block = block_construct(3, flower);
+    Segment *segment = segment_construct(block, rootEvent);
+    End *end = block_get5End(block);
+    Cap *cap = segment_get5Cap(segment);
+    CuAssertTrue(testCase, llabs((char *) block_getReverse(block) - (char *) block) < (int64_t) sizeof(BlockUnit));
+    CuAssertTrue(testCase, llabs((char *) end_getReverse(end) - (char *) end) < (int64_t) sizeof(EndUnit));
+    CuAssertTrue(testCase, llabs((char *) cap_getReverse(cap) - (char *) cap) < (int64_t) sizeof(CapUnit));
+    CuAssertTrue(testCase, llabs((char *) segment_getReverse(segment) - (char *) segment) < (int64_t) sizeof(SegmentUnit));
+    CuAssertIntEquals(testCase, 1, cactusSlabAllocator_getSlabNumber(flower_getBlockAllocator(flower)));
+    CuAssertIntEquals(testCase, 1, cactusSlabAllocator_getSlabNumber(flower_getSegmentAllocator(flower)));
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+void testCactusSlab_flowersShareSlabs(CuTest* testCase) {
+    int64_t flowerNumber = 100;
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Event *rootEvent = eventTree_getRootEvent(cactusDisk_getEventTree(cactusDisk));
+    stList *flowers = stList_construct();
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        Flower *flower = flower_construct(cactusDisk);
+        segment_construct(block_construct(1, flower), rootEvent);
+        CuAssertPtrEquals(testCase, cactusDisk_getBlockAllocator(cactusDisk), flower_getBlockAllocator(flower));
+        stList_append(flowers, flower);
+    }
+    //Small flowers are packed into the same slabs, rather than each having slabs of its own.
+    CuAssertTrue(testCase, cactusSlabAllocator_getSlabNumber(cactusDisk_getBlockAllocator(cactusDisk))
+            <= flowerNumber * (int64_t) sizeof(BlockUnit) / CACTUS_SLAB_SIZE + 1);
+    CuAssertTrue(testCase, cactusSlabAllocator_getSlabNumber(cactusDisk_getSegmentAllocator(cactusDisk))
+            <= flowerNumber * (int64_t) sizeof(SegmentUnit) / CACTUS_SLAB_SIZE + 1);
+    //Destroying the flowers releases all but one slab of each kind.
+    for (int64_t i = 0; i < flowerNumber; i++) {
+        flower_destruct(stList_get(flowers, i), 0);
+    }
+    CuAssertIntEquals(testCase, 1, cactusSlabAllocator_getSlabNumber(cactusDisk_getBlockAllocator(cactusDisk)));
+    CuAssertIntEquals(testCase, 1, cactusSlabAllocator_getSlabNumber(cactusDisk_getSegmentAllocator(cactusDisk)));
+    stList_destruct(flowers);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
+/*
+ * Times loading a flower with many blocks, iterating over its caps and segments and destroying it.
+ * Kept to unit test size; raise the numbers to use it as a benchmark.
+ */
+void testCactusSlab_timing(CuTest* testCase) {
+    int64_t sequenceNumber = 5, blockNumber = 2000, blockLength = 5;
+    stKVDatabaseConf *conf = testCommon_getTemporaryKVDatabaseConf();
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    Name flowerName = flower_getName(flower);
+    Event *rootEvent = eventTree_getRootEvent(flower_getEventTree(flower));
+    int64_t sequenceLength = blockNumber * (blockLength + 1);
+    char *string = stRandom_getRandomDNAString(sequenceLength, true, true, true);
+    stList *sequences = stList_construct();
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        char *header = stString_print("sequence%" PRIi64, i);
+        MetaSequence *metaSequence = metaSequence_construct(1, sequenceLength, string, header, event_getName(rootEvent),
+                cactusDisk);
+        stList_append(sequences, sequence_construct(metaSequence, flower));
+        free(header);
+    }
+    for (int64_t i = 0; i < blockNumber; i++) {
+        Block *block = block_construct(blockLength, flower);
+        for (int64_t j = 0; j < sequenceNumber; j++) {
+            segment_construct2(block, 1 + i * (blockLength + 1), 1, stList_get(sequences, j));
+        }
+    }
+    cactusDisk_write(cactusDisk);
+    cactusDisk_destruct(cactusDisk);
+
+    double startTime = getSeconds();
+    cactusDisk = cactusDisk_construct(conf, false, true);
+    flower = cactusDisk_getFlower(cactusDisk, flowerName);
+    double loadTime = getSeconds() - startTime;
+    CuAssertIntEquals(testCase, blockNumber, flower_getBlockNumber(flower));
+    CuAssertIntEquals(testCase, blockNumber * sequenceNumber, flower_getSegmentNumber(flower));
+
+    startTime = getSeconds();
+    int64_t totalCoordinate = 0, totalLength = 0;
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        totalCoordinate += cap_getCoordinate(cap_getReverse(cap));
+    }
+    flower_destructCapIterator(capIt);
+    Flower_SegmentIterator *segmentIt = flower_getSegmentIterator(flower);
+    Segment *segment;
+    while ((segment = flower_getNextSegment(segmentIt)) != NULL) {
+        totalLength += segment_getLength(segment) + block_getLength(segment_getBlock(segment_getReverse(segment)));
+    }
+    flower_destructSegmentIterator(segmentIt);
+    double iterateTime = getSeconds() - startTime;
+    CuAssertIntEquals(testCase, 2 * blockNumber * sequenceNumber * blockLength, totalLength);
+    CuAssertTrue(testCase, totalCoordinate > 0);
+
+    startTime = getSeconds();
+    flower_unload(flower);
+    double destructTime = getSeconds() - startTime;
+    st_logInfo("Loaded a flower of %" PRIi64 " segments in %f seconds, iterated over it in %f seconds and destroyed it in %f seconds\n",
+            blockNumber * sequenceNumber, loadTime, iterateTime, destructTime);
+
+    stList_destruct(sequences);
+    free(string);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    stKVDatabaseConf_destruct(conf);
+}
+
+CuSuite* cactusSlabTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusSlab_allocateAndFree);
+    SUITE_ADD_TEST(suite, testCactusSlab_objectsOutliveAllocator);
+    SUITE_ADD_TEST(suite, testCactusSlab_reversesAreAdjacent);
+    SUITE_ADD_TEST(suite, testCactusSlab_flowersShareSlabs);
+    SUITE_ADD_TEST(suite, testCactusSlab_timing);
+    return suite;
+}
@@ -55,7 +55,7 @@ void usage() {
 
     fprintf(stderr, "-D --precomputedAlignments : Precomputed end alignments.\n");
 
-    fprintf(stderr, "-E --endAlignmentsToPrecomputeOutputFile [fileName] : If this output file is provided then bar will read stdin first to parse the flower, then to parse the names of the end alignments to precompute. The results will be placed in this file.\n");
+    fprintf(stderr, "-E --endAlignmentsToPrecomputeOutputFile [fileName] : If this output file is provided then bar will read stdin first to parse the flower, then to parse the names of the end alignments to precompute. The results will be placed in this file, in the binary end alignment format.\n");
 
     fprintf(stderr,
             "-F --useProgressiveMerging : Use progressive merging instead of poset merging for constructing multiple sequence alignments.\n");
@@ -70,6 +70,12 @@ void usage() {
 
     fprintf(stderr, "-M --minimumCoverageToRescue : Unaligned segments must have at least this proportion of their bases covered by an outgroup to be rescued.\n");
 
+    fprintf(stderr, "-T --numThreads : (int >= 1) The number of threads used to compute the end alignments of a flower and to serialise the flowers written to the database.\n");
+
+    fprintf(stderr, "-U --recordCacheSize : (int >= 0) Bytes of database records to cache. Default %i.\n", CACTUS_DISK_RECORD_CACHE_SIZE);
+
+    fprintf(stderr, "-V --stringCacheSize : (int >= 0) Bytes of sequence to cache. Default %i.\n", CACTUS_DISK_STRING_CACHE_SIZE);
+
     fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
@@ -111,6 +117,9 @@ int main(int argc, char *argv[]) {
     char *ingroupCoverageFilePath = NULL;
     int64_t minimumSizeToRescue = 1;
     double minimumCoverageToRescue = 0.0;
+    int64_t numThreads = 1;
+    int64_t recordCacheSize = CACTUS_DISK_RECORD_CACHE_SIZE;
+    int64_t stringCacheSize = CACTUS_DISK_STRING_CACHE_SIZE;
 
     PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters_construct();
 
@@ -140,11 +149,14 @@ int main(int argc, char *argv[]) {
                         {"minimumSizeToRescue", required_argument, 0, 'K'},
                         {"minimumCoverageToRescue", required_argument, 0, 'M'},
                         { "minimumNumberOfSpecies", required_argument, 0, 'N' },
+                        { "numThreads", required_argument, 0, 'T' },
+                        { "recordCacheSize", required_argument, 0, 'U' },
+                        { "stringCacheSize", required_argument, 0, 'V' },
                         { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:b:hi:j:kl:o:p:q:r:t:u:wy:A:B:D:E:FGI:J:K:L:M:N:T:U:V:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -265,6 +277,24 @@ int main(int argc, char *argv[]) {
                     st_errAbort("Error parsing minimumNumberOfSpecies parameter");
                 }
                 break;
+            case 'T':
+                i = sscanf(optarg, "%" PRIi64, &numThreads);
+                if (i != 1 || numThreads < 1) {
+                    st_errAbort("Error parsing numThreads parameter");
+                }
+                break;
+            case 'U':
+                i = sscanf(optarg, "%" PRIi64, &recordCacheSize);
+                if (i != 1 || recordCacheSize < 0) {
+                    st_errAbort("Error parsing recordCacheSize parameter");
+                }
+                break;
+            case 'V':
+                i = sscanf(optarg, "%" PRIi64, &stringCacheSize);
+                if (i != 1 || stringCacheSize < 0) {
+                    st_errAbort("Error parsing stringCacheSize parameter");
+                }
+                break;
             default:
                 usage();
                 return 1;
@@ -278,6 +308,8 @@ int main(int argc, char *argv[]) {
      */
     stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true); //We precache the sequences
+    cactusDisk_setWriteThreads(cactusDisk, numThreads);
+    cactusDisk_setCacheSizes(cactusDisk, recordCacheSize, stringCacheSize);
     st_logInfo("Set up the flower disk\n");
 
     /*
@@ -320,7 +352,7 @@ int main(int argc, char *argv[]) {
             }
             stSortedSet *endAlignment = makeEndAlignment(sM, end, spanningTrees, maximumLength, useProgressiveMerging,
                             matchGamma, pairwiseAlignmentBandingParameters);
-            writeEndAlignmentToDisk(end, endAlignment, fileHandle);
+            writeEndAlignmentToBinaryFile(end, endAlignment, fileHandle);
             stSortedSet_destruct(endAlignment);
         }
         fclose(fileHandle);
@@ -372,7 +404,8 @@ int main(int argc, char *argv[]) {
             st_logInfo("Processing a flower\n");
 
             stSortedSet *alignedPairs = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
-                    useProgressiveMerging, matchGamma, pairwiseAlignmentBandingParameters, pruneOutStubAlignments);
+                    useProgressiveMerging, matchGamma, pairwiseAlignmentBandingParameters, pruneOutStubAlignments,
+                    numThreads);
             st_logInfo("Created the alignment: %" PRIi64 " pairs\n", stSortedSet_size(alignedPairs));
             stPinchIterator *pinchIterator = stPinchIterator_constructFromAlignedPairs(alignedPairs, getNextAlignedPairAlignment);
 
@@ -14,9 +14,9 @@
 #include "adjacencySequences.h"
 
 /*
- * Gets the raw sequence.
+ * Gets a view of the raw sequence.
  */
-static char *getAdjacencySequenceP(Cap *cap, int64_t maxLength) {
+static SequenceView getAdjacencySequenceP(Cap *cap, int64_t maxLength) {
     Sequence *sequence = cap_getSequence(cap);
     assert(sequence != NULL);
     Cap *cap2 = cap_getAdjacency(cap);
@@ -27,12 +27,12 @@ static char *getAdjacencySequenceP(Cap *cap, int64_t maxLength) {
         int64_t length = cap_getCoordinate(cap2) - cap_getCoordinate(cap) - 1;
         assert(length >= 0);
         assert(maxLength >= 0);
-        return sequence_getString(sequence, cap_getCoordinate(cap) + 1, length
+        return sequence_getView(sequence, cap_getCoordinate(cap) + 1, length
                 > maxLength ? maxLength : length, 1);
     } else {
         int64_t length = cap_getCoordinate(cap) - cap_getCoordinate(cap2) - 1;
         assert(length >= 0);
-        return sequence_getString(sequence,
+        return sequence_getView(sequence,
                 length > maxLength ? cap_getCoordinate(cap) - maxLength
                         : cap_getCoordinate(cap2) + 1,
                 length > maxLength ? maxLength : length, 0);
@@ -42,7 +42,9 @@ static char *getAdjacencySequenceP(Cap *cap, int64_t maxLength) {
 AdjacencySequence *adjacencySequence_construct(Cap *cap, int64_t maxLength) {
     AdjacencySequence *subSequence = (AdjacencySequence *) st_malloc(
             sizeof(AdjacencySequence));
-    subSequence->string = getAdjacencySequenceP(cap, maxLength);
+    SequenceView view = getAdjacencySequenceP(cap, maxLength);
+    subSequence->string = st_malloc(view.length + 1);
+    sequenceView_copyString(&view, subSequence->string);
     Cap *adjacentCap = cap_getAdjacency(cap);
     assert(adjacentCap != NULL);
     assert(!cap_getSide(cap));
@@ -50,7 +52,7 @@ AdjacencySequence *adjacencySequence_construct(Cap *cap, int64_t maxLength) {
     subSequence->subsequenceIdentifier = cap_getName(cap_getStrand(cap) ? cap : adjacentCap);
     subSequence->strand = cap_getStrand(cap);
     subSequence->start = cap_getCoordinate(cap) + (cap_getStrand(cap) ? 1 : -1);
-    subSequence->length = strlen(subSequence->string);
+    subSequence->length = view.length;
     subSequence->hasStubEnd = end_isFree(cap_getEnd(adjacentCap)) && end_isStubEnd(cap_getEnd(adjacentCap));
     return subSequence;
 }
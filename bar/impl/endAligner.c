@@ -4,6 +4,10 @@
  * Released under the MIT license, see LICENSE.txt
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "endAligner.h"
 #include "multipleAligner.h"
 #include "adjacencySequences.h"
@@ -52,16 +56,19 @@ int alignedPair_cmpFn(const AlignedPair *alignedPair1, const AlignedPair *aligne
     return i;
 }
 
-stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
-        bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
-    //Make an alignment of the sequences in the ends
+struct _endAlignmentInput {
+    stList *sequences; //The adjacency sequences to align.
+    stList *seqFrags; //The sequences as fragments for the multiple aligner.
+    int64_t *commonInstanceNumbers; //For each sequence, the number of sequences whose adjacency ends in the same end.
+};
 
+EndAlignmentInput *endAlignmentInput_construct(End *end, int64_t maxSequenceLength) {
     //Get the adjacency sequences to be aligned.
     Cap *cap;
     End_InstanceIterator *it = end_getInstanceIterator(end);
     stList *sequences = stList_construct3(0, (void (*)(void *))adjacencySequence_destruct);
     stList *seqFrags = stList_construct3(0, (void (*)(void *))seqFrag_destruct);
+    stList *otherEnds = stList_construct();
     stHash *endInstanceNumbers = stHash_construct2(NULL, free);
     while((cap = end_getNext(it)) != NULL) {
         if(cap_getSide(cap)) {
@@ -72,6 +79,7 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
         assert(cap_getAdjacency(cap) != NULL);
         End *otherEnd = end_getPositiveOrientation(cap_getEnd(cap_getAdjacency(cap)));
         stList_append(seqFrags, seqFrag_construct(adjacencySequence->string, 0, end_getName(otherEnd)));
+        stList_append(otherEnds, otherEnd);
         //Increase count of seqfrags with a given end.
         int64_t *c = stHash_search(endInstanceNumbers, otherEnd);
         if(c == NULL) {
@@ -83,6 +91,40 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     }
     end_destructInstanceIterator(it);
 
+    EndAlignmentInput *input = st_malloc(sizeof(EndAlignmentInput));
+    input->sequences = sequences;
+    input->seqFrags = seqFrags;
+    input->commonInstanceNumbers = st_malloc(stList_length(seqFrags) * sizeof(int64_t));
+    for(int64_t i=0; i<stList_length(seqFrags); i++) {
+        assert(stHash_search(endInstanceNumbers, stList_get(otherEnds, i)) != NULL);
+        input->commonInstanceNumbers[i] = *(int64_t *)stHash_search(endInstanceNumbers, stList_get(otherEnds, i));
+    }
+    stList_destruct(otherEnds);
+    stHash_destruct(endInstanceNumbers);
+    return input;
+}
+
+void endAlignmentInput_destruct(EndAlignmentInput *input) {
+    stList_destruct(input->seqFrags);
+    stList_destruct(input->sequences);
+    free(input->commonInstanceNumbers);
+    free(input);
+}
+
+int64_t endAlignmentInput_getTotalLength(EndAlignmentInput *input) {
+    int64_t totalLength = 0;
+    for(int64_t i=0; i<stList_length(input->sequences); i++) {
+        totalLength += ((AdjacencySequence *)stList_get(input->sequences, i))->length;
+    }
+    return totalLength;
+}
+
+stSortedSet *endAlignmentInput_align(EndAlignmentInput *input, StateMachine *sM, int64_t spanningTrees,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+    stList *sequences = input->sequences;
+    stList *seqFrags = input->seqFrags;
+
     //Get the alignment.
     MultipleAlignment *mA = makeAlignment(sM, seqFrags, spanningTrees, 100000000, useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
 
@@ -107,11 +149,7 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     double *scoreAdjustmentsNonCommonEnds = st_malloc(stList_length(seqFrags) * sizeof(double));
     double *scoreAdjustmentsCommonEnds = st_malloc(stList_length(seqFrags) * sizeof(double));
     for(int64_t i=0; i<stList_length(seqFrags); i++) {
-        SeqFrag *seqFrag = stList_get(seqFrags, i);
-        End *otherEnd = flower_getEnd(end_getFlower(end), seqFrag->rightEndId);
-        assert(otherEnd != NULL);
-        assert(stHash_search(endInstanceNumbers, otherEnd) != NULL);
-        int64_t commonInstanceNumber = *(int64_t *)stHash_search(endInstanceNumbers, otherEnd);
+        int64_t commonInstanceNumber = input->commonInstanceNumbers[i];
         int64_t nonCommonInstanceNumber = stList_length(seqFrags) - commonInstanceNumber;
 
         assert(commonInstanceNumber > 0 && nonCommonInstanceNumber >= 0);
@@ -177,18 +215,26 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
     }
 
     //Cleanup
-    stList_destruct(seqFrags);
-    stList_destruct(sequences);
     free(pairwiseAlignmentsPerSequenceNonCommonEnds);
     free(pairwiseAlignmentsPerSequenceCommonEnds);
     free(scoreAdjustmentsNonCommonEnds);
     free(scoreAdjustmentsCommonEnds);
     multipleAlignment_destruct(mA);
-    stHash_destruct(endInstanceNumbers);
 
     return sortedAlignment;
 }
 
+stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees, int64_t maxSequenceLength,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+    //Make an alignment of the sequences in the ends
+    EndAlignmentInput *input = endAlignmentInput_construct(end, maxSequenceLength);
+    stSortedSet *sortedAlignment = endAlignmentInput_align(input, sM, spanningTrees, useProgressiveMerging, gapGamma,
+            pairwiseAlignmentBandingParameters);
+    endAlignmentInput_destruct(input);
+    return sortedAlignment;
+}
+
 void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHandle) {
     fprintf(fileHandle, "%s %" PRIi64 "\n", cactusMisc_nameToStringStatic(end_getName(end)), stSortedSet_size(endAlignment));
     stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
@@ -239,3 +285,126 @@ stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **en
     return endAlignment;
 }
 
+/*
+ * Binary end alignment files: for each end alignment a header followed by a flat array of fixed width
+ * records, one per aligned pair, in alignedPair_cmpFn order. The file is memory mapped on loading,
+ * so the pairs are read without any parsing and inserted into the set in order.
+ */
+
+#define BINARY_END_ALIGNMENT_MAGIC "CACTUSEA"
+
+typedef struct _binaryEndAlignmentHeader {
+    char magic[8];
+    Name end;
+    int64_t pairNumber;
+} BinaryEndAlignmentHeader;
+
+typedef struct _binaryAlignedPair {
+    int64_t subsequenceIdentifier1, position1, score1;
+    int64_t subsequenceIdentifier2, position2, score2;
+    int64_t strands; //The first strand in the low bit, the second strand in the next bit.
+} BinaryAlignedPair;
+
+struct _binaryEndAlignmentFile {
+    char *fileName;
+    char *data;
+    size_t size;
+    size_t offset;
+};
+
+void writeEndAlignmentToBinaryFile(End *end, stSortedSet *endAlignment, FILE *fileHandle) {
+    BinaryEndAlignmentHeader header;
+    memcpy(header.magic, BINARY_END_ALIGNMENT_MAGIC, sizeof(header.magic));
+    header.end = end_getName(end);
+    header.pairNumber = stSortedSet_size(endAlignment);
+    bool failed = fwrite(&header, sizeof(BinaryEndAlignmentHeader), 1, fileHandle) != 1;
+    stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
+    AlignedPair *aP;
+    while(!failed && (aP = stSortedSet_getNext(it)) != NULL) {
+        BinaryAlignedPair binaryAlignedPair = { aP->subsequenceIdentifier, aP->position, aP->score,
+                aP->reverse->subsequenceIdentifier, aP->reverse->position, aP->reverse->score,
+                (aP->strand ? 1 : 0) | (aP->reverse->strand ? 2 : 0) };
+        failed = fwrite(&binaryAlignedPair, sizeof(BinaryAlignedPair), 1, fileHandle) != 1;
+    }
+    stSortedSet_destructIterator(it);
+    if(failed) {
+        st_errAbort("Error writing a binary end alignment\n");
+    }
+}
+
+bool isBinaryEndAlignmentFile(const char *fileName) {
+    FILE *fileHandle = fopen(fileName, "r");
+    if(fileHandle == NULL) {
+        st_errAbort("Could not open the end alignment file %s\n", fileName);
+    }
+    char magic[sizeof(BINARY_END_ALIGNMENT_MAGIC) - 1];
+    bool isBinary = fread(magic, sizeof(magic), 1, fileHandle) == 1
+            && memcmp(magic, BINARY_END_ALIGNMENT_MAGIC, sizeof(magic)) == 0;
+    fclose(fileHandle);
+    return isBinary;
+}
+
+BinaryEndAlignmentFile *binaryEndAlignmentFile_construct(const char *fileName) {
+    int fd = open(fileName, O_RDONLY);
+    struct stat fileStat;
+    if(fd < 0 || fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not open the binary end alignment file %s\n", fileName);
+    }
+    BinaryEndAlignmentFile *binaryFile = st_calloc(1, sizeof(BinaryEndAlignmentFile));
+    binaryFile->fileName = stString_copy(fileName);
+    binaryFile->size = fileStat.st_size;
+    if(binaryFile->size > 0) {
+        binaryFile->data = mmap(NULL, binaryFile->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(binaryFile->data == MAP_FAILED) {
+            st_errAbort("Could not memory map the binary end alignment file %s\n", fileName);
+        }
+        madvise(binaryFile->data, binaryFile->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return binaryFile;
+}
+
+void binaryEndAlignmentFile_destruct(BinaryEndAlignmentFile *binaryFile) {
+    if(binaryFile->size > 0) {
+        munmap(binaryFile->data, binaryFile->size);
+    }
+    free(binaryFile->fileName);
+    free(binaryFile);
+}
+
+stSortedSet *loadEndAlignmentFromBinaryFile(Flower *flower, BinaryEndAlignmentFile *binaryFile, End **end) {
+    if(binaryFile->offset == binaryFile->size) {
+        *end = NULL;
+        return NULL;
+    }
+    if(binaryFile->size - binaryFile->offset < sizeof(BinaryEndAlignmentHeader)) {
+        st_errAbort("The binary end alignment file %s is truncated\n", binaryFile->fileName);
+    }
+    BinaryEndAlignmentHeader *header = (BinaryEndAlignmentHeader *)(binaryFile->data + binaryFile->offset);
+    if(memcmp(header->magic, BINARY_END_ALIGNMENT_MAGIC, sizeof(header->magic)) != 0 || header->pairNumber < 0) {
+        st_errAbort("We encountered a mis-specified header in the binary end alignment file %s\n", binaryFile->fileName);
+    }
+    binaryFile->offset += sizeof(BinaryEndAlignmentHeader);
+    if((binaryFile->size - binaryFile->offset) / sizeof(BinaryAlignedPair) < header->pairNumber) {
+        st_errAbort("The binary end alignment file %s is truncated\n", binaryFile->fileName);
+    }
+    *end = flower_getEnd(flower, header->end);
+    if(*end == NULL) {
+        st_errAbort("We encountered an end name that is not in the database: %" PRIi64 "\n", header->end);
+    }
+    BinaryAlignedPair *binaryAlignedPairs = (BinaryAlignedPair *)(binaryFile->data + binaryFile->offset);
+    binaryFile->offset += header->pairNumber * sizeof(BinaryAlignedPair);
+    //The records are already in the order of the set, so each insert only walks the right spine of the tree.
+    stSortedSet *endAlignment =
+                stSortedSet_construct3((int (*)(const void *, const void *))alignedPair_cmpFn,
+                (void (*)(void *))alignedPair_destruct);
+    for(int64_t i=0; i<header->pairNumber; i++) {
+        BinaryAlignedPair *bAP = &binaryAlignedPairs[i];
+        stSortedSet_insert(endAlignment, alignedPair_construct(bAP->subsequenceIdentifier1, bAP->position1, bAP->strands & 1,
+                bAP->subsequenceIdentifier2, bAP->position2, (bAP->strands >> 1) & 1, bAP->score1, bAP->score2));
+    }
+    if(stSortedSet_size(endAlignment) != header->pairNumber) {
+        st_errAbort("The binary end alignment file %s contains duplicate aligned pairs\n", binaryFile->fileName);
+    }
+    return endAlignment;
+}
@@ -521,16 +521,108 @@ static stSortedSet *getEndsToAlign(Flower *flower, int64_t maxSequenceLength) {
  * then call the makeFlowerAlignment2 consistency generating function.
  */
 
+typedef struct _endAlignmentTask {
+    EndAlignmentInput *input;
+    int64_t totalLength;
+    stSortedSet *endAlignment;
+    //Shared, read only alignment parameters
+    StateMachine *sM;
+    int64_t spanningTrees;
+    bool useProgressiveMerging;
+    float gapGamma;
+    PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters;
+} EndAlignmentTask;
+
+static int endAlignmentTask_cmpByDecreasingLength(const void *a, const void *b) {
+    const EndAlignmentTask *task1 = a, *task2 = b;
+    return task1->totalLength > task2->totalLength ? -1 : (task1->totalLength < task2->totalLength ? 1 : 0);
+}
+
+static void *alignEndAlignmentTask(EndAlignmentTask *task) {
+    task->endAlignment = endAlignmentInput_align(task->input, task->sM, task->spanningTrees,
+            task->useProgressiveMerging, task->gapGamma, task->pairwiseAlignmentBandingParameters);
+    //The input holds no cactus objects, so it can be released here, as soon as it is aligned.
+    endAlignmentInput_destruct(task->input);
+    task->input = NULL;
+    return task;
+}
+
+static void computeMissingEndAlignmentsInParallel(StateMachine *sM, Flower *flower, stHash *endAlignments,
+        stSortedSet *endsToAlign, int64_t spanningTrees, int64_t maxSequenceLength, bool useProgressiveMerging,
+        float gapGamma, PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, int64_t numThreads) {
+    /*
+     * Computes the end alignments with a pool of threads. The sequences of each end are gathered
+     * first, as the cactus API is not thread safe, then the ends are handed to the pool largest
+     * first (by total sequence length), so that a single big end is started early rather than
+     * holding back the flower at the end. The alignments are added to the hash in the order of the
+     * ends, so the result does not depend on the number of threads.
+     */
+    stList *ends = stList_construct();
+    stList *tasks = stList_construct3(0, free);
+    End *end;
+    Flower_EndIterator *endIterator = flower_getEndIterator(flower);
+    while ((end = flower_getNextEnd(endIterator)) != NULL) {
+        if (stHash_search(endAlignments, end) == NULL && stSortedSet_search(endsToAlign, end) != NULL) {
+            EndAlignmentTask *task = st_malloc(sizeof(EndAlignmentTask));
+            task->input = endAlignmentInput_construct(end, maxSequenceLength);
+            task->totalLength = endAlignmentInput_getTotalLength(task->input);
+            task->endAlignment = NULL;
+            task->sM = sM;
+            task->spanningTrees = spanningTrees;
+            task->useProgressiveMerging = useProgressiveMerging;
+            task->gapGamma = gapGamma;
+            task->pairwiseAlignmentBandingParameters = pairwiseAlignmentBandingParameters;
+            stList_append(tasks, task);
+        }
+        stList_append(ends, end);
+    }
+    flower_destructEndIterator(endIterator);
+
+    if (stList_length(tasks) > 0) { //A pool needs at least one thread, so skip it if every end is already aligned
+        stList *tasksBySize = stList_copy(tasks, NULL);
+        stList_sort(tasksBySize, endAlignmentTask_cmpByDecreasingLength);
+        stThreadPool *threadPool = stThreadPool_construct(numThreads < stList_length(tasks) ? numThreads : stList_length(tasks),
+                (void *(*)(void *)) alignEndAlignmentTask, cactusMisc_ignoreThreadPoolResult);
+        for (int64_t i = 0; i < stList_length(tasksBySize); i++) {
+            stThreadPool_push(threadPool, stList_get(tasksBySize, i));
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+        stList_destruct(tasksBySize);
+    }
+
+    //Merge the alignments into the hash, in the order of the ends.
+    int64_t taskIndex = 0;
+    for (int64_t i = 0; i < stList_length(ends); i++) {
+        end = stList_get(ends, i);
+        if (stHash_search(endAlignments, end) == NULL && stSortedSet_search(endsToAlign, end) != NULL) {
+            EndAlignmentTask *task = stList_get(tasks, taskIndex++);
+            assert(task->endAlignment != NULL && task->input == NULL);
+            stHash_insert(endAlignments, end, task->endAlignment);
+        }
+    }
+    assert(taskIndex == stList_length(tasks));
+    stList_destruct(tasks);
+    stList_destruct(ends);
+}
+
 static void computeMissingEndAlignments(StateMachine *sM, Flower *flower, stHash *endAlignments, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters) {
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, int64_t numThreads) {
     /*
      * Creates end alignments for the ends that
      * do not have an alignment in the "endAlignments" hash, only creating
      * non-trivial end alignments for those specified by "getEndsToAlign".
+     *
+     * If numThreads > 1 the end alignments are computed by a pool of threads, otherwise
+     * they are computed one at a time, holding the sequences of only one end in memory.
      */
     //Make the end alignments, representing each as an adjacency alignment.
     stSortedSet *endsToAlign = getEndsToAlign(flower, maxSequenceLength);
+    if (numThreads > 1 && stSortedSet_size(endsToAlign) > 1) {
+        computeMissingEndAlignmentsInParallel(sM, flower, endAlignments, endsToAlign, spanningTrees, maxSequenceLength,
+                useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters, numThreads);
+    }
     End *end;
     Flower_EndIterator *endIterator = flower_getEndIterator(flower);
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
@@ -549,6 +641,14 @@ static void computeMissingEndAlignments(StateMachine *sM, Flower *flower, stHash
     }
     flower_destructEndIterator(endIterator);
     stSortedSet_destruct(endsToAlign);
+
+    //The adjacency sequences are copied out of the views, so the bases cached for them can go.
+    Flower_SequenceIterator *sequenceIterator = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    while ((sequence = flower_getNextSequence(sequenceIterator)) != NULL) {
+        sequence_clearViewCache(sequence);
+    }
+    flower_destructSequenceIterator(sequenceIterator);
 }
 
 stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spanningTrees, int64_t maxSequenceLength,
@@ -556,35 +656,46 @@ stSortedSet *makeFlowerAlignment(StateMachine *sM, Flower *flower, int64_t spann
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
     stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
     computeMissingEndAlignments(sM, flower, endAlignments, spanningTrees, maxSequenceLength,
-            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters, 1);
     return makeFlowerAlignment2(flower, endAlignments, pruneOutStubAlignments);
 }
 
 static void loadEndAlignments(Flower *flower, stHash *endAlignments, stList *listOfEndAlignments) {
     /*
      * Load alignments from given list of files and add them to the "endAlignments" hash.
+     * The files may be in either the text or the binary end alignment format.
      */
     for (int64_t i = 0; i < stList_length(listOfEndAlignments); i++) {
         End *end;
-        FILE *fileHandle = fopen(stList_get(listOfEndAlignments, i), "r");
         stSortedSet *alignment;
-        while((alignment = loadEndAlignmentFromDisk(flower, fileHandle, &end)) != NULL) {
-            assert(stHash_search(endAlignments, end) == NULL);
-            stHash_insert(endAlignments, end, alignment);
+        if (isBinaryEndAlignmentFile(stList_get(listOfEndAlignments, i))) {
+            BinaryEndAlignmentFile *binaryFile = binaryEndAlignmentFile_construct(stList_get(listOfEndAlignments, i));
+            while((alignment = loadEndAlignmentFromBinaryFile(flower, binaryFile, &end)) != NULL) {
+                assert(stHash_search(endAlignments, end) == NULL);
+                stHash_insert(endAlignments, end, alignment);
+            }
+            binaryEndAlignmentFile_destruct(binaryFile);
+        } else {
+            FILE *fileHandle = fopen(stList_get(listOfEndAlignments, i), "r");
+            while((alignment = loadEndAlignmentFromDisk(flower, fileHandle, &end)) != NULL) {
+                assert(stHash_search(endAlignments, end) == NULL);
+                stHash_insert(endAlignments, end, alignment);
+            }
+            fclose(fileHandle);
         }
-        fclose(fileHandle);
     }
 }
 
 stSortedSet *makeFlowerAlignment3(StateMachine *sM, Flower *flower, stList *listOfEndAlignmentFiles, int64_t spanningTrees,
         int64_t maxSequenceLength, bool useProgressiveMerging, float gapGamma,
-        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments) {
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters, bool pruneOutStubAlignments,
+        int64_t numThreads) {
     stHash *endAlignments = stHash_construct2(NULL, (void(*)(void *)) stSortedSet_destruct);
     if(listOfEndAlignmentFiles != NULL) {
         loadEndAlignments(flower, endAlignments, listOfEndAlignmentFiles);
     }
     computeMissingEndAlignments(sM, flower, endAlignments, spanningTrees, maxSequenceLength,
-            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters);
+            useProgressiveMerging, gapGamma, pairwiseAlignmentBandingParameters, numThreads);
     return makeFlowerAlignment2(flower, endAlignments, pruneOutStubAlignments);
 }
 
@@ -51,6 +51,33 @@ stSortedSet *makeEndAlignment(StateMachine *sM, End *end, int64_t spanningTrees,
         bool useProgressiveMerging, float gapGamma,
         PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
 
+/*
+ * The sequences of an end, gathered from the cactus API, ready to be aligned. Building the input
+ * must be done on the thread that owns the flower, as the cactus API is not thread safe, but aligning
+ * it (endAlignmentInput_align) touches no cactus objects, so inputs can be aligned concurrently.
+ */
+typedef struct _endAlignmentInput EndAlignmentInput;
+
+/*
+ * Gathers the adjacency sequences of the end, truncated to maxSequenceLength.
+ */
+EndAlignmentInput *endAlignmentInput_construct(End *end, int64_t maxSequenceLength);
+
+void endAlignmentInput_destruct(EndAlignmentInput *input);
+
+/*
+ * Total length of the sequences to be aligned.
+ */
+int64_t endAlignmentInput_getTotalLength(EndAlignmentInput *input);
+
+/*
+ * Aligns the sequences of the input, as makeEndAlignment. Safe to call from several threads at once on
+ * different inputs.
+ */
+stSortedSet *endAlignmentInput_align(EndAlignmentInput *input, StateMachine *sM, int64_t spanningTrees,
+        bool useProgressiveMerging, float gapGamma,
+        PairwiseAlignmentParameters *pairwiseAlignmentBandingParameters);
+
 /*
  * Writes an end alignment to the given file.
  */
@@ -61,5 +88,36 @@ void writeEndAlignmentToDisk(End *end, stSortedSet *endAlignment, FILE *fileHand
  */
 stSortedSet *loadEndAlignmentFromDisk(Flower *flower, FILE *fileHandle, End **end);
 
+/*
+ * Binary end alignment files, a faster alternative to the text format above for big end alignments.
+ * The aligned pairs are stored as fixed width records, already in alignedPair_cmpFn order, and the
+ * file is memory mapped when loaded.
+ */
+typedef struct _binaryEndAlignmentFile BinaryEndAlignmentFile;
+
+/*
+ * Writes an end alignment to the given file in the binary format. Several end alignments
+ * can be written to the same file.
+ */
+void writeEndAlignmentToBinaryFile(End *end, stSortedSet *endAlignment, FILE *fileHandle);
+
+/*
+ * Returns non-zero if the file starts with a binary end alignment, rather than a text one.
+ */
+bool isBinaryEndAlignmentFile(const char *fileName);
+
+/*
+ * Memory maps a binary end alignment file.
+ */
+BinaryEndAlignmentFile *binaryEndAlignmentFile_construct(const char *fileName);
+
+void binaryEndAlignmentFile_destruct(BinaryEndAlignmentFile *binaryFile);
+
+/*
+ * Loads the next end alignment from the binary file, returning NULL (and setting end to NULL)
+ * when there are no more.
+ */
+stSortedSet *loadEndAlignmentFromBinaryFile(Flower *flower, BinaryEndAlignmentFile *binaryFile, End **end);
+
 
 #endif /* ENDALIGNER_H_ */
@@ -149,10 +149,53 @@ static void testReadAndWriteEndAlignments(CuTest *testCase) {
     teardown();
 }
 
+static void testReadAndWriteBinaryEndAlignments(CuTest *testCase) {
+    setup();
+    End *ends[3] = { end1, end2, end3 };
+    int64_t maxLength = 4;
+    char *temporaryEndAlignmentFile = "temporaryEndAlignmentFile.bin";
+    stList *endAlignments = stList_construct3(0, (void (*)(void *))stSortedSet_destruct);
+    FILE *fileHandle = fopen(temporaryEndAlignmentFile, "w");
+    for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
+        stSortedSet *endAlignment = makeEndAlignment(stateMachine, ends[endIndex], 5, maxLength,
+                end_getInstanceNumber(ends[endIndex]) > 50, 0.5, pairwiseParameters);
+        writeEndAlignmentToBinaryFile(ends[endIndex], endAlignment, fileHandle);
+        stList_append(endAlignments, endAlignment);
+    }
+    fclose(fileHandle);
+    CuAssertTrue(testCase, isBinaryEndAlignmentFile(temporaryEndAlignmentFile));
+    BinaryEndAlignmentFile *binaryFile = binaryEndAlignmentFile_construct(temporaryEndAlignmentFile);
+    for (int64_t endIndex = 0; endIndex < 3; endIndex++) {
+        End *end;
+        stSortedSet *endAlignment = loadEndAlignmentFromBinaryFile(flower, binaryFile, &end);
+        CuAssertPtrEquals(testCase, ends[endIndex], end);
+        CuAssertTrue(testCase, stSortedSet_equals(stList_get(endAlignments, endIndex), endAlignment));
+        //Check the scores and strands survive too
+        stSortedSetIterator *it = stSortedSet_getIterator(endAlignment);
+        AlignedPair *alignedPair;
+        while ((alignedPair = stSortedSet_getNext(it)) != NULL) {
+            AlignedPair *alignedPair2 = stSortedSet_search(stList_get(endAlignments, endIndex), alignedPair);
+            CuAssertIntEquals(testCase, alignedPair2->score, alignedPair->score);
+            CuAssertIntEquals(testCase, alignedPair2->reverse->score, alignedPair->reverse->score);
+            CuAssertIntEquals(testCase, alignedPair2->reverse->strand, alignedPair->reverse->strand);
+        }
+        stSortedSet_destructIterator(it);
+        stSortedSet_destruct(endAlignment);
+    }
+    End *end;
+    CuAssertTrue(testCase, loadEndAlignmentFromBinaryFile(flower, binaryFile, &end) == NULL);
+    CuAssertTrue(testCase, end == NULL);
+    binaryEndAlignmentFile_destruct(binaryFile);
+    stList_destruct(endAlignments);
+    stFile_rmrf(temporaryEndAlignmentFile);
+    teardown();
+}
+
 CuSuite* endAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testMakeEndAlignments);
     SUITE_ADD_TEST(suite, testReadAndWriteEndAlignments);
+    SUITE_ADD_TEST(suite, testReadAndWriteBinaryEndAlignments);
     SUITE_ADD_TEST(suite, test_alignedPair_cmpFn);
     return suite;
 }
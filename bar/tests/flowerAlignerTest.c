@@ -126,9 +126,40 @@ void test_flowerAlignerRandom(CuTest *testCase) {
     teardown();
 }
 
+/*
+ * Checks the threaded flower alignment is the same as the serial one.
+ */
+void test_flowerAlignerThreaded(CuTest *testCase) {
+    setup();
+    int64_t maxLength = 10;
+    bool pruneOutStubAlignments = st_random() > 0.5;
+    StateMachine *sM = stateMachine5_construct(fiveState);
+    stSortedSet *flowerAlignment = makeFlowerAlignment(sM, flower, 5, maxLength, 1, 0.5, pairwiseParameters,
+            pruneOutStubAlignments);
+    stSortedSet *flowerAlignment2 = makeFlowerAlignment3(sM, flower, NULL, 5, maxLength, 1, 0.5, pairwiseParameters,
+            pruneOutStubAlignments, 4);
+    stateMachine_destruct(sM);
+    CuAssertIntEquals(testCase, stSortedSet_size(flowerAlignment), stSortedSet_size(flowerAlignment2));
+    stSortedSetIterator *iterator = stSortedSet_getIterator(flowerAlignment);
+    AlignedPair *alignedPair;
+    while((alignedPair = stSortedSet_getNext(iterator)) != NULL) {
+        AlignedPair *alignedPair2 = stSortedSet_search(flowerAlignment2, alignedPair);
+        CuAssertTrue(testCase, alignedPair2 != NULL);
+        CuAssertIntEquals(testCase, alignedPair->score, alignedPair2->score);
+        CuAssertTrue(testCase, alignedPair_cmpFn(alignedPair->reverse, alignedPair2->reverse) == 0);
+        CuAssertIntEquals(testCase, alignedPair->reverse->score, alignedPair2->reverse->score);
+    }
+    stSortedSet_destructIterator(iterator);
+    stSortedSet_destruct(flowerAlignment);
+    stSortedSet_destruct(flowerAlignment2);
+
+    teardown();
+}
+
 CuSuite* flowerAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_getInducedAlignment);
     SUITE_ADD_TEST(suite, test_flowerAlignerRandom);
+    SUITE_ADD_TEST(suite, test_flowerAlignerThreaded);
     return suite;
 }
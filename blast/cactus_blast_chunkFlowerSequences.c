@@ -27,7 +27,7 @@ int main(int argc, char *argv[]) {
 	 */
 	CactusDisk *cactusDisk;
 	Flower *flower;
-	assert(argc == 7);
+	assert(argc == 8);
 	st_setLogLevelFromString(argv[1]);
 	stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(argv[2]);
 	cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
@@ -43,9 +43,22 @@ int main(int argc, char *argv[]) {
     assert(i == 1);
 	i = sscanf(argv[6], "%" PRIi64 "", &minimumSequenceLength);
 	assert(i == 1);
-	setupToChunkSequences(chunkSize, chunkOverlapSize, argv[7]);
-	writeFlowerSequences(flower, processSequenceToChunk, minimumSequenceLength);
-	finishChunkingSequences();
+	SequenceChunker *chunker = sequenceChunker_construct(chunkSize, chunkOverlapSize,
+			(const char *(*)(void *)) flowerSequence_getHeader,
+			(char *(*)(void *, int64_t, int64_t)) flowerSequence_getSubsequence);
+	stList *flowerSequences = getFlowerSequences(flower, minimumSequenceLength);
+	for (int64_t j = 0; j < stList_length(flowerSequences); j++) {
+		FlowerSequence *flowerSequence = stList_get(flowerSequences, j);
+		sequenceChunker_addSequence(chunker, flowerSequence, flowerSequence_getLength(flowerSequence));
+	}
+	// The sequences are read from the cactus disk, which is not thread safe
+	stList *chunkFiles = sequenceChunker_writeChunks(chunker, argv[7], 1);
+	for (int64_t j = 0; j < stList_length(chunkFiles); j++) {
+		fprintf(stdout, "%s\n", (char *)stList_get(chunkFiles, j));
+	}
+	stList_destruct(chunkFiles);
+	stList_destruct(flowerSequences);
+	sequenceChunker_destruct(chunker);
 	st_logInfo("Written the sequences from the flower into a file");
 	cactusDisk_destruct(cactusDisk);
 	stKVDatabaseConf_destruct(kvDatabaseConf);
@@ -8,26 +8,68 @@
 #include <string.h>
 #include <assert.h>
 #include <float.h>
+#include <getopt.h>
 #include "bioioC.h"
 #include "commonC.h"
 
 #include "blastAlignmentLib.h"
 
+static void usage() {
+    fprintf(stderr, "cactus_blast_chunkSequences [--threads N] logLevel chunkSize overlapSize dirToPutChunksIn seqFiles...\n");
+    fprintf(stderr, "Chunks up the sequences into overlapping fasta files in dirToPutChunksIn and prints their paths.\n");
+    fprintf(stderr, "--threads <N>: Write the chunk files on N threads.\n");
+}
+
 int main(int argc, char *argv[]) {
+    int64_t numThreads = 1;
+    struct option opts[] = { { "threads", required_argument, NULL, 't' }, { 0, 0, 0, 0 } };
+    int flag;
+    while ((flag = getopt_long(argc, argv, "+", opts, NULL)) != -1) {
+        switch (flag) {
+            case 't':
+                if (sscanf(optarg, "%" PRIi64, &numThreads) != 1 || numThreads < 1) {
+                    st_errAbort("Error parsing threads parameter");
+                }
+                break;
+            default:
+                usage();
+                return 1;
+        }
+    }
     //log-string, chunkSize, overlapSize, dirToPutChunksIn, seqFilesX n
-    assert(argc >= 5);
-    st_setLogLevelFromString(argv[1]);
+    if (argc - optind < 4) {
+        usage();
+        return 1;
+    }
+    st_setLogLevelFromString(argv[optind]);
     int64_t chunkSize, chunkOverlapSize;
-    int64_t i = sscanf(argv[2], "%" PRIi64 "", &chunkSize);
+    int64_t i = sscanf(argv[optind + 1], "%" PRIi64 "", &chunkSize);
+    (void)i;
     assert(i == 1);
-    i = sscanf(argv[3], "%" PRIi64 "", &chunkOverlapSize);
+    i = sscanf(argv[optind + 2], "%" PRIi64 "", &chunkOverlapSize);
     assert(i == 1);
-    setupToChunkSequences(chunkSize, chunkOverlapSize, argv[4]);
-    for (int64_t i = 5; i < argc; i++) {
-        FILE *fileHandle2 = fopen(argv[i], "r");
-        fastaReadToFunction(fileHandle2, processSequenceToChunk);
-        fclose(fileHandle2);
+
+    // Plan the chunks from the indexes of the sequence files, then read the chunks straight out
+    // of the sequence files while writing them
+    SequenceChunker *chunker = sequenceChunker_construct(chunkSize, chunkOverlapSize,
+            (const char *(*)(void *)) fastaIndexSequence_getHeader,
+            (char *(*)(void *, int64_t, int64_t)) fastaIndexSequence_getSubsequence);
+    stList *fastaIndexes = stList_construct3(0, (void (*)(void *)) fastaIndex_destruct);
+    for (int64_t j = optind + 4; j < argc; j++) {
+        FastaIndex *fastaIndex = fastaIndex_construct(argv[j]);
+        stList_append(fastaIndexes, fastaIndex);
+        for (int64_t k = 0; k < fastaIndex_getSequenceNumber(fastaIndex); k++) {
+            FastaIndexSequence *sequence = fastaIndex_getSequence(fastaIndex, k);
+            sequenceChunker_addSequence(chunker, sequence, fastaIndexSequence_getLength(sequence));
+        }
+    }
+    stList *chunkFiles = sequenceChunker_writeChunks(chunker, argv[optind + 3], numThreads);
+    for (int64_t j = 0; j < stList_length(chunkFiles); j++) {
+        fprintf(stdout, "%s\n", (char *)stList_get(chunkFiles, j));
     }
-    finishChunkingSequences();
+
+    stList_destruct(chunkFiles);
+    sequenceChunker_destruct(chunker);
+    stList_destruct(fastaIndexes);
     return 0;
 }
@@ -16,6 +16,7 @@
 #include "avl.h"
 #include "pairwiseAlignment.h"
 #include "blastAlignmentLib.h"
+#include "cigarPipeline.h"
 
 int main(int argc, char *argv[]) {
     /*
@@ -48,17 +49,10 @@ int main(int argc, char *argv[]) {
     (void)i;
     assert(i == 1);
     assert(roundsOfConversion >= 1);
-    struct PairwiseAlignment *pairwiseAlignment;
-    while ((pairwiseAlignment = cigarRead(fileHandleIn)) != NULL) {
-        //Correct coordinates
-        for(int64_t j=0; j<roundsOfConversion; j++) {
-            convertCoordinatesOfPairwiseAlignment(pairwiseAlignment,
-                                                  convertContig1,
-                                                  convertContig2);
-        }
-        cigarWrite(fileHandleOut, pairwiseAlignment, 0);
-        destructPairwiseAlignment(pairwiseAlignment);
-    }
+    CigarStage *stage = cigarStage_constructConvertCoordinates(roundsOfConversion, convertContig1, convertContig2,
+            cigarStage_constructWriter(fileHandleOut, 0));
+    cigarStage_pushCigarFile(stage, fileHandleIn);
+    cigarStage_destruct(stage);
     fclose(fileHandleIn);
     fclose(fileHandleOut);
     return 0;
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2009-2018 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include <getopt.h>
+#include "sonLib.h"
+#include "cactus.h"
+#include "pairwiseAlignment.h"
+#include "cigarPipeline.h"
+
+/*
+ * Runs a chain of the blast post-processing steps on a cigar file in one process, so the
+ * alignments are parsed and written once, rather than once per program.
+ */
+
+static void usage() {
+    fprintf(stderr, "cactus_blast_processAlignments [options] inputFile outputFile [secondaryOutputFiles]\n");
+    fprintf(stderr, "The steps are applied in the order they are given on the command line.\n");
+    fprintf(stderr, "-a --logLevel : Set the log level\n");
+    fprintf(stderr, "-b --cactusDisk : The cactus disk, needed by --convertToInternalNames (the flower is read from stdin)\n");
+    fprintf(stderr, "-c --convertCoordinates [rounds] : As cactus_blast_convertCoordinates\n");
+    fprintf(stderr, "-d --mirrorAndOrient : As cactus_mirrorAndOrientAlignments\n");
+    fprintf(stderr, "-e --convertToInternalNames : As cactus_convertAlignmentsToInternalNames\n");
+    fprintf(stderr, "-f --sortByCoordinates : Sort by the coordinates of the first sequence, as sort -k6,6 -k7,7n -k8,8n\n");
+    fprintf(stderr, "-g --sortByScore : Sort by descending score, as cactus_blast_sortAlignments\n");
+    fprintf(stderr, "-i --unique : Remove adjacent duplicate alignments, as uniq\n");
+    fprintf(stderr, "-j --splitOverlaps : As cactus_splitAlignmentOverlaps\n");
+    fprintf(stderr, "-k --mappingQualities [maxAlignmentsPerSite,minimumMapQValue,alpha] : As cactus_calculateMappingQualities, "
+            "must be the last step. The i-th best alignment at each site is written to the i-th output file, so "
+            "maxAlignmentsPerSite output files must be given\n");
+    fprintf(stderr, "-l --maxBytesInMemory : (int >= 1) Sorts spill to disk beyond this many bytes of alignments\n");
+    fprintf(stderr, "-m --withProbs : Write the alignment operation scores\n");
+    fprintf(stderr, "-h --help : Print this help screen\n");
+}
+
+typedef struct _step {
+    int key;
+    char *arg;
+} Step;
+
+int main(int argc, char *argv[]) {
+    char *logLevelString = NULL;
+    char *cactusDiskDatabaseString = NULL;
+    int64_t maxBytesInMemory = 268435456; // As cactus_blast_sortAlignments
+    bool withProbs = 0;
+    stList *steps = stList_construct3(0, free);
+
+    while (1) {
+        static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' },
+                { "cactusDisk", required_argument, 0, 'b' }, { "convertCoordinates", required_argument, 0, 'c' },
+                { "mirrorAndOrient", no_argument, 0, 'd' }, { "convertToInternalNames", no_argument, 0, 'e' },
+                { "sortByCoordinates", no_argument, 0, 'f' }, { "sortByScore", no_argument, 0, 'g' },
+                { "unique", no_argument, 0, 'i' }, { "splitOverlaps", no_argument, 0, 'j' },
+                { "mappingQualities", required_argument, 0, 'k' }, { "maxBytesInMemory", required_argument, 0, 'l' },
+                { "withProbs", no_argument, 0, 'm' }, { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+
+        int option_index = 0;
+        int key = getopt_long(argc, argv, "a:b:c:defgijk:l:mh", long_options, &option_index);
+        if (key == -1) {
+            break;
+        }
+        switch (key) {
+            case 'a':
+                logLevelString = stString_copy(optarg);
+                break;
+            case 'b':
+                cactusDiskDatabaseString = stString_copy(optarg);
+                break;
+            case 'l':
+                if (sscanf(optarg, "%" PRIi64, &maxBytesInMemory) != 1 || maxBytesInMemory < 1) {
+                    st_errAbort("Error parsing maxBytesInMemory parameter");
+                }
+                break;
+            case 'm':
+                withProbs = 1;
+                break;
+            case 'c':
+            case 'd':
+            case 'e':
+            case 'f':
+            case 'g':
+            case 'i':
+            case 'j':
+            case 'k': {
+                Step *step = st_malloc(sizeof(Step));
+                step->key = key;
+                step->arg = optarg;
+                stList_append(steps, step);
+                break;
+            }
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+    st_setLogLevelFromString(logLevelString);
+
+    if (argc - optind < 2) {
+        usage();
+        return 1;
+    }
+    FILE *fileHandleIn = fopen(argv[optind], "r");
+    if (fileHandleIn == NULL) {
+        st_errnoAbort("Could not open the input file %s", argv[optind]);
+    }
+    int64_t outputNumber = argc - optind - 1;
+    FILE **fileHandleOuts = st_malloc(sizeof(FILE *) * outputNumber);
+    for (int64_t i = 0; i < outputNumber; i++) {
+        if ((fileHandleOuts[i] = fopen(argv[optind + 1 + i], "w")) == NULL) {
+            st_errnoAbort("Could not open the output file %s", argv[optind + 1 + i]);
+        }
+    }
+
+    // Build the chain of stages from the last step back to the first
+    CigarStage *stage = NULL;
+    CactusDisk *cactusDisk = NULL;
+    stHash *headerToName = NULL;
+    for (int64_t i = stList_length(steps) - 1; i >= 0; i--) {
+        Step *step = stList_get(steps, i);
+        if (step->key == 'k') {
+            int64_t maxAlignmentsPerSite;
+            float minimumMapQValue, alpha;
+            if (sscanf(step->arg, "%" PRIi64 ",%f,%f", &maxAlignmentsPerSite, &minimumMapQValue, &alpha) != 3
+                    || maxAlignmentsPerSite < 1) {
+                st_errAbort("Error parsing mappingQualities parameter: %s", step->arg);
+            }
+            if (stage != NULL) {
+                st_errAbort("--mappingQualities must be the last step");
+            }
+            if (maxAlignmentsPerSite != outputNumber) {
+                st_errAbort("--mappingQualities needs %" PRIi64 " output files, got %" PRIi64, maxAlignmentsPerSite, outputNumber);
+            }
+            CigarStage **outputs = st_malloc(sizeof(CigarStage *) * outputNumber);
+            for (int64_t j = 0; j < outputNumber; j++) {
+                outputs[j] = cigarStage_constructWriter(fileHandleOuts[j], withProbs);
+            }
+            stage = cigarStage_constructMappingQualities(maxAlignmentsPerSite, minimumMapQValue, alpha, outputs);
+            continue;
+        }
+        if (stage == NULL) {
+            if (outputNumber != 1) {
+                st_errAbort("Only --mappingQualities writes more than one output file");
+            }
+            stage = cigarStage_constructWriter(fileHandleOuts[0], withProbs);
+        }
+        switch (step->key) {
+            case 'c': {
+                int64_t roundsOfConversion;
+                if (sscanf(step->arg, "%" PRIi64, &roundsOfConversion) != 1 || roundsOfConversion < 1) {
+                    st_errAbort("Error parsing convertCoordinates parameter: %s", step->arg);
+                }
+                stage = cigarStage_constructConvertCoordinates(roundsOfConversion, 1, 1, stage);
+                break;
+            }
+            case 'd':
+                stage = cigarStage_constructMirrorAndOrient(stage);
+                break;
+            case 'e':
+                if (cactusDiskDatabaseString == NULL) {
+                    st_errAbort("--convertToInternalNames needs the --cactusDisk option");
+                }
+                if (headerToName == NULL) {
+                    stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
+                    cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+                    stList *flowers = flowerWriter_parseFlowersFromStdin(cactusDisk);
+                    if (stList_length(flowers) != 1) {
+                        st_errAbort("Expected one flower on stdin, got %" PRIi64, stList_length(flowers));
+                    }
+                    headerToName = constructHeaderToNameHash(stList_get(flowers, 0));
+                    stList_destruct(flowers);
+                }
+                stage = cigarStage_constructConvertToInternalNames(headerToName, stage);
+                break;
+            case 'f':
+                stage = cigarStage_constructSort(cigarPipeline_cmpByFirstSequenceCoordinates, maxBytesInMemory, stage);
+                break;
+            case 'g':
+                stage = cigarStage_constructSort(cigarPipeline_cmpByDescendingScore, maxBytesInMemory, stage);
+                break;
+            case 'i':
+                stage = cigarStage_constructUnique(stage);
+                break;
+            case 'j':
+                stage = cigarStage_constructSplitOverlaps(stage);
+                break;
+            default:
+                assert(0);
+        }
+    }
+    if (stage == NULL) { // No steps, just copy the alignments
+        if (outputNumber != 1) {
+            st_errAbort("Only --mappingQualities writes more than one output file");
+        }
+        stage = cigarStage_constructWriter(fileHandleOuts[0], withProbs);
+    }
+
+    cigarStage_pushCigarFile(stage, fileHandleIn);
+
+    // Cleanup
+    cigarStage_destruct(stage);
+    fclose(fileHandleIn);
+    for (int64_t i = 0; i < outputNumber; i++) {
+        if (fclose(fileHandleOuts[i]) != 0) {
+            st_errnoAbort("Error writing the output file %s", argv[optind + 1 + i]);
+        }
+    }
+    free(fileHandleOuts);
+    if (headerToName != NULL) {
+        stHash_destruct(headerToName);
+        cactusDisk_destruct(cactusDisk);
+    }
+    stList_destruct(steps);
+    free(logLevelString);
+    free(cactusDiskDatabaseString);
+
+    return 0;
+}
@@ -10,9 +10,14 @@
 int main(int argc, char *argv[]) {
 	/*
 	 * Sort cigar file in descending order of score.
+	 * Arguments: logLevel cigarsFile sortedFile [numThreads]
 	 */
-	assert(argc == 4);
+	assert(argc == 4 || argc == 5);
 	st_setLogLevelFromString(argv[1]);
-	stCaf_sortCigarsFileByScoreInDescendingOrder(argv[2], argv[3]);
+	int64_t numThreads = 1;
+	if (argc == 5 && (sscanf(argv[4], "%" PRIi64 "", &numThreads) != 1 || numThreads < 1)) {
+		st_errAbort("Error parsing the number of threads: %s", argv[4]);
+	}
+	stCaf_sortCigarsFileByScoreInDescendingOrder2(argv[2], argv[3], STCAF_SORT_CIGARS_MAX_BYTES_IN_MEMORY, numThreads);
 	return 0;
 }
@@ -9,6 +9,7 @@
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
 #include "bioioC.h"
+#include "cigarPipeline.h"
 
 static void usage(void)
 {
@@ -17,29 +18,6 @@ static void usage(void)
             "Output will be a sorted binary coverage file.\n");
 }
 
-static void convertHeadersToNames(struct PairwiseAlignment *pA, stHash *headerToName)
-{
-    Name *name = NULL;
-    if((name = stHash_search(headerToName, pA->contig1)) == NULL) {
-        fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
-                "database\n", pA->contig1);
-        exit(1);
-    }
-    pA->contig1 = cactusMisc_nameToString(*name);
-    // Coordinates have to be shifted by 2 to keep compatibility with
-    // cactus coordinates.
-    pA->start1 += 2;
-    pA->end1 += 2;
-    if((name = stHash_search(headerToName, pA->contig2)) == NULL) {
-        fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
-                "database\n", pA->contig2);
-        exit(1);
-    }
-    pA->contig2 = cactusMisc_nameToString(*name);
-    pA->start2 += 2;
-    pA->end2 += 2;
-}
-
 int main(int argc, char *argv[])
 {
     char *cactusDiskString = NULL;
@@ -47,9 +25,6 @@ int main(int argc, char *argv[])
     stKVDatabaseConf *kvDatabaseConf;
     stHash *headerToName;
     stList *flowers;
-    Flower_EndIterator *endIt;
-    End_InstanceIterator *capIt;
-    End *end;
     FILE *inputFile;
     FILE *outputFile;
     bool isBedFile = false; // true if bed, false if cigar
@@ -74,9 +49,6 @@ int main(int argc, char *argv[])
     }
     assert(argc == optind + 2);
 
-    headerToName = stHash_construct3(stHash_stringKey, stHash_stringEqualKey,
-                                     free, free);
-
     // Load a header->cactus ID map from the cactus DB
     if (cactusDiskString == NULL) {
         st_errAbort("--cactusDisk option must be provided");
@@ -86,38 +58,7 @@ int main(int argc, char *argv[])
     flowers = flowerWriter_parseFlowersFromStdin(cactusDisk);
     assert(stList_length(flowers) == 1);
     Flower *flower = stList_get(flowers, 0);
-    endIt = flower_getEndIterator(flower);
-    while ((end = flower_getNextEnd(endIt)) != NULL) {
-        capIt = end_getInstanceIterator(end);
-        Cap *cap;
-        while ((cap = end_getNext(capIt)) != NULL) {
-            const char *header;
-            Name name;
-            Name *heapName;
-            if (!cap_getStrand(cap)) {
-                cap = cap_getReverse(cap);
-            }
-            if (cap_getSide(cap)) {
-                continue;
-            }
-            name = cap_getName(cap);
-            header = sequence_getHeader(cap_getSequence(cap));
-            heapName = st_malloc(sizeof(Name));
-            *heapName = name;
-            // The casts to void * are just to drop the const
-            // qualifier. The functions won't modify the header.
-            if (stHash_search(headerToName, (void *) header)) {
-                // There is already a header -> cap name map, check
-                // that it has the same name.
-                Name *otherName = stHash_search(headerToName, (void *) header);
-                fprintf(stderr, "Collision with header %s: name %" PRIi64
-                        " otherName: %" PRIi64 "\n", header, name, *otherName);
-                assert(*otherName == name);
-            }
-            stHash_insert(headerToName, (void *) header, heapName);
-        }
-        end_destructInstanceIterator(capIt);
-    }
+    headerToName = constructHeaderToNameHash(flower);
 
     inputFile = fopen(argv[optind], "r");
     if (inputFile == NULL) {
@@ -214,7 +155,7 @@ int main(int argc, char *argv[])
                 // Signals end of cigar file.
                 break;
             }
-            convertHeadersToNames(pA, headerToName);
+            convertHeadersOfPairwiseAlignmentToNames(pA, headerToName);
             checkPairwiseAlignment(pA);
             cigarWrite(outputFile, pA, TRUE);
         }
@@ -223,6 +164,6 @@ int main(int argc, char *argv[])
     // Cleanup.
     fclose(inputFile);
     fclose(outputFile);
-    flower_destructEndIterator(endIt);
+    stHash_destruct(headerToName);
     cactusDisk_destruct(cactusDisk);
 }
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include "sonLib.h"
 #include "bioioC.h"
+#include "cactus.h"
 #include "pairwiseAlignment.h"
 
 // For blocks on the same contig.
@@ -11,6 +12,29 @@ struct block {
     int64_t value;
 };
 
+// A +1/-1 change in coverage at a position of a sequence, made by an
+// alignment from the sequence with the given id (always 0 unless
+// we're using the --depthById option).
+struct coverageEvent {
+    int64_t position;
+    int64_t delta;
+    int64_t id;
+};
+
+// The coverage of one sequence. Alignments are recorded as blocks
+// (with the id of the other sequence as the value) as they are read,
+// then swept into maximal regions of constant coverage (with the depth
+// as the value) once all have been read.
+typedef struct _sequenceCoverage {
+    char *name;
+    int64_t length;
+    struct block *blocks;
+    int64_t blockNumber;
+    int64_t maxBlockNumber;
+    struct block *regions;
+    int64_t regionNumber;
+} SequenceCoverage;
+
 // For calculating coverage on the target genome
 static stHash *sequenceLengths = NULL;
 static stList *sequenceNames = NULL;
@@ -19,9 +43,12 @@ static stHash *sequenceCoverage = NULL;
 // (although there is no relation to the query contig in the cigar):
 // i.e. the genome specified in --from, if any
 static stSet *otherGenomeSequences = NULL;
-// For splitting sequence coverage arrays by ID, if we're using the
-// --depthByID option.
-static stHash *IDToSequenceCoverage;
+// For counting coverage depth by the number of distinct "id=N|"
+// prefixes, if we're using the --depthById option: maps headers to
+// the index of their ID, and IDs to their index.
+static stHash *headerToIDIndex = NULL;
+static stHash *IDToIndex = NULL;
+static int64_t IDNumber = 0;
 
 // Add a sequence from the genome to sequenceLength and sequenceNames
 static void addSequenceLength(const char *name, const char *seq, int64_t len)
@@ -68,47 +95,66 @@ static void usage(void)
     fprintf(stderr, "--depthById: Assume that headers have an 'id=N|' prefix, "
             "where N is an integer. Score coverage depth by the number of "
             "different prefixes that align to a region, rather than the total "
-            "number of alignments. Uses much more memory than the standard mode."
+            "number of alignments."
             "\n");
     fprintf(stderr, "--from <fromFastaFile>: Only consider alignments for which one sequence is in fastaFile and the other is in fromFastaFile.\n");
+    fprintf(stderr, "--threads <N>: Compute the coverage of the sequences on N threads.\n");
 }
 
-static void printCoverage(char *name, uint16_t *array, int64_t length) {
-    int64_t i, regionStart = 0;
-    uint16_t prevCoverage = 0;
-    for(i = 0; i < length; i++) {
-        if(array[i] != prevCoverage) {
-            if(prevCoverage != 0) {
-                printf("%s\t%" PRIi64 "\t%" PRIi64 "\t\t%u\n", name,
-                       regionStart, i, prevCoverage);
-            }
-            regionStart = i;
+static void printCoverage(SequenceCoverage *coverage) {
+    for(int64_t i = 0; i < coverage->regionNumber; i++) {
+        struct block *region = &coverage->regions[i];
+        printf("%s\t%" PRIi64 "\t%" PRIi64 "\t\t%" PRIi64 "\n", coverage->name,
+               region->start, region->end, region->value);
+    }
+}
+
+// Record that [start, end) of the sequence is covered by an alignment
+// from the sequence with the given id. If the block continues the
+// previous block of the same alignment (i.e. one recorded at or after
+// firstBlock) it is merged with it.
+static void addBlock(SequenceCoverage *coverage, int64_t firstBlock,
+                     int64_t start, int64_t end, int64_t id)
+{
+    if(coverage->blockNumber > firstBlock) {
+        struct block *prevBlock = &coverage->blocks[coverage->blockNumber - 1];
+        if(prevBlock->end == start) {
+            prevBlock->end = end;
+            return;
+        }
+        if(prevBlock->start == end) {
+            prevBlock->start = start;
+            return;
         }
-        prevCoverage = array[i];
     }
-    if(prevCoverage != 0) {
-        printf("%s\t%" PRIi64 "\t%" PRIi64 "\t\t%u\n", name,
-               regionStart, i, prevCoverage);
+    if(coverage->blockNumber == coverage->maxBlockNumber) {
+        coverage->maxBlockNumber = coverage->maxBlockNumber == 0 ? 16 : coverage->maxBlockNumber * 2;
+        coverage->blocks = realloc(coverage->blocks, coverage->maxBlockNumber * sizeof(struct block));
+        if(coverage->blocks == NULL) {
+            st_errAbort("Out of memory recording the coverage of %s", coverage->name);
+        }
     }
+    struct block *block = &coverage->blocks[coverage->blockNumber++];
+    block->start = start;
+    block->end = end;
+    block->value = id;
 }
 
-// Fill in the part of a coverage array that is covered by a
-// particular pairwise alignment. contigNum is which contig this
-// coverage array corresponds to in the CIGAR.
+// Record the match blocks of a particular pairwise alignment on the
+// coverage of one of its sequences. contigNum is which contig this
+// coverage corresponds to in the CIGAR.
 static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
-                         uint16_t *coverageArray)
+                         SequenceCoverage *coverage, int64_t id)
 {
     int strand = contigNum == 1 ? pA->strand1 : pA->strand2;
     int64_t startPos = contigNum == 1 ? pA->start1 : pA->start2;
     int64_t endPos = contigNum == 1 ? pA->end1 : pA->end2;
-    int64_t i, j;
-    int64_t *lenPtr = stHash_search(sequenceLengths, contigNum == 1 ? pA->contig1 : pA->contig2);
-    assert(lenPtr != NULL);
-    int64_t len = *lenPtr;
-    if(endPos > len) {
-        fprintf(stderr, "Error: alignment on %s:%" PRIi64 "-%" PRIi64 " is past chr end\n", contigNum == 1 ? pA->contig1 : pA->contig2, startPos, endPos);
+    int64_t i;
+    if(endPos > coverage->length) {
+        fprintf(stderr, "Error: alignment on %s:%" PRIi64 "-%" PRIi64 " is past chr end\n", coverage->name, startPos, endPos);
         exit(1);
     }
+    int64_t firstBlock = coverage->blockNumber;
     int64_t curAlignmentPos = startPos;
     for(i = 0; i < pA->operationList->length; i++) {
         struct AlignmentOperation *op = pA->operationList->list[i];
@@ -132,28 +178,15 @@ static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
             }
             break;
         case PAIRWISE_MATCH:
+            if(op->length == 0) {
+                break;
+            }
             if(strand) {
-                for(j=curAlignmentPos; j < curAlignmentPos + op->length; j++) {
-                    if(coverageArray[j] == 65535) {
-                        fprintf(stderr, "WARNING: Coverage hit cap (65535) on contig: "
-                                "%s pos: %" PRIi64 "\n",
-                                contigNum == 1 ? pA->contig1 : pA->contig2, j);
-                    } else {
-                        coverageArray[j]++;
-                    }
-                }
+                addBlock(coverage, firstBlock, curAlignmentPos, curAlignmentPos + op->length, id);
                 curAlignmentPos += op->length;
                 assert(curAlignmentPos <= endPos);
             } else {
-                for(j=curAlignmentPos-1; j >= curAlignmentPos - op->length; j--) {
-                    if(coverageArray[j] == 65535) {
-                        fprintf(stderr, "WARNING: Coverage hit cap (65535) on contig: "
-                                "%s pos: %" PRIi64 "\n",
-                                contigNum == 1 ? pA->contig1 : pA->contig2, j);
-                    } else {
-                        coverageArray[j]++;
-                    }
-                }
+                addBlock(coverage, firstBlock, curAlignmentPos - op->length, curAlignmentPos, id);
                 curAlignmentPos -= op->length;
                 assert(curAlignmentPos >= endPos);
             }
@@ -161,46 +194,121 @@ static void fillCoverage(struct PairwiseAlignment *pA, int contigNum,
     }
 }
 
-// Get the proper coverage array to fill in, given the "on" header
-// (i.e. a header in the fasta provided in the arguments to this
-// program), and the "from" header (the other header in the CIGAR file,
-// which may or may not be in that fasta). Initialize the array if necessary.
-static uint16_t *getCoverageArray(char *onHeader, char *fromHeader,
-                                  int depthById) {
-    stHash *coverageHash;
-    if (depthById) {
-        // We're splitting arrays by "id=N|" of the "from" header.
+// Get the coverage to fill in for the "on" header (i.e. a header in
+// the fasta provided in the arguments to this program). Initialize it
+// if necessary.
+static SequenceCoverage *getSequenceCoverage(char *onHeader) {
+    SequenceCoverage *coverage;
+    if((coverage = stHash_search(sequenceCoverage, onHeader)) == NULL) {
+        int64_t *lengthPtr = stHash_search(sequenceLengths, onHeader);
+        assert(lengthPtr != NULL);
+        coverage = st_calloc(1, sizeof(SequenceCoverage));
+        coverage->name = stString_copy(onHeader);
+        coverage->length = *lengthPtr;
+        stHash_insert(sequenceCoverage, coverage->name, coverage);
+    }
+    return coverage;
+}
+
+static void sequenceCoverage_destruct(SequenceCoverage *coverage) {
+    free(coverage->name);
+    free(coverage->blocks);
+    free(coverage->regions);
+    free(coverage);
+}
+
+// Get the id that coverage from the "from" header (the other header
+// in the CIGAR file, which may or may not be in the fasta) is counted
+// under: the index of its "id=N|" prefix if we're using the
+// --depthById option, otherwise 0.
+static int64_t getID(char *fromHeader, int depthById) {
+    if(!depthById) {
+        return 0;
+    }
+    int64_t *index = stHash_search(headerToIDIndex, fromHeader);
+    if(index == NULL) {
         stList *attributes = fastaDecodeHeader(fromHeader);
         char *id = stList_get(attributes, 0);
         if (strncmp(id, "id=", 3)) {
             st_errAbort("Using --depthById mode, but header %s does not have an "
                         "'id=N|' prefix", fromHeader);
         }
-        stHash *sequenceSubCoverage = stHash_search(IDToSequenceCoverage, id);
-        if (sequenceSubCoverage == NULL) {
-            // Initialize coverage sub-hash.
-            sequenceSubCoverage = stHash_construct3(stHash_stringKey,
-                                                    stHash_stringEqualKey, free,
-                                                    free);
-            stHash_insert(IDToSequenceCoverage, id, sequenceSubCoverage);
+        if((index = stHash_search(IDToIndex, id)) == NULL) {
+            index = st_malloc(sizeof(int64_t));
+            *index = IDNumber++;
+            stHash_insert(IDToIndex, stString_copy(id), index);
         }
-        coverageHash = sequenceSubCoverage;
-    } else {
-        coverageHash = sequenceCoverage;
+        stHash_insert(headerToIDIndex, stString_copy(fromHeader), index);
+        stList_destruct(attributes);
+    }
+    return *index;
+}
+
+static int coverageEvent_cmp(const void *a, const void *b) {
+    const struct coverageEvent *event1 = a, *event2 = b;
+    return event1->position < event2->position ? -1 : (event1->position > event2->position ? 1 : 0);
+}
+
+// Sweep the blocks recorded on the sequence into maximal regions of
+// constant, nonzero coverage, in order. If depthById is set, the depth
+// of a region is the number of distinct ids covering it rather than the
+// number of blocks.
+static void *computeCoverageRegions(SequenceCoverage *coverage, int depthById) {
+    int64_t eventNumber = 2 * coverage->blockNumber;
+    struct coverageEvent *events = st_malloc(eventNumber * sizeof(struct coverageEvent));
+    for(int64_t i = 0; i < coverage->blockNumber; i++) {
+        struct block *block = &coverage->blocks[i];
+        events[2 * i] = (struct coverageEvent) { block->start, 1, block->value };
+        events[2 * i + 1] = (struct coverageEvent) { block->end, -1, block->value };
     }
-    int64_t *lengthPtr = stHash_search(sequenceLengths, onHeader);
-    assert(lengthPtr != NULL);
-    uint16_t *array;
-    if((array = stHash_search(coverageHash, onHeader)) == NULL) {
-        // Coverage array for this seq doesn't exist yet, so
-        // create it
-        int64_t length = *lengthPtr;
-        array = st_malloc(length * sizeof(uint16_t));
-        memset(array, 0, length * sizeof(uint16_t));
-        stHash_insert(coverageHash, stString_copy(onHeader),
-                      array);
+    free(coverage->blocks);
+    coverage->blocks = NULL;
+    coverage->blockNumber = coverage->maxBlockNumber = 0;
+    qsort(events, eventNumber, sizeof(struct coverageEvent), coverageEvent_cmp);
+
+    // With --depthById, the number of blocks from each id covering the
+    // current position
+    int64_t *IDDepths = depthById ? st_calloc(IDNumber, sizeof(int64_t)) : NULL;
+    // Every block adds two events, and there is at most one region
+    // between each pair of adjacent events.
+    coverage->regions = st_malloc((eventNumber > 0 ? eventNumber - 1 : 1) * sizeof(struct block));
+    coverage->regionNumber = 0;
+    int64_t depth = 0, regionStart = 0;
+    for(int64_t i = 0; i < eventNumber;) {
+        int64_t position = events[i].position, prevDepth = depth;
+        // Apply all the events at this position before deciding if
+        // the coverage has changed
+        for(; i < eventNumber && events[i].position == position; i++) {
+            if(depthById) {
+                int64_t prevIDDepth = IDDepths[events[i].id];
+                IDDepths[events[i].id] += events[i].delta;
+                if(prevIDDepth == 0 || IDDepths[events[i].id] == 0) {
+                    depth += events[i].delta;
+                }
+            } else {
+                depth += events[i].delta;
+            }
+        }
+        if(depth != prevDepth) {
+            if(prevDepth != 0) {
+                coverage->regions[coverage->regionNumber++] = (struct block) { regionStart, position, prevDepth };
+            }
+            regionStart = position;
+        }
     }
-    return array;
+    assert(depth == 0);
+    free(IDDepths);
+    free(events);
+    return coverage;
+}
+
+typedef struct _coverageTask {
+    SequenceCoverage *coverage;
+    int depthById;
+} CoverageTask;
+
+static void *computeCoverageRegionsTask(CoverageTask *task) {
+    return computeCoverageRegions(task->coverage, task->depthById);
 }
 
 int main(int argc, char *argv[])
@@ -211,9 +319,10 @@ int main(int argc, char *argv[])
                              {"onlyContig2", no_argument, NULL, '2'},
                              {"depthById", no_argument, NULL, 'i'},
                              {"from", required_argument, NULL, 'f'},
+                             {"threads", required_argument, NULL, 't'},
                              {0, 0, 0, 0} };
     int outputOnContig1 = TRUE, outputOnContig2 = TRUE, depthById = FALSE;
-    int64_t flag, i;
+    int64_t flag, i, numThreads = 1;
     while((flag = getopt_long(argc, argv, "", opts, NULL)) != -1) {
         switch(flag) {
         case '1':
@@ -228,6 +337,11 @@ int main(int argc, char *argv[])
         case 'f':
             otherGenomeFastaPath = stString_copy(optarg);
             break;
+        case 't':
+            if(sscanf(optarg, "%" PRIi64, &numThreads) != 1 || numThreads < 1) {
+                st_errAbort("Error parsing threads parameter");
+            }
+            break;
         case '?':
         default:
             usage();
@@ -256,12 +370,13 @@ int main(int argc, char *argv[])
     sequenceLengths = stHash_construct3(stHash_stringKey,
                                         stHash_stringEqualKey, free, free);
     sequenceCoverage = stHash_construct3(stHash_stringKey,
-                                         stHash_stringEqualKey, free, free);
+                                         stHash_stringEqualKey, NULL,
+                                         (void (*)(void *)) sequenceCoverage_destruct);
     sequenceNames = stList_construct3(0, free);
-    IDToSequenceCoverage = stHash_construct3(stHash_stringKey,
-                                             stHash_stringEqualKey,
-                                             free,
-                                             (void (*)(void *)) stHash_destruct);
+    headerToIDIndex = stHash_construct3(stHash_stringKey,
+                                        stHash_stringEqualKey, free, NULL);
+    IDToIndex = stHash_construct3(stHash_stringKey,
+                                  stHash_stringEqualKey, free, free);
 
     if (optind >= argc - 1) {
         fprintf(stderr, "fasta file for sequence and alignments file (in "
@@ -277,7 +392,7 @@ int main(int argc, char *argv[])
     fastaReadToFunction(fastaHandle, addSequenceLength);
     fclose(fastaHandle);
 
-    // Fill coverage arrays with the alignments
+    // Record the blocks of the alignments on the sequences
     FILE *alignmentsHandle = fopen(argv[optind + 1], "r");
     for(;;) {
         int64_t *lengthPtr;
@@ -289,63 +404,57 @@ int main(int argc, char *argv[])
         if((outputOnContig1 && (lengthPtr = stHash_search(sequenceLengths, pA->contig1))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, pA->contig2))) {
             // contig 1 is present in the fasta and contig 2 is in the
             // "from" genome if it exists
-            uint16_t *array = getCoverageArray(pA->contig1, pA->contig2,
-                                               depthById);
-            fillCoverage(pA, 1, array);
+            fillCoverage(pA, 1, getSequenceCoverage(pA->contig1),
+                         getID(pA->contig2, depthById));
         }
         if((outputOnContig2 && (lengthPtr = stHash_search(sequenceLengths, pA->contig2))) && ((otherGenomeSequences == NULL) || stSet_search(otherGenomeSequences, pA->contig1))) {
             // contig 2 is present in the fasta and contig 1 is in the
             // "from" genome if it exists
-            uint16_t *array = getCoverageArray(pA->contig2, pA->contig1,
-                                               depthById);
-            fillCoverage(pA, 2, array);
+            fillCoverage(pA, 2, getSequenceCoverage(pA->contig2),
+                         getID(pA->contig1, depthById));
         }
         destructPairwiseAlignment(pA);
     }
     fclose(alignmentsHandle);
 
-    if (depthById) {
-        // Have to merge all coverage arrays that are divided by
-        // source ID into the main sequenceCoverage hash.
-        stHashIterator *idIt = stHash_getIterator(IDToSequenceCoverage);
-        char *id;
-        while ((id = stHash_getNext(idIt)) != NULL) {
-            stHash *subHash = stHash_search(IDToSequenceCoverage, id);
-            assert(subHash != NULL);
-            stHashIterator *sequenceIt = stHash_getIterator(subHash);
-            char *sequence;
-            while ((sequence = stHash_getNext(sequenceIt)) != NULL) {
-                uint16_t *srcArray = stHash_search(subHash, sequence);
-                assert(srcArray != NULL);
-                uint16_t *destArray = getCoverageArray(sequence, NULL, FALSE);
-                int64_t *length = stHash_search(sequenceLengths, sequence);
-                assert(length != NULL && *length >= 0);
-                for (int64_t i = 0; i < *length; i++) {
-                    if (srcArray[i] > 0) {
-                        destArray[i]++;
-                    }
-                }
-            }
+    // Sweep the blocks of each sequence into coverage regions, which
+    // are independent between sequences
+    stList *tasks = stList_construct3(0, free);
+    for(i = 0; i < stList_length(sequenceNames); i++) {
+        SequenceCoverage *coverage = stHash_search(sequenceCoverage, stList_get(sequenceNames, i));
+        if(coverage != NULL) {
+            CoverageTask *task = st_malloc(sizeof(CoverageTask));
+            task->coverage = coverage;
+            task->depthById = depthById;
+            stList_append(tasks, task);
+        }
+    }
+    if(numThreads > 1 && stList_length(tasks) > 1) {
+        stThreadPool *threadPool = stThreadPool_construct(numThreads < stList_length(tasks) ? numThreads : stList_length(tasks),
+                (void *(*)(void *)) computeCoverageRegionsTask, cactusMisc_ignoreThreadPoolResult);
+        for(i = 0; i < stList_length(tasks); i++) {
+            stThreadPool_push(threadPool, stList_get(tasks, i));
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+    } else {
+        for(i = 0; i < stList_length(tasks); i++) {
+            computeCoverageRegionsTask(stList_get(tasks, i));
         }
-        stHash_destruct(IDToSequenceCoverage);
     }
 
     // Print results as BED
-    for(i = 0; i < stList_length(sequenceNames); i++) {
-        uint16_t *array;
-        char *name = stList_get(sequenceNames, i);
-        int64_t *lengthPtr = stHash_search(sequenceLengths, name);
-        assert(lengthPtr != NULL);
-        int64_t length = *lengthPtr;
-        if((array = stHash_search(sequenceCoverage, name))) {
-            printCoverage(name, array, length);
-        }
+    for(i = 0; i < stList_length(tasks); i++) {
+        printCoverage(((CoverageTask *)stList_get(tasks, i))->coverage);
     }
+    stList_destruct(tasks);
 
     // Cleanup
     stList_destruct(sequenceNames);
     stHash_destruct(sequenceCoverage);
     stHash_destruct(sequenceLengths);
+    stHash_destruct(headerToIDIndex);
+    stHash_destruct(IDToIndex);
     if(otherGenomeSequences) {
 //        stSet_destruct(otherGenomeSequences);
     }
@@ -5,10 +5,14 @@
  *      Author: benedictpaten
  */
 
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "bioioC.h"
 #include "cactus.h"
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
+#include "blastAlignmentLib.h"
 
 /*
  * Converting coordinates of pairwise alignments
@@ -44,111 +48,332 @@ void convertCoordinatesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAli
 }
 
 /*
- * Routine reads in chunk up a set of sequences into overlapping sequence files.
+ * An index of a fasta file, like that of samtools faidx, so subsequences can be read from the file
+ * without reading whole sequences. Rather than the layout of the lines, which faidx needs to be the
+ * same for every line of a sequence, we record the file offset of every FASTA_INDEX_STRIDE-th base,
+ * so files with irregular lines can be indexed too. Like fastaReadToFunction, whitespace is not
+ * part of the sequence.
  */
 
-static int64_t chunkRemaining;
-static FILE *chunkFileHandle = NULL;
-static const char *chunksDir = NULL;
-static int64_t chunkNo = 0;
-static char *tempChunkFile = NULL;
-static int64_t chunkSize;
-static int64_t chunkOverlapSize;
+#define FASTA_INDEX_STRIDE 65536
+#define FASTA_INDEX_BUFFER_SIZE 65536
 
-void finishChunkingSequences() {
-    if (chunkFileHandle != NULL) {
-        fclose(chunkFileHandle);
-        fprintf(stdout, "%s\n", tempChunkFile);
-        free(tempChunkFile);
-        tempChunkFile = NULL;
-        chunkFileHandle = NULL;
+struct _fastaIndex {
+    char *fastaFile;
+    int fileDescriptor;
+    stList *sequences;
+};
+
+struct _fastaIndexSequence {
+    FastaIndex *fastaIndex;
+    char *header;
+    int64_t length;
+    int64_t *offsets; // offsets[i] is the file offset of base i * FASTA_INDEX_STRIDE
+    int64_t maxOffsetNumber;
+};
+
+static void fastaIndexSequence_destruct(FastaIndexSequence *sequence) {
+    free(sequence->header);
+    free(sequence->offsets);
+    free(sequence);
+}
+
+static void fastaIndex_addSequence(FastaIndex *fastaIndex, int64_t headerStart, int64_t headerEnd) {
+    FastaIndexSequence *sequence = st_calloc(1, sizeof(FastaIndexSequence));
+    sequence->fastaIndex = fastaIndex;
+    // Like lastz, only keep the first token of the header
+    sequence->header = st_malloc(headerEnd - headerStart + 1);
+    if (pread(fastaIndex->fileDescriptor, sequence->header, headerEnd - headerStart, headerStart) != headerEnd - headerStart) {
+        st_errnoAbort("Error reading a header of the fasta file %s", fastaIndex->fastaFile);
+    }
+    sequence->header[headerEnd - headerStart] = '\0';
+    for (int64_t i = 0; sequence->header[i] != '\0'; i++) {
+        if (sequence->header[i] == ' ' || sequence->header[i] == '\t') {
+            sequence->header[i] = '\0';
+            break;
+        }
     }
+    stList_append(fastaIndex->sequences, sequence);
 }
 
-static void updateChunkRemaining(int64_t seqLength) {
-    //Update remaining portion of the chunk.
-    assert(seqLength >= 0);
-    chunkRemaining -= seqLength;
-    if (chunkRemaining <= 0) {
-        finishChunkingSequences();
-        chunkRemaining = chunkSize;
+static void fastaIndexSequence_addBase(FastaIndexSequence *sequence, int64_t offset) {
+    if (sequence->length % FASTA_INDEX_STRIDE == 0) {
+        int64_t offsetNumber = sequence->length / FASTA_INDEX_STRIDE;
+        if (offsetNumber == sequence->maxOffsetNumber) {
+            sequence->maxOffsetNumber = sequence->maxOffsetNumber == 0 ? 16 : sequence->maxOffsetNumber * 2;
+            sequence->offsets = st_realloc(sequence->offsets, sequence->maxOffsetNumber * sizeof(int64_t));
+        }
+        sequence->offsets[offsetNumber] = offset;
     }
+    sequence->length++;
 }
 
-static int64_t processSubsequenceChunk(char *fastaHeader, int64_t start, char *sequence, int64_t seqLength, int64_t lengthOfChunkRemaining) {
-    if (chunkFileHandle == NULL) {
-        tempChunkFile = stString_print("%s/%" PRIi64 "", chunksDir, chunkNo++);
-        chunkFileHandle = fopen(tempChunkFile, "w");
+FastaIndex *fastaIndex_construct(const char *fastaFile) {
+    FastaIndex *fastaIndex = st_malloc(sizeof(FastaIndex));
+    fastaIndex->fastaFile = stString_copy(fastaFile);
+    fastaIndex->sequences = stList_construct3(0, (void (*)(void *)) fastaIndexSequence_destruct);
+    if ((fastaIndex->fileDescriptor = open(fastaFile, O_RDONLY)) == -1) {
+        st_errnoAbort("Could not open the fasta file %s", fastaFile);
     }
+    char *buffer = st_malloc(FASTA_INDEX_BUFFER_SIZE);
+    FastaIndexSequence *sequence = NULL;
+    bool atLineStart = 1, inHeader = 0;
+    int64_t offset = 0, headerStart = 0;
+    ssize_t bytesRead;
+    while ((bytesRead = read(fastaIndex->fileDescriptor, buffer, FASTA_INDEX_BUFFER_SIZE)) > 0) {
+        for (int64_t i = 0; i < bytesRead; i++, offset++) {
+            char c = buffer[i];
+            if (inHeader) {
+                if (c == '\n') {
+                    fastaIndex_addSequence(fastaIndex, headerStart, offset);
+                    sequence = stList_peek(fastaIndex->sequences);
+                    inHeader = 0;
+                    atLineStart = 1;
+                }
+            } else if (atLineStart && c == '>') {
+                inHeader = 1;
+                headerStart = offset + 1;
+            } else {
+                atLineStart = c == '\n';
+                if (sequence != NULL && !isspace(c)) {
+                    fastaIndexSequence_addBase(sequence, offset);
+                }
+            }
+        }
+    }
+    if (bytesRead < 0) {
+        st_errnoAbort("Error reading the fasta file %s", fastaFile);
+    }
+    if (inHeader) { // A header on the last line, without a newline
+        fastaIndex_addSequence(fastaIndex, headerStart, offset);
+    }
+    free(buffer);
+    return fastaIndex;
+}
 
-    int64_t i = 0;
-    fastaHeader = stString_copy(fastaHeader);
-    while (fastaHeader[i] != '\0') {
-        if (fastaHeader[i] == ' ' || fastaHeader[i] == '\t') {
-            fastaHeader[i] = '\0';
-            break;
+void fastaIndex_destruct(FastaIndex *fastaIndex) {
+    close(fastaIndex->fileDescriptor);
+    stList_destruct(fastaIndex->sequences);
+    free(fastaIndex->fastaFile);
+    free(fastaIndex);
+}
+
+int64_t fastaIndex_getSequenceNumber(FastaIndex *fastaIndex) {
+    return stList_length(fastaIndex->sequences);
+}
+
+FastaIndexSequence *fastaIndex_getSequence(FastaIndex *fastaIndex, int64_t index) {
+    return stList_get(fastaIndex->sequences, index);
+}
+
+const char *fastaIndexSequence_getHeader(FastaIndexSequence *sequence) {
+    return sequence->header;
+}
+
+int64_t fastaIndexSequence_getLength(FastaIndexSequence *sequence) {
+    return sequence->length;
+}
+
+char *fastaIndexSequence_getSubsequence(FastaIndexSequence *sequence, int64_t start, int64_t length) {
+    assert(start >= 0 && length >= 0 && start + length <= sequence->length);
+    char *subsequence = st_malloc(length + 1);
+    subsequence[length] = '\0';
+    if (length == 0) {
+        return subsequence;
+    }
+    // Scan forward from the last indexed base at or before the start. pread doesn't move a shared file
+    // position, so subsequences can be read on different threads at once.
+    char *buffer = st_malloc(FASTA_INDEX_BUFFER_SIZE);
+    int64_t position = start / FASTA_INDEX_STRIDE * FASTA_INDEX_STRIDE;
+    int64_t offset = sequence->offsets[start / FASTA_INDEX_STRIDE];
+    int64_t j = 0;
+    while (j < length) {
+        ssize_t bytesRead = pread(sequence->fastaIndex->fileDescriptor, buffer, FASTA_INDEX_BUFFER_SIZE, offset);
+        if (bytesRead <= 0) {
+            st_errnoAbort("Error reading %s from the fasta file %s", sequence->header, sequence->fastaIndex->fastaFile);
         }
-        i++;
+        for (int64_t i = 0; i < bytesRead && j < length; i++) {
+            if (!isspace(buffer[i])) {
+                if (position++ >= start) {
+                    subsequence[j++] = buffer[i];
+                }
+            }
+        }
+        offset += bytesRead;
     }
-    char *chunkHeader = stString_print("%s|%" PRIi64 "\n", fastaHeader, start);
-    free(fastaHeader);
-    assert(lengthOfChunkRemaining <= chunkSize);
-    assert(start >= 0);
-    int64_t lengthOfSubsequence = lengthOfChunkRemaining;
-    if (start + lengthOfChunkRemaining > seqLength) {
-        lengthOfSubsequence = seqLength - start;
+    free(buffer);
+    return subsequence;
+}
+
+/*
+ * Chunking up a set of sequences into overlapping chunks. The chunks are planned as lists of
+ * subsequences, and only read and written out as fasta files when asked for.
+ */
+
+typedef struct _chunkPiece {
+    void *sequence;
+    int64_t start;
+    int64_t length;
+} ChunkPiece;
+
+struct _sequenceChunker {
+    int64_t chunkSize;
+    int64_t overlapSize;
+    const char *(*getHeader)(void *);
+    char *(*getSubsequence)(void *, int64_t, int64_t);
+    stList *chunks;
+    stList *currentChunk;
+    int64_t chunkRemaining;
+};
+
+SequenceChunker *sequenceChunker_construct(int64_t chunkSize, int64_t overlapSize,
+        const char *(*getHeader)(void *sequence),
+        char *(*getSubsequence)(void *sequence, int64_t start, int64_t length)) {
+    assert(chunkSize > 0);
+    assert(overlapSize >= 0);
+    SequenceChunker *chunker = st_malloc(sizeof(SequenceChunker));
+    chunker->chunkSize = chunkSize;
+    chunker->overlapSize = overlapSize;
+    chunker->getHeader = getHeader;
+    chunker->getSubsequence = getSubsequence;
+    chunker->chunks = stList_construct3(0, (void (*)(void *)) stList_destruct);
+    chunker->currentChunk = NULL;
+    chunker->chunkRemaining = chunkSize;
+    return chunker;
+}
+
+void sequenceChunker_destruct(SequenceChunker *chunker) {
+    stList_destruct(chunker->chunks);
+    free(chunker);
+}
+
+static int64_t sequenceChunker_addSubsequence(SequenceChunker *chunker, void *sequence, int64_t sequenceLength,
+        int64_t start, int64_t lengthOfChunkRemaining) {
+    if (chunker->currentChunk == NULL) {
+        chunker->currentChunk = stList_construct3(0, free);
+        stList_append(chunker->chunks, chunker->currentChunk);
     }
-    assert(lengthOfSubsequence > 0);
-    char c = sequence[start + lengthOfSubsequence];
-    sequence[start + lengthOfSubsequence] = '\0';
-    fastaWrite(&sequence[start], chunkHeader, chunkFileHandle);
-    //fprintf(chunkFileHandle, "%s\n", &sequence[start]);
-    free(chunkHeader);
-    sequence[start + lengthOfSubsequence] = c;
+    assert(lengthOfChunkRemaining <= chunker->chunkSize);
+    assert(start >= 0);
+    ChunkPiece *piece = st_malloc(sizeof(ChunkPiece));
+    piece->sequence = sequence;
+    piece->start = start;
+    piece->length = start + lengthOfChunkRemaining > sequenceLength ? sequenceLength - start : lengthOfChunkRemaining;
+    assert(piece->length > 0);
+    stList_append(chunker->currentChunk, piece);
 
-    updateChunkRemaining(lengthOfSubsequence);
-    return lengthOfSubsequence;
+    //Update remaining portion of the chunk.
+    chunker->chunkRemaining -= piece->length;
+    if (chunker->chunkRemaining <= 0) {
+        chunker->currentChunk = NULL;
+        chunker->chunkRemaining = chunker->chunkSize;
+    }
+    return piece->length;
 }
 
-void processSequenceToChunk(const char *fastaHeader, const char *sequence, int64_t sequenceLength) {
+void sequenceChunker_addSequence(SequenceChunker *chunker, void *sequence, int64_t sequenceLength) {
     if (sequenceLength > 0) {
-        int64_t lengthOfSubsequence = processSubsequenceChunk((char *) fastaHeader, 0, (char *) sequence, sequenceLength, chunkRemaining);
+        int64_t lengthOfSubsequence = sequenceChunker_addSubsequence(chunker, sequence, sequenceLength, 0, chunker->chunkRemaining);
         while (sequenceLength - lengthOfSubsequence > 0) {
-            //Make the non overlap file
-            int64_t lengthOfFollowingSubsequence = processSubsequenceChunk((char *) fastaHeader, lengthOfSubsequence, (char *) sequence, sequenceLength, chunkRemaining);
+            //Make the non overlap piece
+            int64_t lengthOfFollowingSubsequence = sequenceChunker_addSubsequence(chunker, sequence, sequenceLength,
+                    lengthOfSubsequence, chunker->chunkRemaining);
 
-            //Make the overlap file
-            if(chunkOverlapSize > 0) {
-                int64_t i = lengthOfSubsequence - chunkOverlapSize / 2;
+            //Make the overlap piece
+            if (chunker->overlapSize > 0) {
+                int64_t i = lengthOfSubsequence - chunker->overlapSize / 2;
                 if (i < 0) {
                     i = 0;
                 }
-                processSubsequenceChunk((char *) fastaHeader, i, (char *) sequence, sequenceLength, chunkOverlapSize);
+                sequenceChunker_addSubsequence(chunker, sequence, sequenceLength, i, chunker->overlapSize);
             }
             lengthOfSubsequence += lengthOfFollowingSubsequence;
         }
     }
 }
 
-void setupToChunkSequences(int64_t chunkSize2, int64_t overlapSize2, const char *chunksDir2) {
-    chunkSize = chunkSize2;
-    assert(chunkSize > 0);
-    chunkOverlapSize = overlapSize2;
-    assert(chunkOverlapSize >= 0);
-    chunksDir = chunksDir2;
-    chunkNo = 0;
-    chunkRemaining = chunkSize;
-    chunkFileHandle = NULL;
+int64_t sequenceChunker_getChunkNumber(SequenceChunker *chunker) {
+    return stList_length(chunker->chunks);
+}
+
+void sequenceChunker_writeChunk(SequenceChunker *chunker, int64_t chunk, FILE *fileHandle) {
+    stList *pieces = stList_get(chunker->chunks, chunk);
+    for (int64_t i = 0; i < stList_length(pieces); i++) {
+        ChunkPiece *piece = stList_get(pieces, i);
+        char *chunkHeader = stString_print("%s|%" PRIi64 "\n", chunker->getHeader(piece->sequence), piece->start);
+        char *subsequence = chunker->getSubsequence(piece->sequence, piece->start, piece->length);
+        fastaWrite(subsequence, chunkHeader, fileHandle);
+        free(subsequence);
+        free(chunkHeader);
+    }
+}
+
+typedef struct _chunkWriterTask {
+    SequenceChunker *chunker;
+    int64_t chunk;
+    char *chunkFile;
+} ChunkWriterTask;
+
+static void *writeChunkTask(ChunkWriterTask *task) {
+    FILE *fileHandle = fopen(task->chunkFile, "w");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Could not open the chunk file %s", task->chunkFile);
+    }
+    sequenceChunker_writeChunk(task->chunker, task->chunk, fileHandle);
+    if (fclose(fileHandle) != 0) {
+        st_errnoAbort("Error writing the chunk file %s", task->chunkFile);
+    }
+    return task;
+}
+
+stList *sequenceChunker_writeChunks(SequenceChunker *chunker, const char *chunksDir, int64_t numThreads) {
+    stList *chunkFiles = stList_construct3(0, free);
+    stList *tasks = stList_construct3(0, free);
+    for (int64_t i = 0; i < sequenceChunker_getChunkNumber(chunker); i++) {
+        ChunkWriterTask *task = st_malloc(sizeof(ChunkWriterTask));
+        task->chunker = chunker;
+        task->chunk = i;
+        task->chunkFile = stString_print("%s/%" PRIi64 "", chunksDir, i);
+        stList_append(chunkFiles, task->chunkFile);
+        stList_append(tasks, task);
+    }
+    if (numThreads > 1 && stList_length(tasks) > 1) {
+        stThreadPool *threadPool = stThreadPool_construct(numThreads < stList_length(tasks) ? numThreads : stList_length(tasks),
+                (void *(*)(void *)) writeChunkTask, cactusMisc_ignoreThreadPoolResult);
+        for (int64_t i = 0; i < stList_length(tasks); i++) {
+            stThreadPool_push(threadPool, stList_get(tasks, i));
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+    } else {
+        for (int64_t i = 0; i < stList_length(tasks); i++) {
+            writeChunkTask(stList_get(tasks, i));
+        }
+    }
+    stList_destruct(tasks);
+    return chunkFiles;
 }
 
 /*
  * Get the flowers in a file.
  */
 
-int64_t writeFlowerSequences(Flower *flower, void(*processSequence)(const char *, const char *, int64_t), int64_t minimumSequenceLength) {
+struct _flowerSequence {
+    Sequence *sequence;
+    int64_t start;
+    int64_t length;
+    char *header;
+};
+
+static void flowerSequence_destruct(FlowerSequence *flowerSequence) {
+    free(flowerSequence->header);
+    free(flowerSequence);
+}
+
+stList *getFlowerSequences(Flower *flower, int64_t minimumSequenceLength) {
+    stList *flowerSequences = stList_construct3(0, (void (*)(void *)) flowerSequence_destruct);
     Flower_EndIterator *endIterator = flower_getEndIterator(flower);
     End *end;
-    int64_t sequencesWritten = 0;
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
         End_InstanceIterator *instanceIterator = end_getInstanceIterator(end);
         Cap *cap;
@@ -163,38 +388,67 @@ int64_t writeFlowerSequences(Flower *flower, void(*processSequence)(const char *
                 int64_t length = cap_getCoordinate(cap2) - cap_getCoordinate(cap) - 1;
                 assert(length >= 0);
                 if (length >= minimumSequenceLength) {
-                    Sequence *sequence = cap_getSequence(cap);
-                    assert(sequence != NULL);
-                    char *string = sequence_getString(sequence, cap_getCoordinate(cap) + 1, length, 1);
-                    char *header = stString_print("%s|%" PRIi64 "", cactusMisc_nameToStringStatic(cap_getName(cap)), cap_getCoordinate(cap) + 1);
-                    processSequence(header, string, strlen(string));
-                    free(string);
-                    free(header);
-                    sequencesWritten++;
+                    FlowerSequence *flowerSequence = st_malloc(sizeof(FlowerSequence));
+                    flowerSequence->sequence = cap_getSequence(cap);
+                    assert(flowerSequence->sequence != NULL);
+                    flowerSequence->start = cap_getCoordinate(cap) + 1;
+                    flowerSequence->length = length;
+                    flowerSequence->header = stString_print("%s|%" PRIi64 "", cactusMisc_nameToStringStatic(cap_getName(cap)), flowerSequence->start);
+                    stList_append(flowerSequences, flowerSequence);
                 }
             }
         }
         end_destructInstanceIterator(instanceIterator);
     }
     flower_destructEndIterator(endIterator);
+    return flowerSequences;
+}
+
+const char *flowerSequence_getHeader(FlowerSequence *flowerSequence) {
+    return flowerSequence->header;
+}
+
+int64_t flowerSequence_getLength(FlowerSequence *flowerSequence) {
+    return flowerSequence->length;
+}
+
+char *flowerSequence_getSubsequence(FlowerSequence *flowerSequence, int64_t start, int64_t length) {
+    assert(start >= 0 && start + length <= flowerSequence->length);
+    return sequence_getString(flowerSequence->sequence, flowerSequence->start + start, length, 1);
+}
+
+int64_t writeFlowerSequences(Flower *flower, void (*processSequence)(void *, const char *, const char *, int64_t),
+        void *extraArg, int64_t minimumSequenceLength) {
+    stList *flowerSequences = getFlowerSequences(flower, minimumSequenceLength);
+    for (int64_t i = 0; i < stList_length(flowerSequences); i++) {
+        FlowerSequence *flowerSequence = stList_get(flowerSequences, i);
+        char *string = flowerSequence_getSubsequence(flowerSequence, 0, flowerSequence->length);
+        processSequence(extraArg, flowerSequence->header, string, strlen(string));
+        free(string);
+    }
+    int64_t sequencesWritten = stList_length(flowerSequences);
+    stList_destruct(flowerSequences);
     return sequencesWritten;
 }
 
-static FILE *sequenceFileHandle;
-static const char *tempSequenceFile;
-static void writeSequenceInFile(const char *fastaHeader, const char *sequence, int64_t length) {
-    if (sequenceFileHandle == NULL) {
-        sequenceFileHandle = fopen(tempSequenceFile, "w");
+typedef struct _sequenceFile {
+    const char *fileName;
+    FILE *fileHandle;
+} SequenceFile;
+
+static void writeSequenceInFile(SequenceFile *sequenceFile, const char *fastaHeader, const char *sequence, int64_t length) {
+    if (sequenceFile->fileHandle == NULL) {
+        sequenceFile->fileHandle = fopen(sequenceFile->fileName, "w");
     }
-    fastaWrite((char *)sequence, (char *)fastaHeader, sequenceFileHandle);
+    fastaWrite((char *)sequence, (char *)fastaHeader, sequenceFile->fileHandle);
 }
 
 int64_t writeFlowerSequencesInFile(Flower *flower, const char *tempFile, int64_t minimumSequenceLength) {
-    sequenceFileHandle = NULL;
-    tempSequenceFile = tempFile;
-    int64_t sequencesWritten = writeFlowerSequences(flower, writeSequenceInFile, minimumSequenceLength);
-    if (sequenceFileHandle != NULL) {
-        fclose(sequenceFileHandle);
+    SequenceFile sequenceFile = { tempFile, NULL };
+    int64_t sequencesWritten = writeFlowerSequences(flower,
+            (void (*)(void *, const char *, const char *, int64_t)) writeSequenceInFile, &sequenceFile, minimumSequenceLength);
+    if (sequenceFile.fileHandle != NULL) {
+        fclose(sequenceFile.fileHandle);
     }
     return sequencesWritten;
 }
@@ -13,16 +13,80 @@
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
 
-int64_t writeFlowerSequencesInFile(Flower *flower, const char *tempFile1, int64_t minimumSequenceLength);
+void convertCoordinatesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment, int convertContig1, int convertContig2);
 
-int64_t writeFlowerSequences(Flower *flower, void(*processSequence)(const char *, const char *, int64_t), int64_t minimumSequenceLength);
+/*
+ * A faidx style index of the sequences in a fasta file, from which subsequences are read on demand.
+ * Subsequences can be read on different threads at once.
+ */
 
-void convertCoordinatesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment, int convertContig1, int convertContig2);
+typedef struct _fastaIndex FastaIndex;
+
+typedef struct _fastaIndexSequence FastaIndexSequence;
+
+FastaIndex *fastaIndex_construct(const char *fastaFile);
+
+void fastaIndex_destruct(FastaIndex *fastaIndex);
+
+int64_t fastaIndex_getSequenceNumber(FastaIndex *fastaIndex);
+
+FastaIndexSequence *fastaIndex_getSequence(FastaIndex *fastaIndex, int64_t index);
+
+/*
+ * The first token of the header of the sequence.
+ */
+const char *fastaIndexSequence_getHeader(FastaIndexSequence *sequence);
+
+int64_t fastaIndexSequence_getLength(FastaIndexSequence *sequence);
+
+char *fastaIndexSequence_getSubsequence(FastaIndexSequence *sequence, int64_t start, int64_t length);
+
+/*
+ * Chunks up a set of sequences into overlapping chunks of around chunkSize bases. The chunks are planned from
+ * the sequence lengths alone, and the subsequences are only fetched, with the given functions, when the
+ * chunks are written.
+ */
+
+typedef struct _sequenceChunker SequenceChunker;
 
-void setupToChunkSequences(int64_t chunkSize2, int64_t overlapSize2, const char *chunksDir2);
+SequenceChunker *sequenceChunker_construct(int64_t chunkSize, int64_t overlapSize,
+        const char *(*getHeader)(void *sequence),
+        char *(*getSubsequence)(void *sequence, int64_t start, int64_t length));
 
-void processSequenceToChunk(const char *fastaHeader, const char *sequence, int64_t length);
+void sequenceChunker_destruct(SequenceChunker *chunker);
+
+void sequenceChunker_addSequence(SequenceChunker *chunker, void *sequence, int64_t sequenceLength);
+
+int64_t sequenceChunker_getChunkNumber(SequenceChunker *chunker);
+
+/*
+ * Writes the given chunk as fasta, each subsequence headed by the header of its sequence and "|start".
+ */
+void sequenceChunker_writeChunk(SequenceChunker *chunker, int64_t chunk, FILE *fileHandle);
+
+/*
+ * Writes each chunk to its own file in chunksDir, using numThreads threads, and returns the list of files.
+ * getSubsequence must be thread safe if numThreads > 1.
+ */
+stList *sequenceChunker_writeChunks(SequenceChunker *chunker, const char *chunksDir, int64_t numThreads);
+
+/*
+ * The sequences of the adjacencies of a flower that are at least minimumSequenceLength long.
+ */
+
+typedef struct _flowerSequence FlowerSequence;
+
+stList *getFlowerSequences(Flower *flower, int64_t minimumSequenceLength);
+
+const char *flowerSequence_getHeader(FlowerSequence *flowerSequence);
+
+int64_t flowerSequence_getLength(FlowerSequence *flowerSequence);
+
+char *flowerSequence_getSubsequence(FlowerSequence *flowerSequence, int64_t start, int64_t length);
+
+int64_t writeFlowerSequencesInFile(Flower *flower, const char *tempFile1, int64_t minimumSequenceLength);
 
-void finishChunkingSequences();
+int64_t writeFlowerSequences(Flower *flower, void (*processSequence)(void *, const char *, const char *, int64_t),
+        void *extraArg, int64_t minimumSequenceLength);
 
 #endif /* BLASTALIGNMENTLIB_H_ */
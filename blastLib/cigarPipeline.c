@@ -0,0 +1,978 @@
+/*
+ * cigarPipeline.c
+ *
+ * Streaming stages for post-processing blast alignments, see cigarPipeline.h.
+ */
+
+#include <math.h>
+#include "bioioC.h"
+#include "cactus.h"
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+#include "blastAlignmentLib.h"
+#include "cigarPipeline.h"
+
+struct _cigarStage {
+    void (*process)(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment);
+    void (*finish)(CigarStage *stage);
+    void (*destructState)(void *state);
+    void *state;
+    CigarStage **outputs;
+    int64_t outputNumber;
+};
+
+static CigarStage *cigarStage_construct(void (*process)(CigarStage *, struct PairwiseAlignment *),
+        void (*finish)(CigarStage *), void (*destructState)(void *), void *state,
+        CigarStage **outputs, int64_t outputNumber) {
+    CigarStage *stage = st_malloc(sizeof(CigarStage));
+    stage->process = process;
+    stage->finish = finish;
+    stage->destructState = destructState;
+    stage->state = state;
+    stage->outputs = outputs;
+    stage->outputNumber = outputNumber;
+    return stage;
+}
+
+static CigarStage *cigarStage_construct1(void (*process)(CigarStage *, struct PairwiseAlignment *),
+        void (*finish)(CigarStage *), void (*destructState)(void *), void *state, CigarStage *next) {
+    CigarStage **outputs = st_malloc(sizeof(CigarStage *));
+    outputs[0] = next;
+    return cigarStage_construct(process, finish, destructState, state, outputs, 1);
+}
+
+static void cigarStage_emit(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    cigarStage_push(stage->outputs[0], pairwiseAlignment);
+}
+
+void cigarStage_push(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    stage->process(stage, pairwiseAlignment);
+}
+
+void cigarStage_finish(CigarStage *stage) {
+    if (stage->finish != NULL) {
+        stage->finish(stage);
+    }
+    for (int64_t i = 0; i < stage->outputNumber; i++) {
+        cigarStage_finish(stage->outputs[i]);
+    }
+}
+
+void cigarStage_destruct(CigarStage *stage) {
+    if (stage->destructState != NULL) {
+        stage->destructState(stage->state);
+    }
+    for (int64_t i = 0; i < stage->outputNumber; i++) {
+        cigarStage_destruct(stage->outputs[i]);
+    }
+    free(stage->outputs);
+    free(stage);
+}
+
+void cigarStage_pushCigarFile(CigarStage *stage, FILE *fileHandle) {
+    struct PairwiseAlignment *pairwiseAlignment;
+    while ((pairwiseAlignment = cigarRead(fileHandle)) != NULL) {
+        cigarStage_push(stage, pairwiseAlignment);
+    }
+    cigarStage_finish(stage);
+}
+
+/*
+ * Functions on pairwise alignments used by the stages.
+ */
+
+static struct PairwiseAlignment *copyPairwiseAlignment(struct PairwiseAlignment *pA) {
+    struct List *operationList = constructEmptyList(0, (void (*)(void *))destructAlignmentOperation);
+    for (int64_t i = 0; i < pA->operationList->length; i++) {
+        struct AlignmentOperation *op = pA->operationList->list[i];
+        listAppend(operationList, constructAlignmentOperation(op->opType, op->length, op->score));
+    }
+    return constructPairwiseAlignment(pA->contig1, pA->start1, pA->end1, pA->strand1,
+            pA->contig2, pA->start2, pA->end2, pA->strand2, pA->score, operationList);
+}
+
+void invertStrandsOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment) {
+    // Flips the strands of first sequence
+    if(pairwiseAlignment->start1 != pairwiseAlignment->end1) { // If alignment has non zero length on the first sequence
+        int64_t start = pairwiseAlignment->start1;
+        pairwiseAlignment->start1 = pairwiseAlignment->end1;
+        pairwiseAlignment->end1 = start;
+    }
+    pairwiseAlignment->strand1 = pairwiseAlignment->strand1 ? 0 : 1;
+
+    if(pairwiseAlignment->start1 != pairwiseAlignment->end1) { // If alignment has non zero length on the second sequence
+        int64_t start = pairwiseAlignment->start2;
+        pairwiseAlignment->start2 = pairwiseAlignment->end2;
+        pairwiseAlignment->end2 = start;
+    }
+    pairwiseAlignment->strand2 = pairwiseAlignment->strand2 ? 0 : 1;
+
+    // Invert the order of the operations
+    listReverse(pairwiseAlignment->operationList);
+}
+
+void swapSequencesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment) {
+    // Swap the 1s and 2s
+    char *contig1 = pairwiseAlignment->contig1;
+    int64_t start1 = pairwiseAlignment->start1;
+    int64_t end1 = pairwiseAlignment->end1;
+    int64_t strand1 = pairwiseAlignment->strand1;
+
+    pairwiseAlignment->contig1 = pairwiseAlignment->contig2;
+    pairwiseAlignment->start1 = pairwiseAlignment->start2;
+    pairwiseAlignment->end1 = pairwiseAlignment->end2;
+    pairwiseAlignment->strand1 = pairwiseAlignment->strand2;
+
+    pairwiseAlignment->contig2 = contig1;
+    pairwiseAlignment->start2 = start1;
+    pairwiseAlignment->end2 = end1;
+    pairwiseAlignment->strand2 = strand1;
+
+    // Invert the operations
+    for(int64_t i=0; i<pairwiseAlignment->operationList->length; i++) {
+        struct AlignmentOperation *op = pairwiseAlignment->operationList->list[i];
+        assert(op->length >= 0);
+        if(op->opType == PAIRWISE_INDEL_Y) {
+            op->opType = PAIRWISE_INDEL_X;
+        }
+        else if(op->opType == PAIRWISE_INDEL_X) {
+            op->opType = PAIRWISE_INDEL_Y;
+        }
+    }
+}
+
+#define CMP(a, b) ((a) > (b) ? 1 : ((a) < (b) ? -1 : 0))
+
+int cigarPipeline_cmpByFirstSequenceCoordinates(const void *a, const void *b) {
+    const struct PairwiseAlignment *pA1 = a, *pA2 = b;
+    int i = strcmp(pA1->contig1, pA2->contig1);
+    if (i == 0 && (i = CMP(pA1->start1, pA2->start1)) == 0 && (i = CMP(pA1->end1, pA2->end1)) == 0
+            && (i = CMP(pA1->strand1, pA2->strand1)) == 0 && (i = strcmp(pA1->contig2, pA2->contig2)) == 0
+            && (i = CMP(pA1->start2, pA2->start2)) == 0 && (i = CMP(pA1->end2, pA2->end2)) == 0
+            && (i = CMP(pA1->strand2, pA2->strand2)) == 0 && (i = CMP(pA1->score, pA2->score)) == 0
+            && (i = CMP(pA1->operationList->length, pA2->operationList->length)) == 0) {
+        // Break the remaining ties on the operations, so identical alignments end up next to one another
+        for (int64_t j = 0; j < pA1->operationList->length && i == 0; j++) {
+            struct AlignmentOperation *op1 = pA1->operationList->list[j], *op2 = pA2->operationList->list[j];
+            if ((i = CMP(op1->opType, op2->opType)) == 0 && (i = CMP(op1->length, op2->length)) == 0) {
+                i = CMP(op1->score, op2->score);
+            }
+        }
+    }
+    return i;
+}
+
+int cigarPipeline_cmpByDescendingScore(const void *a, const void *b) {
+    const struct PairwiseAlignment *pA1 = a, *pA2 = b;
+    return CMP(pA2->score, pA1->score);
+}
+
+bool cigarPipeline_pairwiseAlignmentsEqual(struct PairwiseAlignment *pA1, struct PairwiseAlignment *pA2) {
+    return cigarPipeline_cmpByFirstSequenceCoordinates(pA1, pA2) == 0;
+}
+
+stHash *constructHeaderToNameHash(Flower *flower) {
+    stHash *headerToName = stHash_construct3(stHash_stringKey, stHash_stringEqualKey, free, free);
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    End *end;
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        End_InstanceIterator *capIt = end_getInstanceIterator(end);
+        Cap *cap;
+        while ((cap = end_getNext(capIt)) != NULL) {
+            if (!cap_getStrand(cap)) {
+                cap = cap_getReverse(cap);
+            }
+            if (cap_getSide(cap)) {
+                continue;
+            }
+            Name name = cap_getName(cap);
+            const char *header = sequence_getHeader(cap_getSequence(cap));
+            Name *otherName = stHash_search(headerToName, (void *) header);
+            if (otherName != NULL) {
+                // There is already a header -> cap name map, check
+                // that it has the same name.
+                fprintf(stderr, "Collision with header %s: name %" PRIi64
+                        " otherName: %" PRIi64 "\n", header, name, *otherName);
+                assert(*otherName == name);
+                continue;
+            }
+            Name *heapName = st_malloc(sizeof(Name));
+            *heapName = name;
+            stHash_insert(headerToName, stString_copy(header), heapName);
+        }
+        end_destructInstanceIterator(capIt);
+    }
+    flower_destructEndIterator(endIt);
+    return headerToName;
+}
+
+static void convertHeaderToName(char **contig, int64_t *start, int64_t *end, stHash *headerToName) {
+    Name *name = stHash_search(headerToName, *contig);
+    if (name == NULL) {
+        fprintf(stderr, "Error: sequence %s is not loaded into the cactus "
+                "database\n", *contig);
+        exit(1);
+    }
+    free(*contig);
+    *contig = cactusMisc_nameToString(*name);
+    // Coordinates have to be shifted by 2 to keep compatibility with
+    // cactus coordinates.
+    *start += 2;
+    *end += 2;
+}
+
+void convertHeadersOfPairwiseAlignmentToNames(struct PairwiseAlignment *pairwiseAlignment, stHash *headerToName) {
+    convertHeaderToName(&pairwiseAlignment->contig1, &pairwiseAlignment->start1, &pairwiseAlignment->end1, headerToName);
+    convertHeaderToName(&pairwiseAlignment->contig2, &pairwiseAlignment->start2, &pairwiseAlignment->end2, headerToName);
+}
+
+/*
+ * Writer stage.
+ */
+
+typedef struct _writerState {
+    FILE *fileHandle;
+    bool withProbs;
+} WriterState;
+
+static void writer_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    WriterState *state = stage->state;
+    cigarWrite(state->fileHandle, pairwiseAlignment, state->withProbs);
+    destructPairwiseAlignment(pairwiseAlignment);
+}
+
+CigarStage *cigarStage_constructWriter(FILE *fileHandle, bool withProbs) {
+    WriterState *state = st_malloc(sizeof(WriterState));
+    state->fileHandle = fileHandle;
+    state->withProbs = withProbs;
+    return cigarStage_construct(writer_process, NULL, free, state, NULL, 0);
+}
+
+/*
+ * Coordinate conversion stage.
+ */
+
+typedef struct _convertCoordinatesState {
+    int64_t roundsOfConversion;
+    bool convertContig1, convertContig2;
+} ConvertCoordinatesState;
+
+static void convertCoordinates_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    ConvertCoordinatesState *state = stage->state;
+    for (int64_t i = 0; i < state->roundsOfConversion; i++) {
+        convertCoordinatesOfPairwiseAlignment(pairwiseAlignment, state->convertContig1, state->convertContig2);
+    }
+    cigarStage_emit(stage, pairwiseAlignment);
+}
+
+CigarStage *cigarStage_constructConvertCoordinates(int64_t roundsOfConversion, bool convertContig1,
+        bool convertContig2, CigarStage *next) {
+    assert(roundsOfConversion >= 1);
+    ConvertCoordinatesState *state = st_malloc(sizeof(ConvertCoordinatesState));
+    state->roundsOfConversion = roundsOfConversion;
+    state->convertContig1 = convertContig1;
+    state->convertContig2 = convertContig2;
+    return cigarStage_construct1(convertCoordinates_process, NULL, free, state, next);
+}
+
+/*
+ * Mirror and orient stage.
+ */
+
+static void mirrorAndOrient_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    // The original alignment
+    if(!pairwiseAlignment->strand1) {
+        invertStrandsOfPairwiseAlignment(pairwiseAlignment);
+    }
+    checkPairwiseAlignment(pairwiseAlignment);
+
+    // The mirror alignment (with query and target reversed)
+    struct PairwiseAlignment *mirrorAlignment = copyPairwiseAlignment(pairwiseAlignment);
+    swapSequencesOfPairwiseAlignment(mirrorAlignment);
+    if(!mirrorAlignment->strand1) {
+        invertStrandsOfPairwiseAlignment(mirrorAlignment);
+    }
+    checkPairwiseAlignment(mirrorAlignment);
+
+    cigarStage_emit(stage, pairwiseAlignment);
+    cigarStage_emit(stage, mirrorAlignment);
+}
+
+CigarStage *cigarStage_constructMirrorAndOrient(CigarStage *next) {
+    return cigarStage_construct1(mirrorAndOrient_process, NULL, NULL, NULL, next);
+}
+
+/*
+ * Internal names stage.
+ */
+
+static void convertToInternalNames_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    convertHeadersOfPairwiseAlignmentToNames(pairwiseAlignment, stage->state);
+    checkPairwiseAlignment(pairwiseAlignment);
+    cigarStage_emit(stage, pairwiseAlignment);
+}
+
+CigarStage *cigarStage_constructConvertToInternalNames(stHash *headerToName, CigarStage *next) {
+    return cigarStage_construct1(convertToInternalNames_process, NULL, NULL, headerToName, next);
+}
+
+/*
+ * External merge sort stage. Runs are spilled to temporary files in a compact binary form, so
+ * reading them back is exact (scores are not rounded as they are in cigars) and cheap. The sort
+ * is stable: alignments the comparison function ties keep their input order, so the output
+ * doesn't depend on how the input is split into runs.
+ */
+
+typedef struct _sortState {
+    int (*cmpFn)(const void *, const void *);
+    int64_t maxBytesInMemory;
+    int64_t bytesInMemory;
+    int64_t alignmentNumber; // Of the alignments pushed into the stage, used to break ties
+    stList *alignments; // Of SortedAlignments
+    stList *runFiles;
+} SortState;
+
+typedef struct _sortedAlignment {
+    struct PairwiseAlignment *pA;
+    int64_t index;
+} SortedAlignment;
+
+static int sortedAlignment_cmp(const void *a, const void *b, const void *cmpFn) {
+    const SortedAlignment *sA1 = a, *sA2 = b;
+    int i = ((int (*)(const void *, const void *)) cmpFn)(sA1->pA, sA2->pA);
+    return i != 0 ? i : CMP(sA1->index, sA2->index);
+}
+
+/*
+ * The number of bytes the alignment takes up in memory, roughly.
+ */
+static int64_t sort_getAlignmentSize(struct PairwiseAlignment *pA) {
+    return sizeof(SortedAlignment) + sizeof(struct PairwiseAlignment) + strlen(pA->contig1) + strlen(pA->contig2) + 2
+            + pA->operationList->length * (sizeof(struct AlignmentOperation) + sizeof(void *));
+}
+
+typedef struct _binaryAlignmentOperation {
+    int64_t opType, length;
+    double score;
+} BinaryAlignmentOperation;
+
+static void writeBinaryPairwiseAlignment(FILE *fileHandle, struct PairwiseAlignment *pA) {
+    int64_t header[9] = { strlen(pA->contig1), pA->start1, pA->end1, pA->strand1,
+            strlen(pA->contig2), pA->start2, pA->end2, pA->strand2, pA->operationList->length };
+    double score = pA->score;
+    bool failed = fwrite(header, sizeof(int64_t), 9, fileHandle) != 9
+            || fwrite(pA->contig1, 1, header[0], fileHandle) != header[0]
+            || fwrite(pA->contig2, 1, header[4], fileHandle) != header[4]
+            || fwrite(&score, sizeof(double), 1, fileHandle) != 1;
+    for (int64_t i = 0; i < pA->operationList->length && !failed; i++) {
+        struct AlignmentOperation *op = pA->operationList->list[i];
+        BinaryAlignmentOperation binaryOp = { op->opType, op->length, op->score };
+        failed = fwrite(&binaryOp, sizeof(BinaryAlignmentOperation), 1, fileHandle) != 1;
+    }
+    if (failed) {
+        st_errAbort("Error writing a sorted run of alignments to disk\n");
+    }
+}
+
+static char *readBinaryString(FILE *fileHandle, int64_t length) {
+    char *string = st_malloc(length + 1);
+    if (fread(string, 1, length, fileHandle) != length) {
+        st_errAbort("Error reading a sorted run of alignments from disk\n");
+    }
+    string[length] = '\0';
+    return string;
+}
+
+static struct PairwiseAlignment *readBinaryPairwiseAlignment(FILE *fileHandle) {
+    int64_t header[9];
+    size_t i = fread(header, sizeof(int64_t), 9, fileHandle);
+    if (i == 0 && feof(fileHandle)) {
+        return NULL;
+    }
+    if (i != 9) {
+        st_errAbort("Error reading a sorted run of alignments from disk\n");
+    }
+    char *contig1 = readBinaryString(fileHandle, header[0]);
+    char *contig2 = readBinaryString(fileHandle, header[4]);
+    double score;
+    if (fread(&score, sizeof(double), 1, fileHandle) != 1) {
+        st_errAbort("Error reading a sorted run of alignments from disk\n");
+    }
+    struct List *operationList = constructEmptyList(0, (void (*)(void *))destructAlignmentOperation);
+    for (int64_t j = 0; j < header[8]; j++) {
+        BinaryAlignmentOperation binaryOp;
+        if (fread(&binaryOp, sizeof(BinaryAlignmentOperation), 1, fileHandle) != 1) {
+            st_errAbort("Error reading a sorted run of alignments from disk\n");
+        }
+        listAppend(operationList, constructAlignmentOperation(binaryOp.opType, binaryOp.length, binaryOp.score));
+    }
+    struct PairwiseAlignment *pA = constructPairwiseAlignment(contig1, header[1], header[2], header[3],
+            contig2, header[5], header[6], header[7], score, operationList);
+    free(contig1);
+    free(contig2);
+    return pA;
+}
+
+static void sortedAlignment_destruct(SortedAlignment *sA) {
+    if (sA->pA != NULL) {
+        destructPairwiseAlignment(sA->pA);
+    }
+    free(sA);
+}
+
+/*
+ * Empties the in memory buffer once its alignments have been written out or passed on.
+ */
+static void sort_resetAlignments(SortState *state) {
+    stList_destruct(state->alignments);
+    state->alignments = stList_construct3(0, (void (*)(void *))sortedAlignment_destruct);
+    state->bytesInMemory = 0;
+}
+
+static void sort_spillRun(SortState *state) {
+    stList_sort2(state->alignments, sortedAlignment_cmp, state->cmpFn);
+    char *runFile = getTempFile();
+    FILE *fileHandle = fopen(runFile, "w");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Could not open the temporary file %s to spill sorted alignments to", runFile);
+    }
+    for (int64_t i = 0; i < stList_length(state->alignments); i++) {
+        SortedAlignment *sA = stList_get(state->alignments, i);
+        writeBinaryPairwiseAlignment(fileHandle, sA->pA);
+    }
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Error writing the temporary file %s\n", runFile);
+    }
+    st_logDebug("Spilled a sorted run of %" PRIi64 " alignments to %s\n", stList_length(state->alignments), runFile);
+    sort_resetAlignments(state);
+    stList_append(state->runFiles, runFile);
+}
+
+static void sort_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    SortState *state = stage->state;
+    SortedAlignment *sA = st_malloc(sizeof(SortedAlignment));
+    sA->pA = pairwiseAlignment;
+    sA->index = state->alignmentNumber++;
+    stList_append(state->alignments, sA);
+    state->bytesInMemory += sort_getAlignmentSize(pairwiseAlignment);
+    if (state->bytesInMemory >= state->maxBytesInMemory) {
+        sort_spillRun(state);
+    }
+}
+
+typedef struct _sortRun {
+    struct PairwiseAlignment *pA; // The next alignment of the run
+    FILE *fileHandle;
+    int64_t index;
+    int (*cmpFn)(const void *, const void *);
+} SortRun;
+
+static int sortRun_cmp(const void *a, const void *b) {
+    const SortRun *run1 = a, *run2 = b;
+    int i = run1->cmpFn(run1->pA, run2->pA);
+    return i != 0 ? i : CMP(run1->index, run2->index);
+}
+
+static void sort_finish(CigarStage *stage) {
+    SortState *state = stage->state;
+    if (stList_length(state->runFiles) == 0) {
+        // Everything fitted in memory
+        stList_sort2(state->alignments, sortedAlignment_cmp, state->cmpFn);
+        for (int64_t i = 0; i < stList_length(state->alignments); i++) {
+            SortedAlignment *sA = stList_get(state->alignments, i);
+            cigarStage_emit(stage, sA->pA);
+            sA->pA = NULL;
+        }
+        sort_resetAlignments(state);
+        return;
+    }
+    if (stList_length(state->alignments) > 0) {
+        sort_spillRun(state);
+    }
+    // Merge the runs, keeping the next alignment of each run in a sorted set. The runs hold consecutive
+    // stretches of the input, so breaking ties by run keeps the sort stable
+    stSortedSet *runs = stSortedSet_construct3(sortRun_cmp, free);
+    for (int64_t i = 0; i < stList_length(state->runFiles); i++) {
+        SortRun *run = st_malloc(sizeof(SortRun));
+        run->fileHandle = fopen(stList_get(state->runFiles, i), "r");
+        if (run->fileHandle == NULL) {
+            st_errnoAbort("Could not open the sorted run %s", (char *)stList_get(state->runFiles, i));
+        }
+        run->index = i;
+        run->cmpFn = state->cmpFn;
+        run->pA = readBinaryPairwiseAlignment(run->fileHandle);
+        assert(run->pA != NULL);
+        stSortedSet_insert(runs, run);
+    }
+    while (stSortedSet_size(runs) > 0) {
+        SortRun *run = stSortedSet_getFirst(runs);
+        stSortedSet_remove(runs, run);
+        cigarStage_emit(stage, run->pA);
+        if ((run->pA = readBinaryPairwiseAlignment(run->fileHandle)) != NULL) {
+            stSortedSet_insert(runs, run);
+        } else {
+            fclose(run->fileHandle);
+            free(run);
+        }
+    }
+    stSortedSet_destruct(runs);
+    for (int64_t i = 0; i < stList_length(state->runFiles); i++) {
+        stFile_rmrf(stList_get(state->runFiles, i));
+    }
+    stList_destruct(state->runFiles);
+    state->runFiles = stList_construct3(0, free);
+}
+
+static void sort_destructState(SortState *state) {
+    stList_destruct(state->alignments);
+    stList_destruct(state->runFiles);
+    free(state);
+}
+
+CigarStage *cigarStage_constructSort(int (*cmpFn)(const void *, const void *), int64_t maxBytesInMemory,
+        CigarStage *next) {
+    assert(maxBytesInMemory >= 1);
+    SortState *state = st_malloc(sizeof(SortState));
+    state->cmpFn = cmpFn;
+    state->maxBytesInMemory = maxBytesInMemory;
+    state->bytesInMemory = 0;
+    state->alignmentNumber = 0;
+    state->alignments = stList_construct3(0, (void (*)(void *))sortedAlignment_destruct);
+    state->runFiles = stList_construct3(0, free);
+    return cigarStage_construct1(sort_process, sort_finish, (void (*)(void *))sort_destructState, state, next);
+}
+
+/*
+ * Unique stage.
+ */
+
+typedef struct _uniqueState {
+    struct PairwiseAlignment *previous;
+} UniqueState;
+
+static void unique_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    UniqueState *state = stage->state;
+    if (state->previous != NULL && cigarPipeline_pairwiseAlignmentsEqual(state->previous, pairwiseAlignment)) {
+        destructPairwiseAlignment(pairwiseAlignment);
+        return;
+    }
+    if (state->previous != NULL) {
+        cigarStage_emit(stage, state->previous);
+    }
+    state->previous = pairwiseAlignment;
+}
+
+static void unique_finish(CigarStage *stage) {
+    UniqueState *state = stage->state;
+    if (state->previous != NULL) {
+        cigarStage_emit(stage, state->previous);
+        state->previous = NULL;
+    }
+}
+
+static void unique_destructState(UniqueState *state) {
+    if (state->previous != NULL) {
+        destructPairwiseAlignment(state->previous);
+    }
+    free(state);
+}
+
+CigarStage *cigarStage_constructUnique(CigarStage *next) {
+    UniqueState *state = st_calloc(1, sizeof(UniqueState));
+    return cigarStage_construct1(unique_process, unique_finish, (void (*)(void *))unique_destructState, state, next);
+}
+
+/*
+ * Split overlaps stage.
+ *
+ * Each alignment has a unique first sequence interval, defined by where it starts and ends on the
+ * first sequence. Two alignments partially overlap if their first sequence intervals overlap but are not
+ * the same. This stage breaks up the alignments so that there are no partial overlaps between them.
+ *
+ * As the alignments arrive sorted by start coordinate, and each is cut at the start of the next, the
+ * active alignments always share the same start coordinate, so they are kept in a min-heap ordered by
+ * end coordinate. Rather than rewriting the operation list of an alignment each time a prefix is cut
+ * off it, each active alignment has a cursor to the first operation (and the length of it) not yet
+ * passed on, and operations are moved into the prefix alignments without being copied.
+ */
+
+static uint64_t getStartCoordinate(struct PairwiseAlignment *pairwiseAlignment) {
+    assert(pairwiseAlignment->strand1); // This code assumes that the alignment is reported with respect
+    // to the positive strand of the first sequence
+    return pairwiseAlignment->start1;
+}
+
+static uint64_t getEndCoordinate(struct PairwiseAlignment *pairwiseAlignment) {
+    assert(pairwiseAlignment->strand1); // This code assumes that the alignment is reported with respect
+    // to the positive strand of the first sequence
+    return pairwiseAlignment->end1;
+}
+
+typedef struct _alignmentCursor {
+    struct PairwiseAlignment *pairwiseAlignment; // Its start coordinates are those of the cursor
+    int64_t opIndex; // The first operation not yet passed on, those before it are NULL
+    int64_t opOffset; // The length of that operation already passed on
+    int64_t index; // The order the alignment arrived in, to break ties between equal end coordinates
+} AlignmentCursor;
+
+typedef struct _splitOverlapsState {
+    AlignmentCursor **activeAlignments; // Min-heap ordered by end coordinate
+    int64_t activeAlignmentNumber;
+    int64_t maxActiveAlignmentNumber;
+    int64_t alignmentNumber;
+} SplitOverlapsState;
+
+static bool alignmentCursor_lessThan(AlignmentCursor *cursor1, AlignmentCursor *cursor2) {
+    int64_t end1 = cursor1->pairwiseAlignment->end1, end2 = cursor2->pairwiseAlignment->end1;
+    return end1 < end2 || (end1 == end2 && cursor1->index < cursor2->index);
+}
+
+static void activeAlignments_push(SplitOverlapsState *state, AlignmentCursor *cursor) {
+    if(state->activeAlignmentNumber == state->maxActiveAlignmentNumber) {
+        state->maxActiveAlignmentNumber = state->maxActiveAlignmentNumber == 0 ? 16 : 2 * state->maxActiveAlignmentNumber;
+        state->activeAlignments = realloc(state->activeAlignments,
+                state->maxActiveAlignmentNumber * sizeof(AlignmentCursor *));
+        if(state->activeAlignments == NULL) {
+            st_errAbort("Out of memory growing the set of active alignments\n");
+        }
+    }
+    AlignmentCursor **heap = state->activeAlignments;
+    int64_t i = state->activeAlignmentNumber++;
+    while(i > 0 && alignmentCursor_lessThan(cursor, heap[(i-1)/2])) {
+        heap[i] = heap[(i-1)/2];
+        i = (i-1)/2;
+    }
+    heap[i] = cursor;
+}
+
+static AlignmentCursor *activeAlignments_pop(SplitOverlapsState *state) {
+    assert(state->activeAlignmentNumber > 0);
+    AlignmentCursor **heap = state->activeAlignments;
+    AlignmentCursor *min = heap[0];
+    AlignmentCursor *last = heap[--state->activeAlignmentNumber];
+    int64_t i = 0;
+    while(2*i+1 < state->activeAlignmentNumber) {
+        int64_t child = 2*i+1;
+        if(child+1 < state->activeAlignmentNumber && alignmentCursor_lessThan(heap[child+1], heap[child])) {
+            child++;
+        }
+        if(!alignmentCursor_lessThan(heap[child], last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return min;
+}
+
+/*
+ * Moves the operation at the cursor into the list, trimming off the length of it already passed on.
+ */
+static void alignmentCursor_moveOp(AlignmentCursor *cursor, struct List *ops) {
+    struct AlignmentOperation *op = cursor->pairwiseAlignment->operationList->list[cursor->opIndex];
+    op->length -= cursor->opOffset;
+    listAppend(ops, op);
+    cursor->pairwiseAlignment->operationList->list[cursor->opIndex++] = NULL;
+    cursor->opOffset = 0;
+}
+
+static struct PairwiseAlignment *removeAlignmentPrefix(AlignmentCursor *cursor, int64_t prefixEnd) {
+    struct PairwiseAlignment *pairwiseAlignment = cursor->pairwiseAlignment;
+    // Store the original start coordinates
+    int64_t start1 = pairwiseAlignment->start1, start2 = pairwiseAlignment->start2;
+    assert(pairwiseAlignment->end1 > prefixEnd);
+    assert(pairwiseAlignment->start1 < prefixEnd);
+    assert(pairwiseAlignment->strand1);
+
+    // Split the ops in the cigar string between the prefix and suffix alignments
+    struct List *prefixOps = constructEmptyList(0, (void (*)(void *))destructAlignmentOperation);
+    do {
+        assert(cursor->opIndex < pairwiseAlignment->operationList->length);
+        struct AlignmentOperation *op = pairwiseAlignment->operationList->list[cursor->opIndex];
+        int64_t opLength = op->length - cursor->opOffset;
+        assert(opLength > 0);
+
+        if(op->opType == PAIRWISE_INDEL_Y) { // Insert in second sequence
+            alignmentCursor_moveOp(cursor, prefixOps);
+            pairwiseAlignment->start2 += pairwiseAlignment->strand2 ? opLength : -opLength;
+        }
+        else { // Not an insert in second sequence
+            // Op is in the prefix alignment
+            int64_t j;
+            if(pairwiseAlignment->start1 + opLength <= prefixEnd) {
+                alignmentCursor_moveOp(cursor, prefixOps);
+                j = opLength;
+            }
+            // Op spans the prefix and suffix alignments, so split it
+            else {
+                j = prefixEnd-pairwiseAlignment->start1;
+                assert(j > 0);
+                listAppend(prefixOps, constructAlignmentOperation(op->opType, j, op->score));
+                cursor->opOffset += j;
+                assert(pairwiseAlignment->start1+j == prefixEnd);
+            }
+
+            // Update start coordinates of suffix alignments
+            pairwiseAlignment->start1 += j;
+            if(op->opType != PAIRWISE_INDEL_X) {
+                pairwiseAlignment->start2 += pairwiseAlignment->strand2 ? j : -j;
+            }
+        }
+    } while(pairwiseAlignment->start1 < prefixEnd);
+
+    assert(pairwiseAlignment->start1 == prefixEnd);
+    assert(cursor->opIndex < pairwiseAlignment->operationList->length);
+
+    // Create prefix pairwiseAlignment
+    struct PairwiseAlignment *prefixAlignment = constructPairwiseAlignment(pairwiseAlignment->contig1,
+            start1, pairwiseAlignment->start1, 1,
+            pairwiseAlignment->contig2, start2, pairwiseAlignment->start2, pairwiseAlignment->strand2,
+            pairwiseAlignment->score, prefixOps);
+
+    return prefixAlignment;
+}
+
+/*
+ * Destructs the cursor, returning the alignment with the operations already passed on removed.
+ */
+static struct PairwiseAlignment *alignmentCursor_destruct(AlignmentCursor *cursor) {
+    struct PairwiseAlignment *pairwiseAlignment = cursor->pairwiseAlignment;
+    struct List *ops = pairwiseAlignment->operationList;
+    if(cursor->opIndex > 0 || cursor->opOffset > 0) {
+        ((struct AlignmentOperation *)ops->list[cursor->opIndex])->length -= cursor->opOffset;
+        int64_t j = 0;
+        for(int64_t i=cursor->opIndex; i<ops->length; i++) {
+            ops->list[j++] = ops->list[i];
+        }
+        ops->length = j;
+    }
+    free(cursor);
+    return pairwiseAlignment;
+}
+
+static void emitBlock(CigarStage *stage, uint64_t from, uint64_t to) {
+    /*
+     * Emits block of alignments that all start, inclusive, at 'from' and end, exclusive, at 'to'.
+     */
+    SplitOverlapsState *state = stage->state;
+
+    // Pass on the alignments that end at 'to' whole
+    while(state->activeAlignmentNumber > 0 &&
+          getEndCoordinate(state->activeAlignments[0]->pairwiseAlignment) == to) {
+        struct PairwiseAlignment *pairwiseAlignment = alignmentCursor_destruct(activeAlignments_pop(state));
+        assert(getStartCoordinate(pairwiseAlignment) == from);
+        cigarStage_emit(stage, pairwiseAlignment);
+    }
+
+    // Now split the remaining alignments, which must all end after 'to'. Their
+    // end coordinates are unchanged, so the heap remains ordered.
+    for(int64_t i=0; i<state->activeAlignmentNumber; i++) {
+        AlignmentCursor *cursor = state->activeAlignments[i];
+        assert(getStartCoordinate(cursor->pairwiseAlignment) == from);
+        assert(getEndCoordinate(cursor->pairwiseAlignment) > to);
+
+        // Cleave off the prefix of the alignment
+        struct PairwiseAlignment *prefixPairwiseAlignment = removeAlignmentPrefix(cursor, to);
+        assert(getStartCoordinate(prefixPairwiseAlignment) == from);
+        assert(getEndCoordinate(prefixPairwiseAlignment) == to);
+        assert(getStartCoordinate(cursor->pairwiseAlignment) == to);
+
+        // Pass on the prefix alignment up until end
+        cigarStage_emit(stage, prefixPairwiseAlignment);
+    }
+}
+
+static void splitAlignmentOverlaps(CigarStage *stage, uint64_t splitUpto) {
+    SplitOverlapsState *state = stage->state;
+    if(state->activeAlignmentNumber == 0) {
+        return; // Nothing to do
+    }
+
+    // Process overlaps between alignments that precede splitUpto
+    uint64_t from = getStartCoordinate(state->activeAlignments[0]->pairwiseAlignment);
+    uint64_t to;
+    // while (minEndCoordinate = Min end coordinate in S) < splitUpto:
+    while(state->activeAlignmentNumber > 0 &&
+          (to = getEndCoordinate(state->activeAlignments[0]->pairwiseAlignment)) < splitUpto) {
+        assert(from < to);
+        emitBlock(stage, from, to);
+        from = to;
+    }
+
+    // Now split at the splitUpto point
+    if(state->activeAlignmentNumber > 0 && from < splitUpto) {
+        emitBlock(stage, from, splitUpto);
+    }
+}
+
+static void splitOverlaps_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    SplitOverlapsState *state = stage->state;
+    // There are existing alignments
+    if(state->activeAlignmentNumber > 0) {
+        // If the new alignment is on the same sequence as the previous sequence
+        if(strcmp(state->activeAlignments[0]->pairwiseAlignment->contig1, pairwiseAlignment->contig1) == 0) {
+            // Remove overlaps in alignments up to but excluding the start of pairwiseAlignment
+            splitAlignmentOverlaps(stage, getStartCoordinate(pairwiseAlignment));
+        }
+        else {
+            // If pairwiseAlignment is on a new sequence
+            splitAlignmentOverlaps(stage, UINT64_MAX);
+            assert(state->activeAlignmentNumber == 0);
+        }
+    }
+
+    // Add pairwiseAlignment to the set of active alignments
+    AlignmentCursor *cursor = st_malloc(sizeof(AlignmentCursor));
+    cursor->pairwiseAlignment = pairwiseAlignment;
+    cursor->opIndex = 0;
+    cursor->opOffset = 0;
+    cursor->index = state->alignmentNumber++;
+    activeAlignments_push(state, cursor);
+}
+
+static void splitOverlaps_finish(CigarStage *stage) {
+    // Remove remaining overlaps in alignments
+    splitAlignmentOverlaps(stage, UINT64_MAX);
+    assert(((SplitOverlapsState *)stage->state)->activeAlignmentNumber == 0);
+}
+
+static void splitOverlaps_destructState(SplitOverlapsState *state) {
+    for(int64_t i=0; i<state->activeAlignmentNumber; i++) {
+        destructPairwiseAlignment(alignmentCursor_destruct(state->activeAlignments[i]));
+    }
+    free(state->activeAlignments);
+    free(state);
+}
+
+CigarStage *cigarStage_constructSplitOverlaps(CigarStage *next) {
+    SplitOverlapsState *state = st_calloc(1, sizeof(SplitOverlapsState));
+    return cigarStage_construct1(splitOverlaps_process, splitOverlaps_finish,
+            (void (*)(void *))splitOverlaps_destructState, state, next);
+}
+
+/*
+ * Mapping qualities stage.
+ */
+
+typedef struct _mappingQualitiesState {
+    int64_t maxAlignmentsPerSite;
+    float minimumMapQValue;
+    float alpha;
+    stList *alignments; // Alignments with the same first sequence interval
+} MappingQualitiesState;
+
+static int cmpAlignmentsByScore(const void *a, const void *b) {
+    const struct PairwiseAlignment *pA1 = a;
+    const struct PairwiseAlignment *pA2 = b;
+    return pA1->score < pA2->score ? -1 : (pA1->score > pA2->score ? 1 : 0);
+}
+
+static void updateScoresToReflectMappingQualities(stList *alignments, float alpha, uint64_t numAlignmentsToScore) {
+    uint64_t alignmentNumber = stList_length(alignments);
+    if(alignmentNumber == 0) {
+        return;
+    }
+
+    // Create an array of the scores, which are in ascending order
+    float *alignmentScores = st_calloc(alignmentNumber, sizeof(float));
+    for(uint64_t i=0; i<alignmentNumber; i++) {
+        alignmentScores[i] = ((struct PairwiseAlignment *)stList_get(alignments, i))->score;
+    }
+    float maxScore = alignmentScores[alignmentNumber-1];
+
+    // The denominator for the i-th alignment is z_i = sum_j 10^(alpha * (s_j - s_i)), which factors as
+    // 10^(alpha * (m - s_i)) * sum_j 10^(alpha * (s_j - m)), where m is the maximum score. The sum is
+    // shared by every alignment at the site, so it is computed once, and with the maximum factored out
+    // none of its terms exceed one, so it cannot overflow.
+    double alphaLn10 = alpha * log(10.0);
+    double scaledSum = 0.0;
+    for(uint64_t j=0; j<alignmentNumber; j++) {
+        scaledSum += exp(alphaLn10 * (alignmentScores[j] - maxScore));
+    }
+
+    // Calculate mapQs for the best N alignments (N = numAlignmentsToScore).
+    uint64_t start = alignmentNumber > numAlignmentsToScore ? alignmentNumber - numAlignmentsToScore : 0;
+    for(uint64_t i=start; i<alignmentNumber; i++) {
+        struct PairwiseAlignment *pA = stList_get(alignments, i);
+
+        // Cut off the calculation if clearly going to be zero
+        if(alpha * (alignmentScores[i] - maxScore) < -10) {
+            pA->score = 0.0;
+        }
+
+        else {
+            // Calculate the denominator
+            double z = scaledSum * exp(alphaLn10 * (maxScore - alignmentScores[i]));
+            assert(z >= 1.0);
+
+            if(z <= 1.000001) { // Round scores to max of 60
+                pA->score = 60.0;
+            }
+            else {
+                pA->score = -10.0 * log10(1.0 - 1.0/z);
+                assert(pA->score >= 0.0);
+            }
+        }
+    }
+
+    // Cleanup
+    free(alignmentScores);
+}
+
+static void reportAlignments(CigarStage *stage) {
+    MappingQualitiesState *state = stage->state;
+    stList *alignments = state->alignments;
+
+    // Sort by ascending score
+    stList_sort(alignments, cmpAlignmentsByScore);
+
+    // Calculate the mapping qualities
+    updateScoresToReflectMappingQualities(alignments, state->alpha, state->maxAlignmentsPerSite);
+
+    // Report the alignments
+    for(int64_t i=0; stList_length(alignments) > 0;) {
+        struct PairwiseAlignment *pairwiseAlignment = stList_pop(alignments);
+        if(i < state->maxAlignmentsPerSite && pairwiseAlignment->score >= state->minimumMapQValue) {
+            cigarStage_push(stage->outputs[i++], pairwiseAlignment);
+        }
+        else {
+            destructPairwiseAlignment(pairwiseAlignment);
+        }
+    }
+}
+
+static void mappingQualities_process(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment) {
+    MappingQualitiesState *state = stage->state;
+    // If the pairwiseAlignment does not share the same interval
+    // as the previous pairwise alignments report the previous alignments
+    if(stList_length(state->alignments) > 0 &&
+        (strcmp(((struct PairwiseAlignment *)stList_peek(state->alignments))->contig1, pairwiseAlignment->contig1) != 0 ||
+         getStartCoordinate(stList_peek(state->alignments)) != getStartCoordinate(pairwiseAlignment))) {
+        reportAlignments(stage);
+    }
+
+    // Adding the pairwise alignment to the set to consider
+    stList_append(state->alignments, pairwiseAlignment);
+}
+
+static void mappingQualities_finish(CigarStage *stage) {
+    reportAlignments(stage);
+}
+
+static void mappingQualities_destructState(MappingQualitiesState *state) {
+    stList_destruct(state->alignments);
+    free(state);
+}
+
+CigarStage *cigarStage_constructMappingQualities(int64_t maxAlignmentsPerSite, float minimumMapQValue,
+        float alpha, CigarStage **outputs) {
+    assert(maxAlignmentsPerSite >= 1);
+    MappingQualitiesState *state = st_malloc(sizeof(MappingQualitiesState));
+    state->maxAlignmentsPerSite = maxAlignmentsPerSite;
+    state->minimumMapQValue = minimumMapQValue;
+    state->alpha = alpha;
+    state->alignments = stList_construct3(0, (void (*)(void *))destructPairwiseAlignment);
+    return cigarStage_construct(mappingQualities_process, mappingQualities_finish,
+            (void (*)(void *))mappingQualities_destructState, state, outputs, maxAlignmentsPerSite);
+}
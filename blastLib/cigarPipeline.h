@@ -0,0 +1,132 @@
+/*
+ * cigarPipeline.h
+ *
+ * Streaming stages for post-processing blast alignments in memory. Each stage takes ownership of
+ * the pairwise alignments pushed into it and passes the alignments it produces on to the stages
+ * downstream of it, so a chain of stages reads and writes the alignments once, rather than once per
+ * program as when the stand alone programs are piped together.
+ */
+
+#ifndef CIGARPIPELINE_H_
+#define CIGARPIPELINE_H_
+
+#include "cactus.h"
+#include "sonLib.h"
+#include "pairwiseAlignment.h"
+
+typedef struct _cigarStage CigarStage;
+
+/*
+ * Pushes an alignment into the stage, which takes ownership of it.
+ */
+void cigarStage_push(CigarStage *stage, struct PairwiseAlignment *pairwiseAlignment);
+
+/*
+ * Signals there are no more alignments. The stage flushes anything it is holding on to, then
+ * finishes the stages downstream of it.
+ */
+void cigarStage_finish(CigarStage *stage);
+
+/*
+ * Destructs the stage and the stages downstream of it.
+ */
+void cigarStage_destruct(CigarStage *stage);
+
+/*
+ * Pushes each cigar in the file into the stage, then finishes the stage.
+ */
+void cigarStage_pushCigarFile(CigarStage *stage, FILE *fileHandle);
+
+/*
+ * Writes each alignment to the file as a cigar. The file is not closed.
+ */
+CigarStage *cigarStage_constructWriter(FILE *fileHandle, bool withProbs);
+
+/*
+ * As cactus_blast_convertCoordinates: shifts the coordinates of the alignment by the offsets encoded
+ * in the sequence headers, the given number of times.
+ */
+CigarStage *cigarStage_constructConvertCoordinates(int64_t roundsOfConversion, bool convertContig1,
+        bool convertContig2, CigarStage *next);
+
+/*
+ * As cactus_mirrorAndOrientAlignments: passes on each alignment and its mirror (with the
+ * sequences swapped), each reported on the positive strand of its first sequence.
+ */
+CigarStage *cigarStage_constructMirrorAndOrient(CigarStage *next);
+
+/*
+ * As cactus_convertAlignmentsToInternalNames: replaces the sequence headers with the cactus names
+ * given by the hash (see constructHeaderToNameHash), which is not owned by the stage.
+ */
+CigarStage *cigarStage_constructConvertToInternalNames(stHash *headerToName, CigarStage *next);
+
+/*
+ * Sorts the alignments with the given comparison function. The sort is stable, alignments the
+ * function ties are passed on in the order they were pushed. Up to maxBytesInMemory bytes of
+ * alignments are sorted in memory, beyond that sorted runs are spilled to temporary files and
+ * merged when the stage is finished.
+ */
+CigarStage *cigarStage_constructSort(int (*cmpFn)(const void *, const void *), int64_t maxBytesInMemory,
+        CigarStage *next);
+
+/*
+ * Drops alignments identical to the previous one, as unix uniq does for sorted input.
+ */
+CigarStage *cigarStage_constructUnique(CigarStage *next);
+
+/*
+ * As cactus_splitAlignmentOverlaps: splits the alignments, which must be sorted by the coordinates of
+ * their first sequence, so that no two alignments partially overlap on their first sequence.
+ */
+CigarStage *cigarStage_constructSplitOverlaps(CigarStage *next);
+
+/*
+ * As cactus_calculateMappingQualities: replaces the scores of the alignments, which must be split
+ * and sorted as output by the split overlaps stage, by mapping qualities. For each site the
+ * i-th best alignment is passed to outputs[i], for the best maxAlignmentsPerSite alignments with
+ * mapping quality at least minimumMapQValue. The stage takes ownership of the outputs array.
+ */
+CigarStage *cigarStage_constructMappingQualities(int64_t maxAlignmentsPerSite, float minimumMapQValue,
+        float alpha, CigarStage **outputs);
+
+/*
+ * Orders alignments by the coordinates of their first sequence, as
+ * "sort -k6,6 -k7,7n -k8,8n" orders cigar lines, then by the rest of the alignment.
+ */
+int cigarPipeline_cmpByFirstSequenceCoordinates(const void *a, const void *b);
+
+/*
+ * Orders alignments by descending score, as stCaf_sortCigarsByScoreInDescendingOrder. Used by the
+ * (stable) sort stage, ties keep their input order, as with stCaf_sortCigarsFileByScoreInDescendingOrder2.
+ */
+int cigarPipeline_cmpByDescendingScore(const void *a, const void *b);
+
+/*
+ * Returns non-zero if the two alignments are identical.
+ */
+bool cigarPipeline_pairwiseAlignmentsEqual(struct PairwiseAlignment *pA1, struct PairwiseAlignment *pA2);
+
+/*
+ * Builds a hash from the headers of the sequences in the flower to the cactus names of
+ * their (positive strand, left side) caps.
+ */
+stHash *constructHeaderToNameHash(Flower *flower);
+
+/*
+ * Replaces the headers of the alignment with cactus names from the hash, shifting the
+ * coordinates by two to keep them compatible with cactus coordinates.
+ */
+void convertHeadersOfPairwiseAlignmentToNames(struct PairwiseAlignment *pairwiseAlignment, stHash *headerToName);
+
+/*
+ * Inverts the strands of the alignment, reporting it on the opposite strands of both sequences.
+ */
+void invertStrandsOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment);
+
+/*
+ * Swaps the first and second sequences of the alignment.
+ */
+void swapSequencesOfPairwiseAlignment(struct PairwiseAlignment *pairwiseAlignment);
+
+#endif /* CIGARPIPELINE_H_ */
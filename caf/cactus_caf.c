@@ -93,6 +93,9 @@ static void usage() {
     fprintf(stderr, "-T --minimumBlockHomologySupport: Minimum fraction of possible homologies required not to be considered a transitively collapsed megablock.\n");
     fprintf(stderr, "-U --phylogenyNucleotideScalingFactor: Weighting for the nucleotide information in the distance matrix used to build each tree.\n");
     fprintf(stderr, "-V --minimumBlockDegreeToCheckSupport: Minimum degree required to be checked for being a megablock.\n");
+    fprintf(stderr, "--numThreads : Number of threads used to break up giant adjacency components and to serialise the flowers written to the database. Default 1.\n");
+    fprintf(stderr, "--recordCacheSize : Bytes of database records to cache. Default %i.\n", CACTUS_DISK_RECORD_CACHE_SIZE);
+    fprintf(stderr, "--stringCacheSize : Bytes of sequence to cache. Default %i.\n", CACTUS_DISK_STRING_CACHE_SIZE);
 }
 
 static int64_t *getInts(const char *string, int64_t *arrayLength) {
@@ -275,6 +278,20 @@ static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower
     free(blockSupports);
 }
 
+/*
+ * Parses the cigar file once into a temporary binary pinch file and returns an iterator over that, so
+ * each annealing round scans the pinches rather than reparsing the cigars. The name of the temporary
+ * file is added to binaryPinchFiles, for cleanup.
+ */
+static stPinchIterator *constructPinchIteratorFromCigarFile(const char *cigarFile, stList *binaryPinchFiles) {
+    stPinchIterator *cigarPinchIterator = stPinchIterator_constructFromFile(cigarFile);
+    char *binaryPinchFile = getTempFile();
+    stPinchIterator_writeBinaryFile(cigarPinchIterator, binaryPinchFile);
+    stPinchIterator_destruct(cigarPinchIterator);
+    stList_append(binaryPinchFiles, binaryPinchFile);
+    return stPinchIterator_constructFromBinaryFile(binaryPinchFile);
+}
+
 int main(int argc, char *argv[]) {
     /*
      * Script for adding alignments to cactus tree.
@@ -342,6 +359,9 @@ int main(int argc, char *argv[]) {
     const char *referenceEventHeader = NULL;
     double phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce = 1.0;
     int64_t numTreeBuildingThreads = 2;
+    int64_t numThreads = 1;
+    int64_t recordCacheSize = CACTUS_DISK_RECORD_CACHE_SIZE;
+    int64_t stringCacheSize = CACTUS_DISK_STRING_CACHE_SIZE;
     int64_t minimumBlockDegreeToCheckSupport = 10;
     double minimumBlockHomologySupport = 0.7;
     double nucleotideScalingFactor = 1.0;
@@ -404,6 +424,9 @@ int main(int argc, char *argv[]) {
 				{ "maxRecoverableChainsIterations", required_argument, 0, '1' },
 				{ "maxRecoverableChainLength", required_argument, 0, '2' },
 				{ "secondaryAlignments", required_argument, 0, '3' },
+				{ "numThreads", required_argument, 0, '4' },
+				{ "recordCacheSize", required_argument, 0, '5' },
+				{ "stringCacheSize", required_argument, 0, '6' },
 				{ 0, 0, 0, 0 } };
 
         int option_index = 0;
@@ -697,6 +720,21 @@ int main(int argc, char *argv[]) {
             case '3':
                 secondaryAlignmentsFile = stString_copy(optarg);
                 break;
+            case '4':
+                k = sscanf(optarg, "%" PRIi64, &numThreads);
+                assert(k == 1);
+                assert(numThreads >= 1);
+                break;
+            case '5':
+                k = sscanf(optarg, "%" PRIi64, &recordCacheSize);
+                assert(k == 1);
+                assert(recordCacheSize >= 0);
+                break;
+            case '6':
+                k = sscanf(optarg, "%" PRIi64, &stringCacheSize);
+                assert(k == 1);
+                assert(stringCacheSize >= 0);
+                break;
             default:
                 usage();
                 return 1;
@@ -745,15 +783,18 @@ int main(int argc, char *argv[]) {
 
     kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setWriteThreads(cactusDisk, numThreads);
+    cactusDisk_setCacheSizes(cactusDisk, recordCacheSize, stringCacheSize);
     st_logInfo("Set up the flower disk\n");
 
     ///////////////////////////////////////////////////////////////////////////
     // Get the constraints
     ///////////////////////////////////////////////////////////////////////////
 
+    stList *binaryPinchFiles = stList_construct3(0, free);
     stPinchIterator *pinchIteratorForConstraints = NULL;
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = constructPinchIteratorFromCigarFile(constraintsFile, binaryPinchFiles);
         st_logInfo("Created an iterator for the alignment constaints from file: %s\n", constraintsFile);
     }
 
@@ -796,13 +837,13 @@ int main(int argc, char *argv[]) {
                 if (sortAlignments) {
                     tempFile1 = getTempFile();
                     stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-                    pinchIterator = stPinchIterator_constructFromFile(tempFile1);
+                    pinchIterator = constructPinchIteratorFromCigarFile(tempFile1, binaryPinchFiles);
                 } else {
-                    pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
+                    pinchIterator = constructPinchIteratorFromCigarFile(alignmentsFile, binaryPinchFiles);
                 }
 
                 if(secondaryAlignmentsFile != NULL) {
-                	secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                	secondaryPinchIterator = constructPinchIteratorFromCigarFile(secondaryAlignmentsFile, binaryPinchFiles);
                 }
 
             } else {
@@ -837,7 +878,7 @@ int main(int argc, char *argv[]) {
 
                 //Do the annealing
                 if (annealingRound == 0) {
-                    stCaf_anneal(threadSet, pinchIterator, filterFn);
+                    stCaf_annealPipelined(threadSet, pinchIterator, filterFn);
                 } else {
                     stCaf_annealBetweenAdjacencyComponents(threadSet, pinchIterator, filterFn);
                 }
@@ -845,7 +886,7 @@ int main(int argc, char *argv[]) {
                 // Do the secondary annealing
                 if(secondaryPinchIterator != NULL) {
 					if (annealingRound == 0) {
-						stCaf_anneal(threadSet, secondaryPinchIterator, secondaryFilterFn);
+						stCaf_annealPipelined(threadSet, secondaryPinchIterator, secondaryFilterFn);
 					} else {
 						stCaf_annealBetweenAdjacencyComponents(threadSet, secondaryPinchIterator, secondaryFilterFn);
 					}
@@ -883,14 +924,14 @@ int main(int argc, char *argv[]) {
                 }
 
                 //Do the melting rounds
-                for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
-                    int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
-                    st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
-                    if (minimumChainLengthForMeltingRound >= minimumChainLength) {
-                        break;
-                    }
-                    stCaf_melt(flower, threadSet, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
-                } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+                int64_t numberOfMeltingRounds = 0;
+                while (numberOfMeltingRounds < meltingRoundsLength && meltingRounds[numberOfMeltingRounds] < minimumChainLength) {
+                    numberOfMeltingRounds++;
+                }
+                if (numberOfMeltingRounds > 0) {
+                    stCaf_meltInRounds(flower, threadSet, meltingRounds, numberOfMeltingRounds);
+                }
+                st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
                 stCaf_melt(flower, threadSet, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
                 //This does the filtering of blocks that do not have the required species/tree-coverage/degree.
                 stCaf_melt(flower, threadSet, blockFilterFn, blockTrim, 0, 0, INT64_MAX);
@@ -961,7 +1002,7 @@ int main(int argc, char *argv[]) {
                 stCaf_melt(flower, threadSet, blockFilterFn, blockTrim, 0, 0, INT64_MAX);
             } else if (maximumAdjacencyComponentSizeRatio < INT64_MAX) { //Deal with giant components
                 st_logDebug("Breaking up components greedily\n");
-                stCaf_breakupComponentsGreedily(threadSet, maximumAdjacencyComponentSizeRatio);
+                stCaf_breakupComponentsGreedily2(threadSet, maximumAdjacencyComponentSizeRatio, numThreads);
             }
 
             //Finish up
@@ -973,7 +1014,7 @@ int main(int argc, char *argv[]) {
             stPinchThreadSet_destruct(threadSet);
             stPinchIterator_destruct(pinchIterator);
             if(secondaryPinchIterator != NULL) {
-            	free(secondaryPinchIterator);
+            	stPinchIterator_destruct(secondaryPinchIterator);
             }
             stSet_destruct(outgroupThreads);
 
@@ -993,6 +1034,10 @@ int main(int argc, char *argv[]) {
     if (constraintsFile != NULL) {
         stPinchIterator_destruct(pinchIteratorForConstraints);
     }
+    for (int64_t i = 0; i < stList_length(binaryPinchFiles); i++) {
+        stFile_rmrf(stList_get(binaryPinchFiles, i));
+    }
+    stList_destruct(binaryPinchFiles);
 
     ///////////////////////////////////////////////////////////////////////////
     // Write the flower to disk.
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include "sonLib.h"
 #include "cactus.h"
 #include "stPinchGraphs.h"
@@ -44,6 +45,7 @@ void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *
 
 static void stCaf_annealWithFilter2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
     stPinch *pinch;
+    stCaf_resetAlignmentFilteringIndex();
     while ((pinch = pinchIterator(extraArg)) != NULL) {
         stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
         stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
@@ -63,6 +65,141 @@ void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, b
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+///////////////////////////////////////////////////////////////////////////
+// Pipelined annealing function -- the pinches are read on a second thread
+// while the calling thread adds them to the graph.
+///////////////////////////////////////////////////////////////////////////
+
+#define PINCH_BATCH_SIZE 4096
+#define PINCH_BATCH_NUMBER 16
+
+typedef struct _pinchBatch {
+    stPinch pinches[PINCH_BATCH_SIZE];
+    int64_t length;
+} PinchBatch;
+
+typedef struct _pinchReader {
+    stPinch *(*pinchIterator)(void *);
+    void *extraArg;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    stList *fullBatches; //Batches waiting to be pinched, in the order they were read.
+    stList *emptyBatches; //Batches free to be filled.
+    bool finished;
+} PinchReader;
+
+static PinchBatch *pinchReader_getEmptyBatch(PinchReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    while (stList_length(reader->emptyBatches) == 0) {
+        pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+    PinchBatch *batch = stList_pop(reader->emptyBatches);
+    pthread_mutex_unlock(&reader->mutex);
+    batch->length = 0;
+    return batch;
+}
+
+static void pinchReader_addFullBatch(PinchReader *reader, PinchBatch *batch, bool finished) {
+    pthread_mutex_lock(&reader->mutex);
+    stList_append(reader->fullBatches, batch);
+    reader->finished = finished;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+static void *pinchReader_run(void *arg) {
+    PinchReader *reader = arg;
+    PinchBatch *batch = pinchReader_getEmptyBatch(reader);
+    stPinch *pinch;
+    while ((pinch = reader->pinchIterator(reader->extraArg)) != NULL) {
+        batch->pinches[batch->length++] = *pinch; //The iterator may reuse the pinch, so copy it.
+        if (batch->length == PINCH_BATCH_SIZE) {
+            pinchReader_addFullBatch(reader, batch, 0);
+            batch = pinchReader_getEmptyBatch(reader);
+        }
+    }
+    pinchReader_addFullBatch(reader, batch, 1);
+    return NULL;
+}
+
+static PinchReader *pinchReader_construct(stPinch *(*pinchIterator)(void *), void *extraArg) {
+    PinchReader *reader = st_calloc(1, sizeof(PinchReader));
+    reader->pinchIterator = pinchIterator;
+    reader->extraArg = extraArg;
+    reader->fullBatches = stList_construct3(0, free);
+    reader->emptyBatches = stList_construct3(0, free);
+    for (int64_t i = 0; i < PINCH_BATCH_NUMBER; i++) {
+        stList_append(reader->emptyBatches, st_malloc(sizeof(PinchBatch)));
+    }
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    if (pthread_create(&reader->thread, NULL, pinchReader_run, reader) != 0) {
+        st_errAbort("Failed to create the thread to read pinches\n");
+    }
+    return reader;
+}
+
+/*
+ * Gets the next batch of pinches, waiting for it to be read if necessary, or NULL if there are
+ * no more pinches. The batch must be given back with pinchReader_returnBatch.
+ */
+static PinchBatch *pinchReader_getNextBatch(PinchReader *reader) {
+    pthread_mutex_lock(&reader->mutex);
+    while (stList_length(reader->fullBatches) == 0 && !reader->finished) {
+        pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+    PinchBatch *batch = stList_length(reader->fullBatches) > 0 ? stList_remove(reader->fullBatches, 0) : NULL;
+    pthread_mutex_unlock(&reader->mutex);
+    return batch;
+}
+
+static void pinchReader_returnBatch(PinchReader *reader, PinchBatch *batch) {
+    pthread_mutex_lock(&reader->mutex);
+    stList_append(reader->emptyBatches, batch);
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+static void pinchReader_destruct(PinchReader *reader) {
+    pthread_join(reader->thread, NULL);
+    pthread_mutex_destroy(&reader->mutex);
+    pthread_cond_destroy(&reader->cond);
+    stList_destruct(reader->fullBatches);
+    stList_destruct(reader->emptyBatches);
+    free(reader);
+}
+
+void stCaf_annealPipelined2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
+    if (filterFn != NULL) {
+        stCaf_resetAlignmentFilteringIndex();
+    }
+    PinchReader *reader = pinchReader_construct(pinchIterator, extraArg);
+    PinchBatch *batch;
+    while ((batch = pinchReader_getNextBatch(reader)) != NULL) {
+        for (int64_t i = 0; i < batch->length; i++) {
+            stPinch *pinch = &batch->pinches[i];
+            stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
+            stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
+            assert(thread1 != NULL && thread2 != NULL);
+            if (filterFn != NULL) {
+                stPinchThread_filterPinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand, filterFn);
+            } else {
+                stPinchThread_pinch(thread1, thread2, pinch->start1, pinch->start2, pinch->length, pinch->strand);
+            }
+        }
+        pinchReader_returnBatch(reader, batch);
+    }
+    pinchReader_destruct(reader);
+}
+
+void stCaf_annealPipelined(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *)) {
+    stPinchIterator_reset(pinchIterator);
+    stCaf_annealPipelined2(threadSet, (stPinch *(*)(void *)) stPinchIterator_getNext, pinchIterator, filterFn);
+    stCaf_joinTrivialBoundaries(threadSet);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Annealing function that ignores homologies between bases not in the same adjacency component.
 ///////////////////////////////////////////////////////////////////////////
@@ -162,6 +299,9 @@ void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinc
     stList *adjacencyComponents;
     stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
     //Now do the actual alignments.
+    if (filterFn != NULL) {
+        stCaf_resetAlignmentFilteringIndex();
+    }
     stPinch *pinch;
     while ((pinch = pinchIterator(extraArg)) != NULL) {
         alignSameComponents(pinch, threadSet, adjacencyComponentIntervals, filterFn);
@@ -8,8 +8,18 @@
 // parameter.
 static Flower *flower;
 
+// Summaries of the blocks of the pinch graph used by the alignment filters, see below.
+typedef struct _alignmentFilteringIndex AlignmentFilteringIndex;
+static AlignmentFilteringIndex *filteringIndex = NULL;
+static void alignmentFilteringIndex_destruct(AlignmentFilteringIndex *index);
+
 void stCaf_setFlowerForAlignmentFiltering(Flower *input) {
     flower = input;
+    //The index of the alignment filters is built for the new flower on first use
+    if (filteringIndex != NULL) {
+        alignmentFilteringIndex_destruct(filteringIndex);
+        filteringIndex = NULL;
+    }
 }
 
 /*
@@ -88,132 +98,290 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
 }
 
 /*
- * Filtering by presence of repeat species in block. This code is inefficient and does not scale.
+ * Filtering by the species and sequences in blocks. Rather than walking the segments of both blocks
+ * for every pinch, each block has a summary: a bitset of the events it contains and, when first
+ * asked for, the sorted set of sequences it contains. Summaries
+ * are cached by block and checked against the block's degree and first segment when used. Splitting
+ * a block does not change the threads its segments come from, so leaves the summaries correct; the
+ * blocks of each pinch a filter lets through are forgotten, as they are about to be merged. The cache
+ * is cleared by stCaf_resetAlignmentFilteringIndex, which the annealing functions call before filtering.
  */
 
-static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
-    stSortedSet *n12 = stSortedSet_getIntersection(names1, names2);
-    bool b = stSortedSet_size(n12) > 0;
-    stSortedSet_destruct(names1);
-    stSortedSet_destruct(names2);
-    stSortedSet_destruct(n12);
-    return b;
+typedef struct _blockSummary {
+    stPinchSegment *first; //The first segment and degree of the block when summarised.
+    int64_t degree;
+    int64_t eventNumber; //The number of distinct events.
+    uint64_t *events; //Bitset of the events, by index.
+    int64_t *sequences; //Sorted indices of the distinct sequences, or NULL if not yet computed.
+    int64_t sequenceNumber;
+} BlockSummary;
+
+typedef struct _threadInfo {
+    int64_t eventIndex;
+    int64_t sequenceIndex;
+    BlockSummary summary; //The summary of a segment of the thread that is not in a block.
+} ThreadInfo;
+
+struct _alignmentFilteringIndex {
+    stHash *eventsToIndices;
+    stHash *sequencesToIndices;
+    int64_t eventWords;
+    uint64_t *ingroupEvents; //Bitset of the ingroup events.
+    stHash *threadInfos;
+    stHash *blockSummaries;
+};
+
+static void blockSummary_destruct(BlockSummary *summary) {
+    free(summary->events);
+    free(summary->sequences);
+    free(summary);
 }
 
-static stSortedSet *getEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            stSortedSet_insert(events, stCaf_getEvent(segment, flower));
+static void threadInfo_destruct(ThreadInfo *threadInfo) {
+    free(threadInfo->summary.events);
+    free(threadInfo->summary.sequences);
+    free(threadInfo);
+}
+
+static AlignmentFilteringIndex *alignmentFilteringIndex_construct(Flower *flower) {
+    AlignmentFilteringIndex *index = st_malloc(sizeof(AlignmentFilteringIndex));
+    index->eventsToIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    index->sequencesToIndices = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+    EventTree *eventTree = flower_getEventTree(flower);
+    index->eventWords = (eventTree_getEventNumber(eventTree) + 63) / 64;
+    index->ingroupEvents = st_calloc(index->eventWords, sizeof(uint64_t));
+    EventTree_Iterator *eventIt = eventTree_getIterator(eventTree);
+    Event *event;
+    int64_t eventIndex = 0;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        if (!event_isOutgroup(event)) {
+            index->ingroupEvents[eventIndex / 64] |= ((uint64_t) 1) << (eventIndex % 64);
         }
-    } else {
-        stSortedSet_insert(events, stCaf_getEvent(segment, flower));
+        stHash_insert(index->eventsToIndices, event, stIntTuple_construct1(eventIndex++));
     }
-    return events;
+    eventTree_destructIterator(eventIt);
+    index->threadInfos = stHash_construct2(NULL, (void (*)(void *)) threadInfo_destruct);
+    index->blockSummaries = stHash_construct2(NULL, (void (*)(void *)) blockSummary_destruct);
+    return index;
 }
 
-static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
-    if (stPinchSegment_getBlock(segment) == NULL) {
-        return false;
-    } else {
+static void alignmentFilteringIndex_destruct(AlignmentFilteringIndex *index) {
+    stHash_destruct(index->eventsToIndices);
+    stHash_destruct(index->sequencesToIndices);
+    stHash_destruct(index->threadInfos);
+    stHash_destruct(index->blockSummaries);
+    free(index->ingroupEvents);
+    free(index);
+}
+
+void stCaf_resetAlignmentFilteringIndex(void) {
+    if (filteringIndex != NULL) {
+        stHash_destruct(filteringIndex->blockSummaries);
+        filteringIndex->blockSummaries = stHash_construct2(NULL, (void (*)(void *)) blockSummary_destruct);
+    }
+}
+
+static AlignmentFilteringIndex *getFilteringIndex() {
+    if (filteringIndex == NULL) {
+        filteringIndex = alignmentFilteringIndex_construct(flower);
+    }
+    return filteringIndex;
+}
+
+static ThreadInfo *getThreadInfo(AlignmentFilteringIndex *index, stPinchThread *thread) {
+    ThreadInfo *threadInfo = stHash_search(index->threadInfos, thread);
+    if (threadInfo == NULL) {
+        Cap *cap = flower_getCap(flower, stPinchThread_getName(thread));
+        Event *event = cap_getEvent(cap);
+        assert(event != NULL);
+        Sequence *sequence = cap_getSequence(cap);
+        stIntTuple *sequenceIndex = stHash_search(index->sequencesToIndices, sequence);
+        if (sequenceIndex == NULL) {
+            sequenceIndex = stIntTuple_construct1(stHash_size(index->sequencesToIndices));
+            stHash_insert(index->sequencesToIndices, sequence, sequenceIndex);
+        }
+        threadInfo = st_calloc(1, sizeof(ThreadInfo));
+        threadInfo->eventIndex = stIntTuple_get(stHash_search(index->eventsToIndices, event), 0);
+        threadInfo->sequenceIndex = stIntTuple_get(sequenceIndex, 0);
+        BlockSummary *summary = &threadInfo->summary;
+        summary->degree = 1;
+        summary->eventNumber = 1;
+        summary->events = st_calloc(index->eventWords, sizeof(uint64_t));
+        summary->events[threadInfo->eventIndex / 64] |= ((uint64_t) 1) << (threadInfo->eventIndex % 64);
+        summary->sequences = st_malloc(sizeof(int64_t));
+        summary->sequences[0] = threadInfo->sequenceIndex;
+        summary->sequenceNumber = 1;
+        stHash_insert(index->threadInfos, thread, threadInfo);
+    }
+    return threadInfo;
+}
+
+static BlockSummary *blockSummary_construct(AlignmentFilteringIndex *index, stPinchBlock *block) {
+    BlockSummary *summary = st_calloc(1, sizeof(BlockSummary));
+    summary->first = stPinchBlock_getFirst(block);
+    summary->degree = stPinchBlock_getDegree(block);
+    summary->events = st_calloc(index->eventWords, sizeof(uint64_t));
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        ThreadInfo *threadInfo = getThreadInfo(index, stPinchSegment_getThread(segment));
+        uint64_t bit = ((uint64_t) 1) << (threadInfo->eventIndex % 64);
+        if ((summary->events[threadInfo->eventIndex / 64] & bit) == 0) {
+            summary->events[threadInfo->eventIndex / 64] |= bit;
+            summary->eventNumber++;
+        }
+    }
+    return summary;
+}
+
+/*
+ * Gets the summary of the block containing the segment, or of the segment alone if it is not in a block.
+ */
+static BlockSummary *getSummary(AlignmentFilteringIndex *index, stPinchSegment *segment) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block == NULL) {
+        return &getThreadInfo(index, stPinchSegment_getThread(segment))->summary;
+    }
+    BlockSummary *summary = stHash_search(index->blockSummaries, block);
+    if (summary != NULL && (summary->first != stPinchBlock_getFirst(block)
+            || summary->degree != stPinchBlock_getDegree(block))) {
+        blockSummary_destruct(stHash_remove(index->blockSummaries, block));
+        summary = NULL;
+    }
+    if (summary == NULL) {
+        summary = blockSummary_construct(index, block);
+        stHash_insert(index->blockSummaries, block, summary);
+    }
+    return summary;
+}
+
+static int int64_cmp(const void *a, const void *b) {
+    int64_t i = *(const int64_t *) a, j = *(const int64_t *) b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+static int64_t *getSequences(AlignmentFilteringIndex *index, stPinchSegment *segment, int64_t *sequenceNumber) {
+    BlockSummary *summary = getSummary(index, segment);
+    if (summary->sequences == NULL) {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
-        Event *event = stCaf_getEvent(segment, flower);
+        summary->sequences = st_malloc(sizeof(int64_t) * summary->degree);
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            if (stCaf_getEvent(segment, flower) != event) {
-                return true;
+        stPinchSegment *segment2;
+        int64_t i = 0;
+        while ((segment2 = stPinchBlockIt_getNext(&it)) != NULL) {
+            summary->sequences[i++] = getThreadInfo(index, stPinchSegment_getThread(segment2))->sequenceIndex;
+        }
+        qsort(summary->sequences, i, sizeof(int64_t), int64_cmp);
+        summary->sequenceNumber = 0;
+        for (int64_t j = 0; j < i; j++) {
+            if (j == 0 || summary->sequences[j] != summary->sequences[j - 1]) {
+                summary->sequences[summary->sequenceNumber++] = summary->sequences[j];
             }
         }
-        return false;
     }
+    *sequenceNumber = summary->sequenceNumber;
+    return summary->sequences;
+}
+
+static bool eventsIntersect(AlignmentFilteringIndex *index, BlockSummary *summary1, BlockSummary *summary2,
+        bool ingroupsOnly) {
+    for (int64_t i = 0; i < index->eventWords; i++) {
+        uint64_t intersection = summary1->events[i] & summary2->events[i];
+        if ((ingroupsOnly ? intersection & index->ingroupEvents[i] : intersection) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the verdict of a filter, first forgetting the summaries of the blocks of the two segments if
+ * the pinch is let through, as the blocks are about to be merged.
+ */
+static bool filterVerdict(AlignmentFilteringIndex *index, stPinchSegment *segment1, stPinchSegment *segment2,
+        bool filter) {
+    if (!filter) {
+        stPinchBlock *block;
+        if ((block = stPinchSegment_getBlock(segment1)) != NULL && stHash_search(index->blockSummaries, block) != NULL) {
+            blockSummary_destruct(stHash_remove(index->blockSummaries, block));
+        }
+        if ((block = stPinchSegment_getBlock(segment2)) != NULL && stHash_search(index->blockSummaries, block) != NULL) {
+            blockSummary_destruct(stHash_remove(index->blockSummaries, block));
+        }
+    }
+    return filter;
+}
+
+static bool containsMoreThanOneEvent(AlignmentFilteringIndex *index, stPinchSegment *segment) {
+    return stPinchSegment_getBlock(segment) != NULL && getSummary(index, segment)->eventNumber > 1;
 }
 
 bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
                                    stPinchSegment *segment2) {
+    AlignmentFilteringIndex *index = getFilteringIndex();
     stPinchBlock *block1, *block2;
+    bool filter = false;
     if ((block1 = stPinchSegment_getBlock(segment1)) != NULL) {
         if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
             if (block1 == block2) {
-                return stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(segment1, flower);
+                filter = stPinchBlock_getLength(block1) == 1 ? 0 : containsMoreThanOneEvent(index, segment1);
+            } else {
+                filter = containsMoreThanOneEvent(index, segment1) && containsMoreThanOneEvent(index, segment2);
             }
-            if (stPinchBlock_getDegree(block1) < stPinchBlock_getDegree(block2)) {
-            	return containsMoreThanOneEvent(segment1, flower) && containsMoreThanOneEvent(segment2, flower);
-            }
-            return containsMoreThanOneEvent(segment2, flower) && containsMoreThanOneEvent(segment1, flower);
         }
     }
-    // If we get here, we are just adding a segment to a block, not
+    // If we get here without a verdict, we are just adding a segment to a block, not
     // pinching two blocks together.
-    return false;
+    return filterVerdict(index, segment1, segment2, filter);
 }
 
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2) {
-    return checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+    AlignmentFilteringIndex *index = getFilteringIndex();
+    return filterVerdict(index, segment1, segment2,
+            eventsIntersect(index, getSummary(index, segment1), getSummary(index, segment2), 0));
 }
 
 bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
                                         stPinchSegment *segment2) {
-    return stPinchSegment_getBlock(segment1) != NULL
+    AlignmentFilteringIndex *index = getFilteringIndex();
+    return filterVerdict(index, segment1, segment2, stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
-}
-
-static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *names = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-            Sequence *sequence = cap_getSequence(cap);
-            stSortedSet_insert(names, (void *) sequence_getName(sequence));
-        }
-    } else {
-        Cap *cap = flower_getCap(flower, stPinchSegment_getName(segment));
-        Sequence *sequence = cap_getSequence(cap);
-        stSortedSet_insert(names, (void *) sequence_getName(sequence));
-    }
-    return names;
+        && eventsIntersect(index, getSummary(index, segment1), getSummary(index, segment2), 0));
 }
 
 bool stCaf_singleCopyChr(stPinchSegment *segment1,
                          stPinchSegment *segment2) {
-    return checkIntersection(getChrNames(segment1, flower), getChrNames(segment2, flower));
-}
-
-static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
-    stSortedSet *events = stSortedSet_construct();
-    if (stPinchSegment_getBlock(segment) != NULL) {
-        stPinchBlock *block = stPinchSegment_getBlock(segment);
-        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
-        while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Event *event = stCaf_getEvent(segment, flower);
-            if (!event_isOutgroup(event)) {
-                stSortedSet_insert(events, event);
-            }
-        }
-    } else {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!event_isOutgroup(event)) {
-            stSortedSet_insert(events, event);
+    AlignmentFilteringIndex *index = getFilteringIndex();
+    int64_t sequenceNumber1, sequenceNumber2;
+    int64_t *sequences1 = getSequences(index, segment1, &sequenceNumber1);
+    int64_t *sequences2 = getSequences(index, segment2, &sequenceNumber2);
+    bool intersect = 0;
+    for (int64_t i = 0, j = 0; i < sequenceNumber1 && j < sequenceNumber2 && !intersect;) {
+        if (sequences1[i] < sequences2[j]) {
+            i++;
+        } else if (sequences1[i] > sequences2[j]) {
+            j++;
+        } else {
+            intersect = 1;
         }
     }
-    return events;
+    return filterVerdict(index, segment1, segment2, intersect);
 }
 
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
                              stPinchSegment *segment2) {
-    return checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+    AlignmentFilteringIndex *index = getFilteringIndex();
+    return filterVerdict(index, segment1, segment2,
+            eventsIntersect(index, getSummary(index, segment1), getSummary(index, segment2), 1));
 }
 
 bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
                                     stPinchSegment *segment2) {
-    return stPinchSegment_getBlock(segment1) != NULL
+    AlignmentFilteringIndex *index = getFilteringIndex();
+    return filterVerdict(index, segment1, segment2, stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+        && eventsIntersect(index, getSummary(index, segment1), getSummary(index, segment2), 1));
 }
 
 /*
@@ -6,107 +6,167 @@
  */
 
 #include "sonLib.h"
+#include "cactus.h"
 #include "stPinchGraphs.h"
 #include <math.h>
 #include <stdlib.h>
 
-static void *getValue(stHash *hash, int64_t node) {
-    stIntTuple *nodeTuple = stIntTuple_construct1(node);
-    void *object = stHash_search(hash, nodeTuple);
-    stIntTuple_destruct(nodeTuple);
-    return object;
+/*
+ * An edge of a component graph, packed into an array. The nodes are indices in [0, nodeNumber),
+ * and the index is the position of the edge in the caller's list of edges.
+ */
+typedef struct _componentEdge {
+    int64_t score;
+    int64_t node1;
+    int64_t node2;
+    int64_t index;
+} ComponentEdge;
+
+static int componentEdge_cmpByDescendingScore(const void *a, const void *b) {
+    /*
+     * Orders edges best first, breaking ties between equal scores as stIntTuple_cmpFn does
+     * for (score, node1, node2) tuples, but reversed.
+     */
+    const ComponentEdge *edge1 = a, *edge2 = b;
+    if (edge1->score != edge2->score) {
+        return edge1->score > edge2->score ? -1 : 1;
+    }
+    if (edge1->node1 != edge2->node1) {
+        return edge1->node1 > edge2->node1 ? -1 : 1;
+    }
+    if (edge1->node2 != edge2->node2) {
+        return edge1->node2 > edge2->node2 ? -1 : 1;
+    }
+    return 0;
 }
 
-stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
+static int64_t findComponent(int64_t *parents, int64_t node) {
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]]; //Path halving
+        node = parents[node];
+    }
+    return node;
+}
+
+static int64_t breakupComponentGreedily(ComponentEdge *edges, int64_t edgeNumber, int64_t nodeNumber, int64_t maxComponentSize) {
     /*
-     * Make a component for each node in the graph
+     * Adds the edges, which must be sorted best first, to the graph in turn, using a union-find
+     * over the nodes to track the components, rejecting any edge that would join two components
+     * into one larger than maxComponentSize. Moves the rejected edges, in order, to the front of
+     * the array and returns their number.
      */
-    stHash *nodeToComponents = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
-    stListIterator *listIt = stList_getIterator(nodes);
-    stIntTuple *node;
-    while ((node = stList_getNext(listIt)) != NULL) {
-        stSortedSet *component = stSortedSet_construct();
-        stSortedSet_insert(component, node);
-        assert(stHash_search(nodeToComponents, node) == NULL);
-        stHash_insert(nodeToComponents, node, component);
-    }
-    stList_destructIterator(listIt);
-
-    stList *sortedEdges = stList_copy(edges, NULL); //copy, to avoid messing input
-    stList_sort(sortedEdges, (int(*)(const void *, const void *)) stIntTuple_cmpFn); //Sort in ascending order, so best edge first
-    int64_t edgeScore = INT64_MAX;
-    //While edges exist, try and put them into the graph.
-    stList *edgesToDelete = stList_construct();
-    int64_t totalComponents = stList_length(nodes);
-    while (stList_length(sortedEdges) > 0) {
-        stIntTuple *edge = stList_pop(sortedEdges);
-        assert(edgeScore >= stIntTuple_get(edge, 0));
-        edgeScore = stIntTuple_get(edge, 0);
-        stSortedSet *component1 = getValue(nodeToComponents, stIntTuple_get(edge, 1));
-        stSortedSet *component2 = getValue(nodeToComponents, stIntTuple_get(edge, 2));
-        assert(component1 != NULL && component2 != NULL);
+    int64_t *parents = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    int64_t *sizes = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        parents[i] = i;
+        sizes[i] = 1;
+    }
+    int64_t edgesToDeleteNumber = 0;
+    int64_t totalComponents = nodeNumber;
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        assert(i == 0 || edges[i - 1].score >= edges[i].score);
+        assert(edges[i].node1 >= 0 && edges[i].node1 < nodeNumber);
+        assert(edges[i].node2 >= 0 && edges[i].node2 < nodeNumber);
+        int64_t component1 = findComponent(parents, edges[i].node1);
+        int64_t component2 = findComponent(parents, edges[i].node2);
         if (component1 == component2) { //We're golden, as the edge is already contained within one component.
             continue;
         }
-        if (stSortedSet_size(component1) + stSortedSet_size(component2) > maxComponentSize) { //This edge would make a too large component, so reject
-            stList_append(edgesToDelete, edge);
+        if (sizes[component1] + sizes[component2] > maxComponentSize) { //This edge would make a too large component, so reject
+            edges[edgesToDeleteNumber++] = edges[i]; //Safe, as edgesToDeleteNumber <= i
             continue;
         }
-        //Merge the components and replace references in the hash.
-        if (stSortedSet_size(component1) < stSortedSet_size(component2)) {
-            stSortedSet *component3 = component1;
+        //Merge the smaller component into the larger
+        if (sizes[component1] < sizes[component2]) {
+            int64_t component3 = component1;
             component1 = component2;
             component2 = component3;
         }
-        assert(stSortedSet_size(component1) >= stSortedSet_size(component2));
-        while (stSortedSet_size(component2) > 0) {
-            node = stSortedSet_getLast(component2);
-            stSortedSet_remove(component2, node);
-            assert(stSortedSet_search(component1, node) == NULL);
-            stSortedSet_insert(component1, node);
-            stHash_insert(nodeToComponents, node, component1);
-        }
-        stSortedSet_destruct(component2);
+        parents[component2] = component1;
+        sizes[component1] += sizes[component2];
         totalComponents -= 1;
     }
 
     st_logDebug(
             "We broke a graph with %" PRIi64 " nodes and %" PRIi64 " edges for a max component size of %" PRIi64 " into %" PRIi64 " distinct components with %" PRIi64 " edges, discarding %" PRIi64 " edges\n",
-            stList_length(nodes), stList_length(edges), maxComponentSize, totalComponents,
-            stList_length(edges) - stList_length(edgesToDelete), stList_length(edgesToDelete));
-
-    //Cleanup
-    stList_destruct(sortedEdges);
-    stList *components = stHash_getValues(nodeToComponents);
-    stSortedSet *componentsSet = stList_getSortedSet(components, NULL);
-    stList_destruct(components);
-    stSortedSet_setDestructor(componentsSet, (void(*)(void *)) stSortedSet_destruct);
-    stSortedSet_destruct(componentsSet);
-    stHash_destruct(nodeToComponents);
+            nodeNumber, edgeNumber, maxComponentSize, totalComponents, edgeNumber - edgesToDeleteNumber, edgesToDeleteNumber);
+
+    free(parents);
+    free(sizes);
+    return edgesToDeleteNumber;
+}
+
+stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
+    //Pack the edges and sort them, best edge first, ordering ties by the node names as the tuples are ordered
+    ComponentEdge *packedEdges = st_malloc(sizeof(ComponentEdge) * (stList_length(edges) + 1));
+    for (int64_t i = 0; i < stList_length(edges); i++) {
+        stIntTuple *edge = stList_get(edges, i);
+        packedEdges[i].score = stIntTuple_get(edge, 0);
+        packedEdges[i].node1 = stIntTuple_get(edge, 1);
+        packedEdges[i].node2 = stIntTuple_get(edge, 2);
+        packedEdges[i].index = i;
+    }
+    qsort(packedEdges, stList_length(edges), sizeof(ComponentEdge), componentEdge_cmpByDescendingScore);
 
+    //Replace the node names with their indices in the list of nodes
+    stHash *nodesToIndices = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
+            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
+    int64_t *indices = st_malloc(sizeof(int64_t) * (stList_length(nodes) + 1));
+    for (int64_t i = 0; i < stList_length(nodes); i++) {
+        indices[i] = i;
+        assert(stHash_search(nodesToIndices, stList_get(nodes, i)) == NULL);
+        stHash_insert(nodesToIndices, stList_get(nodes, i), &indices[i]);
+    }
+    for (int64_t i = 0; i < stList_length(edges); i++) {
+        for (int64_t j = 0; j < 2; j++) {
+            int64_t *node = j == 0 ? &packedEdges[i].node1 : &packedEdges[i].node2;
+            stIntTuple *nodeTuple = stIntTuple_construct1(*node);
+            int64_t *index = stHash_search(nodesToIndices, nodeTuple);
+            assert(index != NULL);
+            *node = *index;
+            stIntTuple_destruct(nodeTuple);
+        }
+    }
+    stHash_destruct(nodesToIndices);
+    free(indices);
+
+    int64_t edgesToDeleteNumber = breakupComponentGreedily(packedEdges, stList_length(edges), stList_length(nodes), maxComponentSize);
+    stList *edgesToDelete = stList_construct();
+    for (int64_t i = 0; i < edgesToDeleteNumber; i++) {
+        stList_append(edgesToDelete, stList_get(edges, packedEdges[i].index));
+    }
+    free(packedEdges);
     return edgesToDelete;
 }
 
-static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, stList **edges) {
-    //Make nodes
-    *nodes = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+static int componentEdge_cmpByNodes(const void *a, const void *b) {
+    const ComponentEdge *edge1 = a, *edge2 = b;
+    if (edge1->node1 != edge2->node1) {
+        return edge1->node1 < edge2->node1 ? -1 : 1;
+    }
+    return edge1->node2 < edge2->node2 ? -1 : (edge1->node2 > edge2->node2 ? 1 : 0);
+}
+
+static ComponentEdge *getComponentEdges(stList *adjacencyComponent, int64_t *edgeNumber) {
+    /*
+     * Gets the edges between the pinch ends of an adjacency component, each node being the
+     * index of its pinch end in the component, scored by the number of threads that connect
+     * the two ends.
+     */
     stHash *pinchEndsToNodesHash = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
+    int64_t *nodes = st_malloc(sizeof(int64_t) * (stList_length(adjacencyComponent) + 1));
     for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
-        stIntTuple *node = stIntTuple_construct1(i);
-        stList_append(*nodes, node);
+        nodes[i] = i;
         assert(stHash_search(pinchEndsToNodesHash, stList_get(adjacencyComponent, i)) == NULL);
-        stHash_insert(pinchEndsToNodesHash, stList_get(adjacencyComponent, i), node);
+        stHash_insert(pinchEndsToNodesHash, stList_get(adjacencyComponent, i), &nodes[i]);
     }
-    //Make edges
 
-    //First build a hash of edges to their multiplicity
-    stHash *edgesToMultiplicityHash = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, (void(*)(void *)) stIntTuple_destruct,
-            (void(*)(void *)) stIntTuple_destruct);
+    //First get an edge for each thread connecting two ends
+    int64_t maxEdgeNumber = 16;
+    *edgeNumber = 0;
+    ComponentEdge *edges = st_malloc(sizeof(ComponentEdge) * maxEdgeNumber);
     for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
         stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, i);
-        int64_t node1 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, pinchEnd1), 0);
         stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(pinchEnd1));
         stPinchSegment *segment;
         while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
@@ -116,18 +176,17 @@ static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, s
                 if (stPinchSegment_getBlock(segment2) != NULL) {
                     stPinchEnd pinchEnd2 = stPinchEnd_constructStatic(stPinchSegment_getBlock(segment2),
                             stPinchEnd_endOrientation(traverse5Prime, segment2));
-                    assert(stHash_search(pinchEndsToNodesHash, &pinchEnd2) != NULL);
-                    int64_t node2 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, &pinchEnd2), 0);
-                    if (node1 != node2) { //Ignore self edges
-                        stIntTuple *edge = node1 < node2 ? stIntTuple_construct2(node1, node2) : stIntTuple_construct2(node2, node1);
-                        int64_t multiplicity = 1;
-                        if (stHash_search(edgesToMultiplicityHash, edge) != NULL) {
-                            stIntTuple *count = stHash_removeAndFreeKey(edgesToMultiplicityHash, edge);
-                            multiplicity += stIntTuple_get(count, 0);
-                            stIntTuple_destruct(count);
-                            assert(multiplicity > 1);
+                    int64_t *node2 = stHash_search(pinchEndsToNodesHash, &pinchEnd2);
+                    assert(node2 != NULL);
+                    if (i != *node2) { //Ignore self edges
+                        if (*edgeNumber == maxEdgeNumber) {
+                            maxEdgeNumber *= 2;
+                            edges = st_realloc(edges, sizeof(ComponentEdge) * maxEdgeNumber);
                         }
-                        stHash_insert(edgesToMultiplicityHash, edge, stIntTuple_construct1(multiplicity));
+                        edges[*edgeNumber].score = 1;
+                        edges[*edgeNumber].node1 = i < *node2 ? i : *node2;
+                        edges[*edgeNumber].node2 = i < *node2 ? *node2 : i;
+                        (*edgeNumber)++;
                     }
                     break;
                 }
@@ -135,18 +194,23 @@ static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, s
             }
         }
     }
-    //Now build edges, scoring them according to their multiplicity
-    *edges = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
-    stHashIterator *hashIt = stHash_getIterator(edgesToMultiplicityHash);
-    stIntTuple *edge;
-    while ((edge = stHash_getNext(hashIt)) != NULL) {
-        stIntTuple *count = stHash_search(edgesToMultiplicityHash, edge);
-        stList_append(*edges, stIntTuple_construct3(stIntTuple_get(count, 0), stIntTuple_get(edge, 0), stIntTuple_get(edge, 1)));
-    }
-
-    //Cleanup
     stHash_destruct(pinchEndsToNodesHash);
-    stHash_destruct(edgesToMultiplicityHash);
+    free(nodes);
+
+    //Now merge the edges between the same pair of ends, scoring them according to their multiplicity
+    qsort(edges, *edgeNumber, sizeof(ComponentEdge), componentEdge_cmpByNodes);
+    int64_t j = 0;
+    for (int64_t i = 0; i < *edgeNumber; i++) {
+        if (j > 0 && componentEdge_cmpByNodes(&edges[j - 1], &edges[i]) == 0) {
+            edges[j - 1].score++;
+        } else {
+            edges[j] = edges[i];
+            edges[j].index = j;
+            j++;
+        }
+    }
+    *edgeNumber = j;
+    return edges;
 }
 
 static void breakEdges(stPinchThreadSet *threadSet, stPinchEnd *pinchEnd1, stPinchEnd *pinchEnd2) {
@@ -185,44 +249,95 @@ static void breakEdges(stPinchThreadSet *threadSet, stPinchEnd *pinchEnd1, stPin
     }
 }
 
-void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio) {
+typedef struct _componentBreakupTask {
+    stList *adjacencyComponent;
+    int64_t maxComponentSize;
+    ComponentEdge *edges;
+    int64_t edgeNumber;
+    int64_t edgesToDeleteNumber;
+} ComponentBreakupTask;
+
+static ComponentBreakupTask *breakupComponentTask(ComponentBreakupTask *task) {
+    /*
+     * Gets the edges to break to split up an adjacency component. This only reads the pinch graph,
+     * so different components can be done concurrently.
+     */
+    task->edges = getComponentEdges(task->adjacencyComponent, &task->edgeNumber);
+    qsort(task->edges, task->edgeNumber, sizeof(ComponentEdge), componentEdge_cmpByDescendingScore);
+    task->edgesToDeleteNumber = breakupComponentGreedily(task->edges, task->edgeNumber,
+            stList_length(task->adjacencyComponent), task->maxComponentSize);
+    return task;
+}
+
+static int componentBreakupTask_cmpByDecreasingSize(const void *a, const void *b) {
+    int64_t i = stList_length(((ComponentBreakupTask *) a)->adjacencyComponent);
+    int64_t j = stList_length(((ComponentBreakupTask *) b)->adjacencyComponent);
+    return i > j ? -1 : (i < j ? 1 : 0);
+}
+
+void stCaf_breakupComponentsGreedily2(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio, int64_t numThreads) {
     int64_t maximumAdjacencyComponentSize = maximumAdjacencyComponentSizeRatio * log(stPinchThreadSet_getTotalBlockNumber(threadSet) * 2);
     if (maximumAdjacencyComponentSize < 10) {
         maximumAdjacencyComponentSize = 10;
     }
     //Get adjacency components
     stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents(threadSet);
+    stList *tasks = stList_construct3(0, free);
     for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
         stList *adjacencyComponent = stList_get(adjacencyComponents, i);
         if (maximumAdjacencyComponentSize < stList_length(adjacencyComponent)) {
-            //Get graph description
-            stList *nodes, *edges;
-            convertToNodesAndEdges(adjacencyComponent, &nodes, &edges);
-            //Get the edges to remove
-            stList *edgesToDelete = stCaf_breakupComponentGreedily(nodes, edges, maximumAdjacencyComponentSize);
-            //Break edges;
-            int64_t unbrokenEdges = 0;
-            for (int64_t j = 0; j < stList_length(edgesToDelete); j++) {
-                stIntTuple *edge = stList_get(edgesToDelete, j);
-                assert(stIntTuple_get(edge, 1) < stIntTuple_get(edge, 2));
-                stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, stIntTuple_get(edge, 1));
-                stPinchEnd *pinchEnd2 = stList_get(adjacencyComponent, stIntTuple_get(edge, 2));
-                if (stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd1)) > 1 && stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd2))
-                        > 1) {
-                    breakEdges(threadSet, pinchEnd1, pinchEnd2);
-                } else {
-                    unbrokenEdges++;
-                }
-            }
-            if (stList_length(edgesToDelete) > 0) {
-                printf("Pinch graph component with %" PRIi64 " nodes and %" PRIi64 " edges is being split up by breaking %" PRIi64 " edges to reduce size to less than %" PRIi64 " max, but found %" PRIi64 " pointless edges \n",
-                    stList_length(nodes), stList_length(edges), stList_length(edgesToDelete), maximumAdjacencyComponentSize, unbrokenEdges);
+            ComponentBreakupTask *task = st_calloc(1, sizeof(ComponentBreakupTask));
+            task->adjacencyComponent = adjacencyComponent;
+            task->maxComponentSize = maximumAdjacencyComponentSize;
+            stList_append(tasks, task);
+        }
+    }
+
+    //Get the edges to remove, handing the biggest components to the pool first
+    if (numThreads > 1 && stList_length(tasks) > 1) {
+        stList *tasksBySize = stList_copy(tasks, NULL);
+        stList_sort(tasksBySize, componentBreakupTask_cmpByDecreasingSize);
+        stThreadPool *threadPool = stThreadPool_construct(numThreads < stList_length(tasks) ? numThreads : stList_length(tasks),
+                (void *(*)(void *)) breakupComponentTask, cactusMisc_ignoreThreadPoolResult);
+        for (int64_t i = 0; i < stList_length(tasksBySize); i++) {
+            stThreadPool_push(threadPool, stList_get(tasksBySize, i));
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+        stList_destruct(tasksBySize);
+    } else {
+        for (int64_t i = 0; i < stList_length(tasks); i++) {
+            breakupComponentTask(stList_get(tasks, i));
+        }
+    }
+
+    //Break edges, in the order of the components, as this modifies the pinch graph
+    for (int64_t i = 0; i < stList_length(tasks); i++) {
+        ComponentBreakupTask *task = stList_get(tasks, i);
+        int64_t unbrokenEdges = 0;
+        for (int64_t j = 0; j < task->edgesToDeleteNumber; j++) {
+            ComponentEdge *edge = &task->edges[j];
+            assert(edge->node1 < edge->node2);
+            stPinchEnd *pinchEnd1 = stList_get(task->adjacencyComponent, edge->node1);
+            stPinchEnd *pinchEnd2 = stList_get(task->adjacencyComponent, edge->node2);
+            if (stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd1)) > 1 && stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd2))
+                    > 1) {
+                breakEdges(threadSet, pinchEnd1, pinchEnd2);
+            } else {
+                unbrokenEdges++;
             }
-            //Cleanup
-            stList_destruct(edges);
-            stList_destruct(nodes);
-            stList_destruct(edgesToDelete);
         }
+        if (task->edgesToDeleteNumber > 0) {
+            printf("Pinch graph component with %" PRIi64 " nodes and %" PRIi64 " edges is being split up by breaking %" PRIi64 " edges to reduce size to less than %" PRIi64 " max, but found %" PRIi64 " pointless edges \n",
+                stList_length(task->adjacencyComponent), task->edgeNumber, task->edgesToDeleteNumber, maximumAdjacencyComponentSize, unbrokenEdges);
+        }
+        //Cleanup
+        free(task->edges);
     }
+    stList_destruct(tasks);
     stList_destruct(adjacencyComponents);
 }
+
+void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio) {
+    stCaf_breakupComponentsGreedily2(threadSet, maximumAdjacencyComponentSizeRatio, 1);
+}
@@ -7,11 +7,14 @@
 
 #define _XOPEN_SOURCE 500
 
+#include <ctype.h>
+#include <sys/stat.h>
 #include "bioioC.h"
 #include "cactus.h"
 #include "sonLib.h"
 #include "pairwiseAlignment.h"
 #include "blastAlignmentLib.h"
+#include "stLastzAlignments.h"
 
 stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, const char *lastzArgs,
         bool realign, const char *realignArgs,
@@ -80,23 +83,355 @@ void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars) {
 #endif
 }
 
-void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
-    int64_t i = st_system("sort -k10,10nr -k2,2 %s > %s", cigarsFile, sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered unix sort error when sorting cigar alignments in file: %s\n", cigarsFile);
+/*
+ * External merge sort of cigar files by descending score. Each line's score is parsed once, into a key
+ * holding the score and the position of the line. The keys of each memory sized run of the file are sorted,
+ * on several threads, and the run's lines spilled to a temporary file in order, along with their keys, and
+ * the runs are then merged. Lines are copied through as they are. Ties are broken by position in the file,
+ * so the order is stable, and doesn't depend on the locale as unix sort does.
+ */
+
+typedef struct _cigarSortKey {
+    double score;
+    int64_t offset; // Of the line in the cigar file
+    int64_t length; // Of the line, excluding its newline
+} CigarSortKey;
+
+static int cigarSortKey_cmp(const CigarSortKey *key1, const CigarSortKey *key2) {
+    if (key1->score != key2->score) {
+        return key1->score > key2->score ? -1 : 1;
     }
-    i = st_system("chmod 777 %s", sortedFile);
-    if(i != 0) {
-        st_errAbort("Encountered error when changing file permissions: %s\n", cigarsFile);
+    return key1->offset < key2->offset ? -1 : (key1->offset > key2->offset ? 1 : 0);
+}
+
+/*
+ * Gets the score of a cigar line, the tenth whitespace separated field, as in "sort -k10,10".
+ * Returns false if the line is blank.
+ */
+static bool getCigarLineScore(const char *line, int64_t length, int64_t offset, double *score) {
+    int64_t i = 0;
+    for (int64_t field = 0;; field++) {
+        while (i < length && isspace(line[i])) {
+            i++;
+        }
+        if (i == length) {
+            if (field == 0) {
+                return 0;
+            }
+            st_errAbort("Cigar line at offset %" PRIi64 " has only %" PRIi64 " fields\n", offset, field);
+        }
+        int64_t j = i;
+        while (j < length && !isspace(line[j])) {
+            j++;
+        }
+        if (field == 9) {
+            char token[64];
+            char *end;
+            int64_t tokenLength = j - i < 63 ? j - i : 63;
+            memcpy(token, line + i, tokenLength);
+            token[tokenLength] = '\0';
+            *score = strtod(token, &end);
+            if (end == token) {
+                st_errAbort("Could not parse the score of the cigar line at offset %" PRIi64 "\n", offset);
+            }
+            return 1;
+        }
+        i = j;
     }
-#ifndef NDEBUG
-    double score = INT64_MAX;
-    FILE *fileHandle = fopen(sortedFile, "r");
-    struct PairwiseAlignment *pA;
-    while ((pA = cigarRead(fileHandle)) != NULL) {
-        assert(pA->score <= score);
-        score = pA->score;
-    }
-    fclose(fileHandle);
-#endif
+}
+
+typedef struct _cigarSortSlice {
+    CigarSortKey *keys;
+    int64_t keyNumber;
+} CigarSortSlice;
+
+static void *sortCigarSortSlice(CigarSortSlice *slice) {
+    qsort(slice->keys, slice->keyNumber, sizeof(CigarSortKey), (int (*)(const void *, const void *)) cigarSortKey_cmp);
+    return slice;
+}
+
+/*
+ * A k-way merge of sorted sequences of keys: a binary heap of the indices of the sequences, ordered by their
+ * current keys.
+ */
+typedef struct _cigarSortMerge {
+    CigarSortKey *currentKeys;
+    int64_t *heap;
+    int64_t heapSize;
+} CigarSortMerge;
+
+static void cigarSortMerge_siftDown(CigarSortMerge *merge, int64_t i) {
+    for (;;) {
+        int64_t smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < merge->heapSize && cigarSortKey_cmp(&merge->currentKeys[merge->heap[left]], &merge->currentKeys[merge->heap[smallest]]) < 0) {
+            smallest = left;
+        }
+        if (right < merge->heapSize && cigarSortKey_cmp(&merge->currentKeys[merge->heap[right]], &merge->currentKeys[merge->heap[smallest]]) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int64_t j = merge->heap[i];
+        merge->heap[i] = merge->heap[smallest];
+        merge->heap[smallest] = j;
+        i = smallest;
+    }
+}
+
+/*
+ * Sets up the merge of sequenceNumber sequences, sequence i having first key currentKeys[i] if
+ * it is not empty.
+ */
+static void cigarSortMerge_init(CigarSortMerge *merge, CigarSortKey *currentKeys, bool *nonEmpty, int64_t sequenceNumber) {
+    merge->currentKeys = currentKeys;
+    merge->heap = st_malloc(sizeof(int64_t) * (sequenceNumber > 0 ? sequenceNumber : 1));
+    merge->heapSize = 0;
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        if (nonEmpty[i]) {
+            merge->heap[merge->heapSize++] = i;
+        }
+    }
+    for (int64_t i = merge->heapSize / 2 - 1; i >= 0; i--) {
+        cigarSortMerge_siftDown(merge, i);
+    }
+}
+
+/*
+ * The sequence with the smallest current key, or -1 if all are exhausted.
+ */
+static int64_t cigarSortMerge_peek(CigarSortMerge *merge) {
+    return merge->heapSize > 0 ? merge->heap[0] : -1;
+}
+
+/*
+ * Advances the sequence returned by peek, whose current key has been updated if it isn't exhausted.
+ */
+static void cigarSortMerge_next(CigarSortMerge *merge, bool exhausted) {
+    if (exhausted) {
+        merge->heap[0] = merge->heap[--merge->heapSize];
+    }
+    cigarSortMerge_siftDown(merge, 0);
+}
+
+static void writeCigarLine(FILE *fileHandle, const char *line, CigarSortKey *key, CigarSortKey *previousKey) {
+    assert(previousKey->offset == -1 || cigarSortKey_cmp(previousKey, key) < 0);
+    *previousKey = *key;
+    if (fwrite(line, sizeof(char), key->length, fileHandle) != (size_t) key->length || putc('\n', fileHandle) == EOF) {
+        st_errnoAbort("Error writing sorted cigars");
+    }
+}
+
+/*
+ * Sorts the keys of the lines of a run and writes the lines in order, with their keys if writeKeys is set.
+ */
+static void sortAndWriteCigarRun(const char *lines, int64_t linesOffset, CigarSortKey *keys, int64_t keyNumber,
+        int64_t numThreads, FILE *fileHandle, bool writeKeys, CigarSortKey *previousKey) {
+    // Split the keys into a slice per thread, sort the slices in parallel, then merge them
+    int64_t sliceNumber = numThreads > 1 && keyNumber >= 2 * numThreads ? numThreads : 1;
+    CigarSortSlice *slices = st_malloc(sizeof(CigarSortSlice) * sliceNumber);
+    for (int64_t i = 0; i < sliceNumber; i++) {
+        slices[i].keys = keys + keyNumber * i / sliceNumber;
+        slices[i].keyNumber = keyNumber * (i + 1) / sliceNumber - keyNumber * i / sliceNumber;
+    }
+    if (sliceNumber > 1) {
+        stThreadPool *threadPool = stThreadPool_construct(sliceNumber, (void *(*)(void *)) sortCigarSortSlice,
+                cactusMisc_ignoreThreadPoolResult);
+        for (int64_t i = 0; i < sliceNumber; i++) {
+            stThreadPool_push(threadPool, &slices[i]);
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+    } else {
+        sortCigarSortSlice(&slices[0]);
+    }
+
+    CigarSortKey *currentKeys = st_malloc(sizeof(CigarSortKey) * sliceNumber);
+    bool *nonEmpty = st_malloc(sizeof(bool) * sliceNumber);
+    int64_t *positions = st_calloc(sliceNumber, sizeof(int64_t));
+    for (int64_t i = 0; i < sliceNumber; i++) {
+        if ((nonEmpty[i] = slices[i].keyNumber > 0)) {
+            currentKeys[i] = slices[i].keys[0];
+        }
+    }
+    CigarSortMerge merge;
+    cigarSortMerge_init(&merge, currentKeys, nonEmpty, sliceNumber);
+    int64_t i;
+    while ((i = cigarSortMerge_peek(&merge)) != -1) {
+        CigarSortKey *key = &currentKeys[i];
+        if (writeKeys && fwrite(key, sizeof(CigarSortKey), 1, fileHandle) != 1) {
+            st_errnoAbort("Error writing a run of sorted cigars");
+        }
+        writeCigarLine(fileHandle, lines + key->offset - linesOffset, key, previousKey);
+        bool exhausted = ++positions[i] == slices[i].keyNumber;
+        if (!exhausted) {
+            currentKeys[i] = slices[i].keys[positions[i]];
+        }
+        cigarSortMerge_next(&merge, exhausted);
+    }
+    free(merge.heap);
+    free(positions);
+    free(nonEmpty);
+    free(currentKeys);
+    free(slices);
+}
+
+/*
+ * Sorts a run and writes it to a temporary file, returning the file.
+ */
+static char *spillCigarRun(const char *lines, int64_t linesOffset, CigarSortKey *keys, int64_t keyNumber, int64_t numThreads) {
+    char *runFile = getTempFile();
+    FILE *fileHandle = fopen(runFile, "w");
+    if (fileHandle == NULL) {
+        st_errnoAbort("Could not open the temporary file %s to spill sorted cigars to", runFile);
+    }
+    CigarSortKey previousKey = { 0.0, -1, 0 };
+    sortAndWriteCigarRun(lines, linesOffset, keys, keyNumber, numThreads, fileHandle, 1, &previousKey);
+    if (fclose(fileHandle) != 0) {
+        st_errnoAbort("Error writing the run of sorted cigars %s", runFile);
+    }
+    return runFile;
+}
+
+typedef struct _cigarRunReader {
+    FILE *fileHandle;
+    char *line;
+    int64_t maxLineLength;
+} CigarRunReader;
+
+static bool cigarRunReader_next(CigarRunReader *reader, CigarSortKey *key) {
+    if (fread(key, sizeof(CigarSortKey), 1, reader->fileHandle) != 1) {
+        return 0;
+    }
+    if (key->length + 1 > reader->maxLineLength) {
+        reader->maxLineLength = 2 * (key->length + 1);
+        reader->line = st_realloc(reader->line, reader->maxLineLength);
+    }
+    if (fread(reader->line, sizeof(char), key->length + 1, reader->fileHandle) != (size_t) key->length + 1) {
+        st_errAbort("Run of sorted cigars is truncated\n");
+    }
+    return 1;
+}
+
+static void mergeCigarRuns(stList *runFiles, FILE *fileHandle, CigarSortKey *previousKey) {
+    int64_t runNumber = stList_length(runFiles);
+    CigarRunReader *readers = st_calloc(runNumber, sizeof(CigarRunReader));
+    CigarSortKey *currentKeys = st_malloc(sizeof(CigarSortKey) * runNumber);
+    bool *nonEmpty = st_malloc(sizeof(bool) * runNumber);
+    for (int64_t i = 0; i < runNumber; i++) {
+        if ((readers[i].fileHandle = fopen(stList_get(runFiles, i), "r")) == NULL) {
+            st_errnoAbort("Could not open the run of sorted cigars %s", (char *) stList_get(runFiles, i));
+        }
+        nonEmpty[i] = cigarRunReader_next(&readers[i], &currentKeys[i]);
+    }
+    CigarSortMerge merge;
+    cigarSortMerge_init(&merge, currentKeys, nonEmpty, runNumber);
+    int64_t i;
+    while ((i = cigarSortMerge_peek(&merge)) != -1) {
+        writeCigarLine(fileHandle, readers[i].line, &currentKeys[i], previousKey);
+        cigarSortMerge_next(&merge, !cigarRunReader_next(&readers[i], &currentKeys[i]));
+    }
+    for (int64_t i = 0; i < runNumber; i++) {
+        fclose(readers[i].fileHandle);
+        free(readers[i].line);
+    }
+    free(merge.heap);
+    free(nonEmpty);
+    free(currentKeys);
+    free(readers);
+}
+
+void stCaf_sortCigarsFileByScoreInDescendingOrder2(char *cigarsFile, char *sortedFile, int64_t maxBytesInMemory,
+        int64_t numThreads) {
+    assert(maxBytesInMemory > 0);
+    FILE *fileHandleIn = fopen(cigarsFile, "r");
+    if (fileHandleIn == NULL) {
+        st_errnoAbort("Could not open the cigar file %s", cigarsFile);
+    }
+    FILE *fileHandleOut = fopen(sortedFile, "w");
+    if (fileHandleOut == NULL) {
+        st_errnoAbort("Could not open the sorted cigar file %s", sortedFile);
+    }
+
+    // The buffer holds the run's lines from linesOffset in the file, followed by an incomplete line of
+    // bufferLength - parsedLength bytes.
+    int64_t bufferSize = maxBytesInMemory < 1048576 ? maxBytesInMemory : 1048576;
+    char *buffer = st_malloc(bufferSize);
+    int64_t bufferLength = 0, parsedLength = 0, linesOffset = 0;
+    int64_t keyNumber = 0, maxKeyNumber = 1024;
+    CigarSortKey *keys = st_malloc(sizeof(CigarSortKey) * maxKeyNumber);
+    stList *runFiles = stList_construct3(0, free);
+    CigarSortKey previousKey = { 0.0, -1, 0 };
+    for (bool endOfFile = 0; !endOfFile;) {
+        if (bufferLength == bufferSize) {
+            if (bufferSize < maxBytesInMemory || parsedLength == 0) {
+                // Grow the buffer, beyond maxBytesInMemory only if a single line won't fit
+                bufferSize = bufferSize * 2 < maxBytesInMemory || parsedLength == 0 ? bufferSize * 2 : maxBytesInMemory;
+                buffer = st_realloc(buffer, bufferSize);
+            } else {
+                stList_append(runFiles, spillCigarRun(buffer, linesOffset, keys, keyNumber, numThreads));
+                memmove(buffer, buffer + parsedLength, bufferLength - parsedLength);
+                bufferLength -= parsedLength;
+                linesOffset += parsedLength;
+                parsedLength = 0;
+                keyNumber = 0;
+            }
+        }
+        size_t bytesRead = fread(buffer + bufferLength, sizeof(char), bufferSize - bufferLength, fileHandleIn);
+        if (bytesRead == 0) {
+            if (ferror(fileHandleIn)) {
+                st_errnoAbort("Error reading the cigar file %s", cigarsFile);
+            }
+            endOfFile = 1;
+            if (parsedLength < bufferLength) { // The last line is missing its newline
+                if (bufferLength == bufferSize) {
+                    buffer = st_realloc(buffer, ++bufferSize);
+                }
+                buffer[bufferLength] = '\n';
+                bytesRead = 1;
+            }
+        }
+        bufferLength += bytesRead;
+
+        // Parse the scores of the complete lines
+        char *lineEnd;
+        while ((lineEnd = memchr(buffer + parsedLength, '\n', bufferLength - parsedLength)) != NULL) {
+            int64_t lineLength = lineEnd - (buffer + parsedLength);
+            double score;
+            if (getCigarLineScore(buffer + parsedLength, lineLength, linesOffset + parsedLength, &score)) {
+                if (keyNumber == maxKeyNumber) {
+                    maxKeyNumber *= 2;
+                    keys = st_realloc(keys, sizeof(CigarSortKey) * maxKeyNumber);
+                }
+                keys[keyNumber++] = (CigarSortKey) { score, linesOffset + parsedLength, lineLength };
+            }
+            parsedLength += lineLength + 1;
+        }
+    }
+    fclose(fileHandleIn);
+
+    if (stList_length(runFiles) == 0) { // Everything fit in memory, so write the lines out directly
+        sortAndWriteCigarRun(buffer, linesOffset, keys, keyNumber, numThreads, fileHandleOut, 0, &previousKey);
+    } else {
+        stList_append(runFiles, spillCigarRun(buffer, linesOffset, keys, keyNumber, numThreads));
+        free(buffer);
+        buffer = NULL;
+        mergeCigarRuns(runFiles, fileHandleOut, &previousKey);
+    }
+    if (fclose(fileHandleOut) != 0) {
+        st_errnoAbort("Error writing the sorted cigar file %s", sortedFile);
+    }
+    if (chmod(sortedFile, 0777) != 0) {
+        st_errnoAbort("Encountered error when changing file permissions: %s", sortedFile);
+    }
+    for (int64_t i = 0; i < stList_length(runFiles); i++) {
+        stFile_rmrf(stList_get(runFiles, i));
+    }
+    stList_destruct(runFiles);
+    free(keys);
+    free(buffer);
+}
+
+void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile) {
+    stCaf_sortCigarsFileByScoreInDescendingOrder2(cigarsFile, sortedFile, STCAF_SORT_CIGARS_MAX_BYTES_IN_MEMORY, 1);
 }
@@ -142,6 +142,114 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+/*
+ * The chains of a cactus graph, with their lengths, kept across several
+ * melting rounds. Deleting all the blocks of a chain contracts the chain's
+ * cycle into a single node, which leaves the other chains of the graph, and
+ * their lengths, unchanged, so the graph need only be built once as long as
+ * chains are not broken at reverse tandems or by spacing. The exception is
+ * in the top level flower, where a deletion that splits a thread component
+ * causes a thread of the new component to be attached to the dead end
+ * component, so the graph must then be rebuilt.
+ */
+typedef struct _meltingChains {
+    stCactusGraph *cactusGraph;
+    stList *chainEnds;
+    int64_t *chainLengths;
+    bool *deleted;
+    int64_t numberOfThreadComponents;
+} MeltingChains;
+
+static int64_t getNumberOfThreadComponents(stPinchThreadSet *threadSet) {
+    stSortedSet *threadComponents = stPinchThreadSet_getThreadComponents(threadSet);
+    int64_t numberOfThreadComponents = stSortedSet_size(threadComponents);
+    stSortedSet_destruct(threadComponents);
+    return numberOfThreadComponents;
+}
+
+static MeltingChains *meltingChains_construct(Flower *flower, stPinchThreadSet *threadSet) {
+    MeltingChains *chains = st_malloc(sizeof(MeltingChains));
+    stCactusNode *startCactusNode;
+    stList *deadEndComponent;
+    chains->cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, INT64_MAX,
+            0.0, 0, INT64_MAX);
+    chains->chainEnds = stList_construct();
+    stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(chains->cactusGraph);
+    stCactusNode *cactusNode;
+    while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
+        stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+        stCactusEdgeEnd *cactusEdgeEnd;
+        while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
+            if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+                stList_append(chains->chainEnds, cactusEdgeEnd);
+            }
+        }
+    }
+    stCactusGraphNodeIterator_destruct(nodeIt);
+    chains->chainLengths = st_malloc(sizeof(int64_t) * stList_length(chains->chainEnds));
+    chains->deleted = st_calloc(stList_length(chains->chainEnds), sizeof(bool));
+    for (int64_t i = 0; i < stList_length(chains->chainEnds); i++) {
+        chains->chainLengths[i] = getChainLength(stList_get(chains->chainEnds, i));
+    }
+    chains->numberOfThreadComponents = flower_getName(flower) == 0 ? getNumberOfThreadComponents(threadSet) : 0;
+    return chains;
+}
+
+static void meltingChains_destruct(MeltingChains *chains) {
+    stCactusGraph_destruct(chains->cactusGraph);
+    stList_destruct(chains->chainEnds);
+    free(chains->chainLengths);
+    free(chains->deleted);
+    free(chains);
+}
+
+static stList *meltingChains_getBlocksInChainsLessThanGivenLength(MeltingChains *chains, int64_t minimumChainLength) {
+    /*
+     * As stCaf_getBlocksInChainsLessThanGivenLength, but only considers chains not deleted by
+     * a previous round, and marks the chains whose blocks are returned as deleted.
+     */
+    stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
+    for (int64_t i = 0; i < stList_length(chains->chainEnds); i++) {
+        if (!chains->deleted[i] && chains->chainLengths[i] < minimumChainLength) {
+            addChainBlocksToBlocksToDelete(stList_get(chains->chainEnds, i), blocksToDelete);
+            chains->deleted[i] = 1;
+        }
+    }
+    return blocksToDelete;
+}
+
+void stCaf_meltInRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t numberOfRounds) {
+    bool meltingRequired = 0;
+    for (int64_t i = 0; i < numberOfRounds; i++) {
+        meltingRequired = meltingRequired || minimumChainLengths[i] > 1;
+    }
+    if (meltingRequired) {
+        MeltingChains *chains = meltingChains_construct(flower, threadSet);
+        for (int64_t i = 0; i < numberOfRounds; i++) {
+            st_logDebug("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengths[i]);
+            stList *blocksToDelete = meltingChains_getBlocksInChainsLessThanGivenLength(chains, minimumChainLengths[i]);
+
+            printf("A melting round is destroying %" PRIi64 " blocks with an average degree "
+                   "of %lf from chains with length less than %" PRIi64 ". Total aligned bases"
+                   " lost: %" PRIu64 "\n",
+                   stList_length(blocksToDelete), stCaf_averageBlockDegree(blocksToDelete),
+                   minimumChainLengths[i], stCaf_totalAlignedBases(blocksToDelete));
+
+            stList_destruct(blocksToDelete); //This will destroy the blocks
+
+            //If the deletions split a thread component of the top level flower the chains must be rebuilt
+            if (flower_getName(flower) == 0 && i + 1 < numberOfRounds
+                    && getNumberOfThreadComponents(threadSet) != chains->numberOfThreadComponents) {
+                meltingChains_destruct(chains);
+                chains = meltingChains_construct(flower, threadSet);
+            }
+        }
+        meltingChains_destruct(chains);
+    }
+    //Now heal up the trivial boundaries, once for all the rounds
+    stCaf_joinTrivialBoundaries(threadSet);
+}
+
 static bool isTelomere(stPinchEnd *end, stSet *deadEndComponent) {
     stPinchSegment *segment = stPinchBlock_getFirst(end->block);
     bool atEndOfThread = stPinchThread_getFirst(stPinchSegment_getThread(segment)) == segment || stPinchThread_getLast(stPinchSegment_getThread(segment)) == segment;
@@ -333,26 +441,44 @@ static stHash *getPinchEndToChainEndHash(stCactusGraph *cactusGraph) {
     return pinchEndToChainEnd;
 }
 
-// For a given cactus node, recurse through all nodes below it and
-// find recoverable chains below them. Then find recoverable chains
-// below the current node given its parent chain.
-static void getRecoverableChains_R(stCactusNode *cactusNode, stCactusEdgeEnd *parentChain, stSet *deadEndComponent, Flower *flower, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *), stHash *pinchEndToChainEnd, stSet *recoverableChains, stList *telomereAdjacentChains, stHash *chainToRecoverableAdjacencies) {
+// Get the chains hanging from a cactus node. The nodes of chains
+// that have been deleted are treated as if contracted into the node,
+// so the chains hanging from them are returned instead.
+static void getChildChains(stCactusNode *cactusNode, stSet *deletedChains, stList *childChains) {
     stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
     stCactusEdgeEnd *cactusEdgeEnd;
     while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
-        if ((parentChain == NULL
-             || (cactusEdgeEnd != parentChain
-                 && cactusEdgeEnd != stCactusEdgeEnd_getLink(parentChain)))
-            && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)
-            && stCactusEdgeEnd_getOtherNode(cactusEdgeEnd) != cactusNode) {
+        if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+            if (stSet_search(deletedChains, cactusEdgeEnd)) {
+                stCactusEdgeEnd *nextEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd);
+                while (!stCactusEdgeEnd_isChainEnd(nextEdgeEnd)) {
+                    getChildChains(stCactusEdgeEnd_getNode(nextEdgeEnd), deletedChains, childChains);
+                    nextEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(stCactusEdgeEnd_getLink(nextEdgeEnd));
+                }
+            } else {
+                stList_append(childChains, cactusEdgeEnd);
+            }
+        }
+    }
+}
+
+// For a given cactus node, recurse through all nodes below it and
+// find recoverable chains below them. Then find recoverable chains
+// below the current node given its parent chain.
+static void getRecoverableChains_R(stCactusNode *cactusNode, stCactusEdgeEnd *parentChain, stSet *deadEndComponent, Flower *flower, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *), stHash *pinchEndToChainEnd, stSet *deletedChains, stSet *recoverableChains, stList *telomereAdjacentChains, stHash *chainToRecoverableAdjacencies) {
+    stList *childChains = stList_construct();
+    getChildChains(cactusNode, deletedChains, childChains);
+    for (int64_t i = 0; i < stList_length(childChains); i++) {
+        stCactusEdgeEnd *cactusEdgeEnd = stList_get(childChains, i);
+        if (stCactusEdgeEnd_getOtherNode(cactusEdgeEnd) != stCactusEdgeEnd_getNode(cactusEdgeEnd)) {
             // Found a new chain below this node.
-            assert(stCactusEdgeEnd_isChainEnd(cactusEdgeEnd));
             getRecoverableChains_R(stCactusEdgeEnd_getOtherNode(cactusEdgeEnd),
                                    stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd),
                                    deadEndComponent,
                                    flower,
                                    recoverabilityFilter,
                                    pinchEndToChainEnd,
+                                   deletedChains,
                                    recoverableChains,
                                    telomereAdjacentChains,
                                    chainToRecoverableAdjacencies);
@@ -363,31 +489,28 @@ static void getRecoverableChains_R(stCactusNode *cactusNode, stCactusEdgeEnd *pa
         // Visit the next node on this chain (unless it's where we started).
         stCactusEdgeEnd *nextEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(stCactusEdgeEnd_getLink(parentChain));
         if (!stCactusEdgeEnd_isChainEnd(nextEdgeEnd)) {
-            getRecoverableChains_R(stCactusEdgeEnd_getNode(nextEdgeEnd), nextEdgeEnd, deadEndComponent, flower, recoverabilityFilter, pinchEndToChainEnd, recoverableChains, telomereAdjacentChains, chainToRecoverableAdjacencies);
+            getRecoverableChains_R(stCactusEdgeEnd_getNode(nextEdgeEnd), nextEdgeEnd, deadEndComponent, flower, recoverabilityFilter, pinchEndToChainEnd, deletedChains, recoverableChains, telomereAdjacentChains, chainToRecoverableAdjacencies);
         }
     }
 
-    cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
-    while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
-        if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
-            if ((recoverabilityFilter == NULL || recoverabilityFilter(cactusEdgeEnd, flower)) && chainIsRecoverable(cactusEdgeEnd, deadEndComponent)) {
-                stSet_insert(recoverableChains, cactusEdgeEnd);
-                markRecoverableAdjacencies(cactusEdgeEnd, pinchEndToChainEnd, chainToRecoverableAdjacencies);
-                if (chainConnectsToTelomere(cactusEdgeEnd, deadEndComponent)) {
-                    stList_append(telomereAdjacentChains, cactusEdgeEnd);
-                }
+    for (int64_t i = 0; i < stList_length(childChains); i++) {
+        stCactusEdgeEnd *cactusEdgeEnd = stList_get(childChains, i);
+        if ((recoverabilityFilter == NULL || recoverabilityFilter(cactusEdgeEnd, flower)) && chainIsRecoverable(cactusEdgeEnd, deadEndComponent)) {
+            stSet_insert(recoverableChains, cactusEdgeEnd);
+            markRecoverableAdjacencies(cactusEdgeEnd, pinchEndToChainEnd, chainToRecoverableAdjacencies);
+            if (chainConnectsToTelomere(cactusEdgeEnd, deadEndComponent)) {
+                stList_append(telomereAdjacentChains, cactusEdgeEnd);
             }
         }
     }
+    stList_destruct(childChains);
 }
 
-static stList *getRecoverableChains(stCactusGraph *cactusGraph, stCactusNode *startCactusNode, stSet *deadEndComponent, Flower *flower, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *)) {
-    stHash *pinchEndToChainEnd = getPinchEndToChainEndHash(cactusGraph);
-
+static stList *getRecoverableChains(stCactusNode *startCactusNode, stSet *deadEndComponent, Flower *flower, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *), stHash *pinchEndToChainEnd, stSet *deletedChains) {
     stSet *recoverableChainSet = stSet_construct();
     stList *telomereAdjacentChains = stList_construct();
     stHash *chainToRecoverableAdjacencies = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
-    getRecoverableChains_R(startCactusNode, NULL, deadEndComponent, flower, recoverabilityFilter, pinchEndToChainEnd, recoverableChainSet, telomereAdjacentChains, chainToRecoverableAdjacencies);
+    getRecoverableChains_R(startCactusNode, NULL, deadEndComponent, flower, recoverabilityFilter, pinchEndToChainEnd, deletedChains, recoverableChainSet, telomereAdjacentChains, chainToRecoverableAdjacencies);
 
     // Remove anchors that are connected to telomeres and are not
     // transitively connected to an unrecoverable chain. This ensures
@@ -437,7 +560,6 @@ static stList *getRecoverableChains(stCactusGraph *cactusGraph, stCactusNode *st
     }
     stSet_destructIterator(it);
     stSet_destruct(recoverableChainSet);
-    stHash_destruct(pinchEndToChainEnd);
     return recoverableChains;
 }
 
@@ -459,30 +581,78 @@ static int64_t totalAlignedBases(stList *blocks) {
     return total;
 }
 
-void stCaf_meltRecoverableChains(Flower *flower, stPinchThreadSet *threadSet, bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *), int64_t maxNumIterations, int64_t maxRecoverableChainLength) {
-    while (maxNumIterations-- > 0) {
-        stCactusNode *startCactusNode;
-        stList *deadEndComponent;
-        // FIXME: We shouldn't really have to rebuild the cactus graph
-        // every time. Instead we should just be able to do multiple
-        // iterations over the same graph, keeping track of the chains
-        // whose underlying blocks we've already deleted.
-        stCactusGraph *cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, 0,
-                                                                      0.0, breakChainsAtReverseTandems, maximumMedianSpacingBetweenLinkedEnds);
-
-        // Construct a queryable set of stub ends.
-        stSet *deadEndComponentSet = stSet_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL);
-        for (int64_t i = 0; i < stList_length(deadEndComponent); i++) {
-            stSet_insert(deadEndComponentSet, stList_get(deadEndComponent, i));
+// Remove the ends of a deleted chain from the mapping of pinch ends to chain ends.
+static void removeChainFromPinchEndToChainEndHash(stCactusEdgeEnd *chainEnd, stHash *pinchEndToChainEnd) {
+    stCactusEdgeEnd *curEnd = chainEnd;
+    do {
+        stHash_remove(pinchEndToChainEnd, stCactusEdgeEnd_getObject(curEnd));
+        if (stCactusEdgeEnd_getLinkOrientation(curEnd)) {
+            curEnd = stCactusEdgeEnd_getLink(curEnd);
+        } else {
+            curEnd = stCactusEdgeEnd_getOtherEdgeEnd(curEnd);
         }
+    } while (curEnd != chainEnd);
+}
+
+typedef struct _recoverableChainsGraph {
+    stCactusGraph *cactusGraph;
+    stCactusNode *startCactusNode;
+    stSet *deadEndComponent;
+    stHash *pinchEndToChainEnd;
+    stSet *deletedChains;
+    int64_t numberOfThreadComponents;
+} RecoverableChainsGraph;
+
+static RecoverableChainsGraph *recoverableChainsGraph_construct(Flower *flower, stPinchThreadSet *threadSet,
+        bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds) {
+    RecoverableChainsGraph *graph = st_malloc(sizeof(RecoverableChainsGraph));
+    stList *deadEndComponent;
+    graph->cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &graph->startCactusNode, &deadEndComponent, 0, 0,
+                                                          0.0, breakChainsAtReverseTandems, maximumMedianSpacingBetweenLinkedEnds);
+
+    // Construct a queryable set of stub ends.
+    graph->deadEndComponent = stSet_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL);
+    for (int64_t i = 0; i < stList_length(deadEndComponent); i++) {
+        stSet_insert(graph->deadEndComponent, stList_get(deadEndComponent, i));
+    }
+
+    graph->pinchEndToChainEnd = getPinchEndToChainEndHash(graph->cactusGraph);
+    graph->deletedChains = stSet_construct();
+    graph->numberOfThreadComponents = flower_getName(flower) == 0 ? getNumberOfThreadComponents(threadSet) : 0;
+    return graph;
+}
+
+static void recoverableChainsGraph_destruct(RecoverableChainsGraph *graph) {
+    stSet_destruct(graph->deletedChains);
+    stHash_destruct(graph->pinchEndToChainEnd);
+    stSet_destruct(graph->deadEndComponent);
+    stCactusGraph_destruct(graph->cactusGraph);
+    free(graph);
+}
 
-        stList *recoverableChains = getRecoverableChains(cactusGraph, startCactusNode, deadEndComponentSet, flower, recoverabilityFilter);
+void stCaf_meltRecoverableChains(Flower *flower, stPinchThreadSet *threadSet, bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds, bool (*recoverabilityFilter)(stCactusEdgeEnd *, Flower *), int64_t maxNumIterations, int64_t maxRecoverableChainLength) {
+    // The cactus graph is built once. Deleting the blocks of a chain
+    // contracts the chain into the node it hangs from, so each
+    // iteration walks the same graph, looking through the chains
+    // deleted by previous iterations. The recoverability tests query
+    // the pinch graph directly, so see the deletions. As in
+    // stCaf_meltInRounds, the graph is rebuilt if the deletions split
+    // a thread component of the top level flower, as that changes the
+    // dead end component.
+    RecoverableChainsGraph *graph = recoverableChainsGraph_construct(flower, threadSet, breakChainsAtReverseTandems,
+                                                                     maximumMedianSpacingBetweenLinkedEnds);
+
+    while (maxNumIterations-- > 0) {
+        stList *recoverableChains = getRecoverableChains(graph->startCactusNode, graph->deadEndComponent, flower, recoverabilityFilter,
+                                                         graph->pinchEndToChainEnd, graph->deletedChains);
 
         stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
         for (int64_t i = 0; i < stList_length(recoverableChains); i++) {
             stCactusEdgeEnd *chainEnd = stList_get(recoverableChains, i);
             if (getChainLength(chainEnd) <= maxRecoverableChainLength) {
                 addChainBlocksToBlocksToDelete(chainEnd, blocksToDelete);
+                removeChainFromPinchEndToChainEndHash(chainEnd, graph->pinchEndToChainEnd);
+                stSet_insert(graph->deletedChains, chainEnd);
             }
         }
         int64_t numRecoverableBlocks = stList_length(blocksToDelete);
@@ -491,15 +661,22 @@ void stCaf_meltRecoverableChains(Flower *flower, stPinchThreadSet *threadSet, bo
         stList_destruct(recoverableChains);
         stList_destruct(blocksToDelete);
 
-        stCactusGraph_destruct(cactusGraph);
-        stSet_destruct(deadEndComponentSet);
-
         if (numRecoverableBlocks == 0) {
             // We didn't delete anything this round; we can safely
             // stop since we haven't changed the graph at all.
             break;
         }
+
+        //If the deletions split a thread component of the top level flower the graph must be rebuilt
+        if (flower_getName(flower) == 0 && maxNumIterations > 0
+                && getNumberOfThreadComponents(threadSet) != graph->numberOfThreadComponents) {
+            recoverableChainsGraph_destruct(graph);
+            graph = recoverableChainsGraph_construct(flower, threadSet, breakChainsAtReverseTandems,
+                                                     maximumMedianSpacingBetweenLinkedEnds);
+        }
     }
+
+    recoverableChainsGraph_destruct(graph);
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -6,6 +6,10 @@
  */
 
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
@@ -178,6 +182,115 @@ stPinchIterator *stPinchIterator_constructFromAlignedPairs(stSortedSet *alignedP
     return pinchIterator;
 }
 
+/*
+ * Binary pinch files: a header followed by a flat array of pinches, written once and then
+ * memory mapped, so each pass over the pinches is a sequential scan rather than a reparse.
+ */
+
+#define BINARY_PINCH_FILE_MAGIC "CACTUSPN"
+#define BINARY_PINCH_FILE_VERSION 1
+
+typedef struct _binaryPinchFileHeader {
+    char magic[8];
+    int64_t version;
+} BinaryPinchFileHeader;
+
+typedef struct _binaryPinch {
+    int64_t name1, name2, start1, start2;
+    int64_t lengthAndStrand; //The length shifted left by one, with the strand in the low bit.
+} BinaryPinch;
+
+typedef struct _binaryPinchFile {
+    void *data;
+    size_t size;
+    BinaryPinch *pinches;
+    int64_t pinchNumber, index;
+    stPinch pinch; //The pinches are mapped read only but trimming modifies the returned pinch, so return a copy.
+} BinaryPinchFile;
+
+void stPinchIterator_writeBinaryFile(stPinchIterator *pinchIterator, const char *binaryFile) {
+    FILE *fileHandle = fopen(binaryFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open the binary pinch file %s for writing\n", binaryFile);
+    }
+    BinaryPinchFileHeader header;
+    memcpy(header.magic, BINARY_PINCH_FILE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_PINCH_FILE_VERSION;
+    bool failed = fwrite(&header, sizeof(BinaryPinchFileHeader), 1, fileHandle) != 1;
+    //Write the untrimmed pinches, so any trim can be applied when the file is read
+    int64_t alignmentTrim = pinchIterator->alignmentTrim;
+    pinchIterator->alignmentTrim = 0;
+    stPinchIterator_reset(pinchIterator);
+    stPinch *pinch;
+    while (!failed && (pinch = stPinchIterator_getNext(pinchIterator)) != NULL) {
+        BinaryPinch binaryPinch = { pinch->name1, pinch->name2, pinch->start1, pinch->start2,
+                (pinch->length << 1) | (pinch->strand ? 1 : 0) };
+        failed = fwrite(&binaryPinch, sizeof(BinaryPinch), 1, fileHandle) != 1;
+    }
+    pinchIterator->alignmentTrim = alignmentTrim;
+    stPinchIterator_reset(pinchIterator);
+    if (fclose(fileHandle) != 0 || failed) {
+        st_errAbort("Error writing the binary pinch file %s\n", binaryFile);
+    }
+}
+
+static BinaryPinchFile *binaryPinchFile_construct(const char *binaryFile) {
+    int fd = open(binaryFile, O_RDONLY);
+    struct stat fileStat;
+    if (fd < 0 || fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not open the binary pinch file %s\n", binaryFile);
+    }
+    if (fileStat.st_size < sizeof(BinaryPinchFileHeader)
+            || (fileStat.st_size - sizeof(BinaryPinchFileHeader)) % sizeof(BinaryPinch) != 0) {
+        st_errAbort("The binary pinch file %s is truncated\n", binaryFile);
+    }
+    BinaryPinchFile *binaryPinchFile = st_calloc(1, sizeof(BinaryPinchFile));
+    binaryPinchFile->size = fileStat.st_size;
+    binaryPinchFile->data = mmap(NULL, binaryPinchFile->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (binaryPinchFile->data == MAP_FAILED) {
+        st_errAbort("Could not memory map the binary pinch file %s\n", binaryFile);
+    }
+    BinaryPinchFileHeader *header = binaryPinchFile->data;
+    if (memcmp(header->magic, BINARY_PINCH_FILE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != BINARY_PINCH_FILE_VERSION) {
+        st_errAbort("The file %s is not a binary pinch file of version %i\n", binaryFile, BINARY_PINCH_FILE_VERSION);
+    }
+    madvise(binaryPinchFile->data, binaryPinchFile->size, MADV_SEQUENTIAL);
+    binaryPinchFile->pinches = (BinaryPinch *) (header + 1);
+    binaryPinchFile->pinchNumber = (binaryPinchFile->size - sizeof(BinaryPinchFileHeader)) / sizeof(BinaryPinch);
+    return binaryPinchFile;
+}
+
+static stPinch *binaryPinchFile_getNext(BinaryPinchFile *binaryPinchFile) {
+    if (binaryPinchFile->index == binaryPinchFile->pinchNumber) {
+        return NULL;
+    }
+    BinaryPinch *binaryPinch = &binaryPinchFile->pinches[binaryPinchFile->index++];
+    stPinch_fillOut(&binaryPinchFile->pinch, binaryPinch->name1, binaryPinch->name2, binaryPinch->start1,
+            binaryPinch->start2, binaryPinch->lengthAndStrand >> 1, binaryPinch->lengthAndStrand & 1);
+    return &binaryPinchFile->pinch;
+}
+
+static BinaryPinchFile *binaryPinchFile_reset(BinaryPinchFile *binaryPinchFile) {
+    binaryPinchFile->index = 0;
+    return binaryPinchFile;
+}
+
+static void binaryPinchFile_destruct(BinaryPinchFile *binaryPinchFile) {
+    munmap(binaryPinchFile->data, binaryPinchFile->size);
+    free(binaryPinchFile);
+}
+
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile) {
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = binaryPinchFile_construct(binaryFile);
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *)) binaryPinchFile_getNext;
+    pinchIterator->destructAlignmentArg = (void(*)(void *)) binaryPinchFile_destruct;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) binaryPinchFile_reset;
+    return pinchIterator;
+}
+
 void stPinchIterator_setTrim(stPinchIterator *pinchIterator, int64_t alignmentTrim) {
     pinchIterator->alignmentTrim = alignmentTrim;
 }
@@ -38,6 +38,14 @@ stPinchThreadSet *stCaf_setup(Flower *flower);
  */
 void stCaf_anneal(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
+/*
+ * As stCaf_anneal, but the pinches are read from the iterator on a second thread while the calling thread adds
+ * them to the graph, which pays off when the iterator is expensive, e.g. when parsing alignments from a file.
+ * The pinches are added in the same order, so the resulting graph is the same. The iterator must not use the
+ * thread set.
+ */
+void stCaf_annealPipelined(stPinchThreadSet *threadSet, stPinchIterator *pinchIterator, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
+
 /*
  * Add the set of alignments, represented as pinches, to the graph, allowing alignments only between segments in the same component.
  */
@@ -58,6 +66,14 @@ void stCaf_joinTrivialBoundaries(stPinchThreadSet *threadSet);
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *), int64_t blockEndTrim,
         int64_t minimumChainLength, bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds);
 
+/*
+ * Does a series of melting rounds, each removing the chains shorter than the given
+ * minimum chain length for the round. The cactus graph is built once for all the rounds,
+ * so chains are not broken at reverse tandems or by the spacing of their links. The result
+ * is the same as calling stCaf_melt with each minimum chain length in turn.
+ */
+void stCaf_meltInRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t numberOfRounds);
+
 /*
  * Removes any recoverable chains (those expected to be picked up by
  * bar phase) from the graph. Only chains that are recoverable *and*
@@ -124,6 +140,14 @@ void stCaf_finish(Flower *flower, stPinchThreadSet *threadSet, int64_t chainLeng
  */
 void stCaf_setFlowerForAlignmentFiltering(Flower *input);
 
+/*
+ * Forgets the block summaries cached by stCaf_filterByRepeatSpecies, stCaf_filterByMultipleSpecies,
+ * stCaf_singleCopyChr, stCaf_singleCopyIngroup and their relaxed versions. Must be called before
+ * filtering with them if the pinch graph has been changed other than by pinches they let through.
+ * The annealing functions call it before filtering.
+ */
+void stCaf_resetAlignmentFilteringIndex(void);
+
 /*
  * Filters incoming alignments by presence of outgroup, to ensure at
  * most one outgroup segment is in any block.
@@ -142,7 +166,8 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
 
 /*
  * Filters incoming alignments by presence of repeat species in
- * block. This code is inefficient and does not scale.
+ * block. Uses a cached bitset of the events of each block, so costs
+ * O(number of events / 64) per pinch once the blocks are summarised.
  */
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2);
@@ -24,4 +24,10 @@ stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t max
  */
 void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio);
 
+/*
+ * As stCaf_breakupComponentsGreedily, but works out the edges to break for the different components
+ * concurrently, using numThreads threads. The edges broken are the same for any number of threads.
+ */
+void stCaf_breakupComponentsGreedily2(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio, int64_t numThreads);
+
 #endif /* ST_GIANTCOMPONENT_H_ */
@@ -17,6 +17,19 @@ stList *stCaf_selfAlignFlower(Flower *flower, int64_t minimumSequenceLength, con
 
 void stCaf_sortCigarsByScoreInDescendingOrder(stList *cigars);
 
+/*
+ * The memory used by default to sort cigar files, beyond which sorted runs are spilled to disk.
+ */
+#define STCAF_SORT_CIGARS_MAX_BYTES_IN_MEMORY 268435456
+
 void stCaf_sortCigarsFileByScoreInDescendingOrder(char *cigarsFile, char *sortedFile);
 
+/*
+ * Sorts the cigar lines of cigarsFile into sortedFile by descending score, copying the lines through
+ * unchanged. Lines with equal scores keep their order in cigarsFile. Beyond maxBytesInMemory of the
+ * file, sorted runs are spilled to temporary files and merged. Runs are sorted on numThreads threads.
+ */
+void stCaf_sortCigarsFileByScoreInDescendingOrder2(char *cigarsFile, char *sortedFile, int64_t maxBytesInMemory,
+        int64_t numThreads);
+
 #endif /* ST_LASTZALIGNMENT_H_ */
@@ -50,6 +50,18 @@ stPinchIterator *stPinchIterator_constructFromList(
 stPinchIterator *stPinchIterator_constructFromAlignedPairs(
         stSortedSet *alignedPairs, stPinch *(*getNextAlignedPairAlignment)(stSortedSetIterator *));
 
+/*
+ * Writes all the pinches of the iterator, untrimmed, to a binary pinch file, resetting
+ * the iterator before and after.
+ */
+void stPinchIterator_writeBinaryFile(stPinchIterator *pinchIterator, const char *binaryFile);
+
+/*
+ * Get a pinch iterator from a binary pinch file written by stPinchIterator_writeBinaryFile.
+ * The file is memory mapped, so resetting the iterator is free.
+ */
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *binaryFile);
+
 /*
  * Sets the amount to trim from the ends of each pinch in bases.
  */
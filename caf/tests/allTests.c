@@ -11,8 +11,10 @@ CuSuite* annealingTestSuite(void);
 CuSuite* giantComponentTestSuite(void);
 CuSuite* pinchIteratorTestSuite(void);
 CuSuite* recoverableChainsTestSuite(void);
+CuSuite* meltingTestSuite(void);
 CuSuite* phylogenyTestSuite(void);
 CuSuite* filteringTestSuite(void);
+CuSuite* lastzAlignmentsTestSuite(void);
 
 int cactusCoreRunAllTests(void) {
     CuString *output = CuStringNew();
@@ -21,8 +23,10 @@ int cactusCoreRunAllTests(void) {
     CuSuiteAddSuite(suite, pinchIteratorTestSuite());
     CuSuiteAddSuite(suite, giantComponentTestSuite());
     CuSuiteAddSuite(suite, recoverableChainsTestSuite());
+    CuSuiteAddSuite(suite, meltingTestSuite());
     CuSuiteAddSuite(suite, phylogenyTestSuite());
     CuSuiteAddSuite(suite, filteringTestSuite());
+    CuSuiteAddSuite(suite, lastzAlignmentsTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
@@ -8,9 +8,14 @@
 #include "sonLib.h"
 #include "stCaf.h"
 #include "stPinchGraphs.h"
+#include "pairwiseAlignment.h"
+#include <time.h>
 
 void stCaf_anneal2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg);
 
+void stCaf_annealPipelined2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *), void *extraArg,
+        bool (*filterFn)(stPinchSegment *, stPinchSegment *));
+
 void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinch *(*pinchIterator)(void *),
         void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *));
 
@@ -41,9 +46,153 @@ static void testAnnealingBetweenAdjacencyComponents(CuTest *testCase) {
     }
 }
 
+/*
+ * Checks two graphs built by adding the same pinches to the same threads are identical, including the
+ * order and orientation of the segments in each block.
+ */
+static void checkThreadSetsAreIdentical(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getSize(threadSet1), stPinchThreadSet_getSize(threadSet2));
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        CuAssertTrue(testCase, thread2 != NULL);
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1);
+        stPinchSegment *segment2 = stPinchThread_getFirst(thread2);
+        while (segment1 != NULL) {
+            CuAssertTrue(testCase, segment2 != NULL);
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+            stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+                CuAssertIntEquals(testCase, stPinchSegment_getBlockOrientation(segment1), stPinchSegment_getBlockOrientation(segment2));
+                stPinchSegment *first1 = stPinchBlock_getFirst(block1);
+                stPinchSegment *first2 = stPinchBlock_getFirst(block2);
+                CuAssertIntEquals(testCase, stPinchSegment_getName(first1), stPinchSegment_getName(first2));
+                CuAssertIntEquals(testCase, stPinchSegment_getStart(first1), stPinchSegment_getStart(first2));
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment2 == NULL);
+    }
+}
+
+typedef struct _pinchArray {
+    stPinch *pinches;
+    int64_t length, index;
+} PinchArray;
+
+static stPinch *pinchArray_getNext(PinchArray *pinchArray) {
+    return pinchArray->index < pinchArray->length ? &pinchArray->pinches[pinchArray->index++] : NULL;
+}
+
+static void testAnnealingPipelined(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting pipelined annealing random test %" PRIi64 "\n", test);
+        //Build two copies of the same random graph
+        int64_t seed = st_randomInt(0, INT32_MAX);
+        st_randomSeed(seed);
+        stPinchThreadSet *threadSet1 = stPinchThreadSet_getRandomEmptyGraph();
+        st_randomSeed(seed);
+        stPinchThreadSet *threadSet2 = stPinchThreadSet_getRandomEmptyGraph();
+        //Enough pinches to fill several batches
+        PinchArray pinchArray;
+        pinchArray.length = st_randomInt(0, 20000);
+        pinchArray.pinches = st_malloc(sizeof(stPinch) * (pinchArray.length + 1));
+        for (int64_t i = 0; i < pinchArray.length; i++) {
+            pinchArray.pinches[i] = stPinchThreadSet_getRandomPinch(threadSet1);
+        }
+        pinchArray.index = 0;
+        stCaf_anneal2(threadSet1, (stPinch *(*)(void *)) pinchArray_getNext, &pinchArray);
+        pinchArray.index = 0;
+        stCaf_annealPipelined2(threadSet2, (stPinch *(*)(void *)) pinchArray_getNext, &pinchArray, NULL);
+        CuAssertIntEquals(testCase, pinchArray.length, pinchArray.index);
+        checkThreadSetsAreIdentical(testCase, threadSet1, threadSet2);
+        free(pinchArray.pinches);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
+static stPinchThreadSet *getTimingThreadSet(int64_t threadNumber, int64_t threadLength) {
+    stPinchThreadSet *threadSet = stPinchThreadSet_construct();
+    for (int64_t i = 0; i < threadNumber; i++) {
+        stPinchThreadSet_addThread(threadSet, i, 0, threadLength);
+    }
+    return threadSet;
+}
+
+static double getSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+/*
+ * Times annealing a file of random gapped alignments, serially and pipelined, and checks the two
+ * graphs are the same. Kept to unit test size; raise the numbers to use it as a benchmark.
+ */
+static void testAnnealingPipelined_timing(CuTest *testCase) {
+    int64_t threadNumber = 10, threadLength = 100000, alignmentNumber = 2000;
+    char *tempFile = "tempFileForAnnealingTiming.cig";
+    FILE *fileHandle = fopen(tempFile, "w");
+    for (int64_t i = 0; i < alignmentNumber; i++) {
+        char *contig1 = cactusMisc_nameToString(st_randomInt(0, threadNumber));
+        char *contig2 = cactusMisc_nameToString(st_randomInt(0, threadNumber));
+        bool strand2 = st_random() > 0.5;
+        int64_t start1 = st_randomInt(1, threadLength - 2000), end1 = start1;
+        int64_t start2 = strand2 ? st_randomInt(1, threadLength - 2000) : st_randomInt(2000, threadLength - 1), end2 = start2;
+        struct List *operationList = constructEmptyList(0, NULL);
+        for (int64_t j = 0; j < 20; j++) {
+            int64_t length = st_randomInt(1, 50);
+            int64_t type = j % 2 == 0 ? PAIRWISE_MATCH : st_randomInt(1, 3);
+            listAppend(operationList, constructAlignmentOperation(type, length, 0));
+            if (type != PAIRWISE_INDEL_Y) {
+                end1 += length;
+            }
+            if (type != PAIRWISE_INDEL_X) {
+                end2 += strand2 ? length : -length;
+            }
+        }
+        struct PairwiseAlignment *pairwiseAlignment = constructPairwiseAlignment(contig1, start1, end1, 1, contig2,
+                start2, end2, strand2, 0.0, operationList);
+        cigarWrite(fileHandle, pairwiseAlignment, 0);
+        destructPairwiseAlignment(pairwiseAlignment);
+        free(contig1);
+        free(contig2);
+    }
+    fclose(fileHandle);
+    stPinchIterator *pinchIterator = stPinchIterator_constructFromFile(tempFile);
+
+    stPinchThreadSet *threadSet1 = getTimingThreadSet(threadNumber, threadLength);
+    double startTime = getSeconds();
+    stCaf_anneal(threadSet1, pinchIterator, NULL);
+    double serialTime = getSeconds() - startTime;
+
+    stPinchThreadSet *threadSet2 = getTimingThreadSet(threadNumber, threadLength);
+    startTime = getSeconds();
+    stCaf_annealPipelined(threadSet2, pinchIterator, NULL);
+    double pipelinedTime = getSeconds() - startTime;
+
+    st_logInfo("Annealed %" PRIi64 " alignments in %f seconds serially and %f seconds pipelined\n", alignmentNumber,
+            serialTime, pipelinedTime);
+    checkThreadSetsAreIdentical(testCase, threadSet1, threadSet2);
+
+    stPinchThreadSet_destruct(threadSet1);
+    stPinchThreadSet_destruct(threadSet2);
+    stPinchIterator_destruct(pinchIterator);
+    stFile_rmrf(tempFile);
+}
+
 CuSuite* annealingTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testAnnealing);
     SUITE_ADD_TEST(suite, testAnnealingBetweenAdjacencyComponents);
+    SUITE_ADD_TEST(suite, testAnnealingPipelined);
+    SUITE_ADD_TEST(suite, testAnnealingPipelined_timing);
     return suite;
 }
@@ -349,11 +349,142 @@ static void testHGVMFiltering(CuTest *testCase) {
     }
 }
 
+/*
+ * Straightforward versions of the species and sequence based alignment filters, to check the
+ * versions using cached block summaries against.
+ */
+
+static stSet *getNaiveSet(stPinchSegment *segment, int64_t type) {
+    stList *segments = stList_construct();
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+        stPinchSegment *segment2;
+        while ((segment2 = stPinchBlockIt_getNext(&it)) != NULL) {
+            stList_append(segments, segment2);
+        }
+    } else {
+        stList_append(segments, segment);
+    }
+    stSet *set = stSet_construct();
+    for (int64_t i = 0; i < stList_length(segments); i++) {
+        Cap *cap = flower_getCap(flower, stPinchSegment_getName(stList_get(segments, i)));
+        if (type == 0 || (type == 1 && !event_isOutgroup(cap_getEvent(cap)))) {
+            stSet_insert(set, cap_getEvent(cap));
+        } else if (type == 2) {
+            stSet_insert(set, cap_getSequence(cap));
+        }
+    }
+    stList_destruct(segments);
+    return set;
+}
+
+static bool naiveIntersection(stPinchSegment *segment1, stPinchSegment *segment2, int64_t type) {
+    stSet *set1 = getNaiveSet(segment1, type), *set2 = getNaiveSet(segment2, type);
+    stSet *intersection = stSet_getIntersection(set1, set2);
+    bool b = stSet_size(intersection) > 0;
+    stSet_destruct(set1);
+    stSet_destruct(set2);
+    stSet_destruct(intersection);
+    return b;
+}
+
+static bool naiveRepeatSpecies(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return naiveIntersection(segment1, segment2, 0);
+}
+
+static bool naiveRelaxedRepeatSpecies(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return stPinchSegment_getBlock(segment1) != NULL && stPinchSegment_getBlock(segment2) != NULL
+            && naiveIntersection(segment1, segment2, 0);
+}
+
+static bool naiveSingleCopyIngroup(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return naiveIntersection(segment1, segment2, 1);
+}
+
+static bool naiveRelaxedSingleCopyIngroup(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return stPinchSegment_getBlock(segment1) != NULL && stPinchSegment_getBlock(segment2) != NULL
+            && naiveIntersection(segment1, segment2, 1);
+}
+
+static bool naiveSingleCopyChr(stPinchSegment *segment1, stPinchSegment *segment2) {
+    return naiveIntersection(segment1, segment2, 2);
+}
+
+static bool naiveMoreThanOneEvent(stPinchSegment *segment) {
+    if (stPinchSegment_getBlock(segment) == NULL) {
+        return false;
+    }
+    stSet *events = getNaiveSet(segment, 0);
+    bool b = stSet_size(events) > 1;
+    stSet_destruct(events);
+    return b;
+}
+
+static bool naiveMultipleSpecies(stPinchSegment *segment1, stPinchSegment *segment2) {
+    stPinchBlock *block1 = stPinchSegment_getBlock(segment1), *block2 = stPinchSegment_getBlock(segment2);
+    if (block1 == NULL || block2 == NULL) {
+        return false;
+    }
+    if (block1 == block2) {
+        return stPinchBlock_getLength(block1) == 1 ? 0 : naiveMoreThanOneEvent(segment1);
+    }
+    return naiveMoreThanOneEvent(segment1) && naiveMoreThanOneEvent(segment2);
+}
+
+static bool (*filterFnToTest)(stPinchSegment *, stPinchSegment *);
+static bool (*naiveFilterFn)(stPinchSegment *, stPinchSegment *);
+static int64_t filterCalls, filterDisagreements;
+
+static bool checkFilterFn(stPinchSegment *segment1, stPinchSegment *segment2) {
+    bool expected = naiveFilterFn(segment1, segment2);
+    bool filter = filterFnToTest(segment1, segment2);
+    filterCalls++;
+    if (filter != expected) {
+        filterDisagreements++;
+    }
+    return filter;
+}
+
+static void testAlignmentFiltersAgreeWithNaiveFilters(CuTest *testCase) {
+    bool (*filterFns[])(stPinchSegment *, stPinchSegment *) = { stCaf_filterByRepeatSpecies,
+            stCaf_relaxedFilterByRepeatSpecies, stCaf_filterByMultipleSpecies, stCaf_singleCopyChr,
+            stCaf_singleCopyIngroup, stCaf_relaxedSingleCopyIngroup };
+    bool (*naiveFilterFns[])(stPinchSegment *, stPinchSegment *) = { naiveRepeatSpecies,
+            naiveRelaxedRepeatSpecies, naiveMultipleSpecies, naiveSingleCopyChr, naiveSingleCopyIngroup,
+            naiveRelaxedSingleCopyIngroup };
+    for (int64_t testNum = 0; testNum < 60; testNum++) {
+        setup(true);
+        Event *events[] = { ingroup1, ingroup2, outgroup1, outgroup2 };
+        for (int64_t i = 0; i < 8; i++) {
+            addThreadToFlower(flower, events[st_randomInt(0, 4)], st_randomInt(10, 200));
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stCaf_setFlowerForAlignmentFiltering(flower);
+        stCaf_resetAlignmentFilteringIndex();
+        filterFnToTest = filterFns[testNum % 6];
+        naiveFilterFn = naiveFilterFns[testNum % 6];
+        filterCalls = 0;
+        filterDisagreements = 0;
+        for (int64_t i = 0; i < 500; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_filterPinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                      stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                      pinch.start1, pinch.start2, pinch.length, pinch.strand, checkFilterFn);
+        }
+        st_logInfo("Alignment filter %" PRIi64 " made %" PRIi64 " calls\n", testNum % 6, filterCalls);
+        CuAssertIntEquals(testCase, 0, filterDisagreements);
+        stPinchThreadSet_destruct(threadSet);
+        teardown();
+    }
+}
+
 CuSuite* filteringTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopies);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup_noOutgroups);
     SUITE_ADD_TEST(suite, testHGVMFiltering);
+    SUITE_ADD_TEST(suite, testAlignmentFiltersAgreeWithNaiveFilters);
     return suite;
 }
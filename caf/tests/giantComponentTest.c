@@ -181,9 +181,56 @@ static void testBreakUpPinchGraphAdjacencyComponentsGreedily(CuTest *testCase) {
     }
 }
 
+static void checkThreadSetsAreIdentical(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getSize(threadSet1), stPinchThreadSet_getSize(threadSet2));
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet1);
+    stPinchThread *thread1;
+    while ((thread1 = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, stPinchThread_getName(thread1));
+        CuAssertTrue(testCase, thread2 != NULL);
+        stPinchSegment *segment1 = stPinchThread_getFirst(thread1);
+        stPinchSegment *segment2 = stPinchThread_getFirst(thread2);
+        while (segment1 != NULL) {
+            CuAssertTrue(testCase, segment2 != NULL);
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+            stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertTrue(testCase, (block1 == NULL) == (block2 == NULL));
+            if (block1 != NULL) {
+                CuAssertIntEquals(testCase, stPinchBlock_getDegree(block1), stPinchBlock_getDegree(block2));
+            }
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment2 == NULL);
+    }
+}
+
+static void testBreakUpPinchGraphAdjacencyComponentsGreedily_multithreaded(CuTest *testCase) {
+    for (int64_t test = 0; test < 1000; test++) {
+        st_logInfo("Starting multithreaded break up giant pinch graph components random test %" PRIi64 "\n", test);
+        //Build two copies of the same random graph
+        int64_t seed = st_randomInt(0, INT32_MAX);
+        st_randomSeed(seed);
+        stPinchThreadSet *threadSet1 = stPinchThreadSet_getRandomGraph();
+        st_randomSeed(seed);
+        stPinchThreadSet *threadSet2 = stPinchThreadSet_getRandomGraph();
+        float maximumAdjacencyComponentSizeRatio = st_random() * 10;
+        //The edges broken must not depend on the number of threads
+        stCaf_breakupComponentsGreedily(threadSet1, maximumAdjacencyComponentSizeRatio);
+        stCaf_breakupComponentsGreedily2(threadSet2, maximumAdjacencyComponentSizeRatio, st_randomInt(2, 8));
+        checkThreadSetsAreIdentical(testCase, threadSet1, threadSet2);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+    }
+}
+
 CuSuite* giantComponentTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testBreakUpComponentGreedily);
     SUITE_ADD_TEST(suite, testBreakUpPinchGraphAdjacencyComponentsGreedily);
+    SUITE_ADD_TEST(suite, testBreakUpPinchGraphAdjacencyComponentsGreedily_multithreaded);
     return suite;
 }
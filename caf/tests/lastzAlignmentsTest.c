@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2009-2018 by Benedict Paten (benedictpaten@gmail.com)
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stLastzAlignments.h"
+
+typedef struct _cigarLine {
+    char *line;
+    double score;
+    int64_t index;
+} CigarLine;
+
+static int cigarLine_cmp(const CigarLine *line1, const CigarLine *line2) {
+    if (line1->score != line2->score) {
+        return line1->score > line2->score ? -1 : 1;
+    }
+    return line1->index < line2->index ? -1 : (line1->index > line2->index ? 1 : 0);
+}
+
+static char *readFile(const char *file) {
+    FILE *fileHandle = fopen(file, "r");
+    fseek(fileHandle, 0, SEEK_END);
+    int64_t length = ftell(fileHandle);
+    fseek(fileHandle, 0, SEEK_SET);
+    char *contents = st_malloc(length + 1);
+    int64_t i = fread(contents, sizeof(char), length, fileHandle);
+    contents[i] = '\0';
+    fclose(fileHandle);
+    return contents;
+}
+
+static void testSortCigarsFileByScoreInDescendingOrder(CuTest *testCase) {
+    const char *scores[] = { "5", "5.0", "5.5", "10", "-3", "1e2", "0" };
+    for (int64_t test = 0; test < 100; test++) {
+        //Make random cigar lines, with lots of ties between the scores
+        int64_t lineNumber = st_randomInt(0, 1000);
+        CigarLine *lines = st_malloc(sizeof(CigarLine) * (lineNumber > 0 ? lineNumber : 1));
+        char *tempFile = "tempFileForSortCigarsTest.cig";
+        FILE *fileHandle = fopen(tempFile, "w");
+        for (int64_t i = 0; i < lineNumber; i++) {
+            const char *score = scores[st_randomInt(0, 7)];
+            lines[i].line = stString_print("cigar: seq%" PRIi64 "  0 10 + seq%" PRIi64 " 0\t10 + %s M 10", st_randomInt(0, 10), i, score);
+            lines[i].score = atof(score);
+            lines[i].index = i;
+            //The last line may be missing its newline
+            fprintf(fileHandle, "%s%s", lines[i].line, i + 1 < lineNumber || st_random() > 0.5 ? "\n" : "");
+        }
+        fclose(fileHandle);
+        qsort(lines, lineNumber, sizeof(CigarLine), (int (*)(const void *, const void *)) cigarLine_cmp);
+        stList *expectedLines = stList_construct();
+        for (int64_t i = 0; i < lineNumber; i++) {
+            stList_append(expectedLines, lines[i].line);
+        }
+        stList_append(expectedLines, "");
+        char *expected = stString_join2("\n", expectedLines);
+        st_logInfo("Doing a random cigar sort test %" PRIi64 " with %" PRIi64 " lines\n", test, lineNumber);
+
+        //Sort them in memory, and spilling runs of a few lines, on one and several threads
+        int64_t maxBytesInMemory[] = { STCAF_SORT_CIGARS_MAX_BYTES_IN_MEMORY, 10000, 1000 };
+        for (int64_t i = 0; i < 3; i++) {
+            for (int64_t numThreads = 1; numThreads <= 4; numThreads += 3) {
+                char *sortedFile = "tempFileForSortCigarsTest.sorted.cig";
+                stCaf_sortCigarsFileByScoreInDescendingOrder2(tempFile, sortedFile, maxBytesInMemory[i], numThreads);
+                char *sorted = readFile(sortedFile);
+                CuAssertStrEquals(testCase, expected, sorted);
+                free(sorted);
+                stFile_rmrf(sortedFile);
+            }
+        }
+
+        //Cleanup
+        stFile_rmrf(tempFile);
+        free(expected);
+        stList_destruct(expectedLines);
+        for (int64_t i = 0; i < lineNumber; i++) {
+            free(lines[i].line);
+        }
+        free(lines);
+    }
+}
+
+CuSuite* lastzAlignmentsTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testSortCigarsFileByScoreInDescendingOrder);
+    return suite;
+}
@@ -0,0 +1,136 @@
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+static void randomPinches(stList *threadNames, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2,
+        int64_t threadLength, int64_t numberOfPinches) {
+    /*
+     * Applies the same random pinches to both thread sets.
+     */
+    for (int64_t i = 0; i < numberOfPinches; i++) {
+        int64_t j = st_randomInt(0, stList_length(threadNames));
+        int64_t k = st_randomInt(0, stList_length(threadNames));
+        if (j == k) {
+            continue;
+        }
+        Name name1 = *(Name *) stList_get(threadNames, j);
+        Name name2 = *(Name *) stList_get(threadNames, k);
+        int64_t length = st_randomInt(1, 20);
+        int64_t start1 = st_randomInt(2, threadLength + 2 - length);
+        int64_t start2 = st_randomInt(2, threadLength + 2 - length);
+        bool strand = st_random() > 0.5;
+        stPinchThread_pinch(stPinchThreadSet_getThread(threadSet1, name1), stPinchThreadSet_getThread(threadSet1, name2),
+                start1, start2, length, strand);
+        stPinchThread_pinch(stPinchThreadSet_getThread(threadSet2, name1), stPinchThreadSet_getThread(threadSet2, name2),
+                start1, start2, length, strand);
+    }
+}
+
+static void checkThreadSetsAreEqual(CuTest *testCase, stList *threadNames, stPinchThreadSet *threadSet1,
+        stPinchThreadSet *threadSet2) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1), stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    for (int64_t i = 0; i < stList_length(threadNames); i++) {
+        Name name = *(Name *) stList_get(threadNames, i);
+        stPinchSegment *segment1 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet1, name));
+        stPinchSegment *segment2 = stPinchThread_getFirst(stPinchThreadSet_getThread(threadSet2, name));
+        while (segment1 != NULL && segment2 != NULL) {
+            CuAssertIntEquals(testCase, stPinchSegment_getStart(segment1), stPinchSegment_getStart(segment2));
+            CuAssertIntEquals(testCase, stPinchSegment_getLength(segment1), stPinchSegment_getLength(segment2));
+            stPinchBlock *block1 = stPinchSegment_getBlock(segment1);
+            stPinchBlock *block2 = stPinchSegment_getBlock(segment2);
+            CuAssertIntEquals(testCase, block1 == NULL ? 0 : stPinchBlock_getDegree(block1),
+                    block2 == NULL ? 0 : stPinchBlock_getDegree(block2));
+            segment1 = stPinchSegment_get3Prime(segment1);
+            segment2 = stPinchSegment_get3Prime(segment2);
+        }
+        CuAssertTrue(testCase, segment1 == NULL && segment2 == NULL);
+    }
+}
+
+// Check that doing a series of melting rounds with one cactus graph
+// gives the same pinch graph as melting each round with a newly built
+// cactus graph.
+static void testMeltInRounds(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting melting in rounds random test %" PRIi64 "\n", test);
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadLength = st_randomInt(50, 200);
+        stList *threadNames = stList_construct3(0, free);
+        int64_t numberOfThreads = st_randomInt(2, 10);
+        for (int64_t i = 0; i < numberOfThreads; i++) {
+            char *header = stString_print("thread%" PRIi64, i);
+            Name *name = st_malloc(sizeof(Name));
+            *name = testCommon_addThreadToFlower(flower, header, threadLength);
+            stList_append(threadNames, name);
+            free(header);
+        }
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        stPinchThreadSet *threadSet2 = stCaf_constructEmptyPinchGraph(flower);
+        randomPinches(threadNames, threadSet1, threadSet2, threadLength, st_randomInt(0, 100));
+
+        int64_t minimumChainLengths[] = { 2, 4, 8, 16, 32 };
+        for (int64_t i = 0; i < 5; i++) {
+            stCaf_melt(flower, threadSet1, NULL, 0, minimumChainLengths[i], 0, INT64_MAX);
+        }
+        stCaf_meltInRounds(flower, threadSet2, minimumChainLengths, 5);
+        checkThreadSetsAreEqual(testCase, threadNames, threadSet1, threadSet2);
+
+        stList_destruct(threadNames);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+// Check that melting recoverable chains over several iterations of
+// one cactus graph gives the same pinch graph as rebuilding the cactus
+// graph for every iteration. The flower is the top level flower, so
+// the graph must be rebuilt when an iteration splits a thread
+// component.
+static void testMeltRecoverableChains(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        st_logInfo("Starting melting recoverable chains random test %" PRIi64 "\n", test);
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+
+        int64_t threadLength = st_randomInt(50, 200);
+        stList *threadNames = stList_construct3(0, free);
+        int64_t numberOfThreads = st_randomInt(2, 10);
+        for (int64_t i = 0; i < numberOfThreads; i++) {
+            char *header = stString_print("thread%" PRIi64, i);
+            Name *name = st_malloc(sizeof(Name));
+            *name = testCommon_addThreadToFlower(flower, header, threadLength);
+            stList_append(threadNames, name);
+            free(header);
+        }
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower);
+        stPinchThreadSet *threadSet2 = stCaf_constructEmptyPinchGraph(flower);
+        randomPinches(threadNames, threadSet1, threadSet2, threadLength, st_randomInt(0, 100));
+
+        int64_t iterations = st_randomInt(1, 6);
+        for (int64_t i = 0; i < iterations; i++) {
+            stCaf_meltRecoverableChains(flower, threadSet1, 0, INT64_MAX, NULL, 1, INT64_MAX);
+        }
+        stCaf_meltRecoverableChains(flower, threadSet2, 0, INT64_MAX, NULL, iterations, INT64_MAX);
+        checkThreadSetsAreEqual(testCase, threadNames, threadSet1, threadSet2);
+
+        stList_destruct(threadNames);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
+CuSuite *meltingTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testMeltInRounds);
+    SUITE_ADD_TEST(suite, testMeltRecoverableChains);
+    return suite;
+}
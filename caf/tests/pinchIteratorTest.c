@@ -106,6 +106,27 @@ static void testPinchIteratorFromFile(CuTest *testCase) {
     }
 }
 
+static void testPinchIteratorFromBinaryFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch iterator from binary file test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Write the pinches of the alignments to a binary file, with a trim set that should be ignored
+        stPinchIterator *listPinchIterator = stPinchIterator_constructFromList(pairwiseAlignments);
+        stPinchIterator_setTrim(listPinchIterator, 3);
+        char *tempFile = "tempFileForPinchIteratorTest.bin";
+        stPinchIterator_writeBinaryFile(listPinchIterator, tempFile);
+        stPinchIterator_destruct(listPinchIterator);
+        //Get an iterator
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromBinaryFile(tempFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmrf(tempFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 static void testPinchIteratorFromList(CuTest *testCase) {
     for (int64_t test = 0; test < 100; test++) {
         stList *pairwiseAlignments = getRandomPairwiseAlignments();
@@ -124,5 +145,6 @@ CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
     SUITE_ADD_TEST(suite, testPinchIteratorFromList);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromBinaryFile);
     return suite;
 }
@@ -118,10 +118,73 @@ static void testRecoverableTelomereAdjacentChainsNotKept(CuTest *testCase) {
     testCommon_deleteTemporaryCactusDisk(cactusDisk);
 }
 
+// Four threads aligned by two outer blocks, with a block between them
+// involving threads 1-3 that is flanked by indels shared by threads 1
+// and 2:
+//
+// thread 4 =-------=
+// thread 3 =---=---=
+// thread 2 =-=-=-=-=
+// thread 1 =-=-=-=-=
+//
+// The flanking indels are recoverable, but the middle block is only
+// recoverable once they have been removed, so it takes a second
+// iteration to remove it.
+static void testRemovesNestedIndelsOverIterations(CuTest *testCase) {
+    for (int64_t iterations = 1; iterations <= 3; iterations++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct2(0, cactusDisk);
+        group_construct2(flower);
+        flower_check(flower);
+
+        Name thread1Name = testCommon_addThreadToFlower(flower, "one", 100);
+        Name thread2Name = testCommon_addThreadToFlower(flower, "two", 100);
+        Name thread3Name = testCommon_addThreadToFlower(flower, "three", 100);
+        Name thread4Name = testCommon_addThreadToFlower(flower, "four", 100);
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, thread1Name);
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, thread2Name);
+        stPinchThread *thread3 = stPinchThreadSet_getThread(threadSet, thread3Name);
+        stPinchThread *thread4 = stPinchThreadSet_getThread(threadSet, thread4Name);
+        stPinchThread_pinch(thread1, thread2, 10, 10, 10, true);
+        stPinchThread_pinch(thread1, thread3, 10, 10, 10, true);
+        stPinchThread_pinch(thread1, thread4, 10, 10, 10, true);
+        stPinchThread_pinch(thread1, thread2, 30, 30, 10, true);
+        stPinchThread_pinch(thread1, thread2, 50, 50, 10, true);
+        stPinchThread_pinch(thread1, thread3, 50, 50, 10, true);
+        stPinchThread_pinch(thread1, thread2, 70, 70, 10, true);
+        stPinchThread_pinch(thread1, thread2, 85, 85, 10, true);
+        stPinchThread_pinch(thread1, thread3, 85, 85, 10, true);
+        stPinchThread_pinch(thread1, thread4, 85, 85, 10, true);
+        // There should now be 13 blocks -- one for each cap, and the blocks we just added
+        CuAssertIntEquals(testCase, 13, stPinchThreadSet_getTotalBlockNumber(threadSet));
+        stCaf_meltRecoverableChains(flower, threadSet, true, 1000, NULL, iterations, INT64_MAX);
+        // The flanking indels are removed in the first iteration
+        CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 35)) == NULL);
+        CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 75)) == NULL);
+        if (iterations == 1) {
+            CuAssertIntEquals(testCase, 11, stPinchThreadSet_getTotalBlockNumber(threadSet));
+            CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 55)) != NULL);
+        } else {
+            // The middle block is removed in the second
+            CuAssertIntEquals(testCase, 10, stPinchThreadSet_getTotalBlockNumber(threadSet));
+            CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 55)) == NULL);
+        }
+        // The outer blocks are kept
+        CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 15)) != NULL);
+        CuAssertTrue(testCase, stPinchSegment_getBlock(stPinchThread_getSegment(thread1, 90)) != NULL);
+
+        stPinchThreadSet_destruct(threadSet);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
 CuSuite *recoverableChainsTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testDoesNotRemoveIsolatedChain);
     SUITE_ADD_TEST(suite, testRemovesIndel);
     SUITE_ADD_TEST(suite, testRecoverableTelomereAdjacentChainsNotKept);
+    SUITE_ADD_TEST(suite, testRemovesNestedIndelsOverIterations);
     return suite;
 }
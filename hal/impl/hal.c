@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "cactus.h"
 #include "sonLib.h"
@@ -87,7 +88,36 @@ static void writeSequenceHeader(FILE *fileHandle, Sequence *sequence) {
             event_getName(event) == globalReferenceEventName);
 }
 
-static char *writeTerminalAdjacency(Cap *cap) {
+/*
+ * The segment lines of a thread are built as fixed size binary records, which are only formatted
+ * as text when the thread is written to the output file.
+ */
+typedef enum {
+    HAL_BOTTOM_SEGMENT = 0, //a segmentName start length
+    HAL_TOP_SEGMENT = 1, //a start length parentSegment alignmentOrientation
+    HAL_INSERTION = 2 //a start length
+} HalRecordType;
+
+typedef struct _halRecord {
+    int64_t type;
+    int64_t start;
+    int64_t length;
+    int64_t segmentName; //The segment name of a bottom segment, else the parent segment of a top segment.
+    int64_t orientation;
+} HalRecord;
+
+static void writeHalRecord(ThreadBuffer *buffer, HalRecordType type, int64_t start, int64_t length,
+        int64_t segmentName, int64_t orientation) {
+    HalRecord record;
+    record.type = type;
+    record.start = start;
+    record.length = length;
+    record.segmentName = segmentName;
+    record.orientation = orientation;
+    threadBuffer_append(buffer, &record, sizeof(HalRecord));
+}
+
+static void writeTerminalAdjacency(Cap *cap, ThreadBuffer *buffer) {
     //a start length reference-segment block-orientation
     Cap *adjacentCap = cap_getAdjacency(cap);
     assert(adjacentCap != NULL);
@@ -98,26 +128,53 @@ static char *writeTerminalAdjacency(Cap *cap) {
         assert(sequence != NULL);
         assert(cap_getEvent(cap) != NULL);
         if (event_getName(cap_getEvent(cap)) == globalReferenceEventName) {
-            return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", cap_getName(cap), cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
+            writeHalRecord(buffer, HAL_BOTTOM_SEGMENT, cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength,
+                    cap_getName(cap), 0);
+        } else {
+            writeHalRecord(buffer, HAL_INSERTION, cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength, 0, 0);
         }
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\n", cap_getCoordinate(cap) + 1 - sequence_getStart(sequence), adjacencyLength);
-    }
-    else {
-        return stString_copy("");
     }
 }
 
-static char *writeSegment(Segment *segment) {
+static void writeSegment(Segment *segment, ThreadBuffer *buffer) {
     Block *block = segment_getBlock(segment);
     Segment *referenceSegment = block_getSegmentForEvent(block, globalReferenceEventName);
     assert(referenceSegment != NULL);
     Sequence *sequence = segment_getSequence(segment);
     assert(sequence != NULL);
     if (referenceSegment != segment) { //Is a top segment
-        return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment), segment_getName(referenceSegment), segment_getStrand(referenceSegment));
+        writeHalRecord(buffer, HAL_TOP_SEGMENT, segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment),
+                segment_getName(referenceSegment), segment_getStrand(referenceSegment));
+    } else { //Is a bottom segment
+        writeHalRecord(buffer, HAL_BOTTOM_SEGMENT, segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment),
+                segment_getName(segment), 0);
+    }
+}
+
+static void writeThread(FILE *fileHandle, ThreadBuffer *thread) {
+    /*
+     * Formats the binary records of a thread as segment lines.
+     */
+    const char *records = threadBuffer_getData(thread);
+    assert(threadBuffer_getLength(thread) % sizeof(HalRecord) == 0);
+    for (int64_t i = 0; i < threadBuffer_getLength(thread); i += sizeof(HalRecord)) {
+        HalRecord record;
+        memcpy(&record, records + i, sizeof(HalRecord));
+        switch (record.type) {
+            case HAL_BOTTOM_SEGMENT:
+                fprintf(fileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", record.segmentName, record.start, record.length);
+                break;
+            case HAL_TOP_SEGMENT:
+                fprintf(fileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", record.start, record.length,
+                        record.segmentName, record.orientation);
+                break;
+            case HAL_INSERTION:
+                fprintf(fileHandle, "a\t%" PRIi64 "\t%" PRIi64 "\n", record.start, record.length);
+                break;
+            default:
+                st_errAbort("Unknown hal record type: %" PRIi64, record.type);
+        }
     }
-    //Is a bottom segment
-    return stString_print("a\t%" PRIi64 "\t%" PRIi64 "\t%" PRIi64 "\n", segment_getName(segment), segment_getStart(segment) - sequence_getStart(sequence), segment_getLength(segment));
 }
 
 static int compareCaps(Cap *cap, Cap *cap2) {
@@ -167,16 +224,17 @@ void makeHalFormat(Flower *flower, stKVDatabase *database, Name referenceEventNa
     if (fileHandle == NULL) {
         buildRecursiveThreads(database, caps, writeSegment, writeTerminalAdjacency);
     } else {
-        stList *threadStrings = buildRecursiveThreadsInList(database, caps, writeSegment, writeTerminalAdjacency);
-        assert(stList_length(threadStrings) == stList_length(caps));
-        for (int64_t i = 0; i < stList_length(threadStrings); i++) {
+        stList *threads = buildRecursiveThreadsInList(database, caps, writeSegment, writeTerminalAdjacency);
+        assert(stList_length(threads) == stList_length(caps));
+        for (int64_t i = 0; i < stList_length(threads); i++) {
             Cap *cap = stList_get(caps, i);
             if(!metaSequence_isTrivialSequence(sequence_getMetaSequence(cap_getSequence(cap)))) {
-                char *threadString = stList_get(threadStrings, i);
                 writeSequenceHeader(fileHandle, cap_getSequence(cap));
-                fprintf(fileHandle, "%s\n", threadString);
+                writeThread(fileHandle, stList_get(threads, i));
+                fprintf(fileHandle, "\n");
             }
         }
+        stList_destruct(threads);
     }
     stList_destruct(caps);
 }
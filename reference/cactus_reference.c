@@ -48,6 +48,13 @@ void usage() {
     fprintf(
     stderr, "-q --makeScaffolds : Scaffold across regions of adjacency uncertainty.\n");
 
+    fprintf(
+    stderr, "-T --numThreads : (int >= 1) The number of threads used to calculate the z-scores of a flower and to serialise the flowers written to the database. Default=1\n");
+
+    fprintf(stderr, "-U --recordCacheSize : (int >= 0) Bytes of database records to cache. Default=%i\n", CACTUS_DISK_RECORD_CACHE_SIZE);
+
+    fprintf(stderr, "-V --stringCacheSize : (int >= 0) Bytes of sequence to cache. Default=%i\n", CACTUS_DISK_STRING_CACHE_SIZE);
+
     fprintf(stderr, "-h --help : Print this help screen\n");
 }
 
@@ -75,6 +82,9 @@ int main(int argc, char *argv[]) {
     int64_t numberOfNsForScaffoldGap = 10;
     int64_t minNumberOfSequencesToSupportAdjacency = 1;
     bool makeScaffolds = 0;
+    int64_t numThreads = 1;
+    int64_t recordCacheSize = CACTUS_DISK_RECORD_CACHE_SIZE;
+    int64_t stringCacheSize = CACTUS_DISK_STRING_CACHE_SIZE;
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Parse the inputs handed by genomeCactus.py / setup stuff.
@@ -89,11 +99,12 @@ int main(int argc, char *argv[]) {
         required_argument, 0, 's' }, { "maxWalkForCalculatingZ", required_argument, 0, 'l' }, { "ignoreUnalignedGaps",
         no_argument, 0, 'm' }, { "wiggle", required_argument, 0, 'n' }, { "numberOfNs", required_argument, 0, 'o' }, {
                 "minNumberOfSequencesToSupportAdjacency", required_argument, 0, 'p' }, { "makeScaffolds", no_argument,
-                0, 'q' }, { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
+                0, 'q' }, { "numThreads", required_argument, 0, 'T' }, { "recordCacheSize", required_argument, 0, 'U' }, {
+                "stringCacheSize", required_argument, 0, 'V' }, { "help", no_argument, 0, 'h' }, { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int key = getopt_long(argc, argv, "a:c:d:e:g:i:jk:hl:mn:o:p:qs:", long_options, &option_index);
+        int key = getopt_long(argc, argv, "a:c:d:e:g:i:jk:hl:mn:o:p:qs:T:U:V:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -188,6 +199,24 @@ int main(int argc, char *argv[]) {
         case 'q':
             makeScaffolds = 1;
             break;
+        case 'T':
+            j = sscanf(optarg, "%" PRIi64 "", &numThreads);
+            if (j != 1 || numThreads < 1) {
+                stThrowNew(REFERENCE_BUILDING_EXCEPTION, "The number of threads is not valid: %s", optarg);
+            }
+            break;
+        case 'U':
+            j = sscanf(optarg, "%" PRIi64 "", &recordCacheSize);
+            if (j != 1 || recordCacheSize < 0) {
+                stThrowNew(REFERENCE_BUILDING_EXCEPTION, "The record cache size is not valid: %s", optarg);
+            }
+            break;
+        case 'V':
+            j = sscanf(optarg, "%" PRIi64 "", &stringCacheSize);
+            if (j != 1 || stringCacheSize < 0) {
+                stThrowNew(REFERENCE_BUILDING_EXCEPTION, "The string cache size is not valid: %s", optarg);
+            }
+            break;
         default:
             usage();
             return 1;
@@ -211,6 +240,7 @@ int main(int argc, char *argv[]) {
     st_logInfo("Min number of sequences to required to support an adjacency is: %" PRIi64 "\n",
             minNumberOfSequencesToSupportAdjacency);
     st_logInfo("Make scaffolds is: %i\n", makeScaffolds);
+    st_logInfo("The number of threads is: %" PRIi64 "\n", numThreads);
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Check the inputs.
@@ -224,6 +254,8 @@ int main(int argc, char *argv[]) {
 
     stKVDatabaseConf *kvDatabaseConf = stKVDatabaseConf_constructFromString(cactusDiskDatabaseString);
     CactusDisk *cactusDisk = cactusDisk_construct(kvDatabaseConf, false, true);
+    cactusDisk_setWriteThreads(cactusDisk, numThreads);
+    cactusDisk_setCacheSizes(cactusDisk, recordCacheSize, stringCacheSize);
     st_logInfo("Set up the flower disk\n");
 
     ///////////////////////////////////////////////////////////////////////////
@@ -249,7 +281,7 @@ int main(int argc, char *argv[]) {
         if (!flower_hasParentGroup(flower)) {
             buildReferenceTopDown(flower, referenceEventString, permutations, matchingAlgorithm, temperatureFn, theta,
                     phi, maxWalkForCalculatingZ, ignoreUnalignedGaps, wiggle, numberOfNsForScaffoldGap,
-                    minNumberOfSequencesToSupportAdjacency, makeScaffolds);
+                    minNumberOfSequencesToSupportAdjacency, makeScaffolds, numThreads);
             cactusDisk_addUpdateRequest(cactusDisk, flower);
         }
         Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
@@ -259,7 +291,8 @@ int main(int argc, char *argv[]) {
             if (subFlower != NULL) {
                 buildReferenceTopDown(subFlower, referenceEventString, permutations,
                         matchingAlgorithm, temperatureFn, theta, phi, maxWalkForCalculatingZ, ignoreUnalignedGaps,
-                        wiggle, numberOfNsForScaffoldGap, minNumberOfSequencesToSupportAdjacency, makeScaffolds);
+                        wiggle, numberOfNsForScaffoldGap, minNumberOfSequencesToSupportAdjacency, makeScaffolds,
+                        numThreads);
                 cactusDisk_addUpdateRequest(cactusDisk, subFlower);
                 flower_unload(subFlower);
             }
@@ -5,6 +5,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 #include "cactus.h"
 #include "sonLib.h"
 #include "recursiveThreadBuilder.h"
@@ -173,45 +174,84 @@ static void recoverBrokenAdjacencies(Flower *flower, stList *recoveredCaps, Name
     flower_destructGroupIterator(groupIt);
 }
 
-static char *terminalAdjacencyWriteFn(Cap *cap) {
-    return stString_copy("");
+static void terminalAdjacencyWriteFn(Cap *cap, ThreadBuffer *buffer) {
 }
 
 static stHash *segmentWriteFn_flowerToPhylogeneticTreeHash;
 
-static char *segmentWriteFn(Segment *segment) {
+static void releaseSegmentViews(Block *block) {
+    /*
+     * Releases the views of the segments of the block, so that the sequences do not keep the bases
+     * they have merged into larger runs of cached bases.
+     */
+    Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
+    Segment *segment;
+    while ((segment = block_getNext(segmentIt)) != NULL) {
+        if (segment_getSequence(segment) != NULL) {
+            sequence_releaseViews(segment_getSequence(segment));
+        }
+    }
+    block_destructInstanceIterator(segmentIt);
+}
+
+static void clearSequenceViewCaches(stList *flowers) {
+    /*
+     * Frees the bases cached by the sequences of the flowers for the views of their segments.
+     */
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(stList_get(flowers, i));
+        Sequence *sequence;
+        while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+            sequence_clearViewCache(sequence);
+        }
+        flower_destructSequenceIterator(sequenceIt);
+    }
+}
+
+/*
+ * Each segment of a thread is written as a record of its length, a byte that is 1 if it is
+ * part of a block containing more than the reference segment (else 0), and then its bases.
+ * We use these boolean values to determine if a sequence contains only trivial segments, and is therefore trivial.
+ */
+static void segmentWriteFn(Segment *segment, ThreadBuffer *buffer) {
     stTree *phylogeneticTree = stHash_search(segmentWriteFn_flowerToPhylogeneticTreeHash, block_getFlower(segment_getBlock(segment)));
     assert(phylogeneticTree != NULL);
     char *segmentString = getMaximumLikelihoodString(phylogeneticTree, segment_getBlock(segment));
-    //We append a zero to a segment string if it is part of block containing only a reference segment, else we append a 1.
-    //We use these boolean values to determine if a sequence contains only these trivial strings, and is therefore trivial.
-    char *appendedSegmentString = stString_print("%s%c ", segmentString, block_getInstanceNumber(segment_getBlock(segment)) == 1 ? '0' : '1');
+    releaseSegmentViews(segment_getBlock(segment));
+    int64_t length = strlen(segmentString);
+    char nonTrivial = block_getInstanceNumber(segment_getBlock(segment)) == 1 ? 0 : 1;
+    threadBuffer_append(buffer, &length, sizeof(int64_t));
+    threadBuffer_append(buffer, &nonTrivial, 1);
+    threadBuffer_append(buffer, segmentString, length);
     free(segmentString);
-    return appendedSegmentString;
 }
 
-/*
- * A thread is trivial if all the segments it contains come from blocks containing only a reference segment.
- * These reference only segments represent scaffold gaps. At the same time, it processes the thread string
- * to remove the boolean values use to indicate if a thread is trivial or not.
- */
-static bool isTrivialString(char **threadString) {
-    stList *strings = stString_split(*threadString); //Split splits into individual segments.
-    bool trivialString = 1;
-    for(int64_t i=0; i<stList_length(strings); i++) {
-        char *segmentString = stList_get(strings, i);
-        int64_t j = strlen(segmentString)-1; //Location of the boolean value within a segment.
-        assert(j > 0);
-        assert(segmentString[j] == '0' || segmentString[j] == '1');
-        if(segmentString[j] == '1') { //Found a non-trivial segment, hence the thread is non-trivial.
-            trivialString = 0;
+static char *getThreadString(ThreadBuffer *thread, bool *trivialString) {
+    /*
+     * Concatenates the bases of the segment records of a thread into a string.
+     *
+     * A thread is trivial if all the segments it contains come from blocks containing only a reference segment.
+     * These reference only segments represent scaffold gaps.
+     */
+    const char *records = threadBuffer_getData(thread);
+    int64_t recordsLength = threadBuffer_getLength(thread);
+    char *threadString = st_malloc(recordsLength + 1); //The records are longer than the bases they contain.
+    int64_t threadLength = 0;
+    *trivialString = 1;
+    for (int64_t i = 0; i < recordsLength;) {
+        int64_t length;
+        memcpy(&length, records + i, sizeof(int64_t));
+        if (records[i + sizeof(int64_t)]) { //Found a non-trivial segment, hence the thread is non-trivial.
+            *trivialString = 0;
         }
-        segmentString[j] = '\0';
+        i += sizeof(int64_t) + 1;
+        assert(length >= 0 && i + length <= recordsLength);
+        memcpy(threadString + threadLength, records + i, length);
+        threadLength += length;
+        i += length;
     }
-    free(*threadString); //Free old thread string. Doing it this way is a bit more memory efficient, as we don't keep two copies of the string around.
-    *threadString = stString_join2("", strings); //Concatenation makes one sequence, now without the booleans.
-    stList_destruct(strings);
-    return trivialString;
+    threadString[threadLength] = '\0';
+    return threadString;
 }
 
 static MetaSequence *addMetaSequence(Flower *flower, Cap *cap, int64_t index, char *string, bool trivialString) {
@@ -310,18 +350,21 @@ void bottomUp(stList *flowers, stKVDatabase *sequenceDatabase, Name referenceEve
     }
 
     if (isTop) {
-        stList *threadStrings = buildRecursiveThreadsInList(sequenceDatabase, caps, segmentWriteFn,
+        stList *threads = buildRecursiveThreadsInList(sequenceDatabase, caps, segmentWriteFn,
                 terminalAdjacencyWriteFn);
-        assert(stList_length(threadStrings) == stList_length(caps));
+        assert(stList_length(threads) == stList_length(caps));
+        clearSequenceViewCaches(flowers); //The strings of the blocks have been computed.
 
-        int64_t nonTrivialSeqIndex = 0, trivialSeqIndex = stList_length(threadStrings); //These are used as indices for the names of trivial and non-trivial sequences.
-        for (int64_t i = 0; i < stList_length(threadStrings); i++) {
+        int64_t nonTrivialSeqIndex = 0, trivialSeqIndex = stList_length(threads); //These are used as indices for the names of trivial and non-trivial sequences.
+        for (int64_t i = 0; i < stList_length(threads); i++) {
             Cap *cap = stList_get(caps, i);
             assert(cap_getStrand(cap));
             assert(!cap_getSide(cap));
             Flower *flower = end_getFlower(cap_getEnd(cap));
-            char *threadString = stList_get(threadStrings, i);
-            bool trivialString = isTrivialString(&threadString); //This alters the original string
+            bool trivialString;
+            char *threadString = getThreadString(stList_get(threads, i), &trivialString);
+            threadBuffer_destruct(stList_get(threads, i)); //Free the records as we go, so we don't keep two copies of the thread around.
+            stList_set(threads, i, NULL);
             MetaSequence *metaSequence = addMetaSequence(flower, cap, trivialString ? trivialSeqIndex++ : nonTrivialSeqIndex++,
                     threadString, trivialString);
             free(threadString);
@@ -329,10 +372,11 @@ void bottomUp(stList *flowers, stKVDatabase *sequenceDatabase, Name referenceEve
             (void) endCoordinate;
             assert(endCoordinate == metaSequence_getLength(metaSequence) + metaSequence_getStart(metaSequence));
         }
-        stList_setDestructor(threadStrings, NULL); //The strings are already cleaned up by the above loop
-        stList_destruct(threadStrings);
+        stList_setDestructor(threads, NULL); //The threads are already cleaned up by the above loop
+        stList_destruct(threads);
     } else {
         buildRecursiveThreads(sequenceDatabase, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+        clearSequenceViewCaches(flowers);
     }
     stHash_destruct(segmentWriteFn_flowerToPhylogeneticTreeHash);
     stList_destruct(caps);
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "cactus.h"
 #include "sonLib.h"
 
@@ -113,10 +114,10 @@ static char *getMaxLikelihoodString(double *baseProbs, int64_t length) {
     /*
      * For the "baseProbs" 2d array of base probabilities generates a ML string of bases.
      * The baseProbs array is organised as
-     * [ Prob of A at position 0, Prob of C at position 0, Prob of G at position 0, Prob of T at position 0,
-     *   Prob of A at position 1, Prob of C at position 1, Prob of G at position 1, Prob of T at position 1,
+     * [ Prob of A at position 0, Prob of A at position 1, ..., Prob of A at position length-1,
+     *   Prob of C at position 0, Prob of C at position 1, ..., Prob of C at position length-1,
      *   ...
-     *  etc.
+     *  etc. for G and T.
      *  The returned string is a an upper case string of A, C, G and T.
      *  Length is the length of the string.
      *  In case of bases at a position with equal probability a (somewhat) random base is chosen.
@@ -124,9 +125,9 @@ static char *getMaxLikelihoodString(double *baseProbs, int64_t length) {
     char *mlString = st_malloc(sizeof(char) * (length+1));
     for (int64_t i = 0; i < length; i++) {
         int64_t k = 0;
-        double m = baseProbs[i * 4];
+        double m = baseProbs[i];
         for (int64_t j = 1; j < 4; j++) {
-            double n = baseProbs[i * 4 + j];
+            double n = baseProbs[j * length + i];
             if (n > m || (n == m && st_random() > 0.5)) {
                 k = j;
                 m = n;
@@ -140,106 +141,223 @@ static char *getMaxLikelihoodString(double *baseProbs, int64_t length) {
 
 ///
 // The following functions are the meat of the Felsenstein's algorithm implementation.
+// The base probabilities of a block are kept as four arrays, one per base, so that each step is a simple loop over
+// the columns of the block that the compiler can vectorise.
 ///
 
-static double *transformBaseProbsBySubstitutionMatrix(double *baseProbs, int64_t length, stMatrix *substitutionMatrix) {
-    /*
-     * Updates the array of base probs, as described in getMaxLikelihoodString by multiplying the vector of base
-     * probabilities at each position by the given substitution matrix.
-     * Returns the input array.
-     */
-    for (int64_t i = 0; i < length; i++) {
-        assert(stMatrix_n(substitutionMatrix) == 4);
-        double *v = stMatrix_multiplySquareMatrixAndColumnVector(substitutionMatrix, &(baseProbs[i * 4]));
-        memcpy(&(baseProbs[i * 4]), v, sizeof(double) * 4);
-        free(v);
+/*
+ * Columns whose largest probability falls below this are scaled up, by a power of two, so that deep trees
+ * and events with many segments don't underflow. Scaling by a power of two is exact, so it changes neither
+ * the ML base nor the ties between bases.
+ */
+#define BASE_PROBS_RESCALE_THRESHOLD 0x1p-64
+#define BASE_PROBS_RESCALE_FACTOR 0x1p64
+
+/*
+ * Each thread keeps the buffer that the base probabilities of the nodes of the tree are computed in
+ * between calls, so it is only reallocated when a longer block or deeper tree comes along. The buffer
+ * is freed when its thread exits.
+ */
+typedef struct _baseProbsArena {
+    double *baseProbs;
+    int64_t size;
+} BaseProbsArena;
+
+static pthread_key_t baseProbsArenaKey;
+static pthread_once_t baseProbsArenaKeyOnce = PTHREAD_ONCE_INIT;
+
+static void baseProbsArena_destruct(void *arena) {
+    free(((BaseProbsArena *) arena)->baseProbs);
+    free(arena);
+}
+
+static void baseProbsArena_constructKey(void) {
+    if (pthread_key_create(&baseProbsArenaKey, baseProbsArena_destruct) != 0) {
+        st_errAbort("Could not create the thread key of the base probabilities buffer");
     }
-    return baseProbs;
 }
 
-double *getEmptyBaseProbsString(int64_t length) {
-    /*
-     * Gets an array of base probs, as described in getMaxLikelihoodString,
-     * for a block of 'length' positions, in which each position is initialised to 1.0.
-     */
-    double *baseProbs = st_calloc(length * 4, sizeof(double));
-    for (int64_t i = 0; i < length * 4; i++) {
-        baseProbs[i] = 1.0;
+static double *getBaseProbsArena(int64_t size) {
+    pthread_once(&baseProbsArenaKeyOnce, baseProbsArena_constructKey);
+    BaseProbsArena *arena = pthread_getspecific(baseProbsArenaKey);
+    if (arena == NULL) {
+        arena = st_calloc(1, sizeof(BaseProbsArena));
+        pthread_setspecific(baseProbsArenaKey, arena);
+    }
+    if (size > arena->size) {
+        free(arena->baseProbs);
+        arena->baseProbs = st_malloc(sizeof(double) * size);
+        arena->size = size;
+    }
+    return arena->baseProbs;
+}
+
+static int64_t getTreeHeight(stTree *tree) {
+    int64_t height = 0;
+    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
+        int64_t childHeight = getTreeHeight(stTree_getChild(tree, i)) + 1;
+        height = childHeight > height ? childHeight : height;
+    }
+    return height;
+}
+
+static void getSubstitutionMatrixCells(stMatrix *substitutionMatrix, double *m) {
+    assert(stMatrix_n(substitutionMatrix) == 4);
+    assert(stMatrix_m(substitutionMatrix) == 4);
+    for (int64_t i = 0; i < 4; i++) {
+        for (int64_t j = 0; j < 4; j++) {
+            m[i * 4 + j] = *stMatrix_getCell(substitutionMatrix, i, j);
+        }
     }
-    return baseProbs;
 }
 
-double *getBaseProbsString(char *string, int64_t length) {
+static void rescaleColumn(double *baseProbs, int64_t length, int64_t i) {
+    double m = baseProbs[i];
+    for (int64_t j = 1; j < 4; j++) {
+        m = baseProbs[j * length + i] > m ? baseProbs[j * length + i] : m;
+    }
+    while (m < BASE_PROBS_RESCALE_THRESHOLD && m > 0.0) {
+        for (int64_t j = 0; j < 4; j++) {
+            baseProbs[j * length + i] *= BASE_PROBS_RESCALE_FACTOR;
+        }
+        m *= BASE_PROBS_RESCALE_FACTOR;
+    }
+}
+
+static void rescale(double *baseProbs, int64_t length) {
+    for (int64_t i = 0; i < length; i++) {
+        rescaleColumn(baseProbs, length, i);
+    }
+}
+
+static void transformBaseProbsBySubstitutionMatrix(double *baseProbs, int64_t length, stMatrix *substitutionMatrix) {
     /*
-     * Gets an array of base probs, as described in getMaxLikelihoodString, representing
-     * the input string.
+     * Updates the base probs in place by multiplying the vector of base probabilities at each position
+     * by the given substitution matrix.
      */
-    double *baseProbs = st_calloc(length * 4, sizeof(double)); //Gets the initial array initialised to 0.0 values
+    double m[16];
+    getSubstitutionMatrixCells(substitutionMatrix, m);
+    double *a = baseProbs, *c = baseProbs + length, *g = baseProbs + 2 * length, *t = baseProbs + 3 * length;
     for (int64_t i = 0; i < length; i++) {
-        switch (toupper(string[i])) {
-        case 'A':
-            assert(baseProbs[i * 4] == 0.0);
-            baseProbs[i * 4] = 1.0;
-            break;
-        case 'C':
-            baseProbs[i * 4 + 1] = 1.0;
-            break;
-        case 'G':
-            baseProbs[i * 4 + 2] = 1.0;
-            break;
-        case 'T':
-            baseProbs[i * 4 + 3] = 1.0;
-            break;
-        default: //If N we treat marginalise over all possibilities.
-            baseProbs[i * 4] = 1.0;
-            baseProbs[i * 4 + 1] = 1.0;
-            baseProbs[i * 4 + 2] = 1.0;
-            baseProbs[i * 4 + 3] = 1.0;
-            break;
-        }
+        double x0 = a[i], x1 = c[i], x2 = g[i], x3 = t[i];
+        a[i] = m[0] * x0 + m[1] * x1 + m[2] * x2 + m[3] * x3;
+        c[i] = m[4] * x0 + m[5] * x1 + m[6] * x2 + m[7] * x3;
+        g[i] = m[8] * x0 + m[9] * x1 + m[10] * x2 + m[11] * x3;
+        t[i] = m[12] * x0 + m[13] * x1 + m[14] * x2 + m[15] * x3;
     }
-    return baseProbs;
 }
 
 static void multiply(double *baseProbs1, double *baseProbs2, int64_t blockLength) {
     /*
-     * Convenience function.
      * Updates baseProbs1, so that at each position i, baseProbs1[i] = baseProbs1[i] * baseProbs2[i], each
      * being the probability of a given base at a given position whose probability if the product of the initial probabilities.
-     * Frees base probs2.
      */
     for (int64_t j = 0; j < blockLength * 4; j++) {
         baseProbs1[j] *= baseProbs2[j];
     }
-    free(baseProbs2);
 }
 
-static double *computeBaseProbs(stTree *tree, stHash *eventsToStrings, int64_t blockLength) {
+static int64_t baseToIndex(char base) {
+    switch (base) {
+    case 'A':
+    case 'a':
+        return 0;
+    case 'C':
+    case 'c':
+        return 1;
+    case 'G':
+    case 'g':
+        return 2;
+    case 'T':
+    case 't':
+        return 3;
+    default: //If N we marginalise over all possibilities.
+        return 4;
+    }
+}
+
+static void multiplyByView(double *baseProbs, const SequenceView *view, int64_t length, stMatrix *substitutionMatrix) {
+    /*
+     * Multiplies the base probs by those of the string of the view transformed by the substitution matrix. As each
+     * position of the string is one of five vectors (one for each base, and N, which is all ones), the
+     * transformed vectors are computed once and looked up. A view of the negative strand is read backwards,
+     * and as the bases are indexed A, C, G, T the complement of base k (other than N) is 3 - k.
+     */
+    assert(view->length == length);
+    double m[16], transformedBases[5][4];
+    getSubstitutionMatrixCells(substitutionMatrix, m);
+    for (int64_t i = 0; i < 5; i++) {
+        for (int64_t j = 0; j < 4; j++) {
+            double x0 = i == 0 || i == 4, x1 = i == 1 || i == 4, x2 = i == 2 || i == 4, x3 = i == 3 || i == 4;
+            transformedBases[i][j] = m[j * 4] * x0 + m[j * 4 + 1] * x1 + m[j * 4 + 2] * x2 + m[j * 4 + 3] * x3;
+        }
+    }
+    double *a = baseProbs, *c = baseProbs + length, *g = baseProbs + 2 * length, *t = baseProbs + 3 * length;
+    for (int64_t i = 0; i < length; i++) {
+        int64_t k = baseToIndex(view->strand ? view->bases[i] : view->bases[length - 1 - i]);
+        double *x = transformedBases[view->strand || k == 4 ? k : 3 - k];
+        a[i] *= x[0];
+        c[i] *= x[1];
+        g[i] *= x[2];
+        t[i] *= x[3];
+        if (a[i] < BASE_PROBS_RESCALE_THRESHOLD && c[i] < BASE_PROBS_RESCALE_THRESHOLD
+                && g[i] < BASE_PROBS_RESCALE_THRESHOLD && t[i] < BASE_PROBS_RESCALE_THRESHOLD) {
+            rescaleColumn(baseProbs, length, i);
+        }
+    }
+}
+
+static void computeBaseProbsP(stTree *tree, stHash *eventsToViews, int64_t blockLength, double *baseProbs, double *scratch) {
     /*
      * This is the Felsenstein's function to compute the probabilities of each base at each position of the block for the given root node of tree
      * (which is a phylogenetic tree and attached substitution matrices created by getSubstitutionTreeRootedAtGivenEvent).
+     * The probabilities are written to baseProbs, and the children of internal nodes are computed in scratch, which must be
+     * large enough for the height of the tree.
      */
     //The code is recursive.
     if (stTree_getChildNumber(tree) > 0) { //Case root is an internal node.
-        double *baseProbs = computeBaseProbs(stTree_getChild(tree, 0), eventsToStrings, blockLength);
+        computeBaseProbsP(stTree_getChild(tree, 0), eventsToViews, blockLength, baseProbs, scratch);
         for (int64_t i = 1; i < stTree_getChildNumber(tree); i++) {
-            multiply(baseProbs, computeBaseProbs(stTree_getChild(tree, i), eventsToStrings, blockLength), blockLength);
+            computeBaseProbsP(stTree_getChild(tree, i), eventsToViews, blockLength, scratch, scratch + blockLength * 4);
+            multiply(baseProbs, scratch, blockLength);
+            rescale(baseProbs, blockLength);
         }
-        return transformBaseProbsBySubstitutionMatrix(baseProbs, blockLength, getSubMatrix(tree));
+        transformBaseProbsBySubstitutionMatrix(baseProbs, blockLength, getSubMatrix(tree));
     } else { //Case root is a leaf
-        double *baseProbs = getEmptyBaseProbsString(blockLength);
-        stList *strings = stHash_search(eventsToStrings, getEvent(tree));
-        if (strings != NULL) { //If there are strings associated with this event.
-            for (int64_t i = 0; i < stList_length(strings); i++) {
-                multiply(baseProbs,
-                        transformBaseProbsBySubstitutionMatrix(getBaseProbsString(stList_get(strings, i), blockLength),
-                                blockLength, getSubMatrix(tree)), blockLength);
+        for (int64_t i = 0; i < blockLength * 4; i++) {
+            baseProbs[i] = 1.0;
+        }
+        stList *views = stHash_search(eventsToViews, getEvent(tree));
+        if (views != NULL) { //If there are strings associated with this event.
+            for (int64_t i = 0; i < stList_length(views); i++) {
+                multiplyByView(baseProbs, stList_get(views, i), blockLength, getSubMatrix(tree));
             }
         }
-        return baseProbs;
     }
 }
 
+void computeBaseProbs(stTree *tree, stHash *eventsToStrings, int64_t blockLength, double *baseProbs) {
+    //Wrap the strings in views of the positive strand.
+    stHash *eventsToViews = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
+    stHashIterator *it = stHash_getIterator(eventsToStrings);
+    Event *event;
+    while ((event = stHash_getNext(it)) != NULL) {
+        stList *strings = stHash_search(eventsToStrings, event);
+        stList *views = stList_construct3(stList_length(strings), free);
+        for (int64_t i = 0; i < stList_length(strings); i++) {
+            SequenceView *view = st_malloc(sizeof(SequenceView));
+            view->bases = stList_get(strings, i);
+            view->length = blockLength;
+            view->strand = 1;
+            stList_set(views, i, view);
+        }
+        stHash_insert(eventsToViews, event, views);
+    }
+    stHash_destructIterator(it);
+    computeBaseProbsP(tree, eventsToViews, blockLength, baseProbs, getBaseProbsArena(getTreeHeight(tree) * blockLength * 4));
+    stHash_destruct(eventsToViews);
+}
+
 ////
 // The following is used to soft-mask (make lower case) bases deemed to be repetitive in the source genomes.
 ////
@@ -260,13 +378,14 @@ void maskAncestralRepeatBases(Block *block, char *mlString) {
     while ((segment = block_getNext(segmentIt)) != NULL) {
         if (segment_getSequence(segment) != NULL) {
             numSegmentsWithSequence++;
-            char *string = segment_getString(segment);
+            //Complementing preserves case and Ns, so the bases of the view are counted without it.
+            SequenceView view = segment_getView(segment);
             for (int64_t i = 0; i < block_getLength(block); i++) {
-                char uC = toupper(string[i]);
-                upperCounts[i] += uC == string[i] ? 1 : 0;
+                char base = view.strand ? view.bases[i] : view.bases[view.length - 1 - i];
+                char uC = toupper(base);
+                upperCounts[i] += uC == base ? 1 : 0;
                 nCounts[i] += (uC != 'A' && uC != 'C' && uC != 'G' && uC != 'T' ? 1 : 0);
             }
-            free(string);
         }
     }
     block_destructInstanceIterator(segmentIt);
@@ -286,26 +405,28 @@ void maskAncestralRepeatBases(Block *block, char *mlString) {
     free(nCounts);
 }
 
-static stHash *hashEventsToSegmentStrings(Block *block) {
+static stHash *hashEventsToSegmentViews(Block *block, SequenceView *views) {
     /*
-     * Returns a hash of events to the strings of segments with a given event.
-     * The strings are stored in a list.
+     * Returns a hash of events to the views of the strings of segments with a given event.
+     * The views are stored in a list, and point into the given array, which must have room for
+     * the segments of the block.
      */
-    stHash *eventsToStrings = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
+    stHash *eventsToViews = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
     Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
     Segment *segment;
     while ((segment = block_getNext(segmentIt)) != NULL) {
         if (segment_getSequence(segment) != NULL) {
-            stList *strings = stHash_search(eventsToStrings, segment_getEvent(segment));
-            if (strings == NULL) {
-                strings = stList_construct3(0, free);
-                stHash_insert(eventsToStrings, segment_getEvent(segment), strings);
+            stList *eventViews = stHash_search(eventsToViews, segment_getEvent(segment));
+            if (eventViews == NULL) {
+                eventViews = stList_construct();
+                stHash_insert(eventsToViews, segment_getEvent(segment), eventViews);
             }
-            stList_append(strings, segment_getString(segment));
+            *views = segment_getView(segment);
+            stList_append(eventViews, views++);
         }
     }
     block_destructInstanceIterator(segmentIt);
-    return eventsToStrings;
+    return eventsToViews;
 }
 
 char *getMaximumLikelihoodString(stTree *tree, Block *block) {
@@ -323,12 +444,15 @@ char *getMaximumLikelihoodString(stTree *tree, Block *block) {
         memset(mlString, 'N', block_getLength(block));
         mlString[block_getLength(block)] = '\0';
     } else {
-        stHash *eventsToStrings = hashEventsToSegmentStrings(block);
-        double *baseProbs = computeBaseProbs(tree, eventsToStrings, block_getLength(block));
-        mlString = getMaxLikelihoodString(baseProbs, block_getLength(block));
+        SequenceView *views = st_malloc(sizeof(SequenceView) * (block_getInstanceNumber(block) + 1));
+        stHash *eventsToViews = hashEventsToSegmentViews(block, views);
+        int64_t blockLength = block_getLength(block);
+        double *baseProbs = getBaseProbsArena((getTreeHeight(tree) + 1) * blockLength * 4);
+        computeBaseProbsP(tree, eventsToViews, blockLength, baseProbs, baseProbs + blockLength * 4);
+        mlString = getMaxLikelihoodString(baseProbs, blockLength);
         //Cleanup
-        free(baseProbs);
-        stHash_destruct(eventsToStrings);
+        stHash_destruct(eventsToViews);
+        free(views);
     }
     maskAncestralRepeatBases(block, mlString);
     return mlString;
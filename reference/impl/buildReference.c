@@ -296,12 +296,120 @@ static double countAdapterFn(Cap *_5Cap, int64_t length5Segment, int64_t length3
     return 1;
 }
 
-refAdjList *calculateZ(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
-bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs) {
+static void calculateZP3(Cap *cap, stHash *endsToNodes, int64_t maxWalkForCalculatingZ, bool ignoreUnalignedGaps,
+        double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs,
+        void (*addToWeight)(void *, int64_t, int64_t, double), void *addToWeightExtraArg) {
     /*
-     * Calculate the zScores between all ends.
+     * Calculate the zScores between the ends along the thread starting from the given stub cap,
+     * passing each score to addToWeight in turn.
      */
-    refAdjList *aL = refAdjList_construct(nodeNumber);
+    stList *caps = calculateZP(cap, endsToNodes);
+
+    /*
+     * Calculate the lengths of the sequences following the 3 caps, for efficiency.
+     */
+    int64_t *capSizes = st_malloc(sizeof(int64_t) * stList_length(caps));
+    for (int64_t i = 0; i < stList_length(caps); i++) {
+        Cap *cap = stList_get(caps, i);
+        capSizes[i] = calculateZP2(cap, endsToNodes);
+    }
+
+    /*
+     * Iterate through all pairs of 5' and 3' caps to calculate additions to scores.
+     */
+    for (int64_t i = (stList_length(caps) > 0 && cap_getSide(stList_get(caps, 0))) ? 1 : 0; i < stList_length(caps); i += 2) {
+        Cap *_3Cap = stList_get(caps, i);
+        assert(!cap_getSide(_3Cap));
+        int64_t _3CapSize = capSizes[i];
+        int64_t _3Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_3Cap))), 0);
+        int64_t unaligned = 0;
+        for (int64_t k = 0; k < maxWalkForCalculatingZ; k++) {
+            int64_t j = k * 2 + i + 1;
+            if (j >= stList_length(caps)) {
+                break;
+            }
+            Cap *_5Cap = stList_get(caps, j);
+            assert(cap_getSide(_5Cap));
+            assert(cap_getAdjacency(_5Cap) != NULL);
+            if (ignoreUnalignedGaps) {
+                assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1 >= 0);
+                unaligned += cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1;
+            }
+            int64_t _5Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_5Cap))), 0);
+            int64_t _5CapSize = capSizes[j];
+            assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) > 0);
+            int64_t diff = cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) - unaligned;
+            assert(diff >= 1);
+            if (zScoreFn(_5Cap, 1, 1, diff, zScoreExtraArgs) < 0.0000000001) { //no point walking when score gets too small, should be effective for theta >= 0.000001
+                break;
+            }
+            double score = zScoreFn(_5Cap, _5CapSize, _3CapSize, diff, zScoreExtraArgs);
+            assert(score >= -0.0001);
+            if (score <= 0.0) {
+                score = 1e-10; //Make slightly non-zero.
+            }
+            assert(score > 0.0);
+            addToWeight(addToWeightExtraArg, _3Node, _5Node, score);
+        }
+    }
+    stList_destruct(caps);
+    free(capSizes);
+}
+
+static void addToAdjList(refAdjList *aL, int64_t _3Node, int64_t _5Node, double score) {
+    refAdjList_addToWeight(aL, _3Node, _5Node, score);
+    assert(refAdjList_getWeight(aL, _3Node, _5Node) == refAdjList_getWeight(aL, _5Node, _3Node));
+    assert(refAdjList_getWeight(aL, _3Node, _5Node) >= 0.0);
+}
+
+/*
+ * A sparse buffer of the weights calculated by one thread, kept in the order they were calculated.
+ */
+typedef struct _zScoreWeight {
+    int64_t _3Node;
+    int64_t _5Node;
+    double score;
+} ZScoreWeight;
+
+typedef struct _zScoreTask {
+    stList *stubCaps;
+    int64_t start;
+    int64_t end;
+    stHash *endsToNodes;
+    int64_t maxWalkForCalculatingZ;
+    bool ignoreUnalignedGaps;
+    double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *);
+    void *zScoreExtraArgs;
+    ZScoreWeight *weights;
+    int64_t weightNumber;
+    int64_t maxWeightNumber;
+} ZScoreTask;
+
+static void addToZScoreTask(ZScoreTask *task, int64_t _3Node, int64_t _5Node, double score) {
+    if (task->weightNumber == task->maxWeightNumber) {
+        task->maxWeightNumber = task->maxWeightNumber * 2 + 64;
+        task->weights = st_realloc(task->weights, sizeof(ZScoreWeight) * task->maxWeightNumber);
+    }
+    ZScoreWeight *weight = &task->weights[task->weightNumber++];
+    weight->_3Node = _3Node;
+    weight->_5Node = _5Node;
+    weight->score = score;
+}
+
+static void *calculateZScoreTask(ZScoreTask *task) {
+    for (int64_t i = task->start; i < task->end; i++) {
+        calculateZP3(stList_get(task->stubCaps, i), task->endsToNodes, task->maxWalkForCalculatingZ,
+                task->ignoreUnalignedGaps, task->zScoreFn, task->zScoreExtraArgs,
+                (void (*)(void *, int64_t, int64_t, double)) addToZScoreTask, task);
+    }
+    return task;
+}
+
+static stList *getStubCaps(Flower *flower) {
+    /*
+     * Get the positive strand 5' stub caps with sequences, from which the threads are walked.
+     */
+    stList *stubCaps = stList_construct();
     Flower_EndIterator *endIt = flower_getEndIterator(flower);
     End *end;
     while ((end = flower_getNextEnd(endIt)) != NULL) {
@@ -311,69 +419,79 @@ bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, v
             while ((cap = end_getNext(capIt)) != NULL) {
                 cap = cap_getStrand(cap) ? cap : cap_getReverse(cap);
                 if (!cap_getSide(cap) && cap_getSequence(cap) != NULL) {
-                    stList *caps = calculateZP(cap, endsToNodes);
-
-                    /*
-                     * Calculate the lengths of the sequences following the 3 caps, for efficiency.
-                     */
-                    int64_t *capSizes = st_malloc(sizeof(int64_t) * stList_length(caps));
-                    for (int64_t i = 0; i < stList_length(caps); i++) {
-                        Cap *cap = stList_get(caps, i);
-                        capSizes[i] = calculateZP2(cap, endsToNodes);
-                    }
-
-                    /*
-                     * Iterate through all pairs of 5' and 3' caps to calculate additions to scores.
-                     */
-                    for (int64_t i = (stList_length(caps) > 0 && cap_getSide(stList_get(caps, 0))) ? 1 : 0; i < stList_length(caps); i += 2) {
-                        Cap *_3Cap = stList_get(caps, i);
-                        assert(!cap_getSide(_3Cap));
-                        int64_t _3CapSize = capSizes[i];
-                        int64_t _3Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_3Cap))), 0);
-                        int64_t unaligned = 0;
-                        for (int64_t k = 0; k < maxWalkForCalculatingZ; k++) {
-                            int64_t j = k * 2 + i + 1;
-                            if (j >= stList_length(caps)) {
-                                break;
-                            }
-                            Cap *_5Cap = stList_get(caps, j);
-                            assert(cap_getSide(_5Cap));
-                            assert(cap_getAdjacency(_5Cap) != NULL);
-                            if (ignoreUnalignedGaps) {
-                                assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1 >= 0);
-                                unaligned += cap_getCoordinate(_5Cap) - cap_getCoordinate(cap_getAdjacency(_5Cap)) - 1;
-                            }
-                            int64_t _5Node = stIntTuple_get(stHash_search(endsToNodes, end_getPositiveOrientation(cap_getEnd(_5Cap))), 0);
-                            int64_t _5CapSize = capSizes[j];
-                            assert(cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) > 0);
-                            int64_t diff = cap_getCoordinate(_5Cap) - cap_getCoordinate(_3Cap) - unaligned;
-                            assert(diff >= 1);
-                            if (zScoreFn(_5Cap, 1, 1, diff, zScoreExtraArgs) < 0.0000000001) { //no point walking when score gets too small, should be effective for theta >= 0.000001
-                                break;
-                            }
-                            double score = zScoreFn(_5Cap, _5CapSize, _3CapSize, diff, zScoreExtraArgs);
-                            assert(score >= -0.0001);
-                            if (score <= 0.0) {
-                                score = 1e-10; //Make slightly non-zero.
-                            }
-                            assert(score > 0.0);
-                            refAdjList_addToWeight(aL, _3Node, _5Node, score);
-                            assert(refAdjList_getWeight(aL, _3Node, _5Node) == refAdjList_getWeight(aL, _5Node, _3Node));
-                            assert(refAdjList_getWeight(aL, _3Node, _5Node) >= 0.0);
-                        }
-                    }
-                    stList_destruct(caps);
-                    free(capSizes);
+                    stList_append(stubCaps, cap);
                 }
             }
             end_destructInstanceIterator(capIt);
         }
     }
     flower_destructEndIterator(endIt);
+    return stubCaps;
+}
+
+refAdjList *calculateZ2(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
+bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs,
+        int64_t numThreads) {
+    /*
+     * Calculate the zScores between all ends.
+     *
+     * If numThreads > 1 the threads are walked by a pool of threads, each taking a
+     * contiguous run of the stub caps and buffering the weights it calculates. The buffers
+     * are then added to the adjacency list in the order of the stub caps, so the weights,
+     * including their floating point rounding, are the same as for a single thread.
+     */
+    refAdjList *aL = refAdjList_construct(nodeNumber);
+    stList *stubCaps = getStubCaps(flower);
+    if (numThreads > 1 && stList_length(stubCaps) > 1) {
+        // Use several runs per thread so a few long threads do not hold back the rest.
+        int64_t taskNumber = numThreads * 8 < stList_length(stubCaps) ? numThreads * 8 : stList_length(stubCaps);
+        stList *tasks = stList_construct3(0, free);
+        for (int64_t i = 0; i < taskNumber; i++) {
+            ZScoreTask *task = st_calloc(1, sizeof(ZScoreTask));
+            task->stubCaps = stubCaps;
+            task->start = i * stList_length(stubCaps) / taskNumber;
+            task->end = (i + 1) * stList_length(stubCaps) / taskNumber;
+            task->endsToNodes = endsToNodes;
+            task->maxWalkForCalculatingZ = maxWalkForCalculatingZ;
+            task->ignoreUnalignedGaps = ignoreUnalignedGaps;
+            task->zScoreFn = zScoreFn;
+            task->zScoreExtraArgs = zScoreExtraArgs;
+            stList_append(tasks, task);
+        }
+        stThreadPool *threadPool = stThreadPool_construct(numThreads < taskNumber ? numThreads : taskNumber,
+                (void *(*)(void *)) calculateZScoreTask, cactusMisc_ignoreThreadPoolResult);
+        for (int64_t i = 0; i < taskNumber; i++) {
+            stThreadPool_push(threadPool, stList_get(tasks, i));
+        }
+        stThreadPool_wait(threadPool);
+        stThreadPool_destruct(threadPool);
+
+        //Merge the buffers, in the order of the stub caps.
+        for (int64_t i = 0; i < taskNumber; i++) {
+            ZScoreTask *task = stList_get(tasks, i);
+            for (int64_t j = 0; j < task->weightNumber; j++) {
+                addToAdjList(aL, task->weights[j]._3Node, task->weights[j]._5Node, task->weights[j].score);
+            }
+            free(task->weights);
+        }
+        stList_destruct(tasks);
+    } else {
+        for (int64_t i = 0; i < stList_length(stubCaps); i++) {
+            calculateZP3(stList_get(stubCaps, i), endsToNodes, maxWalkForCalculatingZ, ignoreUnalignedGaps,
+                    zScoreFn, zScoreExtraArgs, (void (*)(void *, int64_t, int64_t, double)) addToAdjList, aL);
+        }
+    }
+    stList_destruct(stubCaps);
 
     return aL;
 }
 
+refAdjList *calculateZ(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
+bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs) {
+    return calculateZ2(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps,
+            zScoreFn, zScoreExtraArgs, 1);
+}
+
 ////////////////////////////////////
 ////////////////////////////////////
 //Chain edges
@@ -984,7 +1102,8 @@ stList *getReferenceIntervalsToPreserve(reference *ref, refAdjList *dAL, int64_t
 void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int64_t permutations,
         stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber), double (*temperature)(double),
         double theta, double phi, int64_t maxWalkForCalculatingZ,
-        bool ignoreUnalignedGaps, double wiggle, int64_t numberOfNsForScaffoldGap, int64_t minNumberOfSequencesToSupportAdjacency, bool makeScaffolds) {
+        bool ignoreUnalignedGaps, double wiggle, int64_t numberOfNsForScaffoldGap, int64_t minNumberOfSequencesToSupportAdjacency, bool makeScaffolds,
+        int64_t numThreads) {
     /*
      * Implements a greedy algorithm and greedy update sampler to find a solution to the adjacency problem for a net.
      */
@@ -1048,10 +1167,10 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
     stHash *eventWeighting = getEventWeighting(referenceEvent, phi, chosenEvents);
     stSet_destruct(chosenEvents);
     void *zArgs[2] = { &theta, eventWeighting };
-    refAdjList *aL = calculateZ(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs);
+    refAdjList *aL = calculateZ2(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs, numThreads);
     int64_t directTheta = 0.0;
     zArgs[0] = &directTheta;
-    refAdjList *dAL = calculateZ(flower, endsToNodes, nodeNumber, 1, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs); //Gets set of direct of direct adjacencies
+    refAdjList *dAL = calculateZ2(flower, endsToNodes, nodeNumber, 1, ignoreUnalignedGaps, calculateZScoreWeightedAdapterFn, zArgs, numThreads); //Gets set of direct of direct adjacencies
     stHash_destruct(eventWeighting);
 
     /*
@@ -7,53 +7,139 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "cactus.h"
 #include "sonLib.h"
+#include "recursiveThreadBuilder.h"
 
-static void *compress(char *string, int64_t *dataSize) {
-    void *data = stCompression_compress(string, strlen(string) + 1, dataSize, 1); //going with least, fastest compression-1);
-    free(string);
+/*
+ * The records of a thread are appended to a thread buffer as they are written, so a thread is
+ * built with a single growing allocation rather than a list of strings that are joined.
+ *
+ * A thread that is stored in the database to be used by the parent flower is a series of frames,
+ * each of which is:
+ *
+ *      int64_t compressedLength, int64_t uncompressedLength, compressedLength bytes
+ *
+ * Runs of records are only compressed once they reach THREAD_FRAME_SIZE bytes, or the thread is
+ * finished. When a parent thread includes a nested thread whose frames hold at least
+ * THREAD_FRAME_SIZE bytes, the frames are copied into the parent thread as they are, without
+ * decompressing them. Smaller nested threads are decompressed and appended to the parent's current
+ * run, so that frames do not get ever smaller going up the tree.
+ */
+
+#define THREAD_FRAME_SIZE 1048576
+#define THREAD_FRAME_HEADER_SIZE (2 * sizeof(int64_t))
+
+struct _threadBuffer {
+    char *data;
+    int64_t length;
+    int64_t maxLength;
+};
+
+static ThreadBuffer *threadBuffer_construct(void) {
+    ThreadBuffer *buffer = st_calloc(1, sizeof(ThreadBuffer));
+    buffer->maxLength = 64;
+    buffer->data = st_malloc(buffer->maxLength);
+    buffer->data[0] = '\0';
+    return buffer;
+}
+
+void threadBuffer_destruct(ThreadBuffer *buffer) {
+    free(buffer->data);
+    free(buffer);
+}
+
+static char *threadBuffer_reserve(ThreadBuffer *buffer, int64_t length) {
+    /*
+     * Makes space for the given number of bytes at the end of the buffer and returns a pointer to it.
+     * The buffer is kept null terminated, so text records can be read as a string.
+     */
+    if (buffer->length + length + 1 > buffer->maxLength) {
+        buffer->maxLength = (buffer->length + length + 1) * 2;
+        buffer->data = st_realloc(buffer->data, buffer->maxLength);
+    }
+    char *data = buffer->data + buffer->length;
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
     return data;
 }
 
-static char *decompress(void *data, int64_t dataSize) {
-    int64_t uncompressedSize;
-    char *string = stCompression_decompress(data, dataSize, &uncompressedSize);
-    assert(strlen(string)+1 == uncompressedSize);
-    free(data);
-    return string;
+void threadBuffer_append(ThreadBuffer *buffer, const void *data, int64_t length) {
+    memcpy(threadBuffer_reserve(buffer, length), data, length);
 }
 
-static void cacheNonNestedRecords(stCache *cache, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
+void threadBuffer_appendString(ThreadBuffer *buffer, const char *string) {
+    threadBuffer_append(buffer, string, strlen(string));
+}
+
+const char *threadBuffer_getData(ThreadBuffer *buffer) {
+    return buffer->data;
+}
+
+int64_t threadBuffer_getLength(ThreadBuffer *buffer) {
+    return buffer->length;
+}
+
+static void threadBuffer_clear(ThreadBuffer *buffer) {
+    buffer->length = 0;
+    buffer->data[0] = '\0';
+}
+
+static void readFrameHeader(const char *frame, int64_t *compressedLength, int64_t *uncompressedLength) {
+    memcpy(compressedLength, frame, sizeof(int64_t));
+    memcpy(uncompressedLength, frame + sizeof(int64_t), sizeof(int64_t));
+    assert(*compressedLength >= 0);
+    assert(*uncompressedLength >= 0);
+}
+
+static void writeFrame(ThreadBuffer *frames, ThreadBuffer *run) {
     /*
-     * Caches the set of terminal adjacency and segment records present in the threads.
+     * Compresses the run of records and appends it as a frame.
      */
-    for (int64_t i = 0; i < stList_length(caps); i++) {
-        Cap *cap = stList_get(caps, i);
-        int64_t recordSize;
-        while (1) {
-            Cap *adjacentCap = cap_getAdjacency(cap);
-            assert(adjacentCap != NULL);
-            Group *group = end_getGroup(cap_getEnd(cap));
-            assert(group != NULL);
-            if (group_isLeaf(group)) { //Record must not be in the database already
-                void *data = compress(terminalAdjacencyWriteFn(cap), &recordSize);
-                assert(!stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
-                stCache_setRecord(cache, cap_getName(cap), 0, recordSize, data);
-                free(data);
-            }
-            if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
-                break;
-            }
-            Segment *segment = cap_getSegment(adjacentCap);
-            assert(!stCache_containsRecord(cache, segment_getName(segment), 0, INT64_MAX));
-            void *data = compress(segmentWriteFn(segment), &recordSize);
-            stCache_setRecord(cache, segment_getName(segment), 0, recordSize, data);
+    int64_t compressedLength = 0, uncompressedLength = run->length;
+    void *compressed = uncompressedLength > 0 ?
+            stCompression_compress(run->data, uncompressedLength, &compressedLength, 1) : NULL; //going with least, fastest compression
+    threadBuffer_append(frames, &compressedLength, sizeof(int64_t));
+    threadBuffer_append(frames, &uncompressedLength, sizeof(int64_t));
+    if (compressed != NULL) {
+        threadBuffer_append(frames, compressed, compressedLength);
+        free(compressed);
+    }
+    threadBuffer_clear(run);
+}
+
+static int64_t getUncompressedLength(const char *frames, int64_t framesLength) {
+    int64_t uncompressedLength = 0;
+    for (int64_t i = 0; i < framesLength;) {
+        int64_t frameCompressedLength, frameUncompressedLength;
+        readFrameHeader(frames + i, &frameCompressedLength, &frameUncompressedLength);
+        uncompressedLength += frameUncompressedLength;
+        i += THREAD_FRAME_HEADER_SIZE + frameCompressedLength;
+        assert(i <= framesLength);
+    }
+    return uncompressedLength;
+}
+
+static void decompressFrames(const char *frames, int64_t framesLength, ThreadBuffer *buffer) {
+    /*
+     * Decompresses the frames, appending the records to the buffer.
+     */
+    for (int64_t i = 0; i < framesLength;) {
+        int64_t frameCompressedLength, frameUncompressedLength;
+        readFrameHeader(frames + i, &frameCompressedLength, &frameUncompressedLength);
+        i += THREAD_FRAME_HEADER_SIZE;
+        if (frameUncompressedLength > 0) {
+            int64_t uncompressedLength;
+            void *data = stCompression_decompress((void *) (frames + i), frameCompressedLength, &uncompressedLength);
+            assert(uncompressedLength == frameUncompressedLength);
+            threadBuffer_append(buffer, data, uncompressedLength);
             free(data);
         }
+        i += frameCompressedLength;
+        assert(i <= framesLength);
     }
 }
 
@@ -82,10 +168,11 @@ static stList *getNestedRecordNames(stList *caps) {
     return getRequests;
 }
 
-static void cacheNestedRecords(stKVDatabase *database, stCache *cache, stList *caps) {
+static stCache *cacheNestedRecords(stKVDatabase *database, stList *caps) {
     /*
      * Caches all the non-terminal adjacencies by retrieving them from the database.
      */
+    stCache *cache = stCache_construct();
     stList *getRequests = getNestedRecordNames(caps);
     if (stList_length(caps) > 10000) {
         st_logCritical("Going to request %" PRIi64 " records from the database: %" PRIi64 "\n", stList_length(caps));
@@ -116,16 +203,6 @@ static void cacheNestedRecords(stKVDatabase *database, stCache *cache, stList *c
     assert(stList_length(getRequests) == 0);
     stList_destruct(getRequests);
     stList_destruct(records);
-}
-
-static stCache *cacheRecords(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    /*
-     * Cache all the elements needed to construct the set of threads.
-     */
-    stCache *cache = stCache_construct();
-    cacheNestedRecords(database, cache, caps);
-    cacheNonNestedRecords(cache, caps, segmentWriteFn, terminalAdjacencyWriteFn);
     return cache;
 }
 
@@ -151,47 +228,65 @@ static void deleteNestedRecords(stKVDatabase *database, stList *caps) {
     stList_destruct(deleteRequests);
 }
 
-static char *getThread(stCache *cache, Cap *startCap) {
+static void getThread(stCache *cache, Cap *startCap, void (*segmentWriteFn)(Segment *, ThreadBuffer *),
+        void (*terminalAdjacencyWriteFn)(Cap *, ThreadBuffer *), ThreadBuffer *run, ThreadBuffer *frames) {
     /*
-     * Iterate through, first calculating the length of the final record, then concatenating the results.
+     * Walks the thread, writing the segment and terminal adjacency records to run and adding the nested
+     * threads from the cache. If frames is NULL the whole thread is written uncompressed to run, else
+     * the thread is written to frames, as described above, using run to hold the records not yet compressed.
      */
     Cap *cap = startCap;
-    stList *strings = stList_construct3(0, free);
-    while (1) { //Calculate the size of the entries in the DB that represent the thread.
+    while (1) {
         Cap *adjacentCap = cap_getAdjacency(cap);
         assert(adjacentCap != NULL);
-        int64_t recordSize;
-        assert(stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
-        void *data = stCache_getRecord(cache, cap_getName(cap), 0, INT64_MAX, &recordSize);
-        stList_append(strings, decompress(data, recordSize));
+        Group *group = end_getGroup(cap_getEnd(cap));
+        assert(group != NULL);
+        if (group_isLeaf(group)) {
+            terminalAdjacencyWriteFn(cap, run);
+        } else {
+            int64_t recordSize;
+            assert(stCache_containsRecord(cache, cap_getName(cap), 0, INT64_MAX));
+            char *record = stCache_getRecord(cache, cap_getName(cap), 0, INT64_MAX, &recordSize);
+            if (frames != NULL && getUncompressedLength(record, recordSize) >= THREAD_FRAME_SIZE) {
+                if (run->length > 0) {
+                    writeFrame(frames, run);
+                }
+                threadBuffer_append(frames, record, recordSize);
+            } else {
+                decompressFrames(record, recordSize, run);
+            }
+            free(record);
+        }
+        if (frames != NULL && run->length >= THREAD_FRAME_SIZE) {
+            writeFrame(frames, run);
+        }
         if ((cap = cap_getOtherSegmentCap(adjacentCap)) == NULL) {
             break;
         }
-        assert(stCache_containsRecord(cache, segment_getName(cap_getSegment(adjacentCap)), 0, INT64_MAX));
-        data = stCache_getRecord(cache, segment_getName(cap_getSegment(adjacentCap)), 0, INT64_MAX, &recordSize);
-        stList_append(strings, decompress(data, recordSize));
+        segmentWriteFn(cap_getSegment(adjacentCap), run);
+    }
+    if (frames != NULL && (run->length > 0 || frames->length == 0)) {
+        writeFrame(frames, run);
     }
-    char *string = stString_join2("", strings);
-    stList_destruct(strings);
-    return string;
 }
 
-void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
+void buildRecursiveThreads(stKVDatabase *database, stList *caps, void (*segmentWriteFn)(Segment *, ThreadBuffer *),
+        void (*terminalAdjacencyWriteFn)(Cap *, ThreadBuffer *)) {
     //Cache records
-    stCache *cache = cacheRecords(database, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+    stCache *cache = cacheNestedRecords(database, caps);
 
     //Build new threads
     stList *records = stList_construct3(0, (void(*)(void *)) stKVDatabaseBulkRequest_destruct);
+    ThreadBuffer *run = threadBuffer_construct();
+    ThreadBuffer *frames = threadBuffer_construct();
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
-        char *string = getThread(cache, cap);
-        assert(string != NULL);
-        int64_t recordSize;
-        void *data = compress(string, &recordSize);
-        stList_append(records, stKVDatabaseBulkRequest_constructInsertRequest(cap_getName(cap), data, recordSize));
-        free(data);
+        getThread(cache, cap, segmentWriteFn, terminalAdjacencyWriteFn, run, frames);
+        stList_append(records, stKVDatabaseBulkRequest_constructInsertRequest(cap_getName(cap), frames->data, frames->length));
+        threadBuffer_clear(frames);
     }
+    threadBuffer_destruct(run);
+    threadBuffer_destruct(frames);
 
     //Delete old records and insert new records
     deleteNestedRecords(database, caps);
@@ -208,21 +303,22 @@ void buildRecursiveThreads(stKVDatabase *database, stList *caps, char *(*segment
     stList_destruct(records);
 }
 
-stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps, char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *)) {
-    stList *threadStrings = stList_construct3(0, free);
+stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps, void (*segmentWriteFn)(Segment *, ThreadBuffer *),
+        void (*terminalAdjacencyWriteFn)(Cap *, ThreadBuffer *)) {
+    stList *threads = stList_construct3(0, (void (*)(void *)) threadBuffer_destruct);
 
     //Cache records
-    stCache *cache = cacheRecords(database, caps, segmentWriteFn, terminalAdjacencyWriteFn);
+    stCache *cache = cacheNestedRecords(database, caps);
 
     //Build new threads
     for (int64_t i = 0; i < stList_length(caps); i++) {
         Cap *cap = stList_get(caps, i);
-        stList_append(threadStrings, getThread(cache, cap));
+        ThreadBuffer *thread = threadBuffer_construct();
+        getThread(cache, cap, segmentWriteFn, terminalAdjacencyWriteFn, thread, NULL);
+        stList_append(threads, thread);
     }
 
     stCache_destruct(cache);
 
-    return threadStrings;
+    return threads;
 }
-
@@ -22,4 +22,13 @@ void cleanupPhylogeneticTree(stTree *tree);
 
 void maskAncestralRepeatBases(Block *block, char *mlString);
 
+/*
+ * Computes the probabilities of each base at each position of a block of length blockLength by Felsenstein's
+ * pruning algorithm, given a hash of the events of the tree to lists of the strings of the block's segments.
+ * baseProbs must have room for 4 * blockLength doubles, and is filled with the probabilities of A at each
+ * position, followed by those of C, G and T. The probabilities of each position are scaled by a power of
+ * two to avoid underflow, so only the ratios between them are meaningful.
+ */
+void computeBaseProbs(stTree *tree, stHash *eventsToStrings, int64_t blockLength, double *baseProbs);
+
 #endif /* BLOCKMLSTRING_H_ */
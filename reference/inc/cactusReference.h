@@ -18,6 +18,7 @@
 
 #include "cactus.h"
 #include "stMatchingAlgorithms.h"
+#include "stReferenceProblem2.h"
 
 extern const char *REFERENCE_BUILDING_EXCEPTION;
 
@@ -32,9 +33,23 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader,
         double phi,
         int64_t maxWalkForCalculatingZ, bool ignoreUnalignedGaps,
         double wiggle, int64_t numberOfNsForScaffoldGap,
-        int64_t minNumberOfSequencesToSupportAdjacency, bool makeScaffolds);
+        int64_t minNumberOfSequencesToSupportAdjacency, bool makeScaffolds,
+        int64_t numThreads);
 
-double *calculateZ(Flower *flower, stHash *endsToNodes, double theta);
+/*
+ * Calculate the z-scores between the ends of the flower in endsToNodes, walking
+ * up to maxWalkForCalculatingZ ends along each thread.
+ */
+refAdjList *calculateZ(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
+        bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs);
+
+/*
+ * As calculateZ, but walks the threads using numThreads threads. The weights
+ * are the same as those calculated by calculateZ.
+ */
+refAdjList *calculateZ2(Flower *flower, stHash *endsToNodes, int64_t nodeNumber, int64_t maxWalkForCalculatingZ,
+        bool ignoreUnalignedGaps, double (*zScoreFn)(Cap *, int64_t, int64_t, int64_t, void *), void *zScoreExtraArgs,
+        int64_t numThreads);
 
 /*
  * Weights events by how informative they are for inferring the
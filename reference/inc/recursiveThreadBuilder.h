@@ -8,12 +8,38 @@
 #ifndef RECURSIVETHREADBUILDER_H_
 #define RECURSIVETHREADBUILDER_H_
 
+/*
+ * A growing buffer of the records of a thread. The segment and terminal adjacency
+ * write functions append their records to it, in whatever binary or text format
+ * the caller chooses. The data is always followed by a null byte, which is not counted
+ * in the length, so text records can be read as a string.
+ */
+typedef struct _threadBuffer ThreadBuffer;
+
+void threadBuffer_destruct(ThreadBuffer *buffer);
+
+void threadBuffer_append(ThreadBuffer *buffer, const void *data, int64_t length);
+
+void threadBuffer_appendString(ThreadBuffer *buffer, const char *string);
+
+const char *threadBuffer_getData(ThreadBuffer *buffer);
+
+int64_t threadBuffer_getLength(ThreadBuffer *buffer);
+
+/*
+ * Builds the threads starting from the given caps, including the threads of nested flowers
+ * stored in the database, and stores them in the database, replacing the nested threads.
+ */
 void buildRecursiveThreads(stKVDatabase *database, stList *caps,
-        char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *));
+        void (*segmentWriteFn)(Segment *, ThreadBuffer *),
+        void (*terminalAdjacencyWriteFn)(Cap *, ThreadBuffer *));
 
+/*
+ * As buildRecursiveThreads, but returns the threads as a list of thread buffers, in the order
+ * of the caps, rather than storing them.
+ */
 stList *buildRecursiveThreadsInList(stKVDatabase *database, stList *caps,
-        char *(*segmentWriteFn)(Segment *),
-        char *(*terminalAdjacencyWriteFn)(Cap *));
+        void (*segmentWriteFn)(Segment *, ThreadBuffer *),
+        void (*terminalAdjacencyWriteFn)(Cap *, ThreadBuffer *));
 
 #endif /* RECURSIVETHREADBUILDER_H_ */
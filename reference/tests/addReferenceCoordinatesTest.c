@@ -5,6 +5,7 @@
  */
 
 #include <ctype.h>
+#include <time.h>
 #include "CuTest.h"
 #include "sonLib.h"
 #include "cactus.h"
@@ -157,10 +158,164 @@ static void testMLStringMakesScaffoldGaps(CuTest *testCase) {
     }
 }
 
+/*
+ * The scalar implementation of Felsenstein's algorithm that computeBaseProbs replaced, with the base
+ * probabilities of each position kept together, used to check and time it.
+ */
+static double *scalarTransformBaseProbs(double *baseProbs, int64_t length, stMatrix *substitutionMatrix) {
+    for (int64_t i = 0; i < length; i++) {
+        double *v = stMatrix_multiplySquareMatrixAndColumnVector(substitutionMatrix, &(baseProbs[i * 4]));
+        memcpy(&(baseProbs[i * 4]), v, sizeof(double) * 4);
+        free(v);
+    }
+    return baseProbs;
+}
+
+static double *scalarGetBaseProbsString(char *string, int64_t length) {
+    double *baseProbs = st_calloc(length * 4, sizeof(double));
+    for (int64_t i = 0; i < length; i++) {
+        char *bases = "ACGT";
+        char *base = strchr(bases, toupper(string[i]));
+        for (int64_t j = 0; j < 4; j++) {
+            baseProbs[i * 4 + j] = base == NULL || base - bases == j ? 1.0 : 0.0;
+        }
+    }
+    return baseProbs;
+}
+
+static void scalarMultiply(double *baseProbs1, double *baseProbs2, int64_t blockLength) {
+    for (int64_t j = 0; j < blockLength * 4; j++) {
+        baseProbs1[j] *= baseProbs2[j];
+    }
+    free(baseProbs2);
+}
+
+static double *scalarComputeBaseProbs(stTree *tree, stHash *eventsToStrings, int64_t blockLength) {
+    if (stTree_getChildNumber(tree) > 0) {
+        double *baseProbs = scalarComputeBaseProbs(stTree_getChild(tree, 0), eventsToStrings, blockLength);
+        for (int64_t i = 1; i < stTree_getChildNumber(tree); i++) {
+            scalarMultiply(baseProbs, scalarComputeBaseProbs(stTree_getChild(tree, i), eventsToStrings, blockLength), blockLength);
+        }
+        return scalarTransformBaseProbs(baseProbs, blockLength, getSubMatrix(tree));
+    }
+    double *baseProbs = st_malloc(sizeof(double) * blockLength * 4);
+    for (int64_t i = 0; i < blockLength * 4; i++) {
+        baseProbs[i] = 1.0;
+    }
+    stList *strings = stHash_search(eventsToStrings, getEvent(tree));
+    for (int64_t i = 0; strings != NULL && i < stList_length(strings); i++) {
+        scalarMultiply(baseProbs, scalarTransformBaseProbs(scalarGetBaseProbsString(stList_get(strings, i), blockLength),
+                blockLength, getSubMatrix(tree)), blockLength);
+    }
+    return baseProbs;
+}
+
+static double getSeconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+/*
+ * Times computeBaseProbs against the scalar implementation on random trees and blocks, and checks that
+ * the base probabilities of each position are in the same ratios.
+ */
+static void testComputeBaseProbs_benchmark(CuTest *testCase) {
+    double scalarTime = 0.0, batchedTime = 0.0;
+    int64_t columns = 0;
+    for (int64_t test = 0; test < 10; test++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct(cactusDisk);
+        stList *events = stList_construct();
+        stList_append(events, eventTree_getRootEvent(flower_getEventTree(flower)));
+        for (int64_t i = 0; i < 20; i++) {
+            stList_append(events, event_construct3("Boo", st_random(), st_randomChoice(events), flower_getEventTree(flower)));
+        }
+        int64_t blockLength = st_randomInt(1000, 10000);
+        stHash *eventsToStrings = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
+        for (int64_t i = 0; i < 30; i++) {
+            Event *event = st_randomChoice(events);
+            stList *strings = stHash_search(eventsToStrings, event);
+            if (strings == NULL) {
+                strings = stList_construct3(0, free);
+                stHash_insert(eventsToStrings, event, strings);
+            }
+            stList_append(strings, stRandom_getRandomDNAString(blockLength, 1, 0, 1));
+        }
+        stTree *tree = getPhylogeneticTreeRootedAtGivenEvent(st_randomChoice(events), generateJukesCantorMatrix);
+
+        double startTime = getSeconds();
+        double *scalarBaseProbs = scalarComputeBaseProbs(tree, eventsToStrings, blockLength);
+        scalarTime += getSeconds() - startTime;
+        double *baseProbs = st_malloc(sizeof(double) * blockLength * 4);
+        startTime = getSeconds();
+        computeBaseProbs(tree, eventsToStrings, blockLength, baseProbs);
+        batchedTime += getSeconds() - startTime;
+        columns += blockLength;
+
+        for (int64_t i = 0; i < blockLength; i++) {
+            double scalarTotal = 0.0, total = 0.0;
+            for (int64_t j = 0; j < 4; j++) {
+                scalarTotal += scalarBaseProbs[i * 4 + j];
+                total += baseProbs[j * blockLength + i];
+            }
+            for (int64_t j = 0; j < 4; j++) {
+                CuAssertDblEquals(testCase, scalarBaseProbs[i * 4 + j] / scalarTotal, baseProbs[j * blockLength + i] / total, 1e-9);
+            }
+        }
+
+        free(baseProbs);
+        free(scalarBaseProbs);
+        cleanupPhylogeneticTree(tree);
+        stHash_destruct(eventsToStrings);
+        stList_destruct(events);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+    st_logInfo("Computed the base probabilities of %" PRIi64 " columns in %f seconds with the scalar implementation "
+            "and %f seconds batched\n", columns, scalarTime, batchedTime);
+}
+
+static void testComputeBaseProbsDeepTree(CuTest *testCase) {
+    /*
+     * Checks that the base probabilities of a long chain of events, each with a segment, don't underflow.
+     */
+    CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct(cactusDisk);
+    Event *event = eventTree_getRootEvent(flower_getEventTree(flower));
+    int64_t blockLength = 100;
+    char *string = stRandom_getRandomDNAString(blockLength, 1, 0, 1);
+    stHash *eventsToStrings = stHash_construct2(NULL, (void (*)(void *)) stList_destruct);
+    for (int64_t i = 0; i < 2000; i++) {
+        event = event_construct3("Boo", 1.0, event, flower_getEventTree(flower));
+        stList *strings = stList_construct3(0, free);
+        stList_append(strings, stString_copy(string));
+        stHash_insert(eventsToStrings, event, strings);
+    }
+    stTree *tree = getPhylogeneticTreeRootedAtGivenEvent(eventTree_getRootEvent(flower_getEventTree(flower)), generateJukesCantorMatrix);
+    double *baseProbs = st_malloc(sizeof(double) * blockLength * 4);
+    computeBaseProbs(tree, eventsToStrings, blockLength, baseProbs);
+    for (int64_t i = 0; i < blockLength; i++) {
+        //The base of the string is the most likely
+        int64_t k = strchr("ACGT", toupper(string[i])) - "ACGT";
+        for (int64_t j = 0; j < 4; j++) {
+            CuAssertTrue(testCase, j == k ? baseProbs[j * blockLength + i] > 0.0 : baseProbs[j * blockLength + i] < baseProbs[k * blockLength + i]);
+        }
+    }
+    free(baseProbs);
+    free(string);
+    cleanupPhylogeneticTree(tree);
+    stHash_destruct(eventsToStrings);
+    testCommon_deleteTemporaryCactusDisk(cactusDisk);
+}
+
 CuSuite* addReferenceCoordinatesTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testMLStringRandom);
     SUITE_ADD_TEST(suite, testMLStringMakesScaffoldGaps);
+    SUITE_ADD_TEST(suite, testComputeBaseProbsDeepTree);
+    SUITE_ADD_TEST(suite, testComputeBaseProbs_benchmark);
 
     return suite;
 }
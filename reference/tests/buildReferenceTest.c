@@ -84,8 +84,115 @@ static void testEventWeighting(CuTest *testCase) {
     stSet_destruct(chosenEvents);
 }
 
+static double zScoreFn(Cap *_5Cap, int64_t length5Segment, int64_t length3Segment, int64_t gap, void *extraArgs) {
+    return calculateZScore(length5Segment, length3Segment, gap, *((double *) extraArgs));
+}
+
+/*
+ * Adds a thread to the flower that passes through the given blocks, in order, on the positive strand,
+ * with random gaps between them.
+ */
+static void addThroughThreadToFlower(Flower *flower, stList *blocks, int64_t blockLength, stHash *endsToNodes,
+        int64_t *nodeCounter) {
+    int64_t *gaps = st_malloc(sizeof(int64_t) * (stList_length(blocks) + 1));
+    int64_t length = 0;
+    for (int64_t i = 0; i <= stList_length(blocks); i++) {
+        gaps[i] = st_randomInt(0, 20);
+        length += gaps[i] + (i < stList_length(blocks) ? blockLength : 0);
+    }
+    char *dna = stRandom_getRandomDNAString(length, true, true, true);
+    EventTree *eventTree = flower_getEventTree(flower);
+    MetaSequence *metaSequence = metaSequence_construct(2, length, dna, "thread",
+            event_getName(eventTree_getRootEvent(eventTree)), flower_getCactusDisk(flower));
+    Sequence *sequence = sequence_construct(metaSequence, flower);
+    End *end1 = end_construct2(0, 0, flower);
+    End *end2 = end_construct2(1, 0, flower);
+    stHash_insert(endsToNodes, end1, stIntTuple_construct1((*nodeCounter)++));
+    stHash_insert(endsToNodes, end2, stIntTuple_construct1((*nodeCounter)++));
+    Cap *cap = cap_construct2(end1, 1, 1, sequence);
+    int64_t coordinate = 2;
+    for (int64_t i = 0; i < stList_length(blocks); i++) {
+        coordinate += gaps[i];
+        Segment *segment = segment_construct2(stList_get(blocks, i), coordinate, 1, sequence);
+        cap_makeAdjacent(cap, segment_get5Cap(segment));
+        cap = segment_get3Cap(segment);
+        coordinate += blockLength;
+    }
+    coordinate += gaps[stList_length(blocks)];
+    assert(coordinate == length + 2);
+    cap_makeAdjacent(cap, cap_construct2(end2, length + 2, 1, sequence));
+    free(dna);
+    free(gaps);
+}
+
+static void testCalculateZ_multithreaded(CuTest *testCase) {
+    /*
+     * Test that calculating the z-scores with several threads gives exactly the same
+     * weights as with one thread.
+     */
+    for (int64_t test = 0; test < 10; test++) {
+        CactusDisk *cactusDisk = testCommon_getTemporaryCactusDisk();
+        eventTree_construct2(cactusDisk);
+        Flower *flower = flower_construct(cactusDisk);
+
+        int64_t blockLength = 5;
+        int64_t blockNumber = st_randomInt(1, 50);
+        stHash *endsToNodes = stHash_construct2(NULL, (void (*)(void *)) stIntTuple_destruct);
+        stList *blocks = stList_construct();
+        int64_t nodeCounter = 1;
+        for (int64_t i = 0; i < blockNumber; i++) {
+            Block *block = block_construct(blockLength, flower);
+            stHash_insert(endsToNodes, block_get5End(block), stIntTuple_construct1(nodeCounter));
+            stHash_insert(endsToNodes, block_get3End(block), stIntTuple_construct1(-nodeCounter));
+            nodeCounter++;
+            stList_append(blocks, block);
+        }
+        int64_t threadNumber = st_randomInt(1, 30);
+        for (int64_t i = 0; i < threadNumber; i++) {
+            for (int64_t j = stList_length(blocks) - 1; j > 0; j--) { // Shuffle the blocks
+                int64_t k = st_randomInt(0, j + 1);
+                void *block = stList_get(blocks, j);
+                stList_set(blocks, j, stList_get(blocks, k));
+                stList_set(blocks, k, block);
+            }
+            stList *threadBlocks = stList_construct();
+            int64_t threadBlockNumber = st_randomInt(0, blockNumber + 1);
+            for (int64_t j = 0; j < threadBlockNumber; j++) {
+                stList_append(threadBlocks, stList_get(blocks, j));
+            }
+            addThroughThreadToFlower(flower, threadBlocks, blockLength, endsToNodes, &nodeCounter);
+            stList_destruct(threadBlocks);
+        }
+        int64_t nodeNumber = nodeCounter - 1;
+
+        double theta = 0.001 * st_random();
+        int64_t maxWalkForCalculatingZ = st_randomInt(1, 100);
+        bool ignoreUnalignedGaps = st_random() > 0.5;
+        refAdjList *aL = calculateZ(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps,
+                zScoreFn, &theta);
+        for (int64_t numThreads = 2; numThreads <= 8; numThreads *= 2) {
+            refAdjList *aL2 = calculateZ2(flower, endsToNodes, nodeNumber, maxWalkForCalculatingZ, ignoreUnalignedGaps,
+                    zScoreFn, &theta, numThreads);
+            for (int64_t i = -nodeNumber; i <= nodeNumber; i++) {
+                for (int64_t j = -nodeNumber; j <= nodeNumber; j++) {
+                    if (i != 0 && j != 0) {
+                        CuAssertTrue(testCase, refAdjList_getWeight(aL, i, j) == refAdjList_getWeight(aL2, i, j));
+                    }
+                }
+            }
+            refAdjList_destruct(aL2);
+        }
+
+        refAdjList_destruct(aL);
+        stList_destruct(blocks);
+        stHash_destruct(endsToNodes);
+        testCommon_deleteTemporaryCactusDisk(cactusDisk);
+    }
+}
+
 CuSuite* buildReferenceTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testEventWeighting);
+    SUITE_ADD_TEST(suite, testCalculateZ_multithreaded);
     return suite;
 }
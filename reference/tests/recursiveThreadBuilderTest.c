@@ -6,27 +6,41 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "sonLib.h"
 #include "cactus.h"
 #include "CuTest.h"
 #include "recursiveThreadBuilder.h"
 
-static char *writeSegment(Segment *segment) {
-    return stString_print("%" PRIi64 " %s ", segment_getStart(segment), segment_getString(segment));
+static void writeSegment(Segment *segment, ThreadBuffer *buffer) {
+    char *string = segment_getString(segment);
+    char *record = stString_print("%" PRIi64 " %s ", segment_getStart(segment), string);
+    threadBuffer_appendString(buffer, record);
+    free(record);
+    free(string);
 }
 
-static char *writeTerminalAdjacency(Cap *cap) {
+static void writeTerminalAdjacency(Cap *cap, ThreadBuffer *buffer) {
     if(cap_getCoordinate(cap_getAdjacency(cap)) - cap_getCoordinate(cap) - 1 == 0) {
-        return stString_print("");
+        return;
     }
     Sequence *sequence = cap_getSequence(cap);
     assert(sequence != NULL);
-    return stString_print("%" PRIi64 " %s ", cap_getCoordinate(cap), sequence_getString(sequence, cap_getCoordinate(cap)+1, cap_getCoordinate(cap_getAdjacency(cap)) - cap_getCoordinate(cap) - 1, 1));
+    char *string = sequence_getString(sequence, cap_getCoordinate(cap)+1, cap_getCoordinate(cap_getAdjacency(cap)) - cap_getCoordinate(cap) - 1, 1);
+    char *record = stString_print("%" PRIi64 " %s ", cap_getCoordinate(cap), string);
+    threadBuffer_appendString(buffer, record);
+    free(record);
+    free(string);
 }
 
-static void recursiveFileBuilder_test(CuTest *testCase) {
-    //Make flower with two ends and 2 blocks, and one child, one empty adjacency and two containing additional blocks.
+static void testRecursiveFileBuilder(CuTest *testCase, const char *sequenceString, int64_t blockLength, int64_t depth) {
+    /*
+     * Make flower with two ends and a sequence, nested depth flowers deep, with the deepest flower
+     * containing a block at the start of the sequence, so its thread has one empty adjacency and one
+     * containing the rest of the sequence.
+     */
+    int64_t sequenceLength = strlen(sequenceString);
 
     const char *tempDir = "recursiveFileBuilderTestTempDir";
     if(stFile_exists(tempDir)) {
@@ -45,26 +59,37 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
     Event *referenceEvent = eventTree_getRootEvent(flower_getEventTree(flower));
 
     //Make sequence and thread
-    MetaSequence *metaSequence1 = metaSequence_construct(1, 5, "ACGTA", "ref sequence", event_getName(referenceEvent), cactusDisk);
+    MetaSequence *metaSequence1 = metaSequence_construct(1, sequenceLength, (char *) sequenceString, "ref sequence", event_getName(referenceEvent), cactusDisk);
     Sequence *sequence1 = sequence_construct(metaSequence1, flower);
     //First reference thread
     Cap *cap1 = cap_construct2(end1, 0, 1, sequence1);
-    Cap *cap2 = cap_construct2(end2, 6, 1, sequence1);
+    Cap *cap2 = cap_construct2(end2, sequenceLength + 1, 1, sequence1);
     cap_makeAdjacent(cap1, cap2);
 
-    //Make a group
-    Group *group1 = group_construct2(flower);
-    end_setGroup(end1, group1);
-    end_setGroup(end2, group1);
-
-    //Make nested flower
-    Flower *nestedFlower = group_makeNestedFlower(group1);
+    //Make the nested flowers, each containing the thread in a single adjacency
+    stList *flowers = stList_construct();
+    stList_append(flowers, flower);
+    Flower *nestedFlower = flower;
+    for (int64_t i = 0; i < depth; i++) {
+        Group *group = group_construct2(nestedFlower);
+        End *end;
+        Flower_EndIterator *endIt = flower_getEndIterator(nestedFlower);
+        while((end = flower_getNextEnd(endIt)) != NULL) {
+            end_setGroup(end, group);
+        }
+        flower_destructEndIterator(endIt);
+        nestedFlower = group_makeNestedFlower(group);
+        stList_append(flowers, nestedFlower);
+        if (i + 1 < depth) {
+            cap_makeAdjacent(flower_getCap(nestedFlower, cap_getName(cap1)), flower_getCap(nestedFlower, cap_getName(cap2)));
+        }
+    }
 
-    //Now will fill in blocks at lower level
-    Block *block1 = block_construct(3, nestedFlower);
+    //Now will fill in blocks at the lowest level
+    Block *block1 = block_construct(blockLength, nestedFlower);
     Segment *segment1 = segment_construct2(block1, 1, 1, flower_getSequence(nestedFlower, sequence_getName(sequence1)));
 
-    //Add adjacencies at lower level
+    //Add adjacencies at lowest level
     cap_makeAdjacent(flower_getCap(nestedFlower, cap_getName(cap1)), segment_get5Cap(segment1));
     cap_makeAdjacent(segment_get3Cap(segment1), flower_getCap(nestedFlower, cap_getName(cap2)));
 
@@ -76,31 +101,60 @@ static void recursiveFileBuilder_test(CuTest *testCase) {
     }
     flower_destructEndIterator(endIt);
 
-    //Create the sequence database
+    //Create the sequence database, and build the threads bottom up
     stKVDatabaseConf *secondaryConf = stKVDatabaseConf_constructTokyoCabinet(
                     stFile_pathJoin(tempDir, "temporaryCactusDisk2"));
-    stKVDatabase *secondaryDatabase = stKVDatabase_construct(secondaryConf, 1);
     stList *caps = stList_construct();
-    stList_append(caps, flower_getCap(nestedFlower, cap_getName(cap1)));
-    buildRecursiveThreads(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
-    stKVDatabase_destruct(secondaryDatabase);
+    for (int64_t i = depth; i > 0; i--) {
+        stKVDatabase *secondaryDatabase = stKVDatabase_construct(secondaryConf, i == depth);
+        stList_append(caps, flower_getCap(stList_get(flowers, i), cap_getName(cap1)));
+        buildRecursiveThreads(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
+        stList_pop(caps);
+        stKVDatabase_destruct(secondaryDatabase);
+    }
 
     //Now complete the alignment
-    secondaryDatabase = stKVDatabase_construct(secondaryConf, 0);
-    stList_pop(caps);
+    stKVDatabase *secondaryDatabase = stKVDatabase_construct(secondaryConf, 0);
     stList_append(caps, cap1);
-    stList *threadStrings = buildRecursiveThreadsInList(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
+    stList *threads = buildRecursiveThreadsInList(secondaryDatabase, caps, writeSegment, writeTerminalAdjacency);
     stKVDatabase_deleteFromDisk(secondaryDatabase);
 
-    CuAssertIntEquals(testCase, 1, stList_length(threadStrings));
-    CuAssertStrEquals(testCase, "1 ACG 3 TA ", stList_get(threadStrings, 0));
+    CuAssertIntEquals(testCase, 1, stList_length(threads));
+    char *expectedThread = stString_print("1 %.*s %" PRIi64 " %s ", (int) blockLength, sequenceString, blockLength,
+            sequenceString + blockLength);
+    CuAssertIntEquals(testCase, strlen(expectedThread), threadBuffer_getLength(stList_get(threads, 0)));
+    CuAssertStrEquals(testCase, expectedThread, threadBuffer_getData(stList_get(threads, 0)));
 
+    free(expectedThread);
+    stList_destruct(threads);
+    stList_destruct(caps);
+    stList_destruct(flowers);
     cactusDisk_destruct(cactusDisk);
     stFile_rmrf(tempDir);
 }
 
+static void recursiveFileBuilder_test(CuTest *testCase) {
+    testRecursiveFileBuilder(testCase, "ACGTA", 3, 1);
+}
+
+static void recursiveFileBuilder_testDeepNesting(CuTest *testCase) {
+    testRecursiveFileBuilder(testCase, "ACGTA", 3, 5);
+}
+
+static void recursiveFileBuilder_testLongThread(CuTest *testCase) {
+    /*
+     * A thread long enough that it is stored as compressed frames which are passed up through
+     * the intermediate flowers without being decompressed.
+     */
+    char *sequenceString = stRandom_getRandomDNAString(3000000, true, true, true);
+    testRecursiveFileBuilder(testCase, sequenceString, 2000000, 3);
+    free(sequenceString);
+}
+
 CuSuite* recursiveThreadBuilderTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, recursiveFileBuilder_test);
+    SUITE_ADD_TEST(suite, recursiveFileBuilder_testDeepNesting);
+    SUITE_ADD_TEST(suite, recursiveFileBuilder_testLongThread);
     return suite;
 }
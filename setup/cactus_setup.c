@@ -31,6 +31,7 @@ void usage() {
     fprintf(stderr, "-f --speciesTree : The species tree, which will form the skeleton of the event tree\n");
     fprintf(stderr, "-g --outgroupEvents : Leaf events in the species tree identified as outgroups\n");
     fprintf(stderr, "-i --makeEventHeadersAlphaNumeric : Remove non alpha-numeric characters from event header names\n");
+    fprintf(stderr, "-k --sequenceStore : Store the sequences in this 2 bit packed, memory mapped file instead of the database\n");
     fprintf(stderr, "-h --help : Print this help screen\n");
     fprintf(stderr, "-d --debug : Run some extra debug checks at the end\n");
 }
@@ -204,6 +205,7 @@ int main(int argc, char *argv[]) {
     char * logLevelString = NULL;
     char * speciesTree = NULL;
     char * outgroupEvents = NULL;
+    char * sequenceStore = NULL;
 
     ///////////////////////////////////////////////////////////////////////////
     // (0) Parse the inputs handed by genomeCactus.py / setup stuff.
@@ -212,11 +214,12 @@ int main(int argc, char *argv[]) {
     while (1) {
         static struct option long_options[] = { { "logLevel", required_argument, 0, 'a' }, { "cactusDisk", required_argument, 0, 'b' }, {
                 "speciesTree", required_argument, 0, 'g' }, { "outgroupEvents", required_argument, 0, 'h' },
-                { "help", no_argument, 0, 'i' }, { "makeEventHeadersAlphaNumeric", no_argument, 0, 'j' }, { 0, 0, 0, 0 } };
+                { "help", no_argument, 0, 'i' }, { "makeEventHeadersAlphaNumeric", no_argument, 0, 'j' },
+                { "sequenceStore", required_argument, 0, 'k' }, { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        key = getopt_long(argc, argv, "a:b:f:hg:i", long_options, &option_index);
+        key = getopt_long(argc, argv, "a:b:f:hg:ik:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -241,6 +244,9 @@ int main(int argc, char *argv[]) {
             case 'j':
                 makeEventHeadersAlphaNumeric = 1;
                 break;
+            case 'k':
+                sequenceStore = optarg;
+                break;
             default:
                 usage();
                 return 1;
@@ -283,6 +289,10 @@ int main(int argc, char *argv[]) {
     } else {
         cactusDisk = cactusDisk_construct(kvDatabaseConf, true, true);
     }
+    if (sequenceStore != NULL) {
+        cactusDisk_setSequenceStore(cactusDisk, sequenceStore);
+        st_logInfo("Storing the sequences in %s\n", sequenceStore);
+    }
     st_logInfo("Set up the flower disk\n");
 
     //////////////////////////////////////////////
@@ -275,8 +275,10 @@ class TrimAndRecurseOnOutgroups(RoundedJob):
         mostRecentResultsFile = fileStore.readGlobalFile(self.mostRecentResultsID)
         trimmedOutgroup = fileStore.getLocalTempFile()
         outgroupCoverage = fileStore.getLocalTempFile()
+        # Compute coverage with as many threads as the job has cores
+        threads = max(1, int(self.cores))
         calculateCoverage(outgroupSequenceFiles[0],
-                          mostRecentResultsFile, outgroupCoverage)
+                          mostRecentResultsFile, outgroupCoverage, threads=threads)
         # The windowSize and threshold are fixed at 1: anything more
         # and we will run into problems with alignments that aren't
         # covered in a matching trimmed sequence.
@@ -298,7 +300,7 @@ class TrimAndRecurseOnOutgroups(RoundedJob):
         for trimmedIngroupSequence, ingroupSequence, ingroupName in zip(sequenceFiles, untrimmedSequenceFiles, self.ingroupNames):
             tmpIngroupCoverage = fileStore.getLocalTempFile()
             calculateCoverage(trimmedIngroupSequence, mostRecentResultsFile,
-                              tmpIngroupCoverage)
+                              tmpIngroupCoverage, threads=threads)
             fileStore.logToMaster("Coverage on %s from outgroup #%d, %s: %s%% (current ingroup length %d, untrimmed length %d). Outgroup trimmed to %d bp from %d" % (ingroupName, self.outgroupNumber, self.outgroupNames[self.outgroupNumber - 1], percentCoverage(trimmedIngroupSequence, tmpIngroupCoverage), sequenceLength(trimmedIngroupSequence), sequenceLength(ingroupSequence), sequenceLength(trimmedOutgroup), sequenceLength(outgroupSequenceFiles[0])))
 
         # Convert the alignments' ingroup coordinates.
@@ -330,7 +332,8 @@ class TrimAndRecurseOnOutgroups(RoundedJob):
         for ingroupSequence, ingroupName in zip(untrimmedSequenceFiles, self.ingroupNames):
             ingroupCoverageFile = fileStore.getLocalTempFile()
             calculateCoverage(sequenceFile=ingroupSequence, cigarFile=outgroupResultsFile,
-                              outputFile=ingroupCoverageFile, depthById=self.blastOptions.trimOutgroupDepth > 1)
+                              outputFile=ingroupCoverageFile, depthById=self.blastOptions.trimOutgroupDepth > 1,
+                              threads=threads)
             ingroupCoverageFiles.append(ingroupCoverageFile)
             self.ingroupCoverageIDs.append(fileStore.writeGlobalFile(ingroupCoverageFile))
             fileStore.logToMaster("Cumulative coverage of %d outgroups on ingroup %s: %s" % (self.outgroupNumber, ingroupName, percentCoverage(ingroupSequence, ingroupCoverageFile)))
@@ -505,7 +508,7 @@ def percentCoverage(sequenceFile, coverageFile):
         return 0
     return 100*float(coverage)/sequenceLen
 
-def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, depthById=False, work_dir=None):
+def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, depthById=False, threads=None, work_dir=None):
     logger.info("Calculating coverage of cigar file %s on %s, writing to %s" % (
         cigarFile, sequenceFile, outputFile))
     args = [sequenceFile, cigarFile]
@@ -513,6 +516,8 @@ def calculateCoverage(sequenceFile, cigarFile, outputFile, fromGenome=None, dept
         args += ["--from", fromGenome]
     if depthById:
         args += ["--depthById"]
+    if threads is not None:
+        args += ["--threads", str(threads)]
     cactus_call(outfile=outputFile, work_dir=work_dir,
                 parameters=["cactus_coverage"] + args)
 
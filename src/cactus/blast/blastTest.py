@@ -14,6 +14,7 @@ import filecmp
 from sonLib.bioio import system
 from sonLib.bioio import logger
 from sonLib.bioio import fastaWrite
+from sonLib.bioio import fastaRead
 from sonLib.bioio import getRandomSequence
 from sonLib.bioio import mutateSequence
 from sonLib.bioio import reverseComplement
@@ -31,6 +32,7 @@ from cactus.blast.blast import decompressFastaFile, compressFastaFile
 
 from cactus.shared.common import runLastz
 from cactus.shared.common import makeURL
+from cactus.shared.common import runGetChunks
 
 from cactus.blast.blast import BlastOptions
 from cactus.blast.blast import BlastIngroupsAndOutgroups
@@ -304,6 +306,43 @@ class TestCase(unittest.TestCase):
                 system("cat %s" % self.tempOutputFile)
             system("rm -rf %s " % toilDir)
 
+    def testChunkSequences(self):
+        """Chunk up sequences written with irregular line lengths and check every chunk
+        holds the subsequences its headers claim, that every base is chunked and that
+        the chunks are the same when written on several threads.
+        """
+        tempSeqFile = os.path.join(self.tempDir, "tempSeq.fa")
+        self.tempFiles.append(tempSeqFile)
+        for test in xrange(self.testNo):
+            seqs = dict((str(i), getRandomSequence(random.choice([0, 1, 100, 70000, 200000]))[1]) for i in xrange(random.choice(xrange(1, 5))))
+            with open(tempSeqFile, 'w') as fileHandle:
+                for header, seq in seqs.items():
+                    fileHandle.write(">%s other tokens\n" % header)
+                    i = 0
+                    while i < len(seq):
+                        lineLength = random.choice(xrange(1, 200))
+                        fileHandle.write(seq[i:i+lineLength] + "\n")
+                        i += lineLength
+            chunkSize = random.choice(xrange(500, 100000))
+            overlapSize = random.choice(xrange(0, 500))
+            chunkContents = []
+            for threads in [1, 4]:
+                chunksDir = getTempDirectory(self.tempDir)
+                chunks = runGetChunks(sequenceFiles=[tempSeqFile], chunksDir=chunksDir, chunkSize=chunkSize,
+                                      overlapSize=overlapSize, threads=threads)
+                chunkContents.append([open(chunk).read() for chunk in chunks])
+                covered = dict((header, [False]*len(seq)) for header, seq in seqs.items())
+                for chunk in chunks:
+                    for chunkHeader, subsequence in fastaRead(open(chunk)):
+                        header, start = chunkHeader.split("|")
+                        start = int(start)
+                        self.assertEqual(subsequence, seqs[header][start:start+len(subsequence)])
+                        covered[header][start:start+len(subsequence)] = [True]*len(subsequence)
+                for header in seqs:
+                    self.assertTrue(all(covered[header]))
+                system("rm -rf %s" % chunksDir)
+            self.assertEqual(chunkContents[0], chunkContents[1])
+
     def testCompression(self):
         tempSeqFile = os.path.join(self.tempDir, "tempSeq.fa")
         tempSeqFile2 = os.path.join(self.tempDir, "tempSeq2.fa")
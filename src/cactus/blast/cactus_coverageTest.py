@@ -154,8 +154,8 @@ class TestCase(unittest.TestCase):
         os.remove(cigarPath)
 
     @silentOnSuccess
-    def testCoverageCap(self):
-        """Test if a base covered by >65535 alignments is capped at 65535 depth."""
+    def testDeepCoverage(self):
+        """Test a base covered by >65535 alignments gets its full depth."""
         deepCigarPath = getTempFile()
         with open(deepCigarPath, 'w') as f:
             for _ in xrange(65537):
@@ -163,9 +163,20 @@ class TestCase(unittest.TestCase):
         bed = cactus_call(parameters=["cactus_coverage", self.simpleFastaPathA, deepCigarPath],
                           check_output=True)
         self.assertEqual(bed, dedent('''\
-        id=0|simpleSeqA1\t9\t10\t\t65535
+        id=0|simpleSeqA1\t9\t10\t\t65537
         '''))
         os.remove(deepCigarPath)
 
+    @silentOnSuccess
+    def testThreads(self):
+        """Test the coverage is the same when the sequences are split between threads."""
+        for fastaPath in [self.simpleFastaPathA, self.simpleFastaPathB]:
+            for depthById in [[], ["--depthById"]]:
+                bed = cactus_call(parameters=["cactus_coverage"] + depthById + [fastaPath, self.simpleCigarPath],
+                                  check_output=True)
+                threadedBed = cactus_call(parameters=["cactus_coverage", "--threads", "4"] + depthById +
+                                          [fastaPath, self.simpleCigarPath], check_output=True)
+                self.assertEqual(bed, threadedBed)
+
 if __name__ == '__main__':
     unittest.main()
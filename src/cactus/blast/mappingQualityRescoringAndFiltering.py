@@ -22,6 +22,9 @@ filtering the alignments to remove lower probability alignments.
             if they overlap they have the same interval. 
         - Calculate mapping qualities for each alignments and optionally filter alignments, 
         for example to only keep the primary alignment: C subscript: cactus_calculateMappingQualities
+        
+        The steps are run in a single process by cactus_blast_processAlignments, which streams the alignments
+        between the steps in memory and sorts them itself, spilling to disk only when there are too many.
 
 """
 from cactus.shared.common import cactus_call
@@ -45,14 +48,14 @@ def mappingQualityRescoring(job, inputAlignmentFileID,
     assert maxAlignmentsPerSite >= 1
     tempAlignmentFiles = [job.fileStore.getLocalTempFile() for i in xrange(maxAlignmentsPerSite)]
     
-    # Mirror and orient alignments, sort, split overlaps and calculate mapping qualities
-    cactus_call(parameters=[["cat", inputAlignmentFile],
-                            ["cactus_mirrorAndOrientAlignments", logLevel],
-                            ["sort", "-k6,6", "-k7,7n", "-k8,8n"], # This sorts by coordinate
-                            ["uniq"], # This eliminates any annoying duplicates if lastz reports the alignment in both orientations
-                            ["cactus_splitAlignmentOverlaps", logLevel],
-                            ["cactus_calculateMappingQualities", logLevel, str(maxAlignmentsPerSite),
-                             str(minimumMapQValue), str(alpha)] + tempAlignmentFiles])
+    # Mirror and orient alignments, sort, split overlaps and calculate mapping qualities, in one process
+    cactus_call(parameters=["cactus_blast_processAlignments", "--logLevel", logLevel,
+                            "--mirrorAndOrient",
+                            "--sortByCoordinates", # This sorts by coordinate
+                            "--unique", # This eliminates any annoying duplicates if lastz reports the alignment in both orientations
+                            "--splitOverlaps",
+                            "--mappingQualities", "%i,%s,%s" % (maxAlignmentsPerSite, minimumMapQValue, alpha),
+                            inputAlignmentFile] + tempAlignmentFiles)
 
     # Merge together the output files in order
     secondaryTempAlignmentFile = job.fileStore.getLocalTempFile()
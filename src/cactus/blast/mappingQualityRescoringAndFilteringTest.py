@@ -1,4 +1,4 @@
-import unittest, os, random, time
+import unittest, os, sys, random, time, math
 
 from toil.job import Job
 from toil.common import Toil
@@ -199,8 +199,114 @@ class TestCase(unittest.TestCase):
             'cigar: simpleSeqC1 0 10 + simpleSeqNonExistent 0 10 + 0.500000 M 10',
             'cigar: simpleSeqA1 6 7 + simpleSeqZ1 0 1 + 3.000000 M 1'
         ]
+        self.checkSplitAlignmentOverlaps(self.inputCigars)
+    
+    @silentOnSuccess
+    def testSplitAlignmentsOverlapsRandom(self):
+        """
+        Tests cactus_splitAlignmentOverlaps on random sets of heavily overlapping alignments, against the
+        cut points and operations expected from the alignment intervals and against the splitter it replaced.
+        """
+        for test in xrange(20):
+            inputCigars = set()
+            for i in xrange(random.randint(1, 200)):
+                ops = []
+                for j in xrange(2*random.randint(0, 5) + 1): # Matches separated by indels
+                    ops += [ "M" if j % 2 == 0 else random.choice(("I", "D")), random.randint(1, 20) ]
+                length1 = sum([ ops[k+1] for k in range(0, len(ops), 2) if ops[k] != "I" ])
+                length2 = sum([ ops[k+1] for k in range(0, len(ops), 2) if ops[k] != "D" ])
+                start1, start2 = random.randint(0, 200), random.randint(0, 200)
+                coordinates1 = "seqA%i" % random.randint(0, 2), start1, start1 + length1, "+"
+                if random.random() > 0.5:
+                    coordinates2 = "seqB%i" % random.randint(0, 2), start2, start2 + length2, "+"
+                else:
+                    coordinates2 = "seqB%i" % random.randint(0, 2), start2 + length2, start2, "-"
+                inputCigars.add(self.makeCigar(coordinates1, coordinates2, random.randint(0, 100), ops))
+            # Sort by the coordinates of the first sequence, as the splitter expects
+            inputCigars = sorted(inputCigars, key=lambda cigar : (cigar.split()[5], int(cigar.split()[6]), 
+                                                                 int(cigar.split()[7]), cigar))
+            self.checkSplitAlignmentOverlaps(inputCigars)
+    
+    @classmethod
+    def referenceSplitAlignmentOverlaps(cls, inputCigars):
+        """
+        A python copy of the splitter cactus_splitAlignmentOverlaps used before it kept its active
+        alignments in a heap, which kept them in a sorted set ordered by start, then end. Returns the
+        split cigars, in no particular order. As for the tool, the cigars must be sorted by the
+        coordinates of their first sequence, which are split on and must be on the positive strand.
+        Cigar lines give the second sequence first, so these are the sixth to ninth fields.
+        """
+        outputCigars = []
+        activeAlignments = [] # Sorted by start, end and arrival
+        
+        def emit(alignment):
+            outputCigars.append(cls.makeCigar((alignment["name1"], alignment["start1"], alignment["end1"], "+"),
+                                              (alignment["name2"], alignment["start2"], alignment["end2"], alignment["strand2"]),
+                                              alignment["score"], sum(alignment["ops"], [])))
+        
+        def insert(alignment):
+            activeAlignments.append(alignment)
+            activeAlignments.sort(key=lambda a : (a["start1"], a["end1"], a["index"]))
+        
+        def removeAlignmentPrefix(alignment, prefixEnd):
+            prefix = dict(alignment)
+            prefix["ops"] = []
+            while True:
+                op, length = alignment["ops"][0]
+                if op == "I": # Only in the other sequence
+                    prefix["ops"].append(alignment["ops"].pop(0))
+                    alignment["start2"] += length if alignment["strand2"] == "+" else -length
+                else:
+                    if alignment["start1"] + length <= prefixEnd:
+                        prefix["ops"].append(alignment["ops"].pop(0))
+                        j = length
+                    else:
+                        j = prefixEnd - alignment["start1"]
+                        prefix["ops"].append([ op, j ])
+                        alignment["ops"][0] = [ op, length - j ]
+                    alignment["start1"] += j
+                    if op == "M":
+                        alignment["start2"] += j if alignment["strand2"] == "+" else -j
+                if alignment["start1"] >= prefixEnd:
+                    break
+            prefix["end1"], prefix["end2"] = prefixEnd, alignment["start2"]
+            return prefix
+        
+        def emitBlock(to):
+            while len(activeAlignments) > 0 and activeAlignments[0]["start1"] < to:
+                alignment = activeAlignments.pop(0)
+                if alignment["end1"] > to:
+                    prefix = removeAlignmentPrefix(alignment, to)
+                    insert(alignment)
+                    alignment = prefix
+                emit(alignment)
+        
+        def splitAlignmentOverlaps(splitUpto):
+            while len(activeAlignments) > 0 and activeAlignments[0]["end1"] < splitUpto:
+                emitBlock(activeAlignments[0]["end1"])
+            if len(activeAlignments) > 0:
+                emitBlock(splitUpto)
+        
+        for index, inputCigar in enumerate(inputCigars):
+            fields = inputCigar.split()
+            assert fields[8] == "+"
+            ops = fields[10:]
+            alignment = { "name1":fields[5], "start1":int(fields[6]), "end1":int(fields[7]),
+                          "name2":fields[1], "start2":int(fields[2]), "end2":int(fields[3]), "strand2":fields[4],
+                          "score":float(fields[9]), "index":index,
+                          "ops":[ [ ops[i], int(ops[i+1]) ] for i in range(0, len(ops), 2) ] }
+            if len(activeAlignments) > 0:
+                if activeAlignments[0]["name1"] == alignment["name1"]:
+                    splitAlignmentOverlaps(alignment["start1"])
+                else:
+                    splitAlignmentOverlaps(sys.maxint)
+            insert(alignment)
+        splitAlignmentOverlaps(sys.maxint)
+        return outputCigars
+    
+    def checkSplitAlignmentOverlaps(self, inputCigars):
         with open(self.simpleInputCigarPath, 'w') as fH:
-            fH.write("\n".join(self.inputCigars) + "\n")
+            fH.write("\n".join(inputCigars) + "\n")
             
         cactus_call(parameters=["cactus_splitAlignmentOverlaps", 
                                  self.logLevelString, 
@@ -212,7 +318,7 @@ class TestCase(unittest.TestCase):
         
         # Get start and end coordinates of cigars
         ends = set()
-        for inputCigar in self.inputCigars:
+        for inputCigar in inputCigars:
             name1, start1, end1, strand1 = inputCigar.split()[5:9]
             ends.add((name1, int(start1)))
             ends.add((name1, int(end1)))
@@ -250,7 +356,7 @@ class TestCase(unittest.TestCase):
             return pOps, sOps     
         
         # For each cigar:
-        for inputCigar in self.inputCigars:
+        for inputCigar in inputCigars:
             name1, start1, end1, strand1 = inputCigar.split()[5:9]
             start1, end1 = int(start1), int(end1)
             assert strand1 == "+"
@@ -294,6 +400,9 @@ class TestCase(unittest.TestCase):
                     
         # Check we have the expected number of cigars  
         self.assertEquals(totalExpectedCigars, len(outputCigars))
+        
+        # Check we have the same cigars as the splitter the tool used to use
+        self.assertEquals(sorted(outputCigars), sorted(self.referenceSplitAlignmentOverlaps(inputCigars)))
     
     @silentOnSuccess
     def testCalculateMappingQualities(self):
@@ -311,6 +420,92 @@ class TestCase(unittest.TestCase):
         
         self.assertEqual(self.filteredSortedNonOverlappingInputCigars, outputCigars)
         
+    @silentOnSuccess
+    def testCalculateMappingQualities_benchmark(self):
+        """
+        Times cactus_calculateMappingQualities on synthetic sites each covered by many totally overlapping
+        alignments, as in repeats, and checks the mapping qualities against the quadratic definition.
+        """
+        siteNumber, alignmentsPerSite, maxAlignmentsPerSite, alpha = 50, 2000, 10, 0.1
+        siteScores = []
+        with open(self.simpleInputCigarPath, 'w') as fH:
+            for site in xrange(siteNumber):
+                scores = [ random.randint(0, 200) for i in xrange(alignmentsPerSite) ]
+                siteScores.append(sorted(scores, reverse=True))
+                for i in xrange(alignmentsPerSite):
+                    fH.write(self.makeCigar(("seqA", 100*site, 100*(site+1), "+"), 
+                                            ("seqB%i" % i, 0, 100, "+"), scores[i], ("M", 100)) + "\n")
+        
+        outputFiles = [ getTempFile() for i in xrange(maxAlignmentsPerSite) ]
+        startTime = time.time()
+        cactus_call(parameters=[ "cactus_calculateMappingQualities", self.logLevelString, 
+                                 str(maxAlignmentsPerSite), '0', str(alpha) ] + outputFiles + 
+                                [ self.simpleInputCigarPath ])
+        print "Calculated the mapping qualities of %s sites of %s alignments in %s seconds" % \
+            (siteNumber, alignmentsPerSite, time.time() - startTime)
+        
+        # The i-th output file holds the i-th best alignment of each site
+        for i in xrange(maxAlignmentsPerSite):
+            with open(outputFiles[i], 'r') as fh:
+                mapQs = [ float(cigar.split()[9]) for cigar in fh.readlines() ]
+            self.assertEquals(siteNumber, len(mapQs))
+            for site in xrange(siteNumber):
+                scores = siteScores[site]
+                if alpha * (scores[i] - scores[0]) < -10:
+                    expectedMapQ = 0.0
+                else:
+                    z = sum(10**(alpha * (score - scores[i])) for score in scores)
+                    expectedMapQ = 60.0 if z <= 1.000001 else -10.0 * math.log10(1.0 - 1.0/z)
+                self.assertAlmostEquals(expectedMapQ, mapQs[site], places=3)
+            os.remove(outputFiles[i])
+    
+    @silentOnSuccess
+    def testProcessAlignments(self):
+        """
+        Tests the fused program gives the same alignments as the chain of programs, with and without
+        spilling sorted runs of alignments to disk.
+        """
+        with open(self.simpleInputCigarPath, 'w') as fH:
+            fH.write("\n".join(self.inputCigars) + "\n")
+        
+        for maxBytesInMemory in (1000000, 500, 1):
+            cactus_call(parameters=[ "cactus_blast_processAlignments", 
+                                     "--logLevel", self.logLevelString,
+                                     "--maxBytesInMemory", str(maxBytesInMemory),
+                                     "--mirrorAndOrient", "--sortByCoordinates", "--unique", 
+                                     "--splitOverlaps", "--mappingQualities", "1,0,1.0",
+                                     self.simpleInputCigarPath,
+                                     self.simpleOutputCigarPath ])
+            
+            with open(self.simpleOutputCigarPath, 'r') as fh:
+                outputCigars = [ cigar[:-1] for cigar in fh.readlines() ] # Remove new lines
+            
+            self.assertEqual(self.filteredSortedNonOverlappingInputCigars, outputCigars)
+    
+    @silentOnSuccess
+    def testProcessAlignmentsSortByScore(self):
+        """
+        Tests sorting by score is stable, alignments with equal scores keeping their input order however
+        the input is split into sorted runs.
+        """
+        with open(self.simpleInputCigarPath, 'w') as fH:
+            fH.write("\n".join(self.sortedNonOverlappingInputCigars) + "\n")
+        # Python's sort is stable
+        expectedCigars = sorted(self.sortedNonOverlappingInputCigars, key=lambda cigar: -float(cigar.split()[9]))
+        
+        for maxBytesInMemory in (1000000, 500, 1):
+            cactus_call(parameters=[ "cactus_blast_processAlignments", 
+                                     "--logLevel", self.logLevelString,
+                                     "--maxBytesInMemory", str(maxBytesInMemory),
+                                     "--sortByScore",
+                                     self.simpleInputCigarPath,
+                                     self.simpleOutputCigarPath ])
+            
+            with open(self.simpleOutputCigarPath, 'r') as fh:
+                outputCigars = [ cigar[:-1] for cigar in fh.readlines() ] # Remove new lines
+            
+            self.assertEqual(expectedCigars, outputCigars)
+        
     def runToilPipeline(self, alignmentsFile, alpha=0.001):
         # Tests the toil pipeline        
         options = Job.Runner.getDefaultOptions(os.path.join(self.tempDir, "toil"))
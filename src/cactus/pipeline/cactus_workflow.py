@@ -114,6 +114,7 @@ class CactusJob(RoundedJob):
             memory = self.evaluateResourcePoly(self.memoryPoly)
             if hasattr(self, 'memoryCap'):
                 memory = int(min(memory, self.memoryCap))
+            cores = self.getOptionalJobAttrib("cpu", typeFn=int)
 
         disk = None
         if memory is None and overlarge:
@@ -126,6 +127,8 @@ class CactusJob(RoundedJob):
                                                default=getOptionalAttrib(self.constantsNode, "defaultMemory", int, default=sys.maxint))
             cores = self.getOptionalJobAttrib("cpu", typeFn=int,
                                               default=getOptionalAttrib(self.constantsNode, "defaultCpu", int, default=sys.maxint))
+        # Multithreaded tools are run with one thread per core reserved for the job.
+        self.numThreads = cores if cores is not None and cores < sys.maxint else None
         RoundedJob.__init__(self, memory=memory, cores=cores, disk=disk,
                             checkpoint=checkpoint, preemptable=preemptable)
 
@@ -772,6 +775,9 @@ class CactusCafWrapper(CactusRecursionJob):
                           referenceEventHeader=getOptionalAttrib(findRequiredNode(self.cactusWorkflowArguments.configNode, "reference"), "reference"),
                           phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce=self.getOptionalPhaseAttrib("phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce"),
                           numTreeBuildingThreads=self.getOptionalPhaseAttrib("numTreeBuildingThreads"),
+                          numThreads=self.numThreads,
+                          recordCacheSize=self.getOptionalPhaseAttrib("recordCacheSize", int),
+                          stringCacheSize=self.getOptionalPhaseAttrib("stringCacheSize", int),
                           doPhylogeny=self.getOptionalPhaseAttrib("doPhylogeny", bool, False),
                           minimumBlockHomologySupport=self.getOptionalPhaseAttrib("minimumBlockHomologySupport"),
                           minimumBlockDegreeToCheckSupport=self.getOptionalPhaseAttrib("minimumBlockDegreeToCheckSupport"),
@@ -860,7 +866,10 @@ def runBarForJob(self, fileStore=None, features=None, calculateWhichEndsToComput
                  ingroupCoverageFile=self.cactusWorkflowArguments.ingroupCoverageID if self.getOptionalPhaseAttrib("rescue", bool) else None,
                  minimumSizeToRescue=self.getOptionalPhaseAttrib("minimumSizeToRescue"),
                  minimumCoverageToRescue=self.getOptionalPhaseAttrib("minimumCoverageToRescue"),
-                 minimumNumberOfSpecies=self.getOptionalPhaseAttrib("minimumNumberOfSpecies", int))
+                 minimumNumberOfSpecies=self.getOptionalPhaseAttrib("minimumNumberOfSpecies", int),
+                 numThreads=self.numThreads,
+                 recordCacheSize=self.getOptionalPhaseAttrib("recordCacheSize", int),
+                 stringCacheSize=self.getOptionalPhaseAttrib("stringCacheSize", int))
 
 class CactusBarWrapper(CactusRecursionJob):
     """Runs the BAR algorithm implementation.
@@ -1111,7 +1120,10 @@ class CactusReferenceWrapper(CactusRecursionJob):
                        wiggle=self.getOptionalPhaseAttrib("wiggle", float),
                        numberOfNs=self.getOptionalPhaseAttrib("numberOfNs", int),
                        minNumberOfSequencesToSupportAdjacency=self.getOptionalPhaseAttrib("minNumberOfSequencesToSupportAdjacency", int),
-                       makeScaffolds=self.getOptionalPhaseAttrib("makeScaffolds", bool))
+                       makeScaffolds=self.getOptionalPhaseAttrib("makeScaffolds", bool),
+                       numThreads=self.numThreads,
+                       recordCacheSize=self.getOptionalPhaseAttrib("recordCacheSize", int),
+                       stringCacheSize=self.getOptionalPhaseAttrib("stringCacheSize", int))
 
 class CactusReferenceRecursion2(CactusRecursionJob):
     memoryPoly = [2e+09]
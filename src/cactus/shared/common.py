@@ -272,6 +272,9 @@ def runCactusCaf(cactusDiskDatabaseString,
                  referenceEventHeader=None,
                  phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce=None,
                  numTreeBuildingThreads=None,
+                 numThreads=None,
+                 recordCacheSize=None,
+                 stringCacheSize=None,
                  doPhylogeny=False,
                  removeLargestBlock=None,
                  phylogenyNucleotideScalingFactor=None,
@@ -350,6 +353,12 @@ def runCactusCaf(cactusDiskDatabaseString,
         args += ["--phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce", str(phylogenyDoSplitsWithSupportHigherThanThisAllAtOnce)]
     if numTreeBuildingThreads is not None:
         args += ["--numTreeBuildingThreads", str(numTreeBuildingThreads)]
+    if numThreads is not None:
+        args += ["--numThreads", str(numThreads)]
+    if recordCacheSize is not None:
+        args += ["--recordCacheSize", str(recordCacheSize)]
+    if stringCacheSize is not None:
+        args += ["--stringCacheSize", str(stringCacheSize)]
     if doPhylogeny:
         args += ["--phylogeny"]
     if minimumBlockDegreeToCheckSupport is not None:
@@ -451,6 +460,9 @@ def runCactusBar(cactusDiskDatabaseString, flowerNames, logLevel=None,
                  minimumSizeToRescue=None,
                  minimumCoverageToRescue=None,
                  minimumNumberOfSpecies=None,
+                 numThreads=None,
+                 recordCacheSize=None,
+                 stringCacheSize=None,
                  jobName=None,
                  fileStore=None,
                  features=None):
@@ -506,6 +518,12 @@ def runCactusBar(cactusDiskDatabaseString, flowerNames, logLevel=None,
         args += ["--minimumCoverageToRescue", str(minimumCoverageToRescue)]
     if minimumNumberOfSpecies is not None:
         args += ["--minimumNumberOfSpecies", str(minimumNumberOfSpecies)]
+    if numThreads is not None:
+        args += ["--numThreads", str(numThreads)]
+    if recordCacheSize is not None:
+        args += ["--recordCacheSize", str(recordCacheSize)]
+    if stringCacheSize is not None:
+        args += ["--stringCacheSize", str(stringCacheSize)]
 
     masterMessages = cactus_call(stdin_string=flowerNames, check_output=True,
                                  parameters=["cactus_bar"] + args,
@@ -531,7 +549,10 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
                        wiggle=None, 
                        numberOfNs=None,
                        minNumberOfSequencesToSupportAdjacency=None,
-                       makeScaffolds=False):
+                       makeScaffolds=False,
+                       numThreads=None,
+                       recordCacheSize=None,
+                       stringCacheSize=None):
     """Runs cactus reference."""
     logLevel = getLogLevelString2(logLevel)
     args = ["--logLevel", logLevel, "--cactusDisk", cactusDiskDatabaseString]
@@ -559,6 +580,12 @@ def runCactusReference(cactusDiskDatabaseString, flowerNames, logLevel=None,
         args += ["--minNumberOfSequencesToSupportAdjacency", str(minNumberOfSequencesToSupportAdjacency)]
     if makeScaffolds:
         args += ["--makeScaffolds"]
+    if numThreads is not None:
+        args += ["--numThreads", str(numThreads)]
+    if recordCacheSize is not None:
+        args += ["--recordCacheSize", str(recordCacheSize)]
+    if stringCacheSize is not None:
+        args += ["--stringCacheSize", str(stringCacheSize)]
 
     masterMessages = cactus_call(stdin_string=flowerNames, check_output=True,
                                  parameters=["cactus_reference"] + args,
@@ -780,11 +807,12 @@ def runCactusCoverage(sequenceFile, alignmentsFile, work_dir=None):
     return cactus_call(check_output=True, work_dir=work_dir,
                 parameters=["cactus_coverage", sequenceFile, alignmentsFile])
 
-def runGetChunks(sequenceFiles, chunksDir, chunkSize, overlapSize, work_dir=None):
+def runGetChunks(sequenceFiles, chunksDir, chunkSize, overlapSize, threads=None, work_dir=None):
+    threadsArgs = ["--threads", str(threads)] if threads is not None else []
     chunks = cactus_call(work_dir=work_dir,
                          check_output=True,
-                         parameters=["cactus_blast_chunkSequences",
-                                     getLogLevelString(),
+                         parameters=["cactus_blast_chunkSequences"] + threadsArgs +
+                                    [getLogLevelString(),
                                      str(chunkSize),
                                      str(overlapSize),
                                      chunksDir] + sequenceFiles)